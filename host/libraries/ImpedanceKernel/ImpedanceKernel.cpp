@@ -0,0 +1,270 @@
+/**
+ * @file ImpedanceKernel.cpp
+ * @brief Batch |Z| and phase from raw AD5933 data, with SSE2 and AVX2
+ * kernels that match the scalar one bit for bit
+ *
+ * @author Michael Meli
+ */
+
+#include "ImpedanceKernel.h"
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define IMPEDANCE_X86
+#include <immintrin.h>
+#endif
+
+// The kernels must not fuse a multiply and an add, or they would round
+// differently from each other. ISO modes (-std=c++11) already keep them
+// apart; this keeps it that way under -std=gnu++11 too.
+#pragma GCC optimize("fp-contract=off")
+
+// atan on [0, 1]: Abramowitz and Stegun 4.4.49, error below 1e-5 rad
+#define ATAN_A1     (0.9998660f)
+#define ATAN_A3     (-0.3302995f)
+#define ATAN_A5     (0.1801410f)
+#define ATAN_A7     (-0.0851330f)
+#define ATAN_A9     (0.0208351f)
+#define PI_F        (3.14159265f)
+#define HALF_PI_F   (1.57079633f)
+#define TWO_PI_F    (6.28318531f)
+
+/**
+ * The reference: one point at a time. Every other kernel follows these
+ * steps exactly, so keep them in step when changing anything here.
+ */
+template <bool column>
+static void kernelScalar(const int16_t *real, const int16_t *imag,
+                         const float *gain, const float *phase, float *z,
+                         float *theta, size_t start, size_t n) {
+    for (size_t i = start; i < n; i++) {
+        float g = column ? gain[0] : gain[i];
+        float ph = column ? phase[0] : phase[i];
+        float fr = real[i];
+        float fi = imag[i];
+
+        float magnitude = sqrtf(fr * fr + fi * fi);
+        z[i] = 1.0f / (magnitude * g);
+
+        // atan2 from atan of the smaller over the larger, in [0, 1]
+        float ax = fabsf(fr);
+        float ay = fabsf(fi);
+        float mn = ax < ay ? ax : ay;
+        float mx = ax > ay ? ax : ay;
+        float a = mx > 0.0f ? mn / mx : 0.0f;
+        float s = a * a;
+        float p = ((((ATAN_A9 * s + ATAN_A7) * s + ATAN_A5) * s + ATAN_A3) * s +
+                   ATAN_A1) * a;
+        p = ay > ax ? HALF_PI_F - p : p;
+        p = fr < 0.0f ? PI_F - p : p;
+        p = fi < 0.0f ? -p : p;
+
+        float d = p - ph;
+        d = d - (d > PI_F ? TWO_PI_F : 0.0f);
+        d = d + (d < -PI_F ? TWO_PI_F : 0.0f);
+        theta[i] = d;
+    }
+}
+
+#ifdef IMPEDANCE_X86
+
+/**
+ * 4 points at a time. SSE2 has no blend, so selects are and/andnot/or.
+ */
+static inline __m128 selectSse2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 loadSse2(const int16_t *p) {
+    __m128i v = _mm_loadl_epi64((const __m128i*)p);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+template <bool column>
+__attribute__((target("sse2")))
+static void kernelSse2(const int16_t *real, const int16_t *imag,
+                       const float *gain, const float *phase, float *z,
+                       float *theta, size_t n) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 pi = _mm_set1_ps(PI_F);
+    const __m128 minusPi = _mm_set1_ps(-PI_F);
+    const __m128 halfPi = _mm_set1_ps(HALF_PI_F);
+    const __m128 twoPi = _mm_set1_ps(TWO_PI_F);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 g = column ? _mm_set1_ps(gain[0]) : _mm_loadu_ps(gain + i);
+        __m128 ph = column ? _mm_set1_ps(phase[0]) : _mm_loadu_ps(phase + i);
+        __m128 fr = loadSse2(real + i);
+        __m128 fi = loadSse2(imag + i);
+
+        __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(fr, fr),
+                                                  _mm_mul_ps(fi, fi)));
+        _mm_storeu_ps(z + i, _mm_div_ps(one, _mm_mul_ps(magnitude, g)));
+
+        __m128 ax = _mm_andnot_ps(sign, fr);
+        __m128 ay = _mm_andnot_ps(sign, fi);
+        __m128 mn = _mm_min_ps(ax, ay);
+        __m128 mx = _mm_max_ps(ax, ay);
+        __m128 a = _mm_and_ps(_mm_cmpgt_ps(mx, zero), _mm_div_ps(mn, mx));
+        __m128 s = _mm_mul_ps(a, a);
+        __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_A9), s),
+                              _mm_set1_ps(ATAN_A7));
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(ATAN_A5));
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(ATAN_A3));
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(ATAN_A1));
+        p = _mm_mul_ps(p, a);
+        p = selectSse2(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(halfPi, p), p);
+        p = selectSse2(_mm_cmplt_ps(fr, zero), _mm_sub_ps(pi, p), p);
+        p = _mm_xor_ps(p, _mm_and_ps(_mm_cmplt_ps(fi, zero), sign));
+
+        __m128 d = _mm_sub_ps(p, ph);
+        d = _mm_sub_ps(d, _mm_and_ps(_mm_cmpgt_ps(d, pi), twoPi));
+        d = _mm_add_ps(d, _mm_and_ps(_mm_cmplt_ps(d, minusPi), twoPi));
+        _mm_storeu_ps(theta + i, d);
+    }
+    kernelScalar<column>(real, imag, gain, phase, z, theta, i, n);
+}
+
+/**
+ * 8 points at a time.
+ */
+template <bool column>
+__attribute__((target("avx2")))
+static void kernelAvx2(const int16_t *real, const int16_t *imag,
+                       const float *gain, const float *phase, float *z,
+                       float *theta, size_t n) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 pi = _mm256_set1_ps(PI_F);
+    const __m256 minusPi = _mm256_set1_ps(-PI_F);
+    const __m256 halfPi = _mm256_set1_ps(HALF_PI_F);
+    const __m256 twoPi = _mm256_set1_ps(TWO_PI_F);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 g = column ? _mm256_set1_ps(gain[0]) : _mm256_loadu_ps(gain + i);
+        __m256 ph = column ? _mm256_set1_ps(phase[0]) : _mm256_loadu_ps(phase + i);
+        __m256 fr = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i*)(real + i))));
+        __m256 fi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i*)(imag + i))));
+
+        __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(fr, fr),
+                                                        _mm256_mul_ps(fi, fi)));
+        _mm256_storeu_ps(z + i, _mm256_div_ps(one, _mm256_mul_ps(magnitude, g)));
+
+        __m256 ax = _mm256_andnot_ps(sign, fr);
+        __m256 ay = _mm256_andnot_ps(sign, fi);
+        __m256 mn = _mm256_min_ps(ax, ay);
+        __m256 mx = _mm256_max_ps(ax, ay);
+        __m256 a = _mm256_and_ps(_mm256_cmp_ps(mx, zero, _CMP_GT_OQ),
+                                 _mm256_div_ps(mn, mx));
+        __m256 s = _mm256_mul_ps(a, a);
+        __m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ATAN_A9), s),
+                                 _mm256_set1_ps(ATAN_A7));
+        p = _mm256_add_ps(_mm256_mul_ps(p, s), _mm256_set1_ps(ATAN_A5));
+        p = _mm256_add_ps(_mm256_mul_ps(p, s), _mm256_set1_ps(ATAN_A3));
+        p = _mm256_add_ps(_mm256_mul_ps(p, s), _mm256_set1_ps(ATAN_A1));
+        p = _mm256_mul_ps(p, a);
+        p = _mm256_blendv_ps(p, _mm256_sub_ps(halfPi, p),
+                             _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+        p = _mm256_blendv_ps(p, _mm256_sub_ps(pi, p),
+                             _mm256_cmp_ps(fr, zero, _CMP_LT_OQ));
+        p = _mm256_xor_ps(p, _mm256_and_ps(_mm256_cmp_ps(fi, zero, _CMP_LT_OQ),
+                                           sign));
+
+        __m256 d = _mm256_sub_ps(p, ph);
+        d = _mm256_sub_ps(d, _mm256_and_ps(_mm256_cmp_ps(d, pi, _CMP_GT_OQ),
+                                           twoPi));
+        d = _mm256_add_ps(d, _mm256_and_ps(_mm256_cmp_ps(d, minusPi, _CMP_LT_OQ),
+                                           twoPi));
+        _mm256_storeu_ps(theta + i, d);
+    }
+    kernelScalar<column>(real, imag, gain, phase, z, theta, i, n);
+}
+
+#endif
+
+/**
+ * Whether this CPU runs a kernel.
+ *
+ * @param kernel IMPEDANCE_SCALAR, IMPEDANCE_SSE2 or IMPEDANCE_AVX2
+ * @return Whether it can be used
+ */
+bool impedanceKernelSupported(int kernel) {
+    switch (kernel) {
+        case IMPEDANCE_SCALAR:
+            return true;
+#ifdef IMPEDANCE_X86
+        case IMPEDANCE_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case IMPEDANCE_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * The fastest kernel this CPU runs, checked once.
+ */
+int impedanceBestKernel(void) {
+    static int best = -1;
+    if (best < 0) {
+        best = IMPEDANCE_SCALAR;
+        for (int k = IMPEDANCE_KERNELS - 1; k > IMPEDANCE_SCALAR; k--) {
+            if (impedanceKernelSupported(k)) {
+                best = k;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+const char *impedanceKernelName(int kernel) {
+    switch (kernel) {
+        case IMPEDANCE_SCALAR: return "scalar";
+        case IMPEDANCE_SSE2: return "SSE2";
+        case IMPEDANCE_AVX2: return "AVX2";
+        default: return "unknown";
+    }
+}
+
+/**
+ * Run a kernel, falling back to the best supported one.
+ */
+template <bool column>
+static void dispatch(const int16_t *real, const int16_t *imag,
+                     const float *gain, const float *phase, float *z,
+                     float *theta, size_t n, int kernel) {
+    if (kernel == IMPEDANCE_BEST || !impedanceKernelSupported(kernel))
+        kernel = impedanceBestKernel();
+    switch (kernel) {
+#ifdef IMPEDANCE_X86
+        case IMPEDANCE_AVX2:
+            kernelAvx2<column>(real, imag, gain, phase, z, theta, n);
+            break;
+        case IMPEDANCE_SSE2:
+            kernelSse2<column>(real, imag, gain, phase, z, theta, n);
+            break;
+#endif
+        default:
+            kernelScalar<column>(real, imag, gain, phase, z, theta, 0, n);
+            break;
+    }
+}
+
+void impedanceCompute(const int16_t *real, const int16_t *imag,
+                      const float *gain, const float *phase, float *z,
+                      float *theta, size_t n, int kernel) {
+    dispatch<false>(real, imag, gain, phase, z, theta, n, kernel);
+}
+
+void impedanceComputeColumn(const int16_t *real, const int16_t *imag,
+                            float gain, float phase, float *z, float *theta,
+                            size_t n, int kernel) {
+    dispatch<true>(real, imag, &gain, &phase, z, theta, n, kernel);
+}
@@ -0,0 +1,63 @@
+#ifndef ImpedanceKernel_h
+#define ImpedanceKernel_h
+
+/**
+ * Includes
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Constants
+ *  Kernels that turn raw AD5933 data into impedance. Every kernel computes
+ *  the same thing with the same float operations in the same order, so they
+ *  agree bit for bit; the vector ones just do 4 or 8 points at a time.
+ */
+#define IMPEDANCE_SCALAR    (0)
+#define IMPEDANCE_SSE2      (1)     // 4 points at a time
+#define IMPEDANCE_AVX2      (2)     // 8 points at a time
+#define IMPEDANCE_KERNELS   (3)
+// The fastest kernel this CPU runs
+#define IMPEDANCE_BEST      (-1)
+// Largest error of the phase against atan2, in radians
+#define IMPEDANCE_PHASE_ERROR   (2e-5f)
+
+/**
+ * Compute |Z| and phase for n points
+ *  Point i has raw data real[i], imag[i] and is calibrated with gain[i] and
+ *  phase[i], as AD5933::calibrate produces them (gain in 1/(ohm * code),
+ *  system phase in radians):
+ *
+ *  |Z| = 1 / (sqrt(real^2 + imag^2) * gain)
+ *  phase = atan2(imag, real) - system phase, wrapped to [-pi, pi]
+ *
+ *  A point with no signal (0, 0) has an infinite |Z| and a phase of minus
+ *  the system phase.
+ *
+ * @param real Real parts
+ * @param imag Imaginary parts
+ * @param gain Gain factor of each point
+ * @param phase System phase of each point
+ * @param z Filled with |Z| in ohms
+ * @param theta Filled with the phase in radians
+ * @param n Number of points
+ * @param kernel Which kernel to use, if this CPU has it
+ */
+void impedanceCompute(const int16_t *real, const int16_t *imag,
+                      const float *gain, const float *phase, float *z,
+                      float *theta, size_t n, int kernel = IMPEDANCE_BEST);
+
+/**
+ * The same for n sweeps of one frequency, as a sweep store column holds
+ * them, all calibrated with the same gain and phase.
+ */
+void impedanceComputeColumn(const int16_t *real, const int16_t *imag,
+                            float gain, float phase, float *z, float *theta,
+                            size_t n, int kernel = IMPEDANCE_BEST);
+
+// Whether this CPU runs a kernel, and the fastest one it does
+bool impedanceKernelSupported(int kernel);
+int impedanceBestKernel(void);
+const char *impedanceKernelName(int kernel);
+
+#endif
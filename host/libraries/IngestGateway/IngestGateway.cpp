@@ -0,0 +1,442 @@
+/**
+ * @file IngestGateway.cpp
+ * @brief Accepts shirt connections, decodes them on a thread pool and
+ * writes the records in batches
+ *
+ * @author Michael Meli
+ */
+
+#include "IngestGateway.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// Connections handed to a worker and not yet picked up
+#define GATEWAY_HANDOFF_SIZE    (1024)
+// epoll events handled per wakeup
+#define GATEWAY_EVENTS          (64)
+// How long the acceptor waits for a connection to close when it is out of
+// file descriptors
+#define GATEWAY_BACKOFF_MICROS  (10000)
+
+/**
+ * A shirt connection, owned by one worker
+ */
+struct IngestGateway::Connection {
+    Connection(int fd, uint32_t device) : fd(fd), decoder(device),
+        prev(NULL), next(NULL) {}
+
+    int fd;
+    ShirtDecoder decoder;
+    Connection *prev;
+    Connection *next;
+};
+
+/**
+ * A worker thread and its connections. The counters are only written by
+ * the worker.
+ */
+struct IngestGateway::Worker {
+    Worker() : gateway(NULL), epollFd(-1), wakeFd(-1),
+        incoming(GATEWAY_HANDOFF_SIZE), connections(NULL), chunkTime(0),
+        accepted(0), active(0), bytes(0), lines(0), errors(0), ignored(0),
+        queueFull(0) {}
+
+    IngestGateway *gateway;
+    int epollFd;
+    int wakeFd;                         // signalled when incoming has more
+    MpscQueue<Connection*> incoming;    // from the acceptor
+    std::thread thread;
+    Connection *connections;
+    uint64_t chunkTime;                 // when the data being decoded arrived
+    char buffer[GATEWAY_READ_SIZE];
+
+    std::atomic<unsigned long> accepted;
+    std::atomic<unsigned long> active;
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long long> lines;
+    std::atomic<unsigned long long> errors;
+    std::atomic<unsigned long long> ignored;
+    std::atomic<unsigned long long> queueFull;
+};
+
+/**
+ * Create a gateway. Nothing runs until start.
+ *
+ * @param sink Where records are written
+ * @param workers Number of decoding threads
+ * @param queueSize Records queued for the writer
+ * @param batchSize Most records per sink write
+ * @param flushMicros Longest a record waits for its batch to fill
+ */
+IngestGateway::IngestGateway(RecordSink *sink, int workers, size_t queueSize,
+                             int batchSize, unsigned long flushMicros) :
+    sink(sink), flushMicros(flushMicros), listenFd(-1), records(queueSize),
+    accepting(false), running(false), workersDone(false), nextDevice(1),
+    refused(0), started(false), written(0), batches(0), sinkErrors(0), latencyMax(0),
+    latencySum(0) {
+    numWorkers = workers < 1 ? 1 : workers > GATEWAY_MAX_WORKERS ?
+                 GATEWAY_MAX_WORKERS : workers;
+    this->batchSize = batchSize < 1 ? 1 : batchSize;
+    this->workers = new Worker[numWorkers];
+    pending.resize(this->batchSize);
+    batch.resize(this->batchSize);
+    for (int i = 0; i < GATEWAY_LATENCY_BUCKETS; i++)
+        latency[i].store(0);
+}
+
+IngestGateway::~IngestGateway() {
+    stop();
+    delete[] workers;
+}
+
+/**
+ * Monotonic time in us.
+ */
+uint64_t IngestGateway::now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Wall clock time in us. Records are stamped with it so they can be stored
+ * and compared across restarts.
+ */
+uint64_t IngestGateway::wallClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Raise the soft limit on open files as far as the hard limit allows.
+ *
+ * @return The soft limit now in force
+ */
+unsigned long IngestGateway::raiseFileLimit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+        return 0;
+    if (rl.rlim_cur < rl.rlim_max) {
+        rlim_t soft = rl.rlim_cur;
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+            rl.rlim_cur = soft;
+    }
+    return rl.rlim_cur == RLIM_INFINITY ? ~0UL : (unsigned long)rl.rlim_cur;
+}
+
+/**
+ * Start the acceptor, the workers and the writer.
+ *
+ * @param listenFd A listening stream socket
+ * @return Whether everything started
+ */
+bool IngestGateway::start(int listenFd) {
+    if (started || listenFd < 0)
+        return false;
+    // The acceptor takes every pending connection per wakeup, and must not
+    // block once they are gone
+    int flags = fcntl(listenFd, F_GETFL);
+    if (flags < 0 || fcntl(listenFd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return false;
+
+    for (int i = 0; i < numWorkers; i++) {
+        Worker *w = &workers[i];
+        w->gateway = this;
+        w->epollFd = epoll_create1(0);
+        w->wakeFd = eventfd(0, EFD_NONBLOCK);
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (w->epollFd < 0 || w->wakeFd < 0 ||
+            epoll_ctl(w->epollFd, EPOLL_CTL_ADD, w->wakeFd, &ev) < 0) {
+            for (int j = 0; j <= i; j++) {
+                if (workers[j].epollFd >= 0)
+                    close(workers[j].epollFd);
+                if (workers[j].wakeFd >= 0)
+                    close(workers[j].wakeFd);
+                workers[j].epollFd = workers[j].wakeFd = -1;
+            }
+            return false;
+        }
+    }
+
+    this->listenFd = listenFd;
+    accepting = true;
+    running = true;
+    workersDone = false;
+    started = true;
+    for (int i = 0; i < numWorkers; i++)
+        workers[i].thread = std::thread(&IngestGateway::workerLoop, this,
+                                        &workers[i]);
+    writer = std::thread(&IngestGateway::writerLoop, this);
+    acceptor = std::thread(&IngestGateway::acceptLoop, this);
+    return true;
+}
+
+/**
+ * Stop in order: no new connections, then no new data, then write out
+ * what is left.
+ */
+void IngestGateway::stop(void) {
+    if (!started)
+        return;
+    accepting = false;
+    acceptor.join();
+    running = false;
+    for (int i = 0; i < numWorkers; i++)
+        workers[i].thread.join();
+    workersDone.store(true, std::memory_order_release);
+    writer.join();
+
+    close(listenFd);
+    for (int i = 0; i < numWorkers; i++) {
+        close(workers[i].epollFd);
+        close(workers[i].wakeFd);
+    }
+    started = false;
+}
+
+/**
+ * Accept connections and deal them out to the workers in turn. Out of file
+ * descriptors, the pending connections stay in the backlog while the
+ * acceptor waits for some to close, rather than spinning on a listener that
+ * stays readable.
+ */
+void IngestGateway::acceptLoop(void) {
+    int next = 0;
+    struct pollfd pfd;
+    pfd.fd = listenFd;
+    pfd.events = POLLIN;
+    while (accepting) {
+        if (poll(&pfd, 1, GATEWAY_POLL_MS) <= 0)
+            continue;
+        int fd;
+        while ((fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+            Worker *w = &workers[next];
+            next = (next + 1) % numWorkers;
+            Connection *conn = new Connection(fd, nextDevice++);
+            while (!w->incoming.push(conn)) {
+                if (!accepting) {
+                    close(fd);
+                    delete conn;
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            uint64_t one = 1;
+            if (write(w->wakeFd, &one, sizeof(one)) < 0) {
+                // The counter is already signalled
+            }
+        }
+        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+            errno == ENOMEM) {
+            refused.fetch_add(1, std::memory_order_relaxed);
+            usleep(GATEWAY_BACKOFF_MICROS);
+        }
+    }
+}
+
+/**
+ * Decode whatever the worker's connections have sent, until stopped.
+ */
+void IngestGateway::workerLoop(Worker *w) {
+    struct epoll_event events[GATEWAY_EVENTS];
+    for (;;) {
+        // Pick up new connections
+        Connection *conn;
+        while (w->incoming.pop(&conn)) {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.ptr = conn;
+            conn->next = w->connections;
+            if (w->connections)
+                w->connections->prev = conn;
+            w->connections = conn;
+            w->accepted.fetch_add(1, std::memory_order_relaxed);
+            w->active.fetch_add(1, std::memory_order_relaxed);
+            if (epoll_ctl(w->epollFd, EPOLL_CTL_ADD, conn->fd, &ev) < 0)
+                closeConnection(w, conn);
+        }
+        if (!running)
+            break;
+
+        int n = epoll_wait(w->epollFd, events, GATEWAY_EVENTS, GATEWAY_POLL_MS);
+        for (int i = 0; i < n; i++) {
+            conn = (Connection*)events[i].data.ptr;
+            if (!conn) {
+                uint64_t count;
+                if (read(w->wakeFd, &count, sizeof(count)) < 0) {
+                    // Nothing to clear
+                }
+                continue;
+            }
+
+            // One read per connection per wakeup, so a busy shirt cannot
+            // starve the others
+            ssize_t r = read(conn->fd, w->buffer, sizeof(w->buffer));
+            if (r > 0) {
+                unsigned long lines = conn->decoder.getLineCount();
+                unsigned long errors = conn->decoder.getErrorCount();
+                unsigned long ignored = conn->decoder.getIgnoredCount();
+                w->chunkTime = now();
+                conn->decoder.feed(w->buffer, r, wallClock(), queueRecord, w);
+                w->bytes.fetch_add(r, std::memory_order_relaxed);
+                w->lines.fetch_add(conn->decoder.getLineCount() - lines,
+                                   std::memory_order_relaxed);
+                w->errors.fetch_add(conn->decoder.getErrorCount() - errors,
+                                    std::memory_order_relaxed);
+                w->ignored.fetch_add(conn->decoder.getIgnoredCount() - ignored,
+                                     std::memory_order_relaxed);
+            } else if (r == 0 || (errno != EAGAIN && errno != EINTR)) {
+                closeConnection(w, conn);
+            }
+        }
+    }
+
+    while (w->connections)
+        closeConnection(w, w->connections);
+}
+
+/**
+ * Close a connection, keeping a sweep it was partway through.
+ */
+void IngestGateway::closeConnection(Worker *w, Connection *conn) {
+    ShirtRecord record;
+    if (conn->decoder.finish(&record)) {
+        w->chunkTime = now();
+        queueRecord(&record, w);
+    }
+    epoll_ctl(w->epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        w->connections = conn->next;
+    if (conn->next)
+        conn->next->prev = conn->prev;
+    delete conn;
+    w->active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * Decoder callback: queue a record for the writer, waiting for room if the
+ * writer is behind.
+ */
+void IngestGateway::queueRecord(const ShirtRecord *record, void *context) {
+    Worker *w = (Worker*)context;
+    QueuedRecord q;
+    q.queued = w->chunkTime;
+    q.record = *record;
+    while (!w->gateway->records.push(q)) {
+        w->queueFull.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * Drain the queue into the sink. A batch is written when it is full or its
+ * oldest record has waited flushMicros, whichever is first.
+ */
+void IngestGateway::writerLoop(void) {
+    int have = 0;
+    for (;;) {
+        bool done = workersDone.load(std::memory_order_acquire);
+        int n = records.popBatch(&pending[have], batchSize - have);
+        have += n;
+        if (have > 0 && (have == batchSize || done ||
+                         now() - pending[0].queued >= flushMicros)) {
+            writeBatch(have);
+            have = 0;
+            continue;
+        }
+        if (n == 0) {
+            if (done && have == 0)
+                break;
+            usleep(GATEWAY_IDLE_MICROS);
+        }
+    }
+    sink->flush();
+}
+
+/**
+ * Write the pending records and account for their latency.
+ */
+void IngestGateway::writeBatch(int n) {
+    for (int i = 0; i < n; i++)
+        batch[i] = pending[i].record;
+    if (!sink->write(&batch[0], n))
+        sinkErrors.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t t = now();
+    unsigned long long sum = 0, max = latencyMax.load(std::memory_order_relaxed);
+    for (int i = 0; i < n; i++) {
+        unsigned long long us = t - pending[i].queued;
+        int bucket = us ? 64 - __builtin_clzll(us) : 0;
+        if (bucket >= GATEWAY_LATENCY_BUCKETS)
+            bucket = GATEWAY_LATENCY_BUCKETS - 1;
+        latency[bucket].fetch_add(1, std::memory_order_relaxed);
+        sum += us;
+        if (us > max)
+            max = us;
+    }
+    latencyMax.store(max, std::memory_order_relaxed);
+    latencySum.fetch_add(sum, std::memory_order_relaxed);
+    written.fetch_add(n, std::memory_order_relaxed);
+    batches.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Snapshot of the statistics. Safe to call while running.
+ *
+ * @param stats Filled in
+ */
+void IngestGateway::getStats(GatewayStats *stats) const {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < numWorkers; i++) {
+        const Worker *w = &workers[i];
+        stats->connections += w->accepted.load(std::memory_order_relaxed);
+        stats->active += w->active.load(std::memory_order_relaxed);
+        stats->bytes += w->bytes.load(std::memory_order_relaxed);
+        stats->lines += w->lines.load(std::memory_order_relaxed);
+        stats->lineErrors += w->errors.load(std::memory_order_relaxed);
+        stats->ignored += w->ignored.load(std::memory_order_relaxed);
+        stats->queueFull += w->queueFull.load(std::memory_order_relaxed);
+    }
+    stats->records = written.load(std::memory_order_relaxed);
+    stats->batches = batches.load(std::memory_order_relaxed);
+    stats->sinkErrors = sinkErrors.load(std::memory_order_relaxed);
+    stats->refused = refused.load(std::memory_order_relaxed);
+    stats->maxLatency = latencyMax.load(std::memory_order_relaxed);
+    stats->meanLatency = stats->records ?
+        latencySum.load(std::memory_order_relaxed) / stats->records : 0;
+
+    // Percentiles from the histogram, as the top of their bucket
+    unsigned long long counts[GATEWAY_LATENCY_BUCKETS], total = 0;
+    for (int i = 0; i < GATEWAY_LATENCY_BUCKETS; i++) {
+        counts[i] = latency[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    unsigned long long seen = 0;
+    for (int i = 0; i < GATEWAY_LATENCY_BUCKETS && total; i++) {
+        seen += counts[i];
+        unsigned long long top = 1ULL << i;
+        if (!stats->p50Latency && seen * 2 >= total)
+            stats->p50Latency = top;
+        if (!stats->p99Latency && seen * 100 >= total * 99) {
+            stats->p99Latency = top;
+            break;
+        }
+    }
+}
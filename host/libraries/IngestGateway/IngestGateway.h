@@ -0,0 +1,147 @@
+#ifndef IngestGateway_h
+#define IngestGateway_h
+
+/**
+ * Includes
+ */
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ShirtDecoder.h"
+#include "MpscQueue.h"
+#include "RecordSink.h"
+
+/**
+ * Constants
+ */
+// Most worker threads
+#define GATEWAY_MAX_WORKERS     (64)
+// Bytes read from a connection at a time
+#define GATEWAY_READ_SIZE       (16384)
+// Records queued between the workers and the writer
+#define GATEWAY_QUEUE_SIZE      (16384)
+// Most records per write to the sink
+#define GATEWAY_BATCH_SIZE      (512)
+// A partial batch is written once its oldest record has waited this long
+#define GATEWAY_FLUSH_MICROS    (5000)
+// How long the writer sleeps when the queue is empty
+#define GATEWAY_IDLE_MICROS     (200)
+// How often the threads check for stop, in ms
+#define GATEWAY_POLL_MS         (50)
+// Latency histogram: bucket i counts latencies below 2^i us
+#define GATEWAY_LATENCY_BUCKETS (32)
+
+/**
+ * Gateway statistics
+ *  Latency is from a record's last message arriving to the sink having
+ *  written it.
+ */
+struct GatewayStats {
+    unsigned long connections;      // accepted since start
+    unsigned long active;           // open now
+    unsigned long long bytes;
+    unsigned long long lines;
+    unsigned long long records;     // written to the sink
+    unsigned long long lineErrors;  // malformed messages
+    unsigned long long ignored;     // messages that are not measurements
+    unsigned long long queueFull;   // times a worker waited on the writer
+    unsigned long long refused;     // accepts put off for want of an fd
+    unsigned long long batches;
+    unsigned long long sinkErrors;  // batches the sink failed to write
+    unsigned long long maxLatency;  // us
+    unsigned long long meanLatency;
+    unsigned long long p50Latency;  // upper bound of the bucket
+    unsigned long long p99Latency;
+};
+
+/**
+ * Multi-shirt ingest gateway
+ *  Accepts shirt connections and spreads them across a pool of worker
+ *  threads, each running an epoll loop over its connections. A worker
+ *  decodes what its shirts send and pushes the records into one lock-free
+ *  MPSC queue; a writer thread drains it into the sink in batches. When the
+ *  writer falls behind the queue fills, the workers wait, and the socket
+ *  buffers push back on the shirts, so memory and queueing delay stay
+ *  bounded.
+ *
+ *  Each connection is only ever touched by its worker, so its records reach
+ *  the sink in the order it sent them.
+ */
+class IngestGateway {
+    public:
+        IngestGateway(RecordSink *sink, int workers = 2,
+                      size_t queueSize = GATEWAY_QUEUE_SIZE,
+                      int batchSize = GATEWAY_BATCH_SIZE,
+                      unsigned long flushMicros = GATEWAY_FLUSH_MICROS);
+        ~IngestGateway();
+
+        // Start accepting on a listening socket (see Transport.h), which
+        // the gateway closes when stopped
+        bool start(int listenFd);
+
+        // Stop accepting, close every connection, write out everything
+        // decoded and flush the sink
+        void stop(void);
+
+        void getStats(GatewayStats *stats) const;
+
+        // Monotonic clock in us, as used for latency
+        static uint64_t now(void);
+
+        // Wall clock in us since the Unix epoch, as used for record times
+        static uint64_t wallClock(void);
+
+        // Raise the soft limit on open files to the hard limit; a gateway
+        // holds one per shirt. Returns the limit now in force.
+        static unsigned long raiseFileLimit(void);
+
+    private:
+        IngestGateway(const IngestGateway &);
+        IngestGateway &operator=(const IngestGateway &);
+
+        struct Connection;
+        struct Worker;
+
+        // A record and when it was queued
+        struct QueuedRecord {
+            uint64_t queued;
+            ShirtRecord record;
+        };
+
+        void acceptLoop(void);
+        void workerLoop(Worker *worker);
+        void writerLoop(void);
+        void closeConnection(Worker *worker, Connection *conn);
+        void writeBatch(int n);
+        static void queueRecord(const ShirtRecord *record, void *context);
+
+        RecordSink *sink;
+        int numWorkers;
+        int batchSize;
+        unsigned long flushMicros;
+        int listenFd;
+
+        MpscQueue<QueuedRecord> records;
+        Worker *workers;
+        std::thread acceptor;
+        std::thread writer;
+        std::atomic<bool> accepting;
+        std::atomic<bool> running;
+        std::atomic<bool> workersDone;
+        std::atomic<unsigned long> nextDevice;
+        std::atomic<unsigned long long> refused;
+        bool started;
+
+        // Writer's batch and statistics
+        std::vector<QueuedRecord> pending;
+        std::vector<ShirtRecord> batch;
+        std::atomic<unsigned long long> written;
+        std::atomic<unsigned long long> batches;
+        std::atomic<unsigned long long> sinkErrors;
+        std::atomic<unsigned long long> latencyMax;
+        std::atomic<unsigned long long> latencySum;
+        std::atomic<unsigned long long> latency[GATEWAY_LATENCY_BUCKETS];
+};
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file RecordSink.cpp
+ * @brief Where decoded records are written: a row-wise text log or a
+ * columnar sweep store
+ *
+ * @author Michael Meli
+ */
+
+#include "RecordSink.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Longest formatted record: header plus each point as freq:real:imag
+#define TEXT_LOG_RECORD_MAX (64 + SHIRT_MAX_POINTS * 20)
+
+TextLogSink::TextLogSink(int fd) : fd(fd), buffer(NULL), size(0), used(0),
+    written(0) {
+}
+
+TextLogSink::~TextLogSink() {
+    free(buffer);
+}
+
+/**
+ * Make room for more bytes in the batch buffer.
+ */
+bool TextLogSink::reserve(size_t more) {
+    if (used + more <= size)
+        return true;
+    size_t newSize = size ? size : 65536;
+    while (newSize < used + more)
+        newSize *= 2;
+    char *newBuffer = (char*)realloc(buffer, newSize);
+    if (!newBuffer)
+        return false;
+    buffer = newBuffer;
+    size = newSize;
+    return true;
+}
+
+/**
+ * Format a batch and write it out.
+ *
+ * @param records The records
+ * @param n How many
+ * @return Whether all of it was written
+ */
+bool TextLogSink::write(const ShirtRecord *records, int n) {
+    used = 0;
+    for (int i = 0; i < n; i++) {
+        const ShirtRecord *r = &records[i];
+        if (!reserve(TEXT_LOG_RECORD_MAX))
+            return false;
+        char *p = buffer + used;
+        switch (r->type) {
+            case SHIRT_RECORD_TEMPERATURE:
+            case SHIRT_RECORD_BATTERY:
+                p += sprintf(p, "%" PRIu64 " %" PRIu32 " %c %" PRId32 "\n",
+                             r->time, r->device,
+                             r->type == SHIRT_RECORD_TEMPERATURE ? 'T' : 'B',
+                             r->value);
+                break;
+            case SHIRT_RECORD_SWEEP:
+                p += sprintf(p, "%" PRIu64 " %" PRIu32 " I %d", r->time,
+                             r->device, r->points);
+                for (int j = 0; j < r->points; j++)
+                    p += sprintf(p, " %u:%d:%d", r->freqKHz[j], r->real[j],
+                                 r->imag[j]);
+                *p++ = '\n';
+                break;
+            default:
+                continue;
+        }
+        used = p - buffer;
+    }
+
+    size_t off = 0;
+    while (off < used) {
+        ssize_t w = ::write(fd, buffer + off, used - off);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        off += w;
+    }
+    written += used;
+    return true;
+}
+
+/**
+ * Flush the log to disk.
+ */
+bool TextLogSink::flush(void) {
+    return fsync(fd) == 0 || errno == EINVAL || errno == EROFS;
+}
+
+SweepStoreSink::SweepStoreSink(const char *path) : path(path), opened(false),
+    calibration(0), rejected(0) {
+}
+
+/**
+ * Keep each shirt's conditions and store its sweeps.
+ *
+ * @param records The records
+ * @param n How many
+ * @return Whether every sweep that fits the store was stored
+ */
+bool SweepStoreSink::write(const ShirtRecord *records, int n) {
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        const ShirtRecord *r = &records[i];
+        Conditions &c = devices[r->device];
+        switch (r->type) {
+            case SHIRT_RECORD_TEMPERATURE:
+                c.temperature = r->value < INT16_MIN + 1 ? INT16_MIN + 1 :
+                                r->value > INT16_MAX ? INT16_MAX : r->value;
+                break;
+            case SHIRT_RECORD_BATTERY:
+                c.battery = r->value;
+                break;
+            case SHIRT_RECORD_SWEEP:
+                ok = append(r) && ok;
+                break;
+        }
+    }
+    return ok;
+}
+
+/**
+ * Store one sweep, creating the store on the first.
+ */
+bool SweepStoreSink::append(const ShirtRecord *r) {
+    uint32_t freqKHz[SHIRT_MAX_POINTS];
+    for (int p = 0; p < r->points; p++)
+        freqKHz[p] = r->freqKHz[p];
+    if (r->points == 0 || r->points != r->expected) {
+        rejected++;
+        return true;
+    }
+    if (!opened) {
+        if (!store.open(path, r->points, freqKHz))
+            return false;
+        opened = true;
+    }
+    if (r->points != store.getPoints()) {
+        rejected++;
+        return true;
+    }
+    for (int p = 0; p < r->points; p++) {
+        if (freqKHz[p] != store.getFrequency(p)) {
+            rejected++;
+            return true;
+        }
+    }
+
+    const Conditions &c = devices[r->device];
+    SweepMeta meta;
+    meta.time = r->time;
+    meta.device = r->device;
+    meta.temperature = c.temperature;
+    meta.battery = c.battery;
+    meta.calibration = calibration;
+    return store.append(meta, r->real, r->imag);
+}
+
+/**
+ * Flush the store to disk.
+ */
+bool SweepStoreSink::flush(void) {
+    return !opened || store.flush();
+}
@@ -0,0 +1,97 @@
+#ifndef RecordSink_h
+#define RecordSink_h
+
+/**
+ * Includes
+ */
+#include <stddef.h>
+#include <unordered_map>
+#include "ShirtDecoder.h"
+#include "SweepStore.h"
+
+/**
+ * Where decoded records go
+ *  The gateway's writer thread hands records over in batches, oldest
+ *  first, and is the only caller.
+ */
+class RecordSink {
+    public:
+        virtual ~RecordSink() {}
+
+        // Store a batch of records. False if they could not be stored.
+        virtual bool write(const ShirtRecord *records, int n) = 0;
+
+        // Make everything written so far durable
+        virtual bool flush(void) { return true; }
+};
+
+/**
+ * Row-wise text log
+ *  One line per record, space separated:
+ *
+ *  time device T centiF
+ *  time device B percent
+ *  time device I points freq:real:imag ...
+ *
+ *  Each batch is formatted in memory and written with one system call.
+ */
+class TextLogSink : public RecordSink {
+    public:
+        // Writes to fd, which stays open
+        explicit TextLogSink(int fd);
+        ~TextLogSink();
+
+        bool write(const ShirtRecord *records, int n);
+        bool flush(void);
+
+        unsigned long long getBytesWritten(void) const { return written; }
+
+    private:
+        bool reserve(size_t more);
+
+        int fd;
+        char *buffer;
+        size_t size;
+        size_t used;
+        unsigned long long written;
+};
+
+/**
+ * Columnar sweep store
+ *  Appends each complete sweep to a SweepStore, with the last temperature
+ *  and battery level its shirt sent before it. The store is created from
+ *  the first sweep's frequency plan when it does not exist yet; sweeps with
+ *  any other plan, and sweeps cut short, are counted and left out.
+ */
+class SweepStoreSink : public RecordSink {
+    public:
+        explicit SweepStoreSink(const char *path);
+
+        bool write(const ShirtRecord *records, int n);
+        bool flush(void);
+
+        // Calibration stored with the sweeps from now on
+        void setCalibration(uint16_t id) { calibration = id; }
+
+        uint64_t getSweepCount(void) const { return store.getSweepCount(); }
+        unsigned long long getRejectedCount(void) const { return rejected; }
+
+    private:
+        struct Conditions {
+            Conditions() : temperature(SWEEP_STORE_UNKNOWN),
+                battery(SWEEP_STORE_UNKNOWN) {}
+            int16_t temperature;
+            int16_t battery;
+        };
+
+        bool append(const ShirtRecord *r);
+
+        const char *path;
+        SweepStoreWriter store;
+        bool opened;
+        uint16_t calibration;
+        unsigned long long rejected;
+        std::unordered_map<uint32_t, Conditions> devices;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file Transport.cpp
+ * @brief Unix and TCP stream sockets for the shirt links
+ *
+ * @author Michael Meli
+ */
+
+#include "Transport.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define TRANSPORT_BACKLOG   (4096)
+
+/**
+ * Fill in a Unix socket address.
+ */
+static bool unixAddress(const char *path, struct sockaddr_un *sun) {
+    if (strlen(path) >= sizeof(sun->sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, path);
+    return true;
+}
+
+/**
+ * Resolve "host:port". An empty host is any address when listening.
+ */
+static struct addrinfo *tcpAddress(const char *hostPort, bool passive) {
+    const char *colon = strrchr(hostPort, ':');
+    if (!colon) {
+        errno = EINVAL;
+        return NULL;
+    }
+    char host[256];
+    size_t hostLen = colon - hostPort;
+    if (hostLen >= sizeof(host)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    memcpy(host, hostPort, hostLen);
+    host[hostLen] = '\0';
+
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    if (getaddrinfo(hostLen ? host : NULL, colon + 1, &hints, &result) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return result;
+}
+
+/**
+ * Listen on a Unix or TCP address. A stale Unix socket file is replaced.
+ *
+ * @param address unix:path or tcp:host:port
+ * @return The listening socket, or -1
+ */
+int transportListen(const char *address) {
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un sun;
+        if (!unixAddress(address + 5, &sun))
+            return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        unlink(sun.sun_path);
+        if (bind(fd, (struct sockaddr*)&sun, sizeof(sun)) < 0 ||
+            listen(fd, TRANSPORT_BACKLOG) < 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        return fd;
+    }
+
+    if (strncmp(address, "tcp:", 4) == 0) {
+        struct addrinfo *ai = tcpAddress(address + 4, true);
+        if (!ai)
+            return -1;
+        int fd = socket(ai->ai_family, SOCK_STREAM, 0);
+        int one = 1;
+        if (fd < 0 ||
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+            bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+            listen(fd, TRANSPORT_BACKLOG) < 0) {
+            int err = errno;
+            if (fd >= 0)
+                close(fd);
+            freeaddrinfo(ai);
+            errno = err;
+            return -1;
+        }
+        freeaddrinfo(ai);
+        return fd;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+/**
+ * Connect to a Unix or TCP address. TCP connections send small messages
+ * straight away rather than waiting to fill a segment, as BLE notifications
+ * would arrive.
+ *
+ * @param address unix:path or tcp:host:port
+ * @return The connected socket, or -1
+ */
+int transportConnect(const char *address) {
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un sun;
+        if (!unixAddress(address + 5, &sun))
+            return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr*)&sun, sizeof(sun)) < 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        return fd;
+    }
+
+    if (strncmp(address, "tcp:", 4) == 0) {
+        struct addrinfo *ai = tcpAddress(address + 4, false);
+        if (!ai)
+            return -1;
+        int fd = socket(ai->ai_family, SOCK_STREAM, 0);
+        int one = 1;
+        if (fd < 0 || connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            int err = errno;
+            if (fd >= 0)
+                close(fd);
+            freeaddrinfo(ai);
+            errno = err;
+            return -1;
+        }
+        freeaddrinfo(ai);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
@@ -0,0 +1,23 @@
+#ifndef Transport_h
+#define Transport_h
+
+/**
+ * Local stand-in for the BLE link
+ *  Shirts (real ones behind a BLE bridge, or simulated ones) reach the
+ *  gateway over a stream socket, one connection per shirt. Addresses are
+ *  written as
+ *
+ *  unix:/path/to/socket
+ *  tcp:host:port       (an empty host listens on every interface)
+ *
+ *  so the transport is picked on the command line. Both calls return a
+ *  socket, or -1 with errno set.
+ */
+
+// Listen for shirts on address
+int transportListen(const char *address);
+
+// Connect to a gateway listening on address
+int transportConnect(const char *address);
+
+#endif
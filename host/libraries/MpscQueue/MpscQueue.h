@@ -0,0 +1,123 @@
+#ifndef MpscQueue_h
+#define MpscQueue_h
+
+/**
+ * Includes
+ */
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Constants
+ */
+// Cache line size, to keep the producer and consumer ends apart
+#define MPSC_CACHE_LINE     (64)
+
+/**
+ * Bounded lock-free multi-producer, single-consumer queue
+ *  A ring of cells, each with a sequence number saying whose turn it is.
+ *  Producers claim a cell by advancing the tail with a compare-and-swap,
+ *  fill it, then publish it by bumping its sequence; the one consumer takes
+ *  cells in order once they are published. Nothing blocks: push fails when
+ *  the ring is full and pop when the next cell is not published yet, so the
+ *  caller decides whether to wait, retry or drop.
+ *
+ *  Any number of threads may push. Only one thread may pop.
+ */
+template <typename T>
+class MpscQueue {
+    public:
+        // Capacity is rounded up to a power of two
+        explicit MpscQueue(size_t capacity) {
+            size_t n = 2;
+            while (n < capacity)
+                n <<= 1;
+            mask = n - 1;
+            cells = new Cell[n];
+            for (size_t i = 0; i < n; i++)
+                cells[i].seq.store(i, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+            head.store(0, std::memory_order_relaxed);
+        }
+
+        ~MpscQueue() {
+            delete[] cells;
+        }
+
+        // Add an item. False if the queue is full.
+        bool push(const T &item) {
+            size_t pos = tail.load(std::memory_order_relaxed);
+            Cell *cell;
+            for (;;) {
+                cell = &cells[pos & mask];
+                size_t seq = cell->seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0) {
+                    if (tail.compare_exchange_weak(pos, pos + 1,
+                                                   std::memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = item;
+            cell->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Take the oldest item. False if there is none. Consumer only.
+        bool pop(T *item) {
+            size_t pos = head.load(std::memory_order_relaxed);
+            Cell *cell = &cells[pos & mask];
+            if (cell->seq.load(std::memory_order_acquire) != pos + 1)
+                return false;
+            *item = cell->value;
+            cell->seq.store(pos + mask + 1, std::memory_order_release);
+            head.store(pos + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Take up to max items, oldest first. Returns how many. Consumer
+        // only.
+        size_t popBatch(T *items, size_t max) {
+            size_t n = 0;
+            while (n < max && pop(&items[n]))
+                n++;
+            return n;
+        }
+
+        // Items claimed by producers and not yet popped. Only a snapshot
+        // while the queue is in use.
+        size_t size(void) const {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t t = tail.load(std::memory_order_relaxed);
+            return t > h ? t - h : 0;
+        }
+
+        size_t capacity(void) const { return mask + 1; }
+
+    private:
+        MpscQueue(const MpscQueue &);
+        MpscQueue &operator=(const MpscQueue &);
+
+        struct Cell {
+            std::atomic<size_t> seq;
+            T value;
+        };
+
+        Cell *cells;
+        size_t mask;
+
+        // Producers' end and the consumer's end, a cache line apart. Padded
+        // rather than aligned, since C++11 new ignores extended alignment.
+        char padTail[MPSC_CACHE_LINE];
+        std::atomic<size_t> tail;
+        char padHead[MPSC_CACHE_LINE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> head;
+        char pad[MPSC_CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif
@@ -0,0 +1,242 @@
+/**
+ * @file ShirtDecoder.cpp
+ * @brief Decodes the shirt's text protocol into records
+ *
+ * The parsing is done by hand on the raw bytes: no copies, no locale and no
+ * allocation, since the gateway runs it for every line of every shirt.
+ *
+ * @author Michael Meli
+ */
+
+#include "ShirtDecoder.h"
+#include <string.h>
+
+/**
+ * Create a decoder for one stream.
+ *
+ * @param device Id of the shirt, until the stream names itself with D$
+ */
+ShirtDecoder::ShirtDecoder(uint32_t device) : device(device) {
+    lineLength = 0;
+    overlong = false;
+    inSweep = false;
+    lines = 0;
+    errors = 0;
+    ignored = 0;
+    memset(&sweep, 0, sizeof(sweep));
+}
+
+/**
+ * Parse a decimal number, optionally signed, with up to decimals digits
+ * after the point. "98.6" with 2 decimals is 9860.
+ *
+ * @param s The text, not null-terminated
+ * @param len Its length
+ * @param decimals Fractional digits to scale by
+ * @param value The result
+ * @return Whether s was a number with no more than decimals fractional digits
+ */
+bool ShirtDecoder::parseFixed(const char *s, int len, int decimals,
+                              long *value) {
+    int i = 0;
+    bool negative = false;
+    if (i < len && (s[i] == '-' || s[i] == '+'))
+        negative = s[i++] == '-';
+
+    long v = 0;
+    int digits = 0, fraction = -1;
+    for (; i < len; i++) {
+        if (s[i] == '.' && fraction < 0) {
+            fraction = 0;
+            continue;
+        }
+        if (s[i] < '0' || s[i] > '9' || digits >= 9)
+            return false;
+        if (fraction >= 0 && ++fraction > decimals)
+            return false;
+        v = v * 10 + (s[i] - '0');
+        digits++;
+    }
+    if (digits == 0)
+        return false;
+    for (int d = fraction < 0 ? 0 : fraction; d < decimals; d++)
+        v *= 10;
+    *value = negative ? -v : v;
+    return true;
+}
+
+/**
+ * Decode a chunk of the stream. Complete lines are decoded as they are
+ * found; the rest is kept for the next chunk. Lines longer than
+ * SHIRT_LINE_MAX are dropped and counted as errors.
+ *
+ * @param data Bytes received
+ * @param len Number of bytes
+ * @param now Time they arrived, in us
+ * @param handler Called with each completed record
+ * @param context Passed to handler
+ * @return The number of records completed
+ */
+int ShirtDecoder::feed(const char *data, int len, uint64_t now,
+                       ShirtRecordHandler handler, void *context) {
+    int records = 0;
+    ShirtRecord record;
+    for (int i = 0; i < len; i++) {
+        char c = data[i];
+        if (c != '\n') {
+            if (lineLength < SHIRT_LINE_MAX)
+                line[lineLength++] = c;
+            else
+                overlong = true;
+            continue;
+        }
+
+        if (overlong) {
+            lines++;
+            errors++;
+        } else {
+            int n = lineLength;
+            if (n > 0 && line[n - 1] == '\r')
+                n--;
+            if (decodeLine(line, n, now, &record)) {
+                handler(&record, context);
+                records++;
+            }
+        }
+        lineLength = 0;
+        overlong = false;
+    }
+    return records;
+}
+
+/**
+ * Decode one message.
+ *
+ * @param s The line, without its line ending
+ * @param len Its length
+ * @param now Time it arrived, in us
+ * @param out The record, if one was completed
+ * @return Whether a record was completed
+ */
+bool ShirtDecoder::decodeLine(const char *s, int len, uint64_t now,
+                              ShirtRecord *out) {
+    lines++;
+    if (len < 2 || s[1] != '$') {
+        if (len > 0)
+            ignored++;
+        return false;
+    }
+
+    long value;
+    switch (s[0]) {
+        case 'I':
+            return decodeSweep(s + 2, len - 2, now, out);
+
+        case 'T':
+        case 'B':
+            if (!parseFixed(s + 2, len - 2, s[0] == 'T' ? 2 : 0, &value)) {
+                errors++;
+                return false;
+            }
+            memset(out, 0, sizeof(*out) - sizeof(out->freqKHz) -
+                           sizeof(out->real) - sizeof(out->imag));
+            out->type = s[0] == 'T' ? SHIRT_RECORD_TEMPERATURE
+                                    : SHIRT_RECORD_BATTERY;
+            out->device = device;
+            out->time = now;
+            out->value = value;
+            return true;
+
+        case 'D':
+            if (!parseFixed(s + 2, len - 2, 0, &value) || value < 0)
+                errors++;
+            else
+                device = value;
+            return false;
+
+        default:
+            ignored++;
+            return false;
+    }
+}
+
+/**
+ * Decode the part of an I$ message after the I$.
+ */
+bool ShirtDecoder::decodeSweep(const char *s, int len, uint64_t now,
+                               ShirtRecord *out) {
+    if (len >= 6 && memcmp(s, "START$", 6) == 0) {
+        long n;
+        bool cutShort = takeSweep(out);
+        if (cutShort)
+            errors++;
+        if (!parseFixed(s + 6, len - 6, 0, &n) || n < 1 ||
+            n > SHIRT_MAX_POINTS) {
+            errors++;
+            return cutShort;
+        }
+        sweep.type = SHIRT_RECORD_SWEEP;
+        sweep.points = 0;
+        sweep.expected = n;
+        sweep.device = device;
+        sweep.time = now;
+        sweep.value = 0;
+        inSweep = true;
+        return cutShort;
+    }
+
+    if (len == 4 && memcmp(s, "HALT", 4) == 0) {
+        if (takeSweep(out))
+            return true;
+        errors++;
+        return false;
+    }
+
+    // freq$real$imag
+    long fields[3];
+    int start = 0, field = 0;
+    for (int i = 0; i <= len && field < 3; i++) {
+        if (i < len && s[i] != '$')
+            continue;
+        if (!parseFixed(s + start, i - start, 0, &fields[field])) {
+            errors++;
+            return false;
+        }
+        field++;
+        start = i + 1;
+    }
+    if (field != 3 || start <= len || !inSweep ||
+        sweep.points >= sweep.expected ||
+        fields[0] < 0 || fields[0] > 0xFFFF ||
+        fields[1] < -32768 || fields[1] > 32767 ||
+        fields[2] < -32768 || fields[2] > 32767) {
+        errors++;
+        return false;
+    }
+    sweep.freqKHz[sweep.points] = fields[0];
+    sweep.real[sweep.points] = fields[1];
+    sweep.imag[sweep.points] = fields[2];
+    sweep.points++;
+    return false;
+}
+
+/**
+ * Hand over the sweep in progress, if there is one, and end it.
+ */
+bool ShirtDecoder::takeSweep(ShirtRecord *out) {
+    if (!inSweep)
+        return false;
+    inSweep = false;
+    *out = sweep;
+    return true;
+}
+
+/**
+ * Take the sweep in progress, e.g. when the stream ends partway through.
+ *
+ * @param out The sweep, with the points received so far
+ * @return Whether there was one
+ */
+bool ShirtDecoder::finish(ShirtRecord *out) {
+    return takeSweep(out);
+}
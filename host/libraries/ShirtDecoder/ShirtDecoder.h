@@ -0,0 +1,110 @@
+#ifndef ShirtDecoder_h
+#define ShirtDecoder_h
+
+/**
+ * Includes
+ */
+#include <stdint.h>
+
+/**
+ * Constants
+ *  The text protocol the shirt sends, one message per line:
+ *
+ *  D$id            which shirt this stream is from (gateway transport only)
+ *  I$START$n       a sweep of n points follows
+ *  I$freq$real$imag  one point: frequency in kHz, raw AD5933 data
+ *  I$HALT          end of the sweep
+ *  T$temp          temperature in degrees F with 2 decimals
+ *  B$percent       battery level
+ *
+ *  Anything else (P$, R$, binary frames) is counted and skipped.
+ */
+// Longest line and largest sweep accepted
+#define SHIRT_LINE_MAX      (64)
+#define SHIRT_MAX_POINTS    (64)
+// Record types
+#define SHIRT_RECORD_TEMPERATURE    (1)     // value in hundredths of a degree F
+#define SHIRT_RECORD_BATTERY        (2)     // value in percent
+#define SHIRT_RECORD_SWEEP          (3)     // points of one sweep
+
+/**
+ * A decoded measurement
+ *  Fixed size, so records can be queued and written without allocation. A
+ *  sweep is only complete when its HALT arrives; one cut short by a new
+ *  START or an error is still recorded with the points it has.
+ */
+struct ShirtRecord {
+    uint8_t type;
+    uint8_t points;         // sweeps: points received
+    uint8_t expected;       // sweeps: points announced by START
+    uint8_t reserved;
+    uint32_t device;
+    uint64_t time;          // us, when the message (a sweep's START) arrived
+    int32_t value;          // temperature or battery
+    uint16_t freqKHz[SHIRT_MAX_POINTS];
+    int16_t real[SHIRT_MAX_POINTS];
+    int16_t imag[SHIRT_MAX_POINTS];
+};
+
+// Called with each record as it is completed
+typedef void (*ShirtRecordHandler)(const ShirtRecord *record, void *context);
+
+/**
+ * Shirt stream decoder
+ *  Splits one shirt's byte stream into lines and turns them into records.
+ *  Each connection needs its own; a decoder is not thread safe.
+ */
+class ShirtDecoder {
+    public:
+        ShirtDecoder(uint32_t device = 0);
+
+        // Decode a chunk of the stream, received at time now (us). Lines
+        // may be split across chunks. Returns the number of records passed
+        // to handler.
+        int feed(const char *data, int len, uint64_t now,
+                 ShirtRecordHandler handler, void *context);
+
+        // Decode one line, without its line ending. Returns whether it
+        // completed a record, which is then in *out.
+        bool decodeLine(const char *line, int len, uint64_t now,
+                        ShirtRecord *out);
+
+        // Whatever sweep is in progress, as a record. Returns false if
+        // there is none.
+        bool finish(ShirtRecord *out);
+
+        uint32_t getDevice(void) const { return device; }
+        void setDevice(uint32_t device) { this->device = device; }
+
+        // Statistics
+        unsigned long getLineCount(void) const { return lines; }
+        unsigned long getErrorCount(void) const { return errors; }
+        unsigned long getIgnoredCount(void) const { return ignored; }
+
+        // Parse a decimal with up to decimals fractional digits, scaled by
+        // 10^decimals. Returns false unless all len characters are used.
+        static bool parseFixed(const char *s, int len, int decimals,
+                               long *value);
+
+    private:
+        bool decodeSweep(const char *s, int len, uint64_t now,
+                         ShirtRecord *out);
+        bool takeSweep(ShirtRecord *out);
+
+        uint32_t device;
+
+        // Partial line carried over between chunks
+        char line[SHIRT_LINE_MAX];
+        int lineLength;
+        bool overlong;
+
+        // Sweep being assembled
+        ShirtRecord sweep;
+        bool inSweep;
+
+        unsigned long lines;
+        unsigned long errors;
+        unsigned long ignored;
+};
+
+#endif
@@ -0,0 +1,506 @@
+/**
+ * @file ShirtTrace.cpp
+ * @brief Compact recordings of shirt message streams, and replaying them as
+ * a fleet
+ *
+ * @author Michael Meli
+ */
+
+#include "ShirtTrace.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "Transport.h"
+
+// Most bytes one line takes in a trace: time, tag and three values, or a
+// raw line
+#define TRACE_EVENT_MAX     (2 * 10 + 3 * 10 + TRACE_LINE_MAX)
+
+static uint64_t zigzag(long v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v < 0 ? -1 : 0);
+}
+
+static long unzigzag(uint64_t v) {
+    return (long)(v >> 1) ^ -(long)(v & 1);
+}
+
+static uint8_t *putVarint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/**
+ * Write a line the way the sketch does.
+ *
+ * @param tag What it is
+ * @param v Its values
+ * @param out At least TRACE_LINE_MAX + 1 bytes
+ * @return Its length
+ */
+static int formatLine(int tag, const long *v, char *out) {
+    switch (tag) {
+        case TRACE_START:
+            return snprintf(out, TRACE_LINE_MAX + 1, "I$START$%ld", v[0]);
+        case TRACE_POINT:
+            return snprintf(out, TRACE_LINE_MAX + 1, "I$%ld$%ld$%ld", v[0],
+                            v[1], v[2]);
+        case TRACE_HALT:
+            return snprintf(out, TRACE_LINE_MAX + 1, "I$HALT");
+        case TRACE_TEMPERATURE:
+            return snprintf(out, TRACE_LINE_MAX + 1, "T$%s%ld.%02ld",
+                            v[0] < 0 ? "-" : "", labs(v[0]) / 100,
+                            labs(v[0]) % 100);
+        case TRACE_BATTERY:
+            return snprintf(out, TRACE_LINE_MAX + 1, "B$%ld", v[0]);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Work out which tag a line can be stored as.
+ *
+ * @return The tag, TRACE_RAW if formatting the values would not give the
+ *  line back exactly
+ */
+static int classifyLine(const char *line, int len, long *v) {
+    char text[TRACE_LINE_MAX + 1];
+    memcpy(text, line, len);
+    text[len] = '\0';
+
+    int tag = TRACE_RAW;
+    char *end;
+    if (len < 2 || text[1] != '$')
+        return TRACE_RAW;
+    if (text[0] == 'I') {
+        if (strcmp(text, "I$HALT") == 0) {
+            tag = TRACE_HALT;
+        } else if (strncmp(text, "I$START$", 8) == 0) {
+            v[0] = strtol(text + 8, &end, 10);
+            tag = TRACE_START;
+        } else if (sscanf(text, "I$%ld$%ld$%ld", &v[0], &v[1], &v[2]) == 3) {
+            tag = TRACE_POINT;
+        }
+    } else if (text[0] == 'T') {
+        double t = strtod(text + 2, &end);
+        if (t > -1e9 && t < 1e9) {
+            v[0] = lround(t * 100);
+            tag = TRACE_TEMPERATURE;
+        }
+    } else if (text[0] == 'B') {
+        v[0] = strtol(text + 2, &end, 10);
+        tag = TRACE_BATTERY;
+    }
+
+    char check[TRACE_LINE_MAX + 1];
+    if (tag != TRACE_RAW &&
+        (formatLine(tag, v, check) != len || memcmp(check, line, len) != 0))
+        tag = TRACE_RAW;
+    return tag;
+}
+
+TraceWriter::TraceWriter() : file(NULL), lastTime(0), lines(0), raw(0),
+    bytes(0) {
+    memset(lastPoint, 0, sizeof(lastPoint));
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+/**
+ * Create a trace file and write its header.
+ *
+ * @param path The file, replaced if it exists
+ * @param start Wall clock time the trace starts at, us since the epoch
+ * @return Whether it was created
+ */
+bool TraceWriter::open(const char *path, uint64_t start) {
+    close();
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    uint8_t header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, 8);
+    for (int i = 0; i < 4; i++)
+        header[8 + i] = (uint8_t)(TRACE_VERSION >> (8 * i));
+    for (int i = 0; i < 8; i++)
+        header[12 + i] = (uint8_t)(start >> (8 * i));
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        close();
+        return false;
+    }
+    lastTime = 0;
+    memset(lastPoint, 0, sizeof(lastPoint));
+    lines = raw = 0;
+    bytes = sizeof(header);
+    return true;
+}
+
+/**
+ * Encode a line and add it to the trace.
+ *
+ * @param time When it arrived, us since the start
+ * @param line The line, without its line ending
+ * @param len Its length
+ * @return Whether it was written
+ */
+bool TraceWriter::addLine(uint64_t time, const char *line, int len) {
+    if (!file)
+        return false;
+    if (len > TRACE_LINE_MAX)
+        len = TRACE_LINE_MAX;
+    uint8_t event[TRACE_EVENT_MAX];
+    uint8_t *p = putVarint(event, time > lastTime ? time - lastTime : 0);
+    if (time > lastTime)
+        lastTime = time;
+
+    long v[3];
+    int tag = classifyLine(line, len, v);
+    *p++ = (uint8_t)tag;
+    switch (tag) {
+        case TRACE_START:
+            memset(lastPoint, 0, sizeof(lastPoint));
+            p = putVarint(p, zigzag(v[0]));
+            break;
+        case TRACE_POINT:
+            for (int i = 0; i < 3; i++) {
+                p = putVarint(p, zigzag(v[i] - lastPoint[i]));
+                lastPoint[i] = v[i];
+            }
+            break;
+        case TRACE_TEMPERATURE:
+        case TRACE_BATTERY:
+            p = putVarint(p, zigzag(v[0]));
+            break;
+        case TRACE_RAW:
+            p = putVarint(p, len);
+            memcpy(p, line, len);
+            p += len;
+            raw++;
+            break;
+    }
+    size_t n = p - event;
+    if (fwrite(event, 1, n, file) != n)
+        return false;
+    lines++;
+    bytes += n;
+    return true;
+}
+
+/**
+ * Finish the trace.
+ */
+bool TraceWriter::close(void) {
+    if (!file)
+        return true;
+    bool ok = fclose(file) == 0;
+    file = NULL;
+    return ok;
+}
+
+TraceReader::TraceReader() : pos(0), start(0), time(0), corrupt(false) {
+    memset(lastPoint, 0, sizeof(lastPoint));
+}
+
+/**
+ * Read a trace file.
+ *
+ * @param path The file
+ * @return Whether it is a trace
+ */
+bool TraceReader::open(const char *path) {
+    data.clear();
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    bool ok = !ferror(f);
+    fclose(f);
+
+    uint32_t version = 0;
+    if (ok && data.size() >= TRACE_HEADER_SIZE) {
+        for (int i = 0; i < 4; i++)
+            version |= (uint32_t)data[8 + i] << (8 * i);
+        start = 0;
+        for (int i = 0; i < 8; i++)
+            start |= (uint64_t)data[12 + i] << (8 * i);
+    }
+    if (!ok || data.size() < TRACE_HEADER_SIZE ||
+        memcmp(&data[0], TRACE_MAGIC, 8) != 0 || version != TRACE_VERSION) {
+        data.clear();
+        errno = EINVAL;
+        return false;
+    }
+    rewind();
+    return true;
+}
+
+void TraceReader::rewind(void) {
+    pos = TRACE_HEADER_SIZE;
+    time = 0;
+    memset(lastPoint, 0, sizeof(lastPoint));
+    corrupt = false;
+}
+
+bool TraceReader::readVarint(uint64_t *value) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size())
+            return false;
+        uint8_t b = data[pos++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Decode the next line.
+ *
+ * @param line Filled in
+ * @return Whether there was one
+ */
+bool TraceReader::next(TraceLine *line) {
+    if (pos >= data.size() || corrupt)
+        return false;
+    uint64_t delta, tag, u[3];
+    long v[3];
+    corrupt = true;     // until the whole line has been read
+    if (!readVarint(&delta) || pos >= data.size())
+        return false;
+    tag = data[pos++];
+    switch (tag) {
+        case TRACE_START:
+        case TRACE_TEMPERATURE:
+        case TRACE_BATTERY:
+            if (!readVarint(&u[0]))
+                return false;
+            v[0] = unzigzag(u[0]);
+            if (tag == TRACE_START)
+                memset(lastPoint, 0, sizeof(lastPoint));
+            break;
+        case TRACE_POINT:
+            for (int i = 0; i < 3; i++) {
+                if (!readVarint(&u[i]))
+                    return false;
+                lastPoint[i] += unzigzag(u[i]);
+                v[i] = lastPoint[i];
+            }
+            break;
+        case TRACE_HALT:
+            break;
+        case TRACE_RAW:
+            if (!readVarint(&u[0]) || u[0] > TRACE_LINE_MAX ||
+                u[0] > data.size() - pos)
+                return false;
+            break;
+        default:
+            return false;
+    }
+    corrupt = false;
+
+    time += delta;
+    line->time = time;
+    if (tag == TRACE_RAW) {
+        line->len = u[0];
+        memcpy(line->text, &data[pos], u[0]);
+        line->text[u[0]] = '\0';
+        pos += u[0];
+    } else {
+        line->len = formatLine(tag, v, line->text);
+    }
+    return true;
+}
+
+TraceReplay::TraceReplay() : loops(1) {
+}
+
+/**
+ * Load a trace to replay.
+ *
+ * @param path The file
+ * @return Whether it was read to the end
+ */
+bool TraceReplay::load(const char *path) {
+    TraceReader reader;
+    if (!reader.open(path))
+        return false;
+    TraceLine line;
+    while (reader.next(&line))
+        addLine(line.time, line.text, line.len);
+    return !reader.isCorrupt();
+}
+
+void TraceReplay::addLine(uint64_t time, const char *line, int len) {
+    if (len >= 2 && line[0] == 'D' && line[1] == '$')
+        return;
+    if (!times.empty() && time < times.back())
+        time = times.back();
+    times.push_back(time);
+    offsets.push_back(text.size());
+    text.append(line, len);
+    text.append("\r\n");
+}
+
+/**
+ * Lay out the copies.
+ *
+ * @param count Number of copies
+ * @param jitterMicros Each copy starts up to this much after the first
+ * @param loops Times each copy runs through the trace
+ * @param seed For the offsets
+ */
+void TraceReplay::plan(int count, uint64_t jitterMicros, int loops,
+                       uint32_t seed) {
+    this->loops = loops < 1 ? 1 : loops;
+    copies.resize(count < 0 ? 0 : count);
+    uint64_t state = seed;
+    for (size_t c = 0; c < copies.size(); c++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        copies[c].offset = jitterMicros ? (state >> 16) % jitterMicros : 0;
+        copies[c].loop = 0;
+        copies[c].line = 0;
+    }
+}
+
+uint64_t TraceReplay::nextTime(int copy) const {
+    const Copy &c = copies[copy];
+    if (times.empty() || c.loop >= loops)
+        return UINT64_MAX;
+    return c.offset + (uint64_t)c.loop * getDuration() + times[c.line];
+}
+
+/**
+ * Take the lines a copy has due.
+ *
+ * @param copy Which copy
+ * @param now Trace time, us
+ * @param out Lines appended here
+ * @return Lines taken
+ */
+int TraceReplay::takeDue(int copy, uint64_t now, std::string *out) {
+    int n = 0;
+    Copy &c = copies[copy];
+    while (nextTime(copy) <= now) {
+        size_t end = c.line + 1 < offsets.size() ? offsets[c.line + 1]
+                                                 : text.size();
+        out->append(text, offsets[c.line], end - offsets[c.line]);
+        n++;
+        if (++c.line == times.size()) {
+            c.line = 0;
+            c.loop++;
+        }
+    }
+    return n;
+}
+
+static uint64_t monotonicMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool sendAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t w = send(fd, data, len, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        data += w;
+        len -= w;
+    }
+    return true;
+}
+
+/**
+ * Connect every copy and send the trace on its schedule.
+ *
+ * @param address Gateway address (see Transport.h)
+ * @param speed How many times faster than recorded, or 0 for no waiting
+ * @param firstDevice Device id of the first copy
+ * @param stats Filled in
+ * @return Whether every copy connected
+ */
+bool TraceReplay::run(const char *address, double speed, uint32_t firstDevice,
+                      ReplayStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    std::vector<int> fds(copies.size(), -1);
+    char hello[32];
+    for (size_t c = 0; c < copies.size(); c++) {
+        fds[c] = transportConnect(address);
+        int len = snprintf(hello, sizeof(hello), "D$%" PRIu32 "\r\n",
+                           (uint32_t)(firstDevice + c));
+        if (fds[c] < 0 || !sendAll(fds[c], hello, len)) {
+            for (size_t i = 0; i <= c; i++)
+                if (fds[i] >= 0)
+                    close(fds[i]);
+            return false;
+        }
+        stats->copies++;
+    }
+
+    // Copies by when their next line is due
+    typedef std::pair<uint64_t, int> Due;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due> > queue;
+    for (size_t c = 0; c < copies.size(); c++)
+        if (nextTime(c) != UINT64_MAX)
+            queue.push(Due(nextTime(c), c));
+
+    std::string out;
+    uint64_t start = monotonicMicros();
+    while (!queue.empty()) {
+        Due d = queue.top();
+        queue.pop();
+        uint64_t now = d.first;
+        if (speed > 0) {
+            uint64_t due = start + (uint64_t)(d.first / speed);
+            uint64_t wall = monotonicMicros();
+            if (wall < due) {
+                usleep(due - wall);
+                wall = monotonicMicros();
+            }
+            stats->maxLagMicros = std::max(stats->maxLagMicros, wall - due);
+            // Everything else this copy has due by now goes too
+            now = std::max(now, (uint64_t)((wall - start) * speed));
+        }
+
+        out.clear();
+        int lines = takeDue(d.second, now, &out);
+        if (!sendAll(fds[d.second], out.data(), out.size())) {
+            stats->sendErrors++;
+            close(fds[d.second]);
+            fds[d.second] = -1;
+            continue;
+        }
+        stats->lines += lines;
+        stats->bytes += out.size();
+        if (nextTime(d.second) != UINT64_MAX)
+            queue.push(Due(nextTime(d.second), d.second));
+    }
+    stats->seconds = (monotonicMicros() - start) / 1e6;
+
+    for (size_t c = 0; c < fds.size(); c++)
+        if (fds[c] >= 0)
+            close(fds[c]);
+    return true;
+}
@@ -0,0 +1,184 @@
+#ifndef ShirtTrace_h
+#define ShirtTrace_h
+
+/**
+ * Includes
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+ * Constants
+ *  A trace is a recording of the lines a shirt sent and when. After a
+ *  header of
+ *
+ *  magic[8] "SHIRTTRC", version (uint32), start (uint64, us since epoch)
+ *
+ *  each line is stored as the time since the one before it, in us, then a
+ *  tag and its values, all as LEB128 varints (signed values zigzagged):
+ *
+ *  START n         I$START$n
+ *  POINT f r i     I$f$r$i, each as the change from the sweep's last point
+ *  HALT            I$HALT
+ *  TEMPERATURE t   T$t, t in hundredths
+ *  BATTERY b       B$b
+ *  RAW len bytes   anything else, or any of the above not written the way
+ *                  the sketch writes it
+ *
+ *  so a trace reproduces the stream exactly, less line endings, in about a
+ *  third of the space of the text.
+ */
+#define TRACE_MAGIC         "SHIRTTRC"
+#define TRACE_VERSION       (1)
+#define TRACE_HEADER_SIZE   (20)
+// Longest line kept; longer ones are cut
+#define TRACE_LINE_MAX      (255)
+// Tags
+#define TRACE_RAW           (0)
+#define TRACE_START         (1)
+#define TRACE_POINT         (2)
+#define TRACE_HALT          (3)
+#define TRACE_TEMPERATURE   (4)
+#define TRACE_BATTERY       (5)
+
+/**
+ * One recorded line, without its line ending
+ */
+struct TraceLine {
+    uint64_t time;          // us since the trace started
+    int len;
+    char text[TRACE_LINE_MAX + 1];
+};
+
+/**
+ * Writes a trace
+ */
+class TraceWriter {
+    public:
+        TraceWriter();
+        ~TraceWriter();
+
+        // Start a trace in a new file. start is the wall clock time, in us,
+        // that line times are counted from.
+        bool open(const char *path, uint64_t start);
+
+        // Record a line, without its line ending, at time us since the
+        // start. Times going backwards are recorded as no time passing.
+        bool addLine(uint64_t time, const char *line, int len);
+
+        bool close(void);
+
+        unsigned long getLineCount(void) const { return lines; }
+        unsigned long getRawCount(void) const { return raw; }
+        unsigned long long getBytesWritten(void) const { return bytes; }
+
+    private:
+        TraceWriter(const TraceWriter &);
+        TraceWriter &operator=(const TraceWriter &);
+
+        FILE *file;
+        uint64_t lastTime;
+        long lastPoint[3];
+        unsigned long lines;
+        unsigned long raw;
+        unsigned long long bytes;
+};
+
+/**
+ * Reads a trace back a line at a time
+ *  The whole file is read on open.
+ */
+class TraceReader {
+    public:
+        TraceReader();
+
+        bool open(const char *path);
+
+        // The next line. False at the end, or if the rest is corrupt.
+        bool next(TraceLine *line);
+
+        // Back to the first line
+        void rewind(void);
+
+        uint64_t getStartTime(void) const { return start; }
+        // Whether reading stopped at a corrupt or cut-off line
+        bool isCorrupt(void) const { return corrupt; }
+
+    private:
+        bool readVarint(uint64_t *value);
+
+        std::vector<uint8_t> data;
+        size_t pos;
+        uint64_t start;
+        uint64_t time;
+        long lastPoint[3];
+        bool corrupt;
+};
+
+/**
+ * How a replay went
+ */
+struct ReplayStats {
+    unsigned long copies;           // connected
+    unsigned long long lines;       // sent, over all copies
+    unsigned long long bytes;
+    unsigned long long sendErrors;  // copies dropped because a send failed
+    uint64_t maxLagMicros;          // furthest behind schedule
+    double seconds;
+};
+
+/**
+ * Replays a trace as a fleet
+ *  Every copy is the trace again on its own connection, starting after a
+ *  random offset within the jitter and sending as its own shirt (D$ id).
+ *  Time runs speed times faster than it did when recording; a speed of 0
+ *  sends everything as fast as the gateway takes it. One thread sends for
+ *  every copy, each line when it is due.
+ */
+class TraceReplay {
+    public:
+        TraceReplay();
+
+        // Load the lines to replay. D$ lines are left out, as each copy
+        // names itself.
+        bool load(const char *path);
+        void addLine(uint64_t time, const char *line, int len);
+
+        size_t getLineCount(void) const { return times.size(); }
+        uint64_t getDuration(void) const { return times.empty() ? 0 : times.back(); }
+
+        // Plan copies: each starts at a random offset in [0, jitter) us and
+        // runs through the trace loops times
+        void plan(int copies, uint64_t jitterMicros, int loops, uint32_t seed);
+
+        // When a copy's next line is due, in trace time, or UINT64_MAX
+        // once it is done
+        uint64_t nextTime(int copy) const;
+
+        // Append everything copy has due by trace time now to out, with
+        // line endings, and move it on. Returns the number of lines.
+        int takeDue(int copy, uint64_t now, std::string *out);
+
+        // Run the plan against a gateway at address, naming the copies
+        // firstDevice, firstDevice + 1, ...
+        bool run(const char *address, double speed, uint32_t firstDevice,
+                 ReplayStats *stats);
+
+    private:
+        struct Copy {
+            uint64_t offset;
+            int loop;
+            size_t line;
+        };
+
+        std::vector<uint64_t> times;
+        std::vector<uint32_t> offsets;  // of each line in text
+        std::string text;
+        std::vector<Copy> copies;
+        int loops;
+};
+
+#endif
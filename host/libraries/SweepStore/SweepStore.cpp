@@ -0,0 +1,496 @@
+/**
+ * @file SweepStore.cpp
+ * @brief Columnar, memory-mapped file of impedance sweeps
+ *
+ * @author Michael Meli
+ */
+
+#include "SweepStore.h"
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Sweeps copied out at a time when only part of a block is in range
+#define SWEEP_STORE_SCAN_CHUNK  (256)
+
+static_assert(sizeof(SweepStoreHeader) <= SWEEP_STORE_PAGE,
+              "file header must fit its page");
+static_assert(sizeof(SweepBlockInfo) <= SWEEP_STORE_PAGE,
+              "block header must fit its page");
+
+/**
+ * Bytes of one column: a value per sweep, padded to whole pages.
+ *
+ * @param blockSweeps Sweeps per block
+ * @param valueBytes Size of a value
+ * @return Bytes
+ */
+size_t sweepStoreColumnBytes(uint32_t blockSweeps, size_t valueBytes) {
+    size_t bytes = (size_t)blockSweeps * valueBytes;
+    return (bytes + SWEEP_STORE_PAGE - 1) & ~(size_t)(SWEEP_STORE_PAGE - 1);
+}
+
+/**
+ * Bytes of a block: its header page, the metadata and two planes per point.
+ *
+ * @param blockSweeps Sweeps per block
+ * @param points Points per sweep
+ * @return Bytes
+ */
+size_t sweepStoreBlockBytes(uint32_t blockSweeps, int points) {
+    return SWEEP_STORE_PAGE + sweepStoreColumnBytes(blockSweeps, 8) +
+           sweepStoreColumnBytes(blockSweeps, 4) +
+           3 * sweepStoreColumnBytes(blockSweeps, 2) +
+           2 * points * sweepStoreColumnBytes(blockSweeps, 2);
+}
+
+/**
+ * Offsets of the columns within a block
+ */
+static size_t timeOffset(uint32_t bs) {
+    return SWEEP_STORE_PAGE;
+}
+
+static size_t deviceOffset(uint32_t bs) {
+    return timeOffset(bs) + sweepStoreColumnBytes(bs, 8);
+}
+
+static size_t temperatureOffset(uint32_t bs) {
+    return deviceOffset(bs) + sweepStoreColumnBytes(bs, 4);
+}
+
+static size_t batteryOffset(uint32_t bs) {
+    return temperatureOffset(bs) + sweepStoreColumnBytes(bs, 2);
+}
+
+static size_t calibrationOffset(uint32_t bs) {
+    return batteryOffset(bs) + sweepStoreColumnBytes(bs, 2);
+}
+
+static size_t realOffset(uint32_t bs, int point) {
+    return calibrationOffset(bs) + (2 * point + 1) * sweepStoreColumnBytes(bs, 2);
+}
+
+static size_t imagOffset(uint32_t bs, int point) {
+    return realOffset(bs, point) + sweepStoreColumnBytes(bs, 2);
+}
+
+/**
+ * Check a header read from a file.
+ */
+static bool validHeader(const SweepStoreHeader *h) {
+    return memcmp(h->magic, SWEEP_STORE_MAGIC, sizeof(h->magic)) == 0 &&
+           h->version == SWEEP_STORE_VERSION &&
+           h->points >= 1 && h->points <= SWEEP_STORE_MAX_POINTS &&
+           h->blockSweeps >= 1 &&
+           h->blockBytes == sweepStoreBlockBytes(h->blockSweeps, h->points);
+}
+
+/**
+ * Empty the ranges in a block header.
+ */
+static void resetBlockInfo(SweepBlockInfo *info, int points) {
+    memset(info, 0, sizeof(*info));
+    info->timeMin = UINT64_MAX;
+    info->deviceMin = UINT32_MAX;
+    info->temperatureMin = info->batteryMin = INT16_MAX;
+    info->temperatureMax = info->batteryMax = INT16_MIN;
+    info->calibrationMin = UINT16_MAX;
+    for (int p = 0; p < points; p++) {
+        info->realMin[p] = info->imagMin[p] = INT16_MAX;
+        info->realMax[p] = info->imagMax[p] = INT16_MIN;
+    }
+}
+
+SweepStoreWriter::SweepStoreWriter() : fd(-1), header(NULL), block(NULL),
+    blockIndex(0) {
+}
+
+SweepStoreWriter::~SweepStoreWriter() {
+    close();
+}
+
+/**
+ * Open or create a store for appending.
+ *
+ * @param path The file
+ * @param points Points per sweep, for a new store
+ * @param freqKHz Frequency of each point, for a new store
+ * @param blockSweeps Sweeps per block, for a new store
+ * @return Whether it is open. An existing store must have the same points
+ *  and frequencies.
+ */
+bool SweepStoreWriter::open(const char *path, int points,
+                            const uint32_t *freqKHz, uint32_t blockSweeps) {
+    close();
+    if (points < 1 || points > SWEEP_STORE_MAX_POINTS || blockSweeps < 1)
+        return false;
+
+    fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        close();
+        return false;
+    }
+    bool created = st.st_size == 0;
+    if ((created && ftruncate(fd, SWEEP_STORE_PAGE) < 0) ||
+        (!created && st.st_size < SWEEP_STORE_PAGE)) {
+        close();
+        return false;
+    }
+    void *m = mmap(NULL, SWEEP_STORE_PAGE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (m == MAP_FAILED) {
+        close();
+        return false;
+    }
+    header = (SweepStoreHeader*)m;
+
+    if (created) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        memcpy(header->magic, SWEEP_STORE_MAGIC, sizeof(header->magic));
+        header->version = SWEEP_STORE_VERSION;
+        header->points = points;
+        header->blockSweeps = blockSweeps;
+        header->blockBytes = sweepStoreBlockBytes(blockSweeps, points);
+        header->sweeps = 0;
+        header->created = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        memcpy(header->freqKHz, freqKHz, points * sizeof(uint32_t));
+    } else if (!validHeader(header) || (int)header->points != points ||
+               memcmp(header->freqKHz, freqKHz, points * sizeof(uint32_t)) ||
+               st.st_size < (off_t)(SWEEP_STORE_PAGE + header->blockBytes *
+                   ((header->sweeps + header->blockSweeps - 1) /
+                    header->blockSweeps))) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Map a block, growing the file to hold it if needed.
+ */
+bool SweepStoreWriter::mapBlock(uint64_t index) {
+    if (block) {
+        munmap(block, header->blockBytes);
+        block = NULL;
+    }
+    off_t offset = SWEEP_STORE_PAGE + (off_t)index * header->blockBytes;
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        (st.st_size < offset + (off_t)header->blockBytes &&
+         ftruncate(fd, offset + header->blockBytes) < 0))
+        return false;
+    void *m = mmap(NULL, header->blockBytes, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, offset);
+    if (m == MAP_FAILED)
+        return false;
+    block = (char*)m;
+    blockIndex = index;
+
+    // Anything past the committed sweeps was left by a writer that stopped
+    // partway; a new block starts empty
+    SweepBlockInfo *info = (SweepBlockInfo*)block;
+    uint32_t have = header->sweeps - index * header->blockSweeps;
+    if (have == 0)
+        resetBlockInfo(info, header->points);
+    else
+        info->sweeps = have;
+    return true;
+}
+
+/**
+ * Append a sweep and commit it.
+ *
+ * @param meta Its time, device and conditions
+ * @param real Real part of each point
+ * @param imag Imaginary part of each point
+ * @return Whether it was stored
+ */
+bool SweepStoreWriter::append(const SweepMeta &meta, const int16_t *real,
+                              const int16_t *imag) {
+    if (!header)
+        return false;
+    uint32_t bs = header->blockSweeps;
+    uint64_t n = header->sweeps;
+    uint64_t index = n / bs;
+    uint32_t i = n % bs;
+    if ((!block || blockIndex != index) && !mapBlock(index))
+        return false;
+
+    SweepBlockInfo *info = (SweepBlockInfo*)block;
+    ((uint64_t*)(block + timeOffset(bs)))[i] = meta.time;
+    ((uint32_t*)(block + deviceOffset(bs)))[i] = meta.device;
+    ((int16_t*)(block + temperatureOffset(bs)))[i] = meta.temperature;
+    ((int16_t*)(block + batteryOffset(bs)))[i] = meta.battery;
+    ((uint16_t*)(block + calibrationOffset(bs)))[i] = meta.calibration;
+    info->timeMin = std::min(info->timeMin, meta.time);
+    info->timeMax = std::max(info->timeMax, meta.time);
+    info->deviceMin = std::min(info->deviceMin, meta.device);
+    info->deviceMax = std::max(info->deviceMax, meta.device);
+    if (meta.temperature != SWEEP_STORE_UNKNOWN) {
+        info->temperatureMin = std::min(info->temperatureMin, meta.temperature);
+        info->temperatureMax = std::max(info->temperatureMax, meta.temperature);
+    }
+    if (meta.battery != SWEEP_STORE_UNKNOWN) {
+        info->batteryMin = std::min(info->batteryMin, meta.battery);
+        info->batteryMax = std::max(info->batteryMax, meta.battery);
+    }
+    info->calibrationMin = std::min(info->calibrationMin, meta.calibration);
+    info->calibrationMax = std::max(info->calibrationMax, meta.calibration);
+
+    for (uint32_t p = 0; p < header->points; p++) {
+        ((int16_t*)(block + realOffset(bs, p)))[i] = real[p];
+        ((int16_t*)(block + imagOffset(bs, p)))[i] = imag[p];
+        info->realMin[p] = std::min(info->realMin[p], real[p]);
+        info->realMax[p] = std::max(info->realMax[p], real[p]);
+        info->imagMin[p] = std::min(info->imagMin[p], imag[p]);
+        info->imagMax[p] = std::max(info->imagMax[p], imag[p]);
+    }
+    info->sweeps = i + 1;
+
+    // Readers in other processes see the same pages; the count goes last
+    std::atomic_thread_fence(std::memory_order_release);
+    header->sweeps = n + 1;
+    return true;
+}
+
+/**
+ * Write the mapped pages back to the file.
+ */
+bool SweepStoreWriter::flush(void) {
+    if (!header)
+        return false;
+    if (block && msync(block, header->blockBytes, MS_SYNC) < 0)
+        return false;
+    return msync(header, SWEEP_STORE_PAGE, MS_SYNC) == 0;
+}
+
+void SweepStoreWriter::close(void) {
+    if (block)
+        munmap(block, header->blockBytes);
+    if (header)
+        munmap(header, SWEEP_STORE_PAGE);
+    if (fd >= 0)
+        ::close(fd);
+    block = NULL;
+    header = NULL;
+    fd = -1;
+}
+
+SweepStoreReader::SweepStoreReader() : fd(-1), map(NULL), mapBytes(0),
+    header(NULL), sweeps(0), blocks(0) {
+}
+
+SweepStoreReader::~SweepStoreReader() {
+    close();
+}
+
+/**
+ * Map a store and build the time index from its block headers.
+ *
+ * @param path The file
+ * @return Whether it is a valid store
+ */
+bool SweepStoreReader::open(const char *path) {
+    close();
+    fd = ::open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < SWEEP_STORE_PAGE) {
+        close();
+        return false;
+    }
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        close();
+        return false;
+    }
+    map = (const char*)m;
+    mapBytes = st.st_size;
+    madvise(m, mapBytes, MADV_RANDOM);
+
+    header = (const SweepStoreHeader*)map;
+    sweeps = header->sweeps;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!validHeader(header)) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+    blocks = (sweeps + header->blockSweeps - 1) / header->blockSweeps;
+    if (mapBytes < SWEEP_STORE_PAGE + (size_t)blocks * header->blockBytes) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+
+    timeMaxBefore.resize(blocks);
+    timeMinAfter.resize(blocks);
+    uint64_t latest = 0;
+    for (uint32_t b = 0; b < blocks; b++) {
+        latest = std::max(latest, getBlockInfo(b)->timeMax);
+        timeMaxBefore[b] = latest;
+    }
+    uint64_t earliest = UINT64_MAX;
+    for (uint32_t b = blocks; b-- > 0;) {
+        earliest = std::min(earliest, getBlockInfo(b)->timeMin);
+        timeMinAfter[b] = earliest;
+    }
+    return true;
+}
+
+void SweepStoreReader::close(void) {
+    if (map)
+        munmap((void*)map, mapBytes);
+    if (fd >= 0)
+        ::close(fd);
+    map = NULL;
+    header = NULL;
+    fd = -1;
+    sweeps = 0;
+    blocks = 0;
+    timeMaxBefore.clear();
+    timeMinAfter.clear();
+}
+
+const char *SweepStoreReader::blockAt(uint32_t block) const {
+    return map + SWEEP_STORE_PAGE + (size_t)block * header->blockBytes;
+}
+
+const SweepBlockInfo *SweepStoreReader::getBlockInfo(uint32_t block) const {
+    return (const SweepBlockInfo*)blockAt(block);
+}
+
+uint32_t SweepStoreReader::getBlockSweepCount(uint32_t block) const {
+    uint64_t first = (uint64_t)block * header->blockSweeps;
+    uint64_t left = sweeps - first;
+    return left < header->blockSweeps ? left : header->blockSweeps;
+}
+
+const uint64_t *SweepStoreReader::getTimes(uint32_t block) const {
+    return (const uint64_t*)(blockAt(block) + timeOffset(header->blockSweeps));
+}
+
+const uint32_t *SweepStoreReader::getDevices(uint32_t block) const {
+    return (const uint32_t*)(blockAt(block) + deviceOffset(header->blockSweeps));
+}
+
+const int16_t *SweepStoreReader::getTemperatures(uint32_t block) const {
+    return (const int16_t*)(blockAt(block) +
+                            temperatureOffset(header->blockSweeps));
+}
+
+const int16_t *SweepStoreReader::getBatteries(uint32_t block) const {
+    return (const int16_t*)(blockAt(block) + batteryOffset(header->blockSweeps));
+}
+
+const uint16_t *SweepStoreReader::getCalibrations(uint32_t block) const {
+    return (const uint16_t*)(blockAt(block) +
+                             calibrationOffset(header->blockSweeps));
+}
+
+const int16_t *SweepStoreReader::getReal(uint32_t block, int point) const {
+    return (const int16_t*)(blockAt(block) +
+                            realOffset(header->blockSweeps, point));
+}
+
+const int16_t *SweepStoreReader::getImag(uint32_t block, int point) const {
+    return (const int16_t*)(blockAt(block) +
+                            imagOffset(header->blockSweeps, point));
+}
+
+/**
+ * The first block that can hold a sweep at or after a time.
+ */
+uint32_t SweepStoreReader::firstBlock(uint64_t from) const {
+    return std::lower_bound(timeMaxBefore.begin(), timeMaxBefore.end(), from) -
+           timeMaxBefore.begin();
+}
+
+/**
+ * Scan one point of every sweep in a time range.
+ *
+ * @param point Which frequency
+ * @param from Earliest time, us
+ * @param to Time after the latest, us
+ * @param handler Called with runs of sweeps, in file order
+ * @param context Passed to handler
+ * @return Sweeps passed to handler
+ */
+uint64_t SweepStoreReader::scanFrequency(int point, uint64_t from, uint64_t to,
+                                         SweepScanHandler handler,
+                                         void *context) const {
+    if (!header || point < 0 || point >= (int)header->points)
+        return 0;
+    uint64_t count = 0;
+    for (uint32_t b = firstBlock(from); b < blocks && timeMinAfter[b] < to; b++) {
+        const SweepBlockInfo *info = getBlockInfo(b);
+        if (info->timeMax < from || info->timeMin >= to)
+            continue;
+        uint32_t n = getBlockSweepCount(b);
+        const uint64_t *time = getTimes(b);
+        const int16_t *real = getReal(b, point);
+        const int16_t *imag = getImag(b, point);
+
+        // All of the block is in range: pass the columns as they are
+        if (info->timeMin >= from && info->timeMax < to) {
+            handler(time, real, imag, n, context);
+            count += n;
+            continue;
+        }
+
+        uint64_t t[SWEEP_STORE_SCAN_CHUNK];
+        int16_t r[SWEEP_STORE_SCAN_CHUNK], i[SWEEP_STORE_SCAN_CHUNK];
+        uint32_t have = 0;
+        for (uint32_t s = 0; s < n; s++) {
+            if (time[s] < from || time[s] >= to)
+                continue;
+            t[have] = time[s];
+            r[have] = real[s];
+            i[have] = imag[s];
+            if (++have == SWEEP_STORE_SCAN_CHUNK) {
+                handler(t, r, i, have, context);
+                count += have;
+                have = 0;
+            }
+        }
+        if (have) {
+            handler(t, r, i, have, context);
+            count += have;
+        }
+    }
+    return count;
+}
+
+/**
+ * What scanFrequency reads for a range: the header page, time column and
+ * the point's two planes of each block it looks at.
+ *
+ * @param from Earliest time, us
+ * @param to Time after the latest, us
+ * @return Bytes
+ */
+uint64_t SweepStoreReader::scanBytes(uint64_t from, uint64_t to) const {
+    if (!header)
+        return 0;
+    uint32_t bs = header->blockSweeps;
+    uint64_t perBlock = SWEEP_STORE_PAGE + sweepStoreColumnBytes(bs, 8) +
+                        2 * sweepStoreColumnBytes(bs, 2);
+    uint64_t bytes = 0;
+    for (uint32_t b = firstBlock(from); b < blocks && timeMinAfter[b] < to; b++) {
+        const SweepBlockInfo *info = getBlockInfo(b);
+        if (info->timeMax < from || info->timeMin >= to)
+            bytes += SWEEP_STORE_PAGE;
+        else
+            bytes += perBlock;
+    }
+    return bytes;
+}
@@ -0,0 +1,208 @@
+#ifndef SweepStore_h
+#define SweepStore_h
+
+/**
+ * Includes
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Constants
+ *  A sweep store is one file holding sweeps that share a frequency plan, as
+ *  a (sweep x frequency) matrix of int16 real and imaginary parts plus a few
+ *  columns of per-sweep metadata. It is little-endian and laid out in pages:
+ *
+ *  page 0          file header (SweepStoreHeader)
+ *  block 0         block header page (SweepBlockInfo), then the columns
+ *  block 1         ...
+ *
+ *  A block holds blockSweeps sweeps column by column, each column padded to
+ *  a whole page:
+ *
+ *  time[blockSweeps]           uint64, us since the Unix epoch
+ *  device[blockSweeps]         uint32
+ *  temperature[blockSweeps]    int16, hundredths of a degree F
+ *  battery[blockSweeps]        int16, percent
+ *  calibration[blockSweeps]    uint16, calibration the sweep was taken under
+ *  real[blockSweeps], imag[blockSweeps]   for point 0
+ *  real[blockSweeps], imag[blockSweeps]   for point 1, and so on
+ *
+ *  So scanning one frequency reads two runs of pages per block and nothing
+ *  else. The block headers are the sparse index: each has the block's time
+ *  range and the range of every column, so whole blocks can be skipped.
+ *
+ *  Sweeps are only ever appended. The header's sweep count is updated after
+ *  a sweep's columns are written, and is what readers go by, so a reader
+ *  never sees a half-written sweep.
+ */
+#define SWEEP_STORE_MAGIC           "SHIRTSWP"
+#define SWEEP_STORE_VERSION         (1)
+#define SWEEP_STORE_PAGE            (4096)
+#define SWEEP_STORE_MAX_POINTS      (64)
+// Sweeps per block: 2048 makes each int16 column exactly a page
+#define SWEEP_STORE_BLOCK_SWEEPS    (2048)
+// Metadata that has not been received yet
+#define SWEEP_STORE_UNKNOWN         (-32768)
+
+/**
+ * File header, at the start of page 0
+ */
+struct SweepStoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t points;            // frequencies per sweep
+    uint32_t blockSweeps;
+    uint32_t blockBytes;        // including the block header page
+    uint64_t sweeps;            // sweeps committed
+    uint64_t created;           // us since the Unix epoch
+    uint32_t freqKHz[SWEEP_STORE_MAX_POINTS];
+};
+
+/**
+ * Block header, at the start of each block: the ranges of everything in it
+ */
+struct SweepBlockInfo {
+    uint64_t timeMin;
+    uint64_t timeMax;
+    uint32_t sweeps;            // written, possibly not all committed yet
+    uint32_t deviceMin;
+    uint32_t deviceMax;
+    int16_t temperatureMin;     // SWEEP_STORE_UNKNOWN values are left out
+    int16_t temperatureMax;
+    int16_t batteryMin;
+    int16_t batteryMax;
+    uint16_t calibrationMin;
+    uint16_t calibrationMax;
+    int16_t realMin[SWEEP_STORE_MAX_POINTS];
+    int16_t realMax[SWEEP_STORE_MAX_POINTS];
+    int16_t imagMin[SWEEP_STORE_MAX_POINTS];
+    int16_t imagMax[SWEEP_STORE_MAX_POINTS];
+};
+
+/**
+ * What is stored with each sweep besides its points
+ */
+struct SweepMeta {
+    uint64_t time;
+    uint32_t device;
+    int16_t temperature;
+    int16_t battery;
+    uint16_t calibration;
+};
+
+/**
+ * Appends sweeps to a store
+ *  The block being filled is mapped into memory, so appending a sweep is a
+ *  few stores per point. Not thread safe, and only one writer may have a
+ *  file open.
+ */
+class SweepStoreWriter {
+    public:
+        SweepStoreWriter();
+        ~SweepStoreWriter();
+
+        // Open a store for appending, creating it with this frequency plan
+        // if it does not exist. Fails if it exists with a different plan.
+        bool open(const char *path, int points, const uint32_t *freqKHz,
+                  uint32_t blockSweeps = SWEEP_STORE_BLOCK_SWEEPS);
+
+        // Append a sweep of getPoints() points
+        bool append(const SweepMeta &meta, const int16_t *real,
+                    const int16_t *imag);
+
+        // Make everything appended durable
+        bool flush(void);
+
+        void close(void);
+
+        int getPoints(void) const { return header ? header->points : 0; }
+        uint32_t getFrequency(int point) const { return header->freqKHz[point]; }
+        uint64_t getSweepCount(void) const { return header ? header->sweeps : 0; }
+
+    private:
+        SweepStoreWriter(const SweepStoreWriter &);
+        SweepStoreWriter &operator=(const SweepStoreWriter &);
+
+        bool mapBlock(uint64_t block);
+
+        int fd;
+        SweepStoreHeader *header;   // page 0, mapped
+        char *block;                // the block being filled, mapped
+        uint64_t blockIndex;
+};
+
+// Called by SweepStoreReader::scanFrequency with sweeps in file order
+typedef void (*SweepScanHandler)(const uint64_t *time, const int16_t *real,
+                                 const int16_t *imag, uint32_t n,
+                                 void *context);
+
+/**
+ * Reads a store through a read-only mapping
+ *  Sees the sweeps committed when it was opened. Pages are only read when
+ *  touched, and read-ahead is turned off so touching one column does not
+ *  pull in its neighbours.
+ */
+class SweepStoreReader {
+    public:
+        SweepStoreReader();
+        ~SweepStoreReader();
+
+        bool open(const char *path);
+        void close(void);
+
+        int getPoints(void) const { return header->points; }
+        uint32_t getFrequency(int point) const { return header->freqKHz[point]; }
+        uint64_t getSweepCount(void) const { return sweeps; }
+        uint32_t getBlockCount(void) const { return blocks; }
+        uint32_t getBlockSweeps(void) const { return header->blockSweeps; }
+
+        // A block's header and committed sweep count
+        const SweepBlockInfo *getBlockInfo(uint32_t block) const;
+        uint32_t getBlockSweepCount(uint32_t block) const;
+
+        // A block's columns
+        const uint64_t *getTimes(uint32_t block) const;
+        const uint32_t *getDevices(uint32_t block) const;
+        const int16_t *getTemperatures(uint32_t block) const;
+        const int16_t *getBatteries(uint32_t block) const;
+        const uint16_t *getCalibrations(uint32_t block) const;
+        const int16_t *getReal(uint32_t block, int point) const;
+        const int16_t *getImag(uint32_t block, int point) const;
+
+        // Pass handler every sweep taken in [from, to) at one point. Only
+        // the blocks that can hold such sweeps are touched, and in them
+        // only the time column and the point's columns. Returns the number
+        // of sweeps passed.
+        uint64_t scanFrequency(int point, uint64_t from, uint64_t to,
+                               SweepScanHandler handler, void *context) const;
+
+        // Bytes of the file scanFrequency touches for a range
+        uint64_t scanBytes(uint64_t from, uint64_t to) const;
+
+    private:
+        SweepStoreReader(const SweepStoreReader &);
+        SweepStoreReader &operator=(const SweepStoreReader &);
+
+        const char *blockAt(uint32_t block) const;
+        uint32_t firstBlock(uint64_t from) const;
+
+        int fd;
+        const char *map;
+        size_t mapBytes;
+        const SweepStoreHeader *header;
+        uint64_t sweeps;
+        uint32_t blocks;
+        // Index built on open: the latest time in any block up to each
+        // block, and the earliest in any block from it on. Times are
+        // mostly increasing, so these let a range be found by bisection.
+        std::vector<uint64_t> timeMaxBefore;
+        std::vector<uint64_t> timeMinAfter;
+};
+
+// Size of one column of a block, and of a whole block, in bytes
+size_t sweepStoreColumnBytes(uint32_t blockSweeps, size_t valueBytes);
+size_t sweepStoreBlockBytes(uint32_t blockSweeps, int points);
+
+#endif
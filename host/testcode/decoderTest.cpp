@@ -0,0 +1,131 @@
+/**
+ * Tests the shirt protocol decoder: each message type, sweeps split across
+ * reads, cut short and malformed, and lines too long to keep. Exits
+ * non-zero if any check fails.
+ *
+ * Usage:
+ *  ./decoderTest
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ShirtDecoder.h"
+#include "check.h"
+
+#define MAX_RECORDS (16)
+
+static ShirtRecord got[MAX_RECORDS];
+static int numGot;
+
+static void collect(const ShirtRecord *record, void *) {
+    if (numGot < MAX_RECORDS)
+        got[numGot] = *record;
+    numGot++;
+}
+
+// Feed a whole string, one chunk
+static int feed(ShirtDecoder &d, const char *text, uint64_t now = 0) {
+    numGot = 0;
+    return d.feed(text, strlen(text), now, collect, NULL);
+}
+
+int main() {
+    // Fixed point parsing
+    long v;
+    CHECK(ShirtDecoder::parseFixed("98.60", 5, 2, &v) && v == 9860);
+    CHECK(ShirtDecoder::parseFixed("98.6", 4, 2, &v) && v == 9860);
+    CHECK(ShirtDecoder::parseFixed("-3", 2, 2, &v) && v == -300);
+    CHECK(ShirtDecoder::parseFixed("95", 2, 0, &v) && v == 95);
+    CHECK(!ShirtDecoder::parseFixed("98.601", 6, 2, &v));
+    CHECK(!ShirtDecoder::parseFixed("", 0, 0, &v));
+    CHECK(!ShirtDecoder::parseFixed("-", 1, 0, &v));
+    CHECK(!ShirtDecoder::parseFixed("9x", 2, 0, &v));
+    CHECK(!ShirtDecoder::parseFixed("1.2.3", 5, 2, &v));
+
+    // Temperature and battery, with either line ending
+    {
+        ShirtDecoder d(7);
+        CHECK(feed(d, "T$98.60\r\nB$95\n", 1234) == 2);
+        CHECK(got[0].type == SHIRT_RECORD_TEMPERATURE && got[0].value == 9860);
+        CHECK(got[0].device == 7 && got[0].time == 1234);
+        CHECK(got[1].type == SHIRT_RECORD_BATTERY && got[1].value == 95);
+        CHECK(d.getLineCount() == 2 && d.getErrorCount() == 0);
+    }
+
+    // A sweep, with the stream naming the shirt first
+    {
+        ShirtDecoder d(1);
+        CHECK(feed(d, "D$42\nI$START$3\nI$80$1200$-30\nI$81$1190$-31\n"
+                      "I$82$1180$-32\n", 10) == 0);
+        CHECK(d.getDevice() == 42);
+        CHECK(feed(d, "I$HALT\n", 20) == 1);
+        CHECK(got[0].type == SHIRT_RECORD_SWEEP && got[0].device == 42);
+        CHECK(got[0].points == 3 && got[0].expected == 3);
+        CHECK(got[0].time == 10);   // when the sweep started
+        CHECK(got[0].freqKHz[0] == 80 && got[0].real[0] == 1200 &&
+              got[0].imag[0] == -30);
+        CHECK(got[0].freqKHz[2] == 82 && got[0].real[2] == 1180 &&
+              got[0].imag[2] == -32);
+        CHECK(d.getErrorCount() == 0);
+    }
+
+    // Lines split at every byte decode the same
+    {
+        ShirtDecoder d;
+        const char *text = "I$START$2\r\nI$80$5$6\r\nI$81$7$8\r\nI$HALT\r\nT$-1.5\r\n";
+        numGot = 0;
+        for (size_t i = 0; i < strlen(text); i++)
+            d.feed(text + i, 1, 0, collect, NULL);
+        CHECK(numGot == 2);
+        CHECK(got[0].points == 2 && got[0].real[1] == 7 && got[0].imag[1] == 8);
+        CHECK(got[1].type == SHIRT_RECORD_TEMPERATURE && got[1].value == -150);
+    }
+
+    // A new START cuts the sweep short; the partial sweep is kept
+    {
+        ShirtDecoder d;
+        CHECK(feed(d, "I$START$3\nI$80$1$2\nI$START$1\nI$90$3$4\nI$HALT\n") == 2);
+        CHECK(got[0].points == 1 && got[0].expected == 3);
+        CHECK(got[1].points == 1 && got[1].freqKHz[0] == 90);
+        CHECK(d.getErrorCount() == 1);
+    }
+
+    // A stream that ends mid-sweep
+    {
+        ShirtDecoder d;
+        ShirtRecord r;
+        feed(d, "I$START$41\nI$80$1$2\n");
+        CHECK(d.finish(&r) && r.points == 1);
+        CHECK(!d.finish(&r));
+    }
+
+    // Malformed and unknown messages are counted, not recorded
+    {
+        ShirtDecoder d;
+        CHECK(feed(d, "I$80$1$2\n") == 0);              // no START
+        CHECK(feed(d, "I$HALT\n") == 0);                // no START
+        CHECK(feed(d, "I$START$0\nI$START$65\n") == 0); // bad counts
+        CHECK(feed(d, "I$START$1\nI$80$1\n") == 0);     // missing field
+        CHECK(feed(d, "I$80$1$2$3\n") == 0);            // extra field
+        CHECK(feed(d, "I$80$40000$2\n") == 0);          // not int16
+        CHECK(feed(d, "I$80$1$2\nI$81$3$4\n") == 0);    // more than announced
+        CHECK(feed(d, "T$hot\nB$\n") == 0);
+        CHECK(d.getErrorCount() == 10);
+        CHECK(feed(d, "P$1$1$41\nR$100$3\nhello\n\n") == 0);
+        CHECK(d.getIgnoredCount() == 3);
+        CHECK(d.getErrorCount() == 10);
+    }
+
+    // A line too long to keep is dropped whole, and decoding carries on
+    {
+        ShirtDecoder d;
+        char text[SHIRT_LINE_MAX * 2 + 16];
+        memset(text, 'x', SHIRT_LINE_MAX * 2);
+        strcpy(text + SHIRT_LINE_MAX * 2, "\nB$50\n");
+        CHECK(feed(d, text) == 1);
+        CHECK(got[0].value == 50);
+        CHECK(d.getErrorCount() == 1);
+    }
+
+    return checkResult("decoderTest");
+}
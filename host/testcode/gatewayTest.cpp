@@ -0,0 +1,304 @@
+/**
+ * Runs the ingest gateway with thousands of simulated shirts connected over
+ * a Unix socket, and a few over TCP. Every record must arrive decoded,
+ * exactly once and in each shirt's order, within a bounded latency. Exits
+ * non-zero if any check fails.
+ *
+ * Usage:
+ *  ./gatewayTest [shirts]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "IngestGateway.h"
+#include "Transport.h"
+#include "check.h"
+
+#define SHIRTS          (2000)
+#define ROUNDS          (3)
+#define POINTS          (41)
+#define CLIENT_THREADS  (4)
+#define SOCKET_PATH     "/tmp/gatewayTest.sock"
+// Worst latency allowed from a message arriving to its record being written
+#define MAX_P99_MICROS  (250000)
+// Shirts left waiting while the gateway is out of file descriptors
+#define STARVED_SHIRTS  (8)
+// Descriptors kept back from the shirts for the process itself
+#define SPARE_FILES     (64)
+
+/**
+ * Checks every record as it is written. Only the writer thread calls it.
+ */
+class CheckingSink : public RecordSink {
+    public:
+        CheckingSink(int shirts) : shirts(shirts), records(0), bad(0),
+            outOfOrder(0) {
+            next.assign((shirts + 1) * 3, 0);
+        }
+
+        bool write(const ShirtRecord *r, int n) {
+            for (int i = 0; i < n; i++)
+                check(&r[i]);
+            return true;
+        }
+
+        void check(const ShirtRecord *r) {
+            records++;
+            if (r->device < 1 || (int)r->device > shirts ||
+                r->type < SHIRT_RECORD_TEMPERATURE ||
+                r->type > SHIRT_RECORD_SWEEP) {
+                bad++;
+                return;
+            }
+            // Each record carries its round in its values
+            int round;
+            if (r->type == SHIRT_RECORD_SWEEP) {
+                round = r->real[0] - 1000;
+                bool ok = r->points == POINTS && r->expected == POINTS;
+                for (int p = 0; ok && p < POINTS; p++)
+                    ok = r->freqKHz[p] == 80 + p &&
+                         r->real[p] == 1000 + round - p &&
+                         r->imag[p] == -(int)r->device % 1000;
+                if (!ok)
+                    bad++;
+            } else if (r->type == SHIRT_RECORD_TEMPERATURE) {
+                round = r->value - 9800;
+            } else {
+                round = 100 - r->value;
+            }
+            int &expect = next[r->device * 3 + r->type - 1];
+            if (round != expect)
+                outOfOrder++;
+            expect = round + 1;
+        }
+
+        int shirts;
+        unsigned long records;
+        unsigned long bad;
+        unsigned long outOfOrder;
+        std::vector<int> next;
+};
+
+// Send everything, as a blocking socket would
+static bool sendAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t w = send(fd, data, len, MSG_NOSIGNAL);
+        if (w <= 0)
+            return false;
+        data += w;
+        len -= w;
+    }
+    return true;
+}
+
+// One round of what a shirt sends, to the letter of pcb-iteration-2
+static size_t shirtRound(char *buf, unsigned int device, int round) {
+    char *p = buf;
+    p += sprintf(p, "I$START$%d\r\n", POINTS);
+    for (int i = 0; i < POINTS; i++)
+        p += sprintf(p, "I$%d$%d$%d\r\n", 80 + i, 1000 + round - i,
+                     -(int)(device % 1000));
+    p += sprintf(p, "I$HALT\r\nT$%d.%02d\r\nB$%d\r\nP$1$1$41\r\n",
+                 98 + round / 100, round % 100, 100 - round);
+    return p - buf;
+}
+
+// Connect shirts [first, last] and send their rounds, a round of every
+// shirt at a time
+static void runShirts(const char *address, unsigned int first,
+                      unsigned int last, bool *ok) {
+    std::vector<int> fds;
+    char buf[4096];
+    *ok = true;
+    for (unsigned int d = first; d <= last; d++) {
+        int fd = transportConnect(address);
+        if (fd < 0) {
+            *ok = false;
+            break;
+        }
+        fds.push_back(fd);
+        int len = sprintf(buf, "D$%u\r\n", d);
+        *ok = *ok && sendAll(fd, buf, len);
+    }
+    for (int round = 0; round < ROUNDS && *ok; round++) {
+        for (size_t i = 0; i < fds.size(); i++) {
+            size_t len = shirtRound(buf, first + i, round);
+            *ok = *ok && sendAll(fds[i], buf, len);
+        }
+    }
+    for (size_t i = 0; i < fds.size(); i++)
+        close(fds[i]);
+}
+
+// Run shirts through a gateway listening on address
+static void runFleet(const char *connectAddress, int listenFd, int shirts,
+                     int threads, size_t queueSize = GATEWAY_QUEUE_SIZE) {
+    CheckingSink sink(shirts);
+    IngestGateway gateway(&sink, 2, queueSize);
+    CHECK(gateway.start(listenFd));
+
+    uint64_t start = IngestGateway::now();
+    std::vector<std::thread> clients;
+    bool ok[CLIENT_THREADS];
+    int per = (shirts + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        unsigned int first = t * per + 1;
+        unsigned int last = (t + 1) * per < shirts ? (t + 1) * per : shirts;
+        clients.push_back(std::thread(runShirts, connectAddress, first, last,
+                                      &ok[t]));
+    }
+    for (int t = 0; t < threads; t++) {
+        clients[t].join();
+        CHECK(ok[t]);
+    }
+
+    // Everything sent is decoded and written once the connections close
+    GatewayStats s;
+    unsigned long long expected = (unsigned long long)shirts * ROUNDS * 3;
+    for (int wait = 0; wait < 1000; wait++) {
+        gateway.getStats(&s);
+        if (s.connections == (unsigned long)shirts && s.active == 0 &&
+            s.records >= expected)
+            break;
+        usleep(10000);
+    }
+    double seconds = (IngestGateway::now() - start) / 1e6;
+    gateway.stop();
+    gateway.getStats(&s);
+
+    printf("%s: %d shirts, %llu lines, %llu records in %llu batches in "
+           "%.2f s (%.0f lines/s), latency mean %llu us, p99 <%llu us, "
+           "max %llu us, %llu queue waits\n", connectAddress, shirts, s.lines,
+           s.records, s.batches, seconds, s.lines / seconds, s.meanLatency,
+           s.p99Latency, s.maxLatency, s.queueFull);
+    CHECK(s.connections == (unsigned long)shirts);
+    CHECK(s.records == expected);
+    CHECK(sink.records == expected);
+    CHECK(sink.bad == 0);
+    CHECK(sink.outOfOrder == 0);
+    CHECK(s.lineErrors == 0);
+    CHECK(s.ignored == (unsigned long long)shirts * ROUNDS);   // P$ lines
+    CHECK(s.sinkErrors == 0);
+    CHECK(s.batches < s.records);
+    CHECK(s.p99Latency <= MAX_P99_MICROS);
+}
+
+// Out of file descriptors, the gateway waits for some to close rather than
+// spinning on the listener, and takes the waiting shirts once it can
+static void runOutOfFiles(void) {
+    int listenFd = transportListen("unix:" SOCKET_PATH);
+    CHECK(listenFd >= 0);
+    if (listenFd < 0)
+        return;
+    CheckingSink sink(STARVED_SHIRTS);
+    IngestGateway gateway(&sink, 2);
+    CHECK(gateway.start(listenFd));
+
+    // Leave room for the shirts' ends of the connections and no more
+    struct rlimit saved, rl;
+    getrlimit(RLIMIT_NOFILE, &saved);
+    int lowest = dup(STDIN_FILENO);
+    close(lowest);
+    rl = saved;
+    rl.rlim_cur = lowest + STARVED_SHIRTS;
+    CHECK(setrlimit(RLIMIT_NOFILE, &rl) == 0);
+
+    int fds[STARVED_SHIRTS];
+    char buf[4096];
+    bool ok = true;
+    for (int i = 0; i < STARVED_SHIRTS; i++) {
+        fds[i] = transportConnect("unix:" SOCKET_PATH);
+        ok = ok && fds[i] >= 0;
+        if (fds[i] < 0)
+            continue;
+        int len = sprintf(buf, "D$%d\r\n", i + 1);
+        ok = ok && sendAll(fds[i], buf, len);
+        for (int round = 0; round < ROUNDS; round++)
+            ok = ok && sendAll(fds[i], buf, shirtRound(buf, i + 1, round));
+    }
+    CHECK(ok);
+
+    // A spinning acceptor would refuse thousands of times meanwhile
+    usleep(200000);
+    GatewayStats s;
+    gateway.getStats(&s);
+    printf("out of files: %llu refusals in 200 ms\n", s.refused);
+    CHECK(s.connections == 0);
+    CHECK(s.refused > 0 && s.refused < 100);
+
+    setrlimit(RLIMIT_NOFILE, &saved);
+    for (int i = 0; i < STARVED_SHIRTS; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    unsigned long long expected = (unsigned long long)STARVED_SHIRTS *
+                                  ROUNDS * 3;
+    for (int wait = 0; wait < 1000; wait++) {
+        gateway.getStats(&s);
+        if (s.active == 0 && s.records >= expected)
+            break;
+        usleep(10000);
+    }
+    gateway.stop();
+    gateway.getStats(&s);
+    CHECK(s.connections == STARVED_SHIRTS);
+    CHECK(s.records == expected);
+    CHECK(sink.bad == 0 && sink.outOfOrder == 0);
+    unlink(SOCKET_PATH);
+}
+
+int main(int argc, char *argv[]) {
+    int shirts = argc > 1 ? atoi(argv[1]) : SHIRTS;
+    signal(SIGPIPE, SIG_IGN);
+
+    // Each shirt takes a descriptor at both ends of its connection
+    unsigned long files = IngestGateway::raiseFileLimit();
+    if (files < 2UL * shirts + SPARE_FILES) {
+        shirts = files > SPARE_FILES ? (files - SPARE_FILES) / 2 : 1;
+        printf("open file limit %lu: running %d shirts\n", files, shirts);
+    }
+
+    // Many shirts over a Unix socket
+    int fd = transportListen("unix:" SOCKET_PATH);
+    CHECK(fd >= 0);
+    if (fd >= 0)
+        runFleet("unix:" SOCKET_PATH, fd, shirts, CLIENT_THREADS);
+    unlink(SOCKET_PATH);
+
+    // A writer that cannot keep up: the workers wait on it, and nothing is
+    // lost or reordered
+    fd = transportListen("unix:" SOCKET_PATH);
+    CHECK(fd >= 0);
+    if (fd >= 0)
+        runFleet("unix:" SOCKET_PATH, fd, shirts / 10, CLIENT_THREADS, 16);
+    unlink(SOCKET_PATH);
+
+    // A few over TCP, on whatever port is free
+    fd = transportListen("tcp:127.0.0.1:0");
+    CHECK(fd >= 0);
+    if (fd >= 0) {
+        struct sockaddr_in sin;
+        socklen_t len = sizeof(sin);
+        getsockname(fd, (struct sockaddr*)&sin, &len);
+        char address[64];
+        snprintf(address, sizeof(address), "tcp:127.0.0.1:%d",
+                 ntohs(sin.sin_port));
+        runFleet(address, fd, 20, 1);
+    }
+
+    runOutOfFiles();
+
+    // Bad addresses
+    CHECK(transportListen("bluetooth:shirt") < 0);
+    CHECK(transportConnect("tcp:nohostport") < 0);
+
+    return checkResult("gatewayTest");
+}
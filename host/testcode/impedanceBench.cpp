@@ -0,0 +1,93 @@
+/**
+ * Measures the impedance kernels in points per second, on raw sweeps of 41
+ * points with per-frequency calibration tables and on sweep store columns
+ * of one frequency, against the double-precision math the sketch uses per
+ * point.
+ *
+ * Usage:
+ *  ./impedanceBench [sweeps]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "ImpedanceKernel.h"
+
+#define POINTS  (41)
+#define SWEEPS  (100000)
+#define REPEATS (5)
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keep the optimizer from discarding a benchmarked result
+static void keep(const void *p) {
+    __asm__ __volatile__("" : : "g"(p) : "memory");
+}
+
+int main(int argc, char *argv[]) {
+    size_t sweeps = argc > 1 ? atol(argv[1]) : SWEEPS;
+    size_t n = sweeps * POINTS;
+    std::vector<int16_t> real(n), imag(n);
+    std::vector<float> z(n), theta(n);
+    float gain[POINTS], phase[POINTS];
+    srand(1);
+    for (size_t i = 0; i < n; i++) {
+        real[i] = rand() % 65536 - 32768;
+        imag[i] = rand() % 65536 - 32768;
+    }
+    for (int p = 0; p < POINTS; p++) {
+        gain[p] = 1e-8f * (1 + p);
+        phase[p] = 0.01f * p;
+    }
+
+    // What measureImpedance does for each point, in double
+    double best = 1e9;
+    for (int r = 0; r < REPEATS; r++) {
+        double start = seconds();
+        for (size_t i = 0; i < n; i++) {
+            int p = i % POINTS;
+            double magnitude = sqrt(pow(real[i], 2) + pow(imag[i], 2));
+            z[i] = 1 / (magnitude * gain[p]);
+            theta[i] = atan2(imag[i], real[i]) - phase[p];
+        }
+        keep(&z[0]);
+        keep(&theta[0]);
+        best = fmin(best, seconds() - start);
+    }
+    printf("%-8s %8.1f M points/s\n", "libm", n / best / 1e6);
+
+    for (int k = 0; k < IMPEDANCE_KERNELS; k++) {
+        if (!impedanceKernelSupported(k))
+            continue;
+        double sweepBest = 1e9, columnBest = 1e9;
+        for (int r = 0; r < REPEATS; r++) {
+            // Sweep by sweep, as they arrive
+            double start = seconds();
+            for (size_t s = 0; s < sweeps; s++)
+                impedanceCompute(&real[s * POINTS], &imag[s * POINTS], gain,
+                                 phase, &z[s * POINTS], &theta[s * POINTS],
+                                 POINTS, k);
+            keep(&z[0]);
+            sweepBest = fmin(sweepBest, seconds() - start);
+
+            // A frequency at a time, as read from a sweep store
+            start = seconds();
+            for (int p = 0; p < POINTS; p++)
+                impedanceComputeColumn(&real[p * sweeps], &imag[p * sweeps],
+                                       gain[p], phase[p], &z[p * sweeps],
+                                       &theta[p * sweeps], sweeps, k);
+            keep(&z[0]);
+            columnBest = fmin(columnBest, seconds() - start);
+        }
+        printf("%-8s %8.1f M points/s by sweep, %8.1f M points/s by column\n",
+               impedanceKernelName(k), n / sweepBest / 1e6,
+               n / columnBest / 1e6);
+    }
+    return 0;
+}
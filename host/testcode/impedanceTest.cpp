@@ -0,0 +1,150 @@
+/**
+ * Tests the impedance kernels: every kernel this CPU runs matches the
+ * scalar reference bit for bit, on random data, on the edges of the int16
+ * range and on every length and alignment the vector loops can leave a
+ * tail for, and the reference agrees with the double-precision math the
+ * sketch uses. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./impedanceTest
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "ImpedanceKernel.h"
+#include "check.h"
+
+#define RANDOM_POINTS   (1000003)
+#define POINTS          (41)
+
+static const int16_t edges[] = { 0, 1, -1, 2, -2, 100, -100, 181, -181,
+                                 32767, -32767, -32768 };
+#define EDGES   (sizeof(edges) / sizeof(edges[0]))
+
+static uint32_t seed = 12345;
+
+static uint32_t nextRandom(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// Same bits, so NaN and -0 compare too
+static bool sameBits(const std::vector<float> &a, const std::vector<float> &b,
+                     size_t n) {
+    return memcmp(&a[0], &b[0], n * sizeof(float)) == 0;
+}
+
+static double wrap(double a) {
+    while (a > M_PI)
+        a -= 2 * M_PI;
+    while (a < -M_PI)
+        a += 2 * M_PI;
+    return a;
+}
+
+int main() {
+    size_t n = RANDOM_POINTS;
+    std::vector<int16_t> real(n + 1), imag(n + 1);
+    std::vector<float> gain(n + 1), phase(n + 1);
+    for (size_t i = 0; i <= n; i++) {
+        real[i] = (int16_t)nextRandom();
+        imag[i] = (int16_t)nextRandom();
+        // Gains as AD5933::calibrate gives them for 100 ohm to 100 kohm
+        gain[i] = 1e-9f * (1 + nextRandom() % 100000);
+        phase[i] = (nextRandom() % 62832) / 10000.0f - 3.1416f;
+    }
+    // The edges of the range, in every combination
+    for (size_t a = 0; a < EDGES; a++) {
+        for (size_t b = 0; b < EDGES; b++) {
+            real[a * EDGES + b] = edges[a];
+            imag[a * EDGES + b] = edges[b];
+        }
+    }
+    phase[7] = 3.14159265f;
+    phase[8] = -3.14159265f;
+
+    std::vector<float> zRef(n + 1), thetaRef(n + 1), z(n + 1), theta(n + 1);
+    impedanceCompute(&real[0], &imag[0], &gain[0], &phase[0], &zRef[0],
+                     &thetaRef[0], n, IMPEDANCE_SCALAR);
+
+    // The reference against double precision
+    double zError = 0, phaseError = 0;
+    bool noSignal = true;
+    for (size_t i = 0; i < n; i++) {
+        if (real[i] == 0 && imag[i] == 0) {
+            noSignal = noSignal && isinf(zRef[i]) && thetaRef[i] == wrap(-phase[i]);
+            continue;
+        }
+        double magnitude = sqrt(pow(real[i], 2) + pow(imag[i], 2));
+        double expected = 1 / (magnitude * gain[i]);
+        zError = fmax(zError, fabs(zRef[i] - expected) / expected);
+        double angle = wrap(atan2(imag[i], real[i]) - phase[i]);
+        phaseError = fmax(phaseError, fabs(wrap(thetaRef[i] - angle)));
+        CHECK(thetaRef[i] >= -3.1416f && thetaRef[i] <= 3.1416f);
+    }
+    printf("scalar reference: |Z| within %.2g relative, phase within %.2g rad\n",
+           zError, phaseError);
+    CHECK(noSignal);
+    CHECK(zError < 1e-6);
+    CHECK(phaseError < IMPEDANCE_PHASE_ERROR);
+
+    // A point measured against the calibration reference reads as it
+    double ref = 200000;
+    int16_t r = 1234, i = -567;
+    float g = (float)((1.0 / ref) / sqrt(pow(r, 2) + pow(i, 2)));
+    float p = (float)atan2(i, r), zz, tt;
+    impedanceCompute(&r, &i, &g, &p, &zz, &tt, 1, IMPEDANCE_SCALAR);
+    CHECK(fabs(zz - ref) / ref < 1e-6 && fabs(tt) < IMPEDANCE_PHASE_ERROR);
+
+    for (int k = 0; k < IMPEDANCE_KERNELS; k++) {
+        if (!impedanceKernelSupported(k)) {
+            printf("%s: not supported here\n", impedanceKernelName(k));
+            continue;
+        }
+
+        // Bit for bit on everything
+        impedanceCompute(&real[0], &imag[0], &gain[0], &phase[0], &z[0],
+                         &theta[0], n, k);
+        CHECK(sameBits(z, zRef, n));
+        CHECK(sameBits(theta, thetaRef, n));
+
+        // Every tail length, from unaligned addresses
+        bool tails = true;
+        for (size_t len = 0; len <= 2 * POINTS; len++) {
+            for (size_t off = 0; off < 2; off++) {
+                std::vector<float> z2(len + 1), theta2(len + 1);
+                std::vector<float> zRef2(len + 1), thetaRef2(len + 1);
+                impedanceCompute(&real[off], &imag[off], &gain[off],
+                                 &phase[off], &z2[0], &theta2[0], len, k);
+                impedanceCompute(&real[off], &imag[off], &gain[off],
+                                 &phase[off], &zRef2[0], &thetaRef2[0], len,
+                                 IMPEDANCE_SCALAR);
+                tails = tails && sameBits(z2, zRef2, len) &&
+                        sameBits(theta2, thetaRef2, len);
+            }
+        }
+        CHECK(tails);
+
+        // A column is the same as tables of one value
+        std::vector<float> oneGain(n, gain[5]), onePhase(n, phase[5]);
+        std::vector<float> zCol(n), thetaCol(n);
+        impedanceComputeColumn(&real[0], &imag[0], gain[5], phase[5],
+                               &zCol[0], &thetaCol[0], n, k);
+        impedanceCompute(&real[0], &imag[0], &oneGain[0], &onePhase[0],
+                         &z[0], &theta[0], n, IMPEDANCE_SCALAR);
+        CHECK(sameBits(zCol, z, n));
+        CHECK(sameBits(thetaCol, theta, n));
+        printf("%s: matches the scalar reference\n", impedanceKernelName(k));
+    }
+
+    // An unknown kernel falls back to the best one
+    impedanceCompute(&real[0], &imag[0], &gain[0], &phase[0], &z[0],
+                     &theta[0], n, 99);
+    CHECK(sameBits(z, zRef, n));
+    CHECK(impedanceKernelSupported(impedanceBestKernel()));
+
+    return checkResult("impedanceTest");
+}
@@ -0,0 +1,99 @@
+/**
+ * Tests the lock-free MPSC queue: ordering, full and empty, and several
+ * producers racing one consumer. Every item must arrive exactly once and in
+ * its producer's order. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./mpscQueueTest
+ */
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "MpscQueue.h"
+#include "check.h"
+
+#define PRODUCERS   (4)
+#define PER_PRODUCER (500000)
+
+struct Item {
+    unsigned int producer;
+    unsigned int seq;
+};
+
+int main() {
+    // One thread: FIFO, full, empty, and wrapping around many times
+    {
+        MpscQueue<int> q(5);
+        CHECK(q.capacity() == 8);
+        int v;
+        CHECK(!q.pop(&v));
+        for (int round = 0; round < 100; round++) {
+            for (int i = 0; i < 8; i++)
+                CHECK(q.push(round * 8 + i));
+            CHECK(!q.push(-1));
+            CHECK(q.size() == 8);
+            for (int i = 0; i < 8; i++)
+                CHECK(q.pop(&v) && v == round * 8 + i);
+            CHECK(!q.pop(&v));
+        }
+        int batch[8];
+        q.push(1);
+        q.push(2);
+        CHECK(q.popBatch(batch, 8) == 2 && batch[0] == 1 && batch[1] == 2);
+    }
+
+    // Producers racing a consumer through a small ring
+    {
+        MpscQueue<Item> q(256);
+        std::vector<std::thread> producers;
+        unsigned long fullCount[PRODUCERS] = { 0 };
+        for (unsigned int p = 0; p < PRODUCERS; p++) {
+            producers.push_back(std::thread([&q, &fullCount, p]() {
+                for (unsigned int i = 0; i < PER_PRODUCER; i++) {
+                    Item item = { p, i };
+                    while (!q.push(item)) {
+                        fullCount[p]++;
+                        std::this_thread::yield();
+                    }
+                }
+            }));
+        }
+
+        unsigned int next[PRODUCERS] = { 0 };
+        unsigned long received = 0;
+        bool ordered = true;
+        Item batch[64];
+        while (received < (unsigned long)PRODUCERS * PER_PRODUCER) {
+            size_t n = q.popBatch(batch, 64);
+            if (n == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (batch[i].producer >= PRODUCERS ||
+                    batch[i].seq != next[batch[i].producer]) {
+                    ordered = false;
+                } else {
+                    next[batch[i].producer]++;
+                }
+            }
+            received += n;
+        }
+        for (size_t p = 0; p < producers.size(); p++)
+            producers[p].join();
+
+        CHECK(ordered);
+        for (int p = 0; p < PRODUCERS; p++)
+            CHECK(next[p] == PER_PRODUCER);
+        Item extra;
+        CHECK(!q.pop(&extra));
+        unsigned long waits = 0;
+        for (int p = 0; p < PRODUCERS; p++)
+            waits += fullCount[p];
+        printf("%d producers, %lu items, %lu pushes found the ring full\n",
+               PRODUCERS, received, waits);
+    }
+
+    return checkResult("mpscQueueTest");
+}
@@ -0,0 +1,360 @@
+/**
+ * Tests the columnar sweep store: sweeps read back exactly as appended,
+ * block ranges cover their columns, time ranges and single frequencies scan
+ * correctly and touch only their share of the file, appends resume after a
+ * writer stops partway, and the gateway sink fills a store from records.
+ * Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./sweepStoreTest
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SweepStore.h"
+#include "RecordSink.h"
+#include "check.h"
+
+#define POINTS          (41)
+#define SMALL_BLOCK     (100)
+#define SWEEPS          (1234)
+#define BIG_SWEEPS      (200000)
+#define STORE_PATH      "/tmp/sweepStoreTest.swp"
+#define BASE_TIME       (1500000000000000ULL)
+
+static uint32_t freqKHz[POINTS];
+
+// Sweep k: every few sweeps arrive out of order, as from different workers
+static uint64_t timeOf(int k) {
+    int swapped = k % 10 == 3 ? k + 1 : k % 10 == 4 ? k - 1 : k;
+    return BASE_TIME + (uint64_t)swapped * 60000000;
+}
+
+static int indexOf(uint64_t time) {
+    int k = (time - BASE_TIME) / 60000000;
+    return k % 10 == 3 ? k + 1 : k % 10 == 4 ? k - 1 : k;
+}
+
+static int16_t realOf(int k, int p) {
+    return (int16_t)((k * 7919 + p * 104729) % 65536 - 32768);
+}
+
+static int16_t imagOf(int k, int p) {
+    return (int16_t)(-(k * 31 + p * 3) % 20000);
+}
+
+static SweepMeta metaOf(int k) {
+    SweepMeta m;
+    m.time = timeOf(k);
+    m.device = k % 5 + 1;
+    m.temperature = k < 10 ? SWEEP_STORE_UNKNOWN : 9800 + k % 50;
+    m.battery = 100 - k / 20;
+    m.calibration = k < SWEEPS / 2 ? 1 : 2;
+    return m;
+}
+
+static bool appendSweeps(SweepStoreWriter *w, int first, int last) {
+    int16_t real[POINTS], imag[POINTS];
+    for (int k = first; k < last; k++) {
+        for (int p = 0; p < POINTS; p++) {
+            real[p] = realOf(k, p);
+            imag[p] = imagOf(k, p);
+        }
+        if (!w->append(metaOf(k), real, imag))
+            return false;
+    }
+    return true;
+}
+
+// Check every column of every sweep, and each block's ranges
+static void checkContents(const SweepStoreReader &r, int sweeps) {
+    CHECK(r.getSweepCount() == (uint64_t)sweeps);
+    CHECK(r.getBlockCount() == (uint32_t)(sweeps + SMALL_BLOCK - 1) / SMALL_BLOCK);
+    bool ok = true, rangesOk = true;
+    for (uint32_t b = 0; b < r.getBlockCount(); b++) {
+        const SweepBlockInfo *info = r.getBlockInfo(b);
+        uint32_t n = r.getBlockSweepCount(b);
+        rangesOk = rangesOk && info->sweeps == n;
+        for (uint32_t s = 0; s < n; s++) {
+            int k = b * SMALL_BLOCK + s;
+            SweepMeta m = metaOf(k);
+            ok = ok && r.getTimes(b)[s] == m.time &&
+                 r.getDevices(b)[s] == m.device &&
+                 r.getTemperatures(b)[s] == m.temperature &&
+                 r.getBatteries(b)[s] == m.battery &&
+                 r.getCalibrations(b)[s] == m.calibration;
+            rangesOk = rangesOk && m.time >= info->timeMin &&
+                       m.time <= info->timeMax &&
+                       m.device >= info->deviceMin &&
+                       m.device <= info->deviceMax &&
+                       m.calibration >= info->calibrationMin &&
+                       m.calibration <= info->calibrationMax &&
+                       (m.temperature == SWEEP_STORE_UNKNOWN ||
+                        (m.temperature >= info->temperatureMin &&
+                         m.temperature <= info->temperatureMax));
+            for (int p = 0; p < POINTS; p++) {
+                ok = ok && r.getReal(b, p)[s] == realOf(k, p) &&
+                     r.getImag(b, p)[s] == imagOf(k, p);
+                rangesOk = rangesOk &&
+                    realOf(k, p) >= info->realMin[p] &&
+                    realOf(k, p) <= info->realMax[p] &&
+                    imagOf(k, p) >= info->imagMin[p] &&
+                    imagOf(k, p) <= info->imagMax[p];
+            }
+        }
+    }
+    CHECK(ok);
+    CHECK(rangesOk);
+    // The first block starts with unknown temperatures, which are left out
+    CHECK(r.getBlockInfo(0)->temperatureMin == 9800);
+}
+
+struct Scan {
+    int point;
+    uint64_t sweeps;
+    bool ok;
+    long long sum;
+};
+
+static void checkScan(const uint64_t *time, const int16_t *real,
+                      const int16_t *imag, uint32_t n, void *context) {
+    Scan *s = (Scan*)context;
+    for (uint32_t i = 0; i < n; i++) {
+        int k = indexOf(time[i]);
+        s->ok = s->ok && real[i] == realOf(k, s->point) &&
+                imag[i] == imagOf(k, s->point);
+    }
+    s->sweeps += n;
+}
+
+static void sumScan(const uint64_t *time, const int16_t *real,
+                    const int16_t *imag, uint32_t n, void *context) {
+    Scan *s = (Scan*)context;
+    for (uint32_t i = 0; i < n; i++)
+        s->sum += real[i] + imag[i];
+    s->sweeps += n;
+}
+
+static uint64_t countIn(int sweeps, uint64_t from, uint64_t to) {
+    uint64_t n = 0;
+    for (int k = 0; k < sweeps; k++)
+        n += timeOf(k) >= from && timeOf(k) < to;
+    return n;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ShirtRecord sweepRecord(uint32_t device, uint64_t time, int points,
+                               int16_t value) {
+    ShirtRecord r;
+    memset(&r, 0, sizeof(r));
+    r.type = SHIRT_RECORD_SWEEP;
+    r.device = device;
+    r.time = time;
+    r.points = r.expected = points;
+    for (int p = 0; p < points; p++) {
+        r.freqKHz[p] = freqKHz[p];
+        r.real[p] = value;
+        r.imag[p] = -value;
+    }
+    return r;
+}
+
+static ShirtRecord valueRecord(uint8_t type, uint32_t device, int32_t value) {
+    ShirtRecord r;
+    memset(&r, 0, sizeof(r));
+    r.type = type;
+    r.device = device;
+    r.value = value;
+    return r;
+}
+
+int main() {
+    for (int p = 0; p < POINTS; p++)
+        freqKHz[p] = 80 + p;
+
+    // Layout: every column starts on a page
+    CHECK(sweepStoreColumnBytes(SWEEP_STORE_BLOCK_SWEEPS, 2) == SWEEP_STORE_PAGE);
+    CHECK(sweepStoreColumnBytes(SMALL_BLOCK, 8) == SWEEP_STORE_PAGE);
+    CHECK(sweepStoreBlockBytes(SWEEP_STORE_BLOCK_SWEEPS, POINTS) ==
+          SWEEP_STORE_PAGE * (1 + 4 + 2 + 3 + 2 * POINTS));
+
+    // Write, read everything back
+    unlink(STORE_PATH);
+    SweepStoreWriter w;
+    CHECK(w.open(STORE_PATH, POINTS, freqKHz, SMALL_BLOCK));
+    CHECK(appendSweeps(&w, 0, SWEEPS / 2));
+    CHECK(w.flush());
+    w.close();
+
+    SweepStoreReader before;
+    CHECK(before.open(STORE_PATH));
+
+    // Appending resumes partway through a block
+    CHECK(w.open(STORE_PATH, POINTS, freqKHz));
+    CHECK(w.getSweepCount() == SWEEPS / 2);
+    CHECK(appendSweeps(&w, SWEEPS / 2, SWEEPS));
+    CHECK(w.flush());
+
+    SweepStoreReader r;
+    CHECK(r.open(STORE_PATH));
+    CHECK(r.getPoints() == POINTS && r.getFrequency(40) == 120);
+    CHECK(r.getBlockSweeps() == SMALL_BLOCK);
+    checkContents(r, SWEEPS);
+
+    // A reader sees what was committed when it opened
+    CHECK(before.getSweepCount() == SWEEPS / 2);
+
+    // One frequency over everything, then over time ranges that start and
+    // end inside blocks and among out-of-order sweeps
+    Scan s;
+    memset(&s, 0, sizeof(s));
+    s.point = 17;
+    s.ok = true;
+    CHECK(r.scanFrequency(17, 0, UINT64_MAX, checkScan, &s) == SWEEPS);
+    CHECK(s.ok && s.sweeps == SWEEPS);
+    uint64_t ranges[][2] = {
+        { timeOf(250), timeOf(260) },
+        { timeOf(3), timeOf(5) },
+        { timeOf(4), timeOf(4) + 1 },
+        { timeOf(99), timeOf(1001) },
+        { timeOf(SWEEPS - 1), UINT64_MAX },
+        { 0, BASE_TIME },
+    };
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        memset(&s, 0, sizeof(s));
+        s.point = 40;
+        s.ok = true;
+        uint64_t n = r.scanFrequency(40, ranges[i][0], ranges[i][1], checkScan, &s);
+        CHECK(n == countIn(SWEEPS, ranges[i][0], ranges[i][1]));
+        CHECK(s.ok && s.sweeps == n);
+    }
+    CHECK(r.scanFrequency(POINTS, 0, UINT64_MAX, checkScan, &s) == 0);
+
+    // A short range only touches the blocks around it
+    CHECK(r.scanBytes(timeOf(250), timeOf(260)) <=
+          3 * (SWEEP_STORE_PAGE + sweepStoreColumnBytes(SMALL_BLOCK, 8) +
+               2 * sweepStoreColumnBytes(SMALL_BLOCK, 2)));
+
+    // Another plan does not fit this store, and junk is not a store
+    uint32_t other[POINTS];
+    memcpy(other, freqKHz, sizeof(other));
+    other[5] = 1;
+    w.close();
+    CHECK(!w.open(STORE_PATH, POINTS, other));
+    CHECK(!w.open(STORE_PATH, POINTS - 1, freqKHz));
+    FILE *f = fopen(STORE_PATH ".junk", "w");
+    for (int i = 0; f && i < 2 * SWEEP_STORE_PAGE; i++)
+        fputc(i, f);
+    if (f)
+        fclose(f);
+    SweepStoreReader junk;
+    CHECK(!junk.open(STORE_PATH ".junk"));
+    CHECK(!junk.open("/nonexistent/store"));
+    unlink(STORE_PATH ".junk");
+
+    // A writer that stopped before committing its last sweeps: the next one
+    // writes over them
+    f = fopen(STORE_PATH, "r+b");
+    SweepStoreHeader h;
+    CHECK(f && fread(&h, sizeof(h), 1, f) == 1);
+    h.sweeps -= 3;
+    CHECK(f && fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1);
+    if (f)
+        fclose(f);
+    CHECK(w.open(STORE_PATH, POINTS, freqKHz));
+    CHECK(w.getSweepCount() == SWEEPS - 3);
+    CHECK(appendSweeps(&w, SWEEPS - 3, SWEEPS));
+    w.close();
+    r.close();
+    CHECK(r.open(STORE_PATH));
+    checkContents(r, SWEEPS);
+    r.close();
+    before.close();
+
+    // The gateway sink: conditions come from each shirt's last T$ and B$
+    unlink(STORE_PATH);
+    {
+        SweepStoreSink sink(STORE_PATH);
+        ShirtRecord records[8];
+        records[0] = sweepRecord(7, BASE_TIME, POINTS, 100);
+        records[1] = valueRecord(SHIRT_RECORD_TEMPERATURE, 7, 9860);
+        records[2] = valueRecord(SHIRT_RECORD_BATTERY, 7, 88);
+        records[3] = sweepRecord(7, BASE_TIME + 1, POINTS, 200);
+        records[4] = sweepRecord(9, BASE_TIME + 2, POINTS, 300);
+        records[5] = sweepRecord(9, BASE_TIME + 3, POINTS - 1, 400);
+        records[6] = sweepRecord(9, BASE_TIME + 4, POINTS, 500);
+        records[6].points = 20;     // cut short
+        records[7] = sweepRecord(9, BASE_TIME + 5, POINTS, 600);
+        records[7].freqKHz[3] = 1;  // another plan
+        CHECK(sink.write(records, 4));
+        sink.setCalibration(3);
+        CHECK(sink.write(records + 4, 4));
+        CHECK(sink.flush());
+        CHECK(sink.getSweepCount() == 3);
+        CHECK(sink.getRejectedCount() == 3);
+    }
+    CHECK(r.open(STORE_PATH));
+    CHECK(r.getSweepCount() == 3 && r.getPoints() == POINTS);
+    if (r.getSweepCount() == 3) {
+        CHECK(r.getDevices(0)[0] == 7 && r.getDevices(0)[2] == 9);
+        CHECK(r.getTemperatures(0)[0] == SWEEP_STORE_UNKNOWN);
+        CHECK(r.getTemperatures(0)[1] == 9860 && r.getBatteries(0)[1] == 88);
+        CHECK(r.getTemperatures(0)[2] == SWEEP_STORE_UNKNOWN);
+        CHECK(r.getCalibrations(0)[1] == 0 && r.getCalibrations(0)[2] == 3);
+        CHECK(r.getReal(0, 40)[2] == 300 && r.getImag(0, 40)[2] == -300);
+        CHECK(r.getTimes(0)[1] == BASE_TIME + 1);
+    }
+    r.close();
+
+    // Fleet scale: a frequency across the whole store reads a small slice
+    // of it
+    unlink(STORE_PATH);
+    CHECK(w.open(STORE_PATH, POINTS, freqKHz));
+    double start = seconds();
+    int16_t real[POINTS], imag[POINTS];
+    SweepMeta m;
+    memset(&m, 0, sizeof(m));
+    for (int k = 0; k < BIG_SWEEPS; k++) {
+        m.time = BASE_TIME + (uint64_t)k * 1000000;
+        m.device = k % 1000;
+        for (int p = 0; p < POINTS; p++) {
+            real[p] = realOf(k, p);
+            imag[p] = imagOf(k, p);
+        }
+        w.append(m, real, imag);
+    }
+    w.close();
+    double appendSeconds = seconds() - start;
+
+    CHECK(r.open(STORE_PATH));
+    start = seconds();
+    memset(&s, 0, sizeof(s));
+    CHECK(r.scanFrequency(20, 0, UINT64_MAX, sumScan, &s) == BIG_SWEEPS);
+    double scanSeconds = seconds() - start;
+    long long expected = 0;
+    for (int k = 0; k < BIG_SWEEPS; k++)
+        expected += realOf(k, 20) + imagOf(k, 20);
+    CHECK(s.sum == expected);
+
+    uint64_t fileBytes = SWEEP_STORE_PAGE +
+        (uint64_t)r.getBlockCount() * sweepStoreBlockBytes(SWEEP_STORE_BLOCK_SWEEPS, POINTS);
+    uint64_t touched = r.scanBytes(0, UINT64_MAX);
+    printf("%d sweeps of %d points: appended at %.0f sweeps/s, one frequency "
+           "scanned at %.0f sweeps/s, touching %llu of %llu KB\n", BIG_SWEEPS,
+           POINTS, BIG_SWEEPS / appendSeconds, BIG_SWEEPS / scanSeconds,
+           (unsigned long long)touched / 1024,
+           (unsigned long long)fileBytes / 1024);
+    CHECK(touched * 10 < fileBytes);
+    r.close();
+    unlink(STORE_PATH);
+
+    return checkResult("sweepStoreTest");
+}
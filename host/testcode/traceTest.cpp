@@ -0,0 +1,252 @@
+/**
+ * Tests shirt traces: a recorded stream reads back line for line with its
+ * times and takes a fraction of the space of the text, damaged traces are
+ * caught, and a replayed fleet reaches the gateway as the right number of
+ * distinct shirts, on schedule. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./traceTest
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "ShirtTrace.h"
+#include "IngestGateway.h"
+#include "Transport.h"
+#include "check.h"
+
+#define TRACE_PATH      "/tmp/traceTest.trc"
+#define SOCKET_PATH     "/tmp/traceTest.sock"
+#define SWEEPS          (10)
+#define POINTS          (41)
+#define SWEEP_MICROS    (10000000ULL)
+#define COPIES          (50)
+#define SPEED           (1000)
+
+struct Line {
+    uint64_t time;
+    std::string text;
+};
+
+// What pcb-iteration-2 sends, plus lines a trace has to keep as they are
+static std::vector<Line> shirtStream(void) {
+    std::vector<Line> lines;
+    char buf[400];
+    for (int s = 0; s < SWEEPS; s++) {
+        uint64_t t = s * SWEEP_MICROS + 1234;
+        lines.push_back(Line{ t, "I$START$41" });
+        for (int p = 0; p < POINTS; p++) {
+            snprintf(buf, sizeof(buf), "I$%d$%d$%d", 80 + p, 9000 - 37 * p + s,
+                     -1500 + 11 * p);
+            lines.push_back(Line{ t + 3200 * (p + 1), buf });
+        }
+        lines.push_back(Line{ t + 3200 * 42, "I$HALT" });
+        snprintf(buf, sizeof(buf), "T$%d.%02d", 98 + s / 5, (s * 7) % 100);
+        lines.push_back(Line{ t + 200000, buf });
+        snprintf(buf, sizeof(buf), "B$%d", 90 - s);
+        lines.push_back(Line{ t + 210000, buf });
+    }
+    uint64_t end = SWEEPS * SWEEP_MICROS;
+    lines.push_back(Line{ end, "P$1$1$41" });
+    lines.push_back(Line{ end, "T$98.6" });
+    lines.push_back(Line{ end, "T$-1.05" });
+    lines.push_back(Line{ end, "I$80$1$2x" });
+    lines.push_back(Line{ end, "I$START$+4" });
+    lines.push_back(Line{ end, "" });
+    lines.push_back(Line{ end, "hello from the shirt" });
+    lines.push_back(Line{ end + 1, "D$5" });
+    lines.push_back(Line{ end + 2, std::string(300, 'x') });
+    return lines;
+}
+
+/**
+ * Counts records per shirt. Only the writer thread calls it.
+ */
+class CountingSink : public RecordSink {
+    public:
+        bool write(const ShirtRecord *records, int n) {
+            for (int i = 0; i < n; i++)
+                perDevice[records[i].device]++;
+            total += n;
+            return true;
+        }
+
+        std::map<uint32_t, unsigned long> perDevice;
+        unsigned long total = 0;
+};
+
+static void ignoreRecord(const ShirtRecord *, void *) {
+}
+
+// Records one copy of the trace decodes to, as the gateway decodes it
+static unsigned long recordsPerCopy(const std::string &stream) {
+    ShirtDecoder decoder;
+    ShirtRecord last;
+    unsigned long n = decoder.feed(stream.data(), stream.size(), 0,
+                                   ignoreRecord, NULL);
+    return n + decoder.finish(&last);
+}
+
+// Replay the trace into a gateway and check what arrives
+static void replayFleet(double speed, const std::string &once) {
+    CountingSink sink;
+    IngestGateway gateway(&sink, 2);
+    int fd = transportListen("unix:" SOCKET_PATH);
+    CHECK(fd >= 0 && gateway.start(fd));
+
+    TraceReplay replay;
+    CHECK(replay.load(TRACE_PATH));
+    replay.plan(COPIES, 200000, 1, 7);
+    ReplayStats stats;
+    CHECK(replay.run("unix:" SOCKET_PATH, speed, 1000, &stats));
+
+    // Each copy's records are written once its connection is closed
+    unsigned long expected = COPIES * recordsPerCopy(once);
+    GatewayStats g;
+    for (int wait = 0; wait < 500; wait++) {
+        gateway.getStats(&g);
+        if (g.active == 0 && g.connections == COPIES && g.records >= expected)
+            break;
+        usleep(10000);
+    }
+    gateway.stop();
+    unlink(SOCKET_PATH);
+
+    printf("replay at %gx: %lu copies, %llu lines, %llu bytes in %.3f s, "
+           "max lag %llu us\n", speed, stats.copies, stats.lines, stats.bytes,
+           stats.seconds, (unsigned long long)stats.maxLagMicros);
+    CHECK(stats.copies == COPIES);
+    CHECK(stats.sendErrors == 0);
+    CHECK(stats.lines == COPIES * replay.getLineCount());
+    // Every copy is its own shirt, and every measurement gets there
+    CHECK(recordsPerCopy(once) >= SWEEPS * 3);
+    CHECK(sink.total == expected);
+    CHECK(sink.perDevice.size() == COPIES);
+    CHECK(sink.perDevice.begin()->first == 1000);
+    CHECK(sink.perDevice.rbegin()->first == 1000 + COPIES - 1);
+    if (speed > 0) {
+        // It took about the trace's time, sped up
+        double minimum = replay.getDuration() / speed / 1e6;
+        CHECK(stats.seconds >= minimum);
+        CHECK(stats.seconds < minimum + 2);
+    }
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN);
+    std::vector<Line> lines = shirtStream();
+
+    // Record
+    TraceWriter w;
+    CHECK(w.open(TRACE_PATH, 1500000000000000ULL));
+    unsigned long long textBytes = 0;
+    for (size_t i = 0; i < lines.size(); i++) {
+        CHECK(w.addLine(lines[i].time, lines[i].text.data(),
+                        lines[i].text.size()));
+        textBytes += lines[i].text.size() + 2;
+    }
+    // Time going backwards is recorded as none passing
+    uint64_t last = lines.back().time;
+    CHECK(w.addLine(last - 100, "B$1", 3));
+    lines.push_back(Line{ last, "B$1" });
+    CHECK(w.getLineCount() == lines.size());
+    CHECK(w.getRawCount() == 8);
+    unsigned long long traceBytes = w.getBytesWritten();
+    CHECK(w.close());
+    printf("%zu lines: %llu bytes of text, %llu bytes of trace (%.0f%%)\n",
+           lines.size(), textBytes, traceBytes, 100.0 * traceBytes / textBytes);
+    CHECK(traceBytes * 2 < textBytes);
+
+    // Read back, line for line
+    TraceReader r;
+    CHECK(r.open(TRACE_PATH));
+    CHECK(r.getStartTime() == 1500000000000000ULL);
+    TraceLine line;
+    size_t n = 0;
+    bool same = true;
+    while (r.next(&line)) {
+        if (n < lines.size()) {
+            std::string expected = lines[n].text.substr(0, TRACE_LINE_MAX);
+            same = same && line.time == lines[n].time &&
+                   std::string(line.text, line.len) == expected;
+        }
+        n++;
+    }
+    CHECK(n == lines.size());
+    CHECK(same);
+    CHECK(!r.isCorrupt());
+    r.rewind();
+    CHECK(r.next(&line) && line.time == lines[0].time);
+
+    // A cut-off trace reads up to the damage
+    std::vector<char> bytes(traceBytes);
+    FILE *f = fopen(TRACE_PATH, "rb");
+    CHECK(f && fread(&bytes[0], 1, traceBytes, f) == traceBytes);
+    if (f)
+        fclose(f);
+    f = fopen(TRACE_PATH ".cut", "wb");
+    if (f) {
+        fwrite(&bytes[0], 1, traceBytes - 200, f);
+        fclose(f);
+    }
+    CHECK(r.open(TRACE_PATH ".cut"));
+    n = 0;
+    while (r.next(&line))
+        n++;
+    CHECK(n > 0 && n < lines.size());
+    CHECK(r.isCorrupt());
+    f = fopen(TRACE_PATH ".cut", "wb");
+    if (f) {
+        fwrite("SHIRTSWP", 1, 8, f);
+        fwrite(&bytes[8], 1, traceBytes - 8, f);
+        fclose(f);
+    }
+    CHECK(!r.open(TRACE_PATH ".cut"));
+    CHECK(!r.open("/nonexistent/trace"));
+    unlink(TRACE_PATH ".cut");
+
+    // Replay plan: each copy is the whole trace, less D$, loops times,
+    // after its own offset
+    TraceReplay replay;
+    CHECK(replay.load(TRACE_PATH));
+    CHECK(replay.getLineCount() == lines.size() - 1);
+    CHECK(replay.getDuration() == lines.back().time);
+    std::string once;
+    for (size_t i = 0; i < lines.size(); i++)
+        if (lines[i].text.compare(0, 2, "D$") != 0)
+            once += lines[i].text.substr(0, TRACE_LINE_MAX) + "\r\n";
+    replay.plan(3, 1000000, 2, 42);
+    bool offsetsOk = true, inOrder = true;
+    std::vector<uint64_t> firsts;
+    for (int c = 0; c < 3; c++) {
+        uint64_t first = replay.nextTime(c);
+        firsts.push_back(first);
+        offsetsOk = offsetsOk && first >= lines[0].time &&
+                    first < lines[0].time + 1000000;
+        // Half way through the first run, then the rest
+        std::string out;
+        uint64_t half = first + replay.getDuration() / 2;
+        int taken = replay.takeDue(c, half, &out);
+        inOrder = inOrder && taken > 0 && replay.nextTime(c) > half;
+        taken += replay.takeDue(c, UINT64_MAX - 1, &out);
+        CHECK(taken == 2 * (int)replay.getLineCount());
+        CHECK(out == once + once);
+        CHECK(replay.nextTime(c) == UINT64_MAX);
+    }
+    CHECK(offsetsOk);
+    CHECK(inOrder);
+    CHECK(firsts[0] != firsts[1] || firsts[1] != firsts[2]);
+
+    // A fleet against the gateway, on schedule and flat out
+    replayFleet(SPEED, once);
+    replayFleet(0, once);
+    unlink(TRACE_PATH);
+
+    return checkResult("traceTest");
+}
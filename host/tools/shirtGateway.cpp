@@ -0,0 +1,111 @@
+/**
+ * Shirt ingest gateway. Accepts shirt streams on a Unix or TCP socket (see
+ * libraries/IngestGateway/Transport.h), decodes the I$/T$/B$ messages and
+ * appends the records to a row-wise text log, or with -s the sweeps to a
+ * columnar sweep store (see libraries/SweepStore/SweepStore.h). Statistics
+ * go to stderr every few seconds and when it is stopped with Ctrl-C.
+ *
+ * Usage:
+ *  ./shirtGateway [-w workers] [-o log | -s store] address
+ *   e.g. ./shirtGateway -w 4 -o shirts.log tcp::7000
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "IngestGateway.h"
+#include "RecordSink.h"
+#include "Transport.h"
+
+#define REPORT_SECONDS  (10)
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+    stopRequested = 1;
+}
+
+static void report(const IngestGateway &gateway) {
+    GatewayStats s;
+    gateway.getStats(&s);
+    fprintf(stderr, "%lu shirts (%lu open), %llu lines, %llu records in "
+            "%llu batches, %llu errors, %llu ignored, %llu queue waits, "
+            "%llu accepts put off, latency mean %llu us p50 <%llu us "
+            "p99 <%llu us max %llu us\n",
+            s.connections, s.active, s.lines, s.records, s.batches,
+            s.lineErrors, s.ignored, s.queueFull, s.refused, s.meanLatency,
+            s.p50Latency, s.p99Latency, s.maxLatency);
+}
+
+static int usage(const char *name) {
+    fprintf(stderr, "usage: %s [-w workers] [-o log | -s store] address\n",
+            name);
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    int workers = 2;
+    const char *logPath = NULL;
+    const char *storePath = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:o:s:")) != -1) {
+        switch (opt) {
+            case 'w': workers = atoi(optarg); break;
+            case 'o': logPath = optarg; break;
+            case 's': storePath = optarg; break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || (logPath && storePath))
+        return usage(argv[0]);
+
+    // One descriptor per shirt
+    unsigned long files = IngestGateway::raiseFileLimit();
+
+    int logFd = logPath ? open(logPath, O_WRONLY | O_CREAT | O_APPEND, 0644)
+                        : STDOUT_FILENO;
+    if (logFd < 0) {
+        fprintf(stderr, "%s: %s\n", logPath, strerror(errno));
+        return 1;
+    }
+    int listenFd = transportListen(argv[optind]);
+    if (listenFd < 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    signal(SIGPIPE, SIG_IGN);
+
+    TextLogSink logSink(logFd);
+    SweepStoreSink storeSink(storePath);
+    RecordSink *sink = storePath ? (RecordSink*)&storeSink : &logSink;
+    IngestGateway gateway(sink, workers);
+    if (!gateway.start(listenFd)) {
+        fprintf(stderr, "could not start the gateway\n");
+        return 1;
+    }
+    fprintf(stderr, "listening on %s with %d workers, up to %lu open files\n",
+            argv[optind], workers, files);
+
+    int seconds = 0;
+    while (!stopRequested) {
+        sleep(1);
+        if (++seconds % REPORT_SECONDS == 0)
+            report(gateway);
+    }
+    gateway.stop();
+    report(gateway);
+    if (storePath)
+        fprintf(stderr, "%s: %llu sweeps, %llu left out\n", storePath,
+                (unsigned long long)storeSink.getSweepCount(),
+                storeSink.getRejectedCount());
+    if (strncmp(argv[optind], "unix:", 5) == 0)
+        unlink(argv[optind] + 5);
+    return 0;
+}
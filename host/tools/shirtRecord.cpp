@@ -0,0 +1,188 @@
+/**
+ * Records a shirt's stream to a trace (see libraries/ShirtTrace/ShirtTrace.h)
+ * with the time each line arrived. The stream is read from a serial port
+ * (set raw at the baud given with -b), a file, stdin ("-"), or the first
+ * bridge to connect to a Unix or TCP address (see
+ * libraries/IngestGateway/Transport.h). Recording stops at the end of the
+ * stream or with Ctrl-C.
+ *
+ * The sketch's serial port only carries the sweep lines (I$START, I$f$r$i,
+ * I$HALT) when it is built with LOG_LEVEL_DEBUG, and only all of them at a
+ * baud rate that keeps up with a sweep, such as 115200; at the default
+ * LOG_LEVEL_INFO a serial recording has temperatures and battery levels but
+ * no sweeps. Otherwise record sweeps from a BLE bridge with the shirt left
+ * in text mode.
+ *
+ * Usage:
+ *  ./shirtRecord [-b baud] input trace
+ *   e.g. ./shirtRecord -b 9600 /dev/ttyUSB0 walk.trc
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "ShirtTrace.h"
+#include "Transport.h"
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+    stopRequested = 1;
+}
+
+static uint64_t monotonicMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int usage(const char *name) {
+    fprintf(stderr, "usage: %s [-b baud] input trace\n"
+            "sweeps only come over serial from a LOG_LEVEL_DEBUG build at a "
+            "baud that keeps up (115200); otherwise record a text-mode BLE "
+            "bridge\n", name);
+    return 2;
+}
+
+/**
+ * Put a serial port in raw mode at baud
+ * @param fd The port
+ * @param baud Its speed
+ * @return True if it was set
+ */
+static bool setRaw(int fd, int baud) {
+    static const struct { int baud; speed_t speed; } speeds[] = {
+        { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+        { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+        { 115200, B115200 }
+    };
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+        return false;
+    cfmakeraw(&tio);
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        if (speeds[i].baud == baud) {
+            cfsetispeed(&tio, speeds[i].speed);
+            cfsetospeed(&tio, speeds[i].speed);
+            return tcsetattr(fd, TCSANOW, &tio) == 0;
+        }
+    }
+    errno = EINVAL;
+    return false;
+}
+
+/**
+ * Open the stream to record
+ * @param input "-", a Unix or TCP address, or a path
+ * @param baud Speed to set if it is a serial port
+ * @return A descriptor, or -1 with errno set
+ */
+static int openInput(const char *input, int baud) {
+    if (strcmp(input, "-") == 0)
+        return STDIN_FILENO;
+    if (strncmp(input, "unix:", 5) == 0 || strncmp(input, "tcp:", 4) == 0) {
+        int listenFd = transportListen(input);
+        if (listenFd < 0)
+            return -1;
+        fprintf(stderr, "waiting for a shirt on %s\n", input);
+        int fd = accept(listenFd, NULL, NULL);
+        int saved = errno;
+        close(listenFd);
+        if (strncmp(input, "unix:", 5) == 0)
+            unlink(input + 5);
+        errno = saved;
+        return fd;
+    }
+    int fd = open(input, O_RDONLY | O_NOCTTY);
+    if (fd >= 0 && isatty(fd) && !setRaw(fd, baud)) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    int baud = 9600;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        switch (opt) {
+            case 'b': baud = atoi(optarg); break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 2)
+        return usage(argv[0]);
+    const char *input = argv[optind];
+    const char *path = argv[optind + 1];
+
+    // No SA_RESTART, so Ctrl-C ends a blocked read or accept
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = requestStop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int fd = openInput(input, baud);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", input, strerror(errno));
+        return 1;
+    }
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    TraceWriter trace;
+    if (!trace.open(path, (uint64_t)now.tv_sec * 1000000 + now.tv_usec)) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    uint64_t start = monotonicMicros();
+
+    // Lines longer than a trace keeps are cut here too
+    char line[TRACE_LINE_MAX + 1];
+    int len = 0;
+    bool ok = true;
+    char buf[4096];
+    while (!stopRequested && ok) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            fprintf(stderr, "%s: %s\n", input, strerror(errno));
+            break;
+        }
+        if (n == 0)
+            break;
+        uint64_t time = monotonicMicros() - start;
+        for (ssize_t i = 0; i < n && ok; i++) {
+            if (buf[i] == '\n') {
+                if (len > 0 && line[len - 1] == '\r')
+                    len--;
+                ok = trace.addLine(time, line, len);
+                len = 0;
+            } else if (len < (int)sizeof(line)) {
+                line[len++] = buf[i];
+            }
+        }
+    }
+    if (ok && len > 0)
+        ok = trace.addLine(monotonicMicros() - start, line, len);
+    if (fd != STDIN_FILENO)
+        close(fd);
+    if (!trace.close() || !ok) {
+        fprintf(stderr, "%s: could not write the trace\n", path);
+        return 1;
+    }
+    fprintf(stderr, "%s: %lu lines (%lu kept as text) in %llu bytes over "
+            "%.1f s\n", path, trace.getLineCount(), trace.getRawCount(),
+            trace.getBytesWritten(), (monotonicMicros() - start) / 1e6);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * Replays a trace recorded by shirtRecord against a gateway as a fleet of
+ * shirts: every copy connects on its own, names itself with D$ and sends
+ * the trace after a random offset within the jitter, speed times faster
+ * than it was recorded (0 for as fast as the gateway takes it).
+ *
+ * Usage:
+ *  ./shirtReplay [-s speed] [-n copies] [-j jitter seconds] [-l loops]
+ *                [-d first device] trace address
+ *   e.g. ./shirtReplay -s 60 -n 200 -j 10 walk.trc tcp:localhost:7000
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "ShirtTrace.h"
+
+#define MAX_SPEED   (1000)
+
+static int usage(const char *name) {
+    fprintf(stderr, "usage: %s [-s speed] [-n copies] [-j jitter seconds] "
+            "[-l loops] [-d first device] trace address\n", name);
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    double speed = 1;
+    int copies = 1;
+    double jitter = 0;
+    int loops = 1;
+    unsigned long firstDevice = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:j:l:d:")) != -1) {
+        switch (opt) {
+            case 's': speed = atof(optarg); break;
+            case 'n': copies = atoi(optarg); break;
+            case 'j': jitter = atof(optarg); break;
+            case 'l': loops = atoi(optarg); break;
+            case 'd': firstDevice = strtoul(optarg, NULL, 0); break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 2)
+        return usage(argv[0]);
+    if (speed < 0 || speed > MAX_SPEED || copies < 1 || loops < 1 ||
+        jitter < 0) {
+        fprintf(stderr, "speed must be 0 to %d, copies and loops at least 1\n",
+                MAX_SPEED);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    TraceReplay replay;
+    if (!replay.load(argv[optind])) {
+        fprintf(stderr, "%s: not a readable trace\n", argv[optind]);
+        return 1;
+    }
+    replay.plan(copies, (uint64_t)(jitter * 1e6), loops, (uint32_t)time(NULL));
+    fprintf(stderr, "%s: %zu lines over %.1f s, %d copies at %gx\n",
+            argv[optind], replay.getLineCount(), replay.getDuration() / 1e6,
+            copies, speed);
+
+    ReplayStats s;
+    bool ok = replay.run(argv[optind + 1], speed, firstDevice, &s);
+    fprintf(stderr, "%lu copies, %llu lines, %llu bytes in %.3f s, "
+            "%llu dropped, max lag %llu us\n", s.copies, s.lines, s.bytes,
+            s.seconds, s.sendErrors, (unsigned long long)s.maxLagMicros);
+    return ok ? 0 : 1;
+}
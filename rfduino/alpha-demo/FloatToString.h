@@ -1,3 +0,0 @@
-// Include file for float to string conversion functions
-void fmtFloat(double val, byte precision, char *buf, unsigned bufLen);
-unsigned fmtUnsigned(unsigned long val, char *buf, unsigned bufLen, byte width);
@@ -26,7 +26,7 @@
 #include <OneWire.h>
 #include "AD5933.h"
 #include "DS18B20.h"
-#include "FloatToString.h"
+#include "FastFormat.h"
 
 // Frequency sweep settings
 #define START_FREQ  (80000)
@@ -18,7 +18,7 @@ fall-design-day-demo
 
 #include <OneWire.h>
 #include <RFduinoBLE.h>
-#include "FloatToString.h"
+#include "FastFormat.h"
 
 // Data wire is plugged into pin 2 on the RFduino
 #define TEMP_PIN 2
@@ -9,7 +9,9 @@
  */
 
 #include "AD5933.h"
-#include <Math.h>
+#include <math.h>
+
+unsigned long AD5933::errors = 0;
 
 /**
  * Request to read a byte from the AD5933.
@@ -26,8 +28,10 @@ int AD5933::getByte(byte address, byte *value) {
     Wire.write(address);
 
     // Ensure transmission worked
-    if (byte res = Wire.endTransmission() != I2C_RESULT_SUCCESS) {
+    byte res = Wire.endTransmission();
+    if (res != I2C_RESULT_SUCCESS) {
         *value = res;
+        errors++;
         return false;
     }
 
@@ -38,6 +42,7 @@ int AD5933::getByte(byte address, byte *value) {
         return true;
     } else {
         *value = 0;
+        errors++;
         return false;
     }
 }
@@ -56,7 +61,8 @@ bool AD5933::sendByte(byte address, byte value) {
     Wire.write(value);
 
     // Check that transmission completed successfully
-    if (byte res = Wire.endTransmission() != I2C_RESULT_SUCCESS) {
+    if (Wire.endTransmission() != I2C_RESULT_SUCCESS) {
+        errors++;
         return false;
     } else {
         return true;
@@ -338,24 +344,46 @@ bool AD5933::getComplexData(int *real, int *imag) {
     // Wait for a measurement to be available
     while ((readStatusRegister() & STATUS_DATA_VALID) != STATUS_DATA_VALID);
 
-    // Read the four data registers.
-    // TODO: Do this faster with a block read
-    byte realComp[2];
-    byte imagComp[2];
-    if (getByte(REAL_DATA_1, &realComp[0]) &&
-        getByte(REAL_DATA_2, &realComp[1]) &&
-        getByte(IMAG_DATA_1, &imagComp[0]) &&
-        getByte(IMAG_DATA_2, &imagComp[1]))
-    {
+    return readComplexData(real, imag);
+}
+
+/**
+ * Read the real and imaginary data registers. The data must be valid.
+ *
+ * @param real Pointer to an int that will contain the real component.
+ * @param imag Pointer to an int that will contain the imaginary component.
+ * @return Success or failure
+ */
+bool AD5933::readComplexData(int *real, int *imag) {
+    // Read the four data registers in one block read, starting at the real
+    // data register. The read must follow the block read command with a
+    // repeated start; a stop in between abandons the block.
+    byte data[4];
+    Wire.beginTransmission(AD5933_ADDR);
+    Wire.write(ADDR_PTR);
+    Wire.write(REAL_DATA_1);
+    bool ok = Wire.endTransmission() == I2C_RESULT_SUCCESS;
+    if (ok) {
+        Wire.beginTransmission(AD5933_ADDR);
+        Wire.write(BLOCK_READ);
+        Wire.write(sizeof(data));
+        ok = Wire.endTransmission(false) == I2C_RESULT_SUCCESS &&
+             Wire.requestFrom(AD5933_ADDR, (int)sizeof(data)) == sizeof(data);
+    }
+    if (ok) {
+        for (unsigned int i = 0; i < sizeof(data); i++)
+            data[i] = Wire.read();
+
         // Combine the two separate bytes into a single 16-bit value and store
         // them at the locations specified.
-        *real = (int16_t)(((realComp[0] << 8) | realComp[1]) & 0xFFFF);
-        *imag = (int16_t)(((imagComp[0] << 8) | imagComp[1]) & 0xFFFF);
+        *real = (int16_t)(((data[0] << 8) | data[1]) & 0xFFFF);
+        *imag = (int16_t)(((data[2] << 8) | data[3]) & 0xFFFF);
 
         return true;
     } else {
         *real = -1;
         *imag = -1;
+        errors++;
         return false;
     }
 }
@@ -420,6 +448,102 @@ bool AD5933::frequencySweep(int real[], int imag[], int n) {
     return setPowerMode(POWER_STANDBY);
 }
 
+/**
+ * Perform a complete frequency sweep, handing each point to a handler as it
+ * arrives. The next frequency is started as soon as a point has been read,
+ * so the AD5933 converts it while the handler works on the current one. As
+ * long as the handler is quicker than a conversion, the sweep takes only as
+ * long as the conversions and the register reads between them.
+ *
+ * @param handler Function called with each point, in order
+ * @param n Most points to accept
+ * @param idle Function called while waiting for a point, or NULL
+ * @return Success or failure
+ */
+bool AD5933::frequencySweepStream(SweepPointHandler handler, int n,
+                                  void (*idle)(void)) {
+    if (!(setPowerMode(POWER_STANDBY) &&         // place in standby
+         setControlMode(CTRL_INIT_START_FREQ) && // init start freq
+         setControlMode(CTRL_START_FREQ_SWEEP))) // begin frequency sweep
+         {
+             return false;
+         }
+
+    // Nothing else changes the control register during the sweep, so the
+    // increment command is written without reading it back first
+    byte control;
+    if (!getByte(CTRL_REG1, &control))
+        return false;
+    byte increment = (control & 0x0F) | CTRL_INCREMENT_FREQ;
+
+    for (int i = 0; i < n; i++) {
+        // Wait for this point. The status that says it is valid also says
+        // whether it is the last one.
+        byte status;
+        while (((status = readStatusRegister()) & STATUS_DATA_VALID) !=
+               STATUS_DATA_VALID) {
+            if (idle)
+                idle();
+        }
+
+        int real, imag;
+        if (status == STATUS_ERROR || !readComplexData(&real, &imag)) {
+            setPowerMode(POWER_STANDBY);
+            return false;
+        }
+
+        // Start the next point, then handle this one while it converts
+        bool done = (status & STATUS_SWEEP_DONE) == STATUS_SWEEP_DONE;
+        if (!done)
+            sendByte(CTRL_REG1, increment);
+        handler(i, real, imag);
+        if (done)
+            return setPowerMode(POWER_STANDBY);
+    }
+
+    // The sweep has more points than asked for
+    setPowerMode(POWER_STANDBY);
+    return false;
+}
+
+/**
+ * Measure the magnitude of the impedance response at the start frequency,
+ * averaged over several repeated measurements. Useful for characterizing a
+ * resistor, where the response doesn't depend on frequency.
+ *
+ * @param magnitude Pointer to where the average magnitude should be stored
+ * @param repeats Number of measurements to average
+ * @return Success or failure
+ */
+bool AD5933::measureMagnitude(double *magnitude, int repeats) {
+    // Start a sweep, but stay on the start frequency
+    if (repeats < 1 ||
+        !(setPowerMode(POWER_STANDBY) &&         // place in standby
+          setControlMode(CTRL_INIT_START_FREQ) && // init start freq
+          setControlMode(CTRL_START_FREQ_SWEEP))) // begin frequency sweep
+    {
+        return false;
+    }
+
+    double sum = 0;
+    for (int i = 0; i < repeats; i++) {
+        int real, imag;
+        if (!getComplexData(&real, &imag)) {
+            setPowerMode(POWER_STANDBY);
+            return false;
+        }
+        sum += sqrt(pow(real, 2) + pow(imag, 2));
+
+        // Measure the same frequency again
+        if (i + 1 < repeats)
+            setControlMode(CTRL_REPEAT_FREQ);
+    }
+    *magnitude = sum / repeats;
+
+    // Put into standby
+    return setPowerMode(POWER_STANDBY);
+}
+
 /**
  * Computes the gain factor and phase for each point in a frequency sweep.
  *
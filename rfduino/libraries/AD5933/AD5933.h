@@ -11,9 +11,10 @@
  * AD5933 Register Map
  *  Datasheet p23
  */
-// Device address and address pointer
+// Device address, address pointer and block read commands
 #define AD5933_ADDR     (0x0D)
 #define ADDR_PTR        (0xB0)
+#define BLOCK_READ      (0xA1)
 // Control Register
 #define CTRL_REG1       (0x80)
 #define CTRL_REG2       (0x81)
@@ -88,6 +89,13 @@
 // Frequency sweep parameters
 #define SWEEP_DELAY             (1)
 
+/**
+ * Streamed sweeps
+ *  Called with each point of a streamed sweep, while the AD5933 converts the
+ *  next one.
+ */
+typedef void (*SweepPointHandler)(int index, int real, int imag);
+
 /**
  * AD5933 Library class
  *  Contains mainly functions for interfacing with the AD5933.
@@ -136,16 +144,28 @@ class AD5933 {
 
         // Perform frequency sweeps
         static bool frequencySweep(int[], int[], int);
+        static bool frequencySweepStream(SweepPointHandler, int,
+                                         void (*idle)(void) = NULL);
         static bool calibrate(double[], int[], int, int);
         static bool calibrate(double gain[], int phase[], int real[],
                               int imag[], int ref, int n);
+
+        // Average magnitude at the start frequency
+        static bool measureMagnitude(double*, int);
+
+        // Number of failed I2C transactions since boot
+        static unsigned long getErrorCount(void) { return errors; }
     private:
         // Private data
         static const unsigned int clockSpeed = 16776000;
+        static unsigned long errors;
 
         // Sending/Receiving byte method, for easy re-use
         static int getByte(byte, byte*);
         static bool sendByte(byte, byte);
+
+        // Read the data registers, without waiting for valid data
+        static bool readComplexData(int*, int*);
 };
 
 #endif
@@ -0,0 +1,142 @@
+/**
+ * @file GainSurface.cpp
+ * @brief Frequency x magnitude gain correction for the AD5933
+ *
+ * Stores gain factors for several reference resistances at a subset of the
+ * sweep points, and looks up a gain factor for any measured point by bilinear
+ * interpolation.
+ *
+ * @author Michael Meli
+ */
+
+#include "GainSurface.h"
+#include <math.h>
+
+/**
+ * Create an empty surface. A node is kept every freqStep sweep points, plus
+ * one at the last point; freqStep is raised if the sweep would need more than
+ * SURFACE_MAX_FREQS nodes.
+ *
+ * @param numPoints Number of points in each sweep
+ * @param freqStep Sweep points between frequency nodes
+ */
+GainSurface::GainSurface(int numPoints, int freqStep) {
+    if (numPoints < 2)
+        numPoints = 2;
+    if (freqStep < 1)
+        freqStep = 1;
+    while ((numPoints - 2) / freqStep + 2 > SURFACE_MAX_FREQS)
+        freqStep++;
+
+    this->numPoints = numPoints;
+    this->freqStep = freqStep;
+    numFreqs = (numPoints - 2) / freqStep + 2;
+    numRefs = 0;
+}
+
+/**
+ * Forget all references. getGain should not be used until at least two
+ * references are added again.
+ */
+void GainSurface::clear() {
+    numRefs = 0;
+}
+
+/**
+ * Add a reference sweep. Only the points at the frequency nodes are kept.
+ *
+ * @param ohms The known reference resistance
+ * @param real Real data of the sweep, numPoints long
+ * @param imag Imaginary data of the sweep, numPoints long
+ * @return Success or failure (surface full, or no signal at a node)
+ */
+bool GainSurface::addReference(double ohms, const int real[],
+                               const int imag[]) {
+    if (numRefs >= SURFACE_MAX_REFS || ohms <= 0)
+        return false;
+
+    float mags[SURFACE_MAX_FREQS];
+    for (int j = 0; j < numFreqs; j++) {
+        int point = j * freqStep;
+        if (point > numPoints - 1)
+            point = numPoints - 1;
+        mags[j] = sqrt(pow(real[point], 2) + pow(imag[point], 2));
+        if (mags[j] <= 0)
+            return false;
+    }
+
+    // Keep the references ordered by magnitude, using the first node
+    int k = numRefs;
+    while (k > 0 && magnitudes[k-1][0] > mags[0]) {
+        for (int j = 0; j < numFreqs; j++) {
+            magnitudes[k][j] = magnitudes[k-1][j];
+            gains[k][j] = gains[k-1][j];
+        }
+        k--;
+    }
+    for (int j = 0; j < numFreqs; j++) {
+        magnitudes[k][j] = mags[j];
+        gains[k][j] = (1.0 / ohms) / mags[j];
+    }
+    numRefs++;
+    return true;
+}
+
+/**
+ * Get the magnitude and gain of a reference, interpolated to a sweep point.
+ *
+ * @param point Sweep point
+ * @param ref Reference index
+ * @param magnitude Pointer to hold the magnitude
+ * @param gain Pointer to hold the gain factor
+ */
+void GainSurface::nodeAt(int point, int ref, float *magnitude, float *gain) {
+    int j = point / freqStep;
+    if (j > numFreqs - 2)
+        j = numFreqs - 2;
+    int p0 = j * freqStep;
+    int p1 = p0 + freqStep;
+    if (p1 > numPoints - 1)
+        p1 = numPoints - 1;
+    float t = (float)(point - p0) / (p1 - p0);
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+
+    *magnitude = magnitudes[ref][j] + t * (magnitudes[ref][j+1] - magnitudes[ref][j]);
+    *gain = gains[ref][j] + t * (gains[ref][j+1] - gains[ref][j]);
+}
+
+/**
+ * Look up the gain factor for a measurement. The gain is interpolated between
+ * the two nearest frequency nodes, then between the two references whose
+ * magnitudes bracket the measured one. Outside the references, the nearest
+ * reference's gain is used.
+ *
+ * @param point Sweep point the measurement was taken at
+ * @param magnitude Measured magnitude, sqrt(real^2 + imag^2)
+ * @return Gain factor, so that impedance = 1/(magnitude*gain)
+ */
+double GainSurface::getGain(int point, double magnitude) {
+    if (numRefs == 0)
+        return 0;
+    if (point < 0)
+        point = 0;
+    if (point >= numPoints)
+        point = numPoints - 1;
+
+    // Walk up the references until one has a larger magnitude
+    float lowMag, lowGain, highMag, highGain;
+    nodeAt(point, 0, &highMag, &highGain);
+    if (magnitude <= highMag)
+        return highGain;
+    for (int k = 1; k < numRefs; k++) {
+        lowMag = highMag;
+        lowGain = highGain;
+        nodeAt(point, k, &highMag, &highGain);
+        if (magnitude <= highMag) {
+            float s = (magnitude - lowMag) / (highMag - lowMag);
+            return lowGain + s * (highGain - lowGain);
+        }
+    }
+    return highGain;
+}
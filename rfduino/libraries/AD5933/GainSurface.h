@@ -0,0 +1,56 @@
+#ifndef GainSurface_h
+#define GainSurface_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+
+/**
+ * Constants
+ *  Constants for use with the gain surface.
+ */
+// Most reference resistances the surface can hold
+#define SURFACE_MAX_REFS    (6)
+// Most frequency nodes the surface can hold
+#define SURFACE_MAX_FREQS   (12)
+
+/**
+ * AD5933 gain correction surface
+ *  A single gain factor sweep is only exact at the magnitude it was taken at,
+ *  since the AD5933's gain is not perfectly flat across magnitude. The surface
+ *  holds gain factors for several reference resistances at every few sweep
+ *  points, and interpolates between them in frequency and magnitude.
+ */
+class GainSurface {
+    public:
+        // A surface for sweeps of numPoints, with a node every freqStep points
+        GainSurface(int numPoints, int freqStep);
+
+        // Forget all references
+        void clear(void);
+
+        // Add a reference sweep of a known resistance
+        bool addReference(double ohms, const int real[], const int imag[]);
+
+        // Gain factor for a magnitude measured at a sweep point
+        double getGain(int point, double magnitude);
+
+        // Number of references, and whether there are enough to interpolate
+        int getReferenceCount(void) { return numRefs; }
+        bool isReady(void) { return numRefs >= 2; }
+
+    private:
+        void nodeAt(int point, int ref, float *magnitude, float *gain);
+
+        int numPoints;
+        int freqStep;
+        int numFreqs;
+        int numRefs;
+
+        // Nodes, ordered by increasing magnitude (decreasing resistance)
+        float magnitudes[SURFACE_MAX_REFS][SURFACE_MAX_FREQS];
+        float gains[SURFACE_MAX_REFS][SURFACE_MAX_FREQS];
+};
+
+#endif
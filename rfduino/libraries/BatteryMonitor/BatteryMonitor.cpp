@@ -0,0 +1,142 @@
+/**
+ * @file BatteryMonitor.cpp
+ * @brief Battery monitor
+ *
+ * Samples the supply voltage without blocking on the ADC, smooths it and
+ * maps it to a battery level with a discharge curve.
+ *
+ * @author Michael Meli
+ */
+
+#include "BatteryMonitor.h"
+
+/**
+ * Create a monitor with no samples.
+ *
+ * @param adc ADC to read the supply with
+ * @param curve Discharge curve, ordered by decreasing voltage
+ * @param points Number of points in the curve, at least one
+ * @param settleMs Time the ADC needs after switching to the supply
+ */
+BatteryMonitor::BatteryMonitor(BatteryAdc *adc, const BatteryPoint curve[],
+                               byte points, unsigned long settleMs) {
+    this->adc = adc;
+    this->curve = curve;
+    this->points = points;
+    this->settleMs = settleMs;
+    pending = false;
+    started = 0;
+    average = 0;
+    reportedMv = 0;
+    percent = 0;
+    samples = 0;
+}
+
+/**
+ * Switch the ADC to the supply. The sample is taken by poll once the ADC
+ * has settled. Does nothing if a sample is already pending.
+ *
+ * @param now Current time in ms
+ */
+void BatteryMonitor::start(unsigned long now) {
+    if (pending)
+        return;
+    adc->selectSupply();
+    pending = true;
+    started = now;
+}
+
+/**
+ * Take the pending sample if the ADC has settled, then switch the ADC back
+ * to the analog inputs.
+ *
+ * @param now Current time in ms
+ * @return Whether a sample was taken
+ */
+bool BatteryMonitor::poll(unsigned long now) {
+    if (!pending || now - started < settleMs)
+        return false;
+    int counts = adc->read();
+    adc->selectInputs();
+    pending = false;
+    addReading(countsToMillivolts(counts));
+    return true;
+}
+
+/**
+ * @param now Current time in ms
+ * @return Time in ms until poll takes the sample: 0 if now, BATT_IDLE if
+ *         no sample is pending
+ */
+unsigned long BatteryMonitor::getPollDelay(unsigned long now) {
+    if (!pending)
+        return BATT_IDLE;
+    unsigned long elapsed = now - started;
+    return elapsed >= settleMs ? 0 : settleMs - elapsed;
+}
+
+/**
+ * Add a supply reading to the average, and move the reported level if the
+ * average has moved far enough. The first reading is taken as it is.
+ *
+ * @param millivolts Supply voltage
+ */
+void BatteryMonitor::addReading(unsigned int millivolts) {
+    unsigned long sample = (unsigned long)millivolts << BATT_EMA_FRACTION;
+    if (samples == 0) {
+        average = sample;
+    } else if (sample > average) {
+        average += (sample - average) >> BATT_EMA_SHIFT;
+    } else {
+        average -= (average - sample) >> BATT_EMA_SHIFT;
+    }
+    samples++;
+
+    unsigned int mv = getMillivolts();
+    unsigned int moved = mv > reportedMv ? mv - reportedMv : reportedMv - mv;
+    if (samples == 1 || moved > BATT_HYSTERESIS_MV) {
+        reportedMv = mv;
+        percent = percentFor(mv);
+    }
+}
+
+/**
+ * @return Smoothed supply voltage in mV, rounded
+ */
+unsigned int BatteryMonitor::getMillivolts() {
+    return (average + (1 << (BATT_EMA_FRACTION - 1))) >> BATT_EMA_FRACTION;
+}
+
+/**
+ * Look up the level for a supply voltage, interpolating between the points
+ * of the discharge curve. Voltages beyond the curve take its end values.
+ *
+ * @param millivolts Supply voltage
+ * @return Level in percent
+ */
+byte BatteryMonitor::percentFor(unsigned int millivolts) {
+    if (millivolts >= curve[0].millivolts)
+        return curve[0].percent;
+    for (byte i = 1; i < points; i++) {
+        const BatteryPoint *hi = &curve[i - 1];
+        const BatteryPoint *lo = &curve[i];
+        if (millivolts >= lo->millivolts) {
+            unsigned int span = hi->millivolts - lo->millivolts;
+            unsigned int above = millivolts - lo->millivolts;
+            return lo->percent +
+                   ((hi->percent - lo->percent) * above + span / 2) / span;
+        }
+    }
+    return curve[points - 1].percent;
+}
+
+/**
+ * @param counts ADC reading of the supply, 0 to BATT_ADC_MAX
+ * @return Supply voltage in mV, rounded
+ */
+unsigned int BatteryMonitor::countsToMillivolts(int counts) {
+    if (counts < 0)
+        counts = 0;
+    return ((unsigned long)counts * BATT_FULL_SCALE_MV + BATT_ADC_MAX / 2) /
+           BATT_ADC_MAX;
+}
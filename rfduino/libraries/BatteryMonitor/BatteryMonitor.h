@@ -0,0 +1,109 @@
+#ifndef BatteryMonitor_h
+#define BatteryMonitor_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+
+/**
+ * Constants
+ *  Constants for use with the BatteryMonitor library class.
+ */
+// Full scale of the supply reading, in mV: the ADC compares VDD/3 with the
+// 1.2 V band gap, so a reading of BATT_ADC_MAX is 3.6 V
+#define BATT_FULL_SCALE_MV  (3600)
+#define BATT_ADC_MAX        (1023)
+// Smoothing: each sample moves the average 1/2^BATT_EMA_SHIFT of the way
+#define BATT_EMA_SHIFT      (2)
+// Fraction bits kept in the average
+#define BATT_EMA_FRACTION   (4)
+// How far the average must move, in mV, before the reported level follows
+#define BATT_HYSTERESIS_MV  (15)
+// Returned by getPollDelay when no sample is pending
+#define BATT_IDLE           (0xFFFFFFFFUL)
+
+/**
+ * A point on the discharge curve
+ */
+struct BatteryPoint {
+    uint16_t millivolts;
+    byte percent;
+};
+
+/**
+ * Supply voltage ADC
+ *  Switches the ADC between the supply and the analog inputs, and reads it.
+ *  A reading taken too soon after switching to the supply is off, which is
+ *  why BatteryMonitor waits for it to settle.
+ */
+class BatteryAdc {
+    public:
+        virtual ~BatteryAdc() {}
+
+        // Measure the supply, or go back to the analog inputs
+        virtual void selectSupply(void) = 0;
+        virtual void selectInputs(void) = 0;
+
+        // Read the selected source, 0 to BATT_ADC_MAX
+        virtual int read(void) = 0;
+};
+
+/**
+ * Battery monitor
+ *  Takes a supply sample without waiting for the ADC: start switches the
+ *  ADC to the supply, and poll, called whenever the loop is awake anyway,
+ *  takes the sample once it has settled and switches straight back.
+ *  Samples are smoothed with an integer moving average and mapped to a
+ *  percentage through a discharge curve. The reported level only moves
+ *  when the average has moved by more than BATT_HYSTERESIS_MV, so it does
+ *  not flicker between neighbouring values.
+ */
+class BatteryMonitor {
+    public:
+        // Points ordered by decreasing voltage, kept by reference; settleMs
+        // is how long the ADC needs after switching to the supply
+        BatteryMonitor(BatteryAdc *adc, const BatteryPoint curve[],
+                       byte points, unsigned long settleMs);
+
+        // Switch to the supply and start waiting for it to settle
+        void start(unsigned long now);
+
+        // Take the sample if it is due. Returns whether one was taken.
+        bool poll(unsigned long now);
+
+        // Time in ms until poll takes the sample: 0 if now, BATT_IDLE if no
+        // sample is pending
+        unsigned long getPollDelay(unsigned long now);
+
+        // Add a supply reading in mV, as poll does
+        void addReading(unsigned int millivolts);
+
+        // Smoothed supply and the reported level
+        unsigned int getMillivolts(void);
+        byte getPercent(void) { return percent; }
+        bool isReady(void) { return samples > 0; }
+        unsigned long getSampleCount(void) { return samples; }
+
+        // Level for a supply voltage, from the discharge curve
+        byte percentFor(unsigned int millivolts);
+
+        // Supply voltage for a reading
+        static unsigned int countsToMillivolts(int counts);
+
+    private:
+        BatteryAdc *adc;
+        const BatteryPoint *curve;
+        byte points;
+        unsigned long settleMs;
+
+        bool pending;
+        unsigned long started;
+
+        unsigned long average;      // mV << BATT_EMA_FRACTION
+        unsigned int reportedMv;    // average when the level last moved
+        byte percent;
+        unsigned long samples;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef RFduinoBatteryAdc_h
+#define RFduinoBatteryAdc_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "BatteryMonitor.h"
+
+/**
+ * RFduino supply measurement
+ *  Compares VDD/3 with the 1.2 V band gap. The analog inputs are left with
+ *  the default reference and 1/3 prescaling.
+ */
+class RFduinoBatteryAdc : public BatteryAdc {
+    public:
+        void selectSupply(void) {
+            analogReference(VBG);
+            analogSelection(VDD_1_3_PS);
+        }
+        void selectInputs(void) {
+            analogReference(DEFAULT);
+            analogSelection(AIN_1_3_PS);
+        }
+        int read(void) {
+            return analogRead(1);   // pin has no meaning when reading VDD
+        }
+};
+
+#endif
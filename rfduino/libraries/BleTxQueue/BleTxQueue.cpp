@@ -0,0 +1,226 @@
+/**
+ * @file BleTxQueue.cpp
+ * @brief Credit-based BLE transmit queue
+ *
+ * Paces notifications to what the link accepts, retrying refused ones, in
+ * place of fixed delays between sends.
+ *
+ * @author Michael Meli
+ */
+
+#include "BleTxQueue.h"
+#include <string.h>
+
+/**
+ * Create an empty queue sending through a link.
+ *
+ * @param link Link to send through
+ */
+BleTxQueue::BleTxQueue(BleLink *link) {
+    this->link = link;
+    head = 0;
+    tail = 0;
+    gap = TXQ_START_GAP;
+    credits = TXQ_MAX_CREDITS;
+    streak = 0;
+    lastCredit = 0;
+    sent = 0;
+    retries = 0;
+    dropped = 0;
+}
+
+/**
+ * Earn the credits due since the last one.
+ *
+ * @param now Current time
+ */
+void BleTxQueue::refill(unsigned long now) {
+    unsigned long earned = (now - lastCredit) / gap;
+    if (earned == 0)
+        return;
+    if (credits + earned >= TXQ_MAX_CREDITS) {
+        credits = TXQ_MAX_CREDITS;
+        lastCredit = now;
+    } else {
+        credits += earned;
+        lastCredit += earned * gap;
+    }
+}
+
+/**
+ * Queue a notification, then send what the credits allow. If the queue is
+ * full, this waits for room.
+ *
+ * @param data Notification payload
+ * @param len Payload length, at most TXQ_MAX_PAYLOAD
+ * @return Success, or failure if the payload is too long or no room came
+ *         free within TXQ_MAX_GAP * TXQ_SLOTS ms
+ */
+bool BleTxQueue::send(const void *data, int len) {
+    if (len < 0 || len > TXQ_MAX_PAYLOAD) {
+        dropped++;
+        return false;
+    }
+
+    char *slot = reserve();
+    if (!slot)
+        return false;
+    memcpy(slot, data, len);
+    return commit(len);
+}
+
+/**
+ * Get the next free slot, to build a notification in place rather than
+ * copy it in. If the queue is full, this waits for room. The slot is only
+ * queued by commit.
+ *
+ * @return The slot, TXQ_MAX_PAYLOAD bytes, or NULL if no room came free
+ *         within TXQ_MAX_GAP * TXQ_SLOTS ms
+ */
+char *BleTxQueue::reserve() {
+    unsigned long start = link->now();
+    while (getCount() >= TXQ_SLOTS) {
+        if (pump() == 0) {
+            if (link->now() - start > (unsigned long)TXQ_MAX_GAP * TXQ_SLOTS) {
+                dropped++;
+                return NULL;
+            }
+            unsigned long wait = getSendDelay();
+            link->sleep(wait > 0 ? wait : 1);
+        }
+    }
+    return data[head & (TXQ_SLOTS - 1)];
+}
+
+/**
+ * Queue a notification if there is room now, then send what the credits
+ * allow.
+ *
+ * @param data Notification payload
+ * @param len Payload length, at most TXQ_MAX_PAYLOAD
+ * @return Success, or failure if the payload is too long or the queue is
+ *         full
+ */
+bool BleTxQueue::trySend(const void *data, int len) {
+    char *slot = len >= 0 && len <= TXQ_MAX_PAYLOAD ? tryReserve() : NULL;
+    if (!slot) {
+        dropped++;
+        return false;
+    }
+    memcpy(slot, data, len);
+    return commit(len);
+}
+
+/**
+ * Get the next free slot if there is one now, sending what the credits
+ * allow to make room. The slot is only queued by commit.
+ *
+ * @return The slot, TXQ_MAX_PAYLOAD bytes, or NULL if the queue is full
+ */
+char *BleTxQueue::tryReserve() {
+    if (getCount() >= TXQ_SLOTS)
+        pump();
+    if (getCount() >= TXQ_SLOTS)
+        return NULL;
+    return data[head & (TXQ_SLOTS - 1)];
+}
+
+/**
+ * Queue the notification built in the slot from reserve, then send what the
+ * credits allow.
+ *
+ * @param len Payload length, at most TXQ_MAX_PAYLOAD
+ * @return Success, or failure if the payload is too long or there is no
+ *         reserved slot
+ */
+bool BleTxQueue::commit(int len) {
+    if (len < 0 || len > TXQ_MAX_PAYLOAD || getCount() >= TXQ_SLOTS) {
+        dropped++;
+        return false;
+    }
+
+    length[head & (TXQ_SLOTS - 1)] = len;
+    head++;
+
+    pump();
+    return true;
+}
+
+/**
+ * Send queued notifications while there are credits. A refused send stays
+ * at the head of the queue, costs the remaining credits and doubles the gap.
+ *
+ * @return Number of notifications the link accepted
+ */
+int BleTxQueue::pump() {
+    refill(link->now());
+
+    int accepted = 0;
+    while (!isEmpty() && credits > 0) {
+        byte slot = tail & (TXQ_SLOTS - 1);
+        if (!link->send(data[slot], length[slot])) {
+            // The radio is full: back off and retry later
+            retries++;
+            streak = 0;
+            credits = 0;
+            gap = gap * 2 > TXQ_MAX_GAP ? TXQ_MAX_GAP : gap * 2;
+            lastCredit = link->now();
+            break;
+        }
+
+        tail++;
+        credits--;
+        accepted++;
+        sent++;
+
+        // A run of accepted sends: try a little faster
+        if (++streak >= TXQ_SPEEDUP) {
+            streak = 0;
+            if (gap > TXQ_MIN_GAP)
+                gap--;
+        }
+    }
+    return accepted;
+}
+
+/**
+ * Send everything queued, sleeping between credits.
+ *
+ * @param timeout Longest time to wait, in ms
+ * @return Whether the queue emptied in time
+ */
+bool BleTxQueue::flush(unsigned long timeout) {
+    unsigned long start = link->now();
+    while (!isEmpty()) {
+        if (pump() == 0) {
+            if (link->now() - start >= timeout)
+                return false;
+            unsigned long wait = getSendDelay();
+            link->sleep(wait > 0 ? wait : 1);
+        }
+    }
+    return true;
+}
+
+/**
+ * Drop everything queued.
+ */
+void BleTxQueue::clear() {
+    dropped += getCount();
+    tail = head;
+}
+
+/**
+ * @return Time in ms until pump can send again, 0 if it can now, or TXQ_IDLE
+ *         if nothing is queued
+ */
+unsigned long BleTxQueue::getSendDelay() {
+    if (isEmpty())
+        return TXQ_IDLE;
+    unsigned long now = link->now();
+    refill(now);
+    if (credits > 0)
+        return 0;
+    unsigned long elapsed = now - lastCredit;
+    return elapsed >= gap ? 0 : gap - elapsed;
+}
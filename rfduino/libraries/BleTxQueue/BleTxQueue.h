@@ -0,0 +1,118 @@
+#ifndef BleTxQueue_h
+#define BleTxQueue_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+
+/**
+ * Constants
+ *  Constants for use with the BleTxQueue library class. Times are in
+ *  milliseconds.
+ */
+// Largest notification payload
+#define TXQ_MAX_PAYLOAD     (20)
+// Notifications the queue holds. Must be a power of two, at most 128.
+#define TXQ_SLOTS           (16)
+// Most sends allowed back to back once credits have built up
+#define TXQ_MAX_CREDITS     (4)
+// Time between credits: starting value and limits
+#define TXQ_START_GAP       (5)
+#define TXQ_MIN_GAP         (1)
+#define TXQ_MAX_GAP         (200)
+// Consecutive accepted sends before the gap is shortened by 1 ms
+#define TXQ_SPEEDUP         (4)
+// Returned by getSendDelay when nothing is queued
+#define TXQ_IDLE            (0xFFFFFFFFUL)
+
+/**
+ * BLE link model
+ *  What the queue sends through: a radio that takes a notification or
+ *  refuses it while its buffers are full, and the clock the pacing runs on.
+ */
+class BleLink {
+    public:
+        virtual ~BleLink() {}
+
+        // Hand a notification to the radio. False if its buffers are full.
+        virtual bool send(const char *data, int len) = 0;
+
+        // Current time and a low power wait, in ms
+        virtual unsigned long now(void) = 0;
+        virtual void sleep(unsigned long ms) = 0;
+};
+
+/**
+ * Credit-based BLE transmit queue
+ *  Queues notifications and sends them as fast as the link takes them. A
+ *  credit is earned every gap ms, and each send spends one. Every run of
+ *  accepted sends shortens the gap; a send the radio refuses stays at the
+ *  head of the queue for a retry and doubles the gap. The pacing settles
+ *  near the link's actual capacity without a fixed delay per notification.
+ */
+class BleTxQueue {
+    public:
+        BleTxQueue(BleLink *link);
+
+        // Queue a notification. Waits for room if the queue is full.
+        bool send(const void *data, int len);
+
+        // Build a notification in place: reserve a slot (waiting for room if
+        // needed), write up to TXQ_MAX_PAYLOAD bytes into it, then commit
+        char *reserve(void);
+        bool commit(int len);
+
+        // As send and reserve, but fail at once if the queue is full rather
+        // than wait on the link. A failed trySend counts as a drop; a
+        // failed tryReserve does not, as the caller still has the message.
+        bool trySend(const void *data, int len);
+        char *tryReserve(void);
+
+        // Send what the credits allow, without waiting. Returns the number
+        // of notifications sent.
+        int pump(void);
+
+        // Send everything, waiting as needed. Fails on timeout.
+        bool flush(unsigned long timeout);
+
+        // Drop everything queued, e.g. after a disconnect
+        void clear(void);
+
+        // Time until the next send may be attempted: 0 if now, TXQ_IDLE if
+        // nothing is queued
+        unsigned long getSendDelay(void);
+
+        bool isEmpty(void) { return head == tail; }
+        byte getCount(void) { return head - tail; }
+
+        // Statistics
+        unsigned long getSentCount(void) { return sent; }
+        unsigned long getRetryCount(void) { return retries; }
+        unsigned long getDropCount(void) { return dropped; }
+        unsigned int getGap(void) { return gap; }
+
+    private:
+        void refill(unsigned long now);
+
+        BleLink *link;
+
+        // Queued notifications
+        char data[TXQ_SLOTS][TXQ_MAX_PAYLOAD];
+        byte length[TXQ_SLOTS];
+        byte head;
+        byte tail;
+
+        // Pacing
+        unsigned int gap;
+        byte credits;
+        byte streak;
+        unsigned long lastCredit;
+
+        // Statistics
+        unsigned long sent;
+        unsigned long retries;
+        unsigned long dropped;
+};
+
+#endif
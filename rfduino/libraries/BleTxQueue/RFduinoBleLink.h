@@ -0,0 +1,24 @@
+#ifndef RFduinoBleLink_h
+#define RFduinoBleLink_h
+
+/**
+ * Includes
+ */
+#include <RFduinoBLE.h>
+#include "BleTxQueue.h"
+
+/**
+ * RFduino BLE link
+ *  Sends through RFduinoBLE, which refuses a notification when the radio's
+ *  transmit buffers are full.
+ */
+class RFduinoBleLink : public BleLink {
+    public:
+        bool send(const char *data, int len) {
+            return RFduinoBLE.send(data, len);
+        }
+        unsigned long now(void) { return millis(); }
+        void sleep(unsigned long ms) { RFduino_ULPDelay(ms); }
+};
+
+#endif
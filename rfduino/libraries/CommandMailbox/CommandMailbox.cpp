@@ -0,0 +1,81 @@
+/**
+ * @file CommandMailbox.cpp
+ * @brief Lock-free command mailbox
+ *
+ * Hands commands from interrupt/callback context to the main loop without
+ * locking. The indices run freely and are masked on use, so full and empty
+ * can be told apart without wasting a slot.
+ *
+ * @author Michael Meli
+ */
+
+#include "CommandMailbox.h"
+
+// Keeps the compiler from moving memory accesses across this point. The
+// Cortex-M0 has a single core and does not reorder its own stores, so this is
+// all the ordering the producer/consumer hand-off needs there.
+#define MAILBOX_BARRIER()   __asm__ __volatile__("" ::: "memory")
+
+/**
+ * Create an empty mailbox.
+ */
+CommandMailbox::CommandMailbox() {
+    head = 0;
+    tail = 0;
+    dropped = 0;
+}
+
+/**
+ * Add a command. Only the producer may call this.
+ *
+ * @param command Command to add, anything but MAILBOX_EMPTY
+ * @return Success, or failure if the mailbox is full or the command invalid
+ */
+bool CommandMailbox::post(byte command) {
+    if (command == MAILBOX_EMPTY)
+        return false;
+
+    byte h = head;
+    if ((byte)(h - tail) >= MAILBOX_SIZE) {
+        dropped++;
+        return false;
+    }
+
+    // Write the entry, then publish it
+    buffer[h & (MAILBOX_SIZE - 1)] = command;
+    MAILBOX_BARRIER();
+    head = h + 1;
+    return true;
+}
+
+/**
+ * Take the oldest command. Only the consumer may call this.
+ *
+ * @return The command, or MAILBOX_EMPTY if there is none
+ */
+byte CommandMailbox::take() {
+    byte t = tail;
+    if (t == head)
+        return MAILBOX_EMPTY;
+
+    // Read the entry, then release its slot
+    MAILBOX_BARRIER();
+    byte command = buffer[t & (MAILBOX_SIZE - 1)];
+    MAILBOX_BARRIER();
+    tail = t + 1;
+    return command;
+}
+
+/**
+ * @return Whether there are no commands waiting
+ */
+bool CommandMailbox::isEmpty() {
+    return head == tail;
+}
+
+/**
+ * @return Number of commands waiting
+ */
+byte CommandMailbox::getCount() {
+    return head - tail;
+}
@@ -0,0 +1,50 @@
+#ifndef CommandMailbox_h
+#define CommandMailbox_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+
+/**
+ * Constants
+ *  Constants for use with the CommandMailbox library class.
+ */
+// Number of commands the mailbox holds. Must be a power of two, at most 128.
+#define MAILBOX_SIZE    (16)
+// Returned by take when the mailbox is empty; never a valid command
+#define MAILBOX_EMPTY   (0x00)
+
+/**
+ * Command mailbox
+ *  A lock-free single-producer/single-consumer ring of command bytes. The
+ *  producer (e.g. a BLE callback) only calls post, the consumer (loop) only
+ *  calls take, and neither ever blocks or disables interrupts. Each index is
+ *  written by one side only, and an entry is published by moving the index
+ *  after the entry is written.
+ */
+class CommandMailbox {
+    public:
+        CommandMailbox();
+
+        // Producer side: add a command. Fails, and counts a drop, if full.
+        bool post(byte command);
+
+        // Consumer side: take the oldest command, or MAILBOX_EMPTY
+        byte take(void);
+
+        // Either side
+        bool isEmpty(void);
+        byte getCount(void);
+
+        // Commands dropped because the mailbox was full
+        unsigned int getDropCount(void) { return dropped; }
+
+    private:
+        volatile byte buffer[MAILBOX_SIZE];
+        volatile byte head;     // next slot to write, producer only
+        volatile byte tail;     // next slot to read, consumer only
+        volatile unsigned int dropped;
+};
+
+#endif
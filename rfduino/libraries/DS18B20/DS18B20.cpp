@@ -17,15 +17,78 @@
  * @return The average temperature in Fahrenheit of all devices, or 0 if fail.
  */
 float DS18B20::getTemperature(OneWire ds) {
+    long rawSum = 0;    // sum of the raw readings of all devices
+
+    // Read every device on the bus. If we didn't catch any devices, return 0.0
+    byte deviceCount = readRawTemperatures(ds, &rawSum);
+    if (deviceCount == 0)
+        return 0.0;
+
+    // Convert the average raw reading (16 bit signed integer) to a float
+    float temp_celsius = ((float)rawSum/deviceCount)/16.0;
+
+    // Convert temperature to Fahrenheit and return it
+    return temp_celsius * 1.8 + 32.0;
+}
+
+/**
+ * Get the raw temperature from the DS18B20 without any floating point math.
+ * The value is in the sensor's native units of 1/16 degree Celsius.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param raw Pointer to where the average raw temperature of all devices
+ *        should be stored.
+ * @return Success or failure
+ */
+bool DS18B20::getTemperatureRaw(OneWire ds, int16_t *raw) {
+    long rawSum = 0;    // sum of the raw readings of all devices
+
+    // Read every device on the bus
+    byte deviceCount = readRawTemperatures(ds, &rawSum);
+    if (deviceCount == 0)
+        return false;
+
+    // Compute the rounded average
+    if (rawSum >= 0)
+        *raw = (rawSum + deviceCount/2) / deviceCount;
+    else
+        *raw = (rawSum - deviceCount/2) / deviceCount;
+    return true;
+}
+
+/**
+ * Convert a raw temperature (1/16 degree Celsius) to hundredths of a degree
+ * Fahrenheit using only integer math.
+ * MATH: F = C * 9/5 + 32 and C = raw/16, so 100F = raw * 45/4 + 3200.
+ *
+ * @param raw Temperature in 1/16 degree Celsius
+ * @return Temperature in 1/100 degree Fahrenheit, rounded to nearest
+ */
+long DS18B20::rawToCentiFahrenheit(int16_t raw) {
+    long scaled = (long)raw * 45;
+    if (scaled >= 0)
+        return (scaled + 2) / 4 + 3200;
+    else
+        return (scaled - 2) / 4 + 3200;
+}
+
+/**
+ * Start a conversion and read the scratchpad of every DS18B20 on the bus.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param rawSum Pointer to where the sum of the raw readings should be stored.
+ * @return The number of devices read, or 0 if fail.
+ */
+byte DS18B20::readRawTemperatures(OneWire &ds, long *rawSum) {
     byte data[12];  // data buffer
     byte addr[8];   // address buffer
     byte deviceCount = 0;   // number of devices taken care of
-    float avgTemp = 0.0;    // the average temperature to be returned
 
     // Search for a new device on the bus. If 1, a new device is available. If 0,
     // the bus may be in error, nothing may be connected, or all devices have been
     // read. This should allow for multiple sensors on the same bus (must remove
     // else block). The address of the next device will be stored in addr.
+    *rawSum = 0;
     ds.reset_search();
     while (ds.search(addr)) {
         // Count this device
@@ -34,14 +97,14 @@ float DS18B20::getTemperature(OneWire ds) {
         // Verify the CRC of the address
         if ( OneWire::crc8( addr, 7) != addr[7]) {
             //Serial.println("CRC is not valid!");
-            return 0.0;
+            return 0;
         }
 
         // Verify the device is recognized by looking at the device ID in the
         // first byte of the address (=0x28).
         if (addr[0] != DS18B20_CODE) {
             //Serial.println("Device not recognized!");
-            return 0.0;
+            return 0;
         }
 
         // Begin a temperature conversion
@@ -64,35 +127,32 @@ float DS18B20::getTemperature(OneWire ds) {
             data[i] = ds.read();
         }
 
-        // Convert read data (16 bit signed integer) to a float
-        int16_t temp_raw = (data[1] << 8) | data[0];
-        float temp_celsius = (float)temp_raw/16.0;
-
-        // Convert temperature to Fahrenheit and add it to our running average
-        float temp_fahrenheit = temp_celsius * 1.8 + 32.0;
-        avgTemp += temp_fahrenheit;
+        // Add the raw reading (16 bit signed integer) to our running sum
+        *rawSum += scratchpadTemperature(data);
     }
 
-    // If we didn't catch any devices, return 0.0
-    if (deviceCount == 0)
-        return 0.0;
-
-    // Compute and return the average
-    avgTemp /= deviceCount;
-    return avgTemp;
+    return deviceCount;
 }
 
 /**
  * Set the temperature resolution. While this speeds up conversion, it also
- * reduces accuracy.
+ * reduces accuracy. The configuration register of each device is read first
+ * and devices that already have the resolution are left alone, so calling
+ * this at every boot costs only a scratchpad read per device (and an EEPROM
+ * recall when persisting).
  *
  * @param ds OneWire instance configured for communication with the DS18B20.
  * @param res One of the resolution constants to set the appropriate resolution.
- * @return Success or failure
+ * @param persist Also copy the setting to the device EEPROM so that it
+ *        survives a power cycle.
+ * @return Success or failure. A device whose scratchpad can't be read is
+ *         left alone and counts as a failure.
  */
-bool DS18B20::setResolution(OneWire ds, byte res) {
+bool DS18B20::setResolution(OneWire ds, byte res, bool persist) {
     byte addr[8];           // address buffer
+    byte data[9];           // scratchpad buffer
     int deviceCount = 0;    // track number of devices serviced
+    bool ok = true;         // every device read and set
 
     // Make sure the resolution byte sent in is valid.
     if (res != RES_9BIT && res != RES_10BIT && res != RES_11BIT && res != RES_12BIT)
@@ -115,21 +175,233 @@ bool DS18B20::setResolution(OneWire ds, byte res) {
             return false;
         }
 
+        // Read the current configuration, trying once more if the CRC fails.
+        // The alarm bytes have to be written back along with the resolution,
+        // so without a good read the device is left alone rather than have
+        // its alarms replaced by a guess.
+        if (!readScratchpad(ds, addr, data) && !readScratchpad(ds, addr, data)) {
+            ok = false;
+            continue;
+        }
+
+        // If the resolution already matches, there is nothing to do. A write
+        // without persist since power up can leave the EEPROM behind the
+        // scratchpad though, so when persisting check the EEPROM copy too.
+        if (data[SPAD_CONFIG] == res &&
+            (!persist || eepromHasConfig(ds, addr, data)))
+            continue;
+
         // Write to the scratchpad register. See pg. 11 of datasheet. This
         // requires sending the write command and then 3 bytes. The first two
-        // set alarms...these are not used. The third is the resolution.
-        ds.reset();
-        ds.select(addr);
-        ds.write(CMD_WRITE_SPAD); // 0x4E = write scratchpad
-        ds.write(ALARM_DISABLED); // alarm low setting = 0 (not used)
-        ds.write(ALARM_DISABLED); // alarm high setting = 0 (not used)
-        ds.write(res);            // resolution
+        // are the alarms, which are written back unchanged. The third is the
+        // resolution.
+        writeScratchpad(ds, addr, data[SPAD_ALARM_HIGH], data[SPAD_ALARM_LOW], res);
+
+        // Copy the scratchpad to EEPROM if requested
+        if (persist)
+            copyScratchpad(ds, addr);
     }
 
     // If we didn't catch any devices, return false
     if (deviceCount == 0)
         return false;
-    // If we did, return true
+    // If we did, return whether they were all set
     else
-        return true;
+        return ok;
+}
+
+/**
+ * Set the alarm thresholds (TH and TL) of every device. A device flags an
+ * alarm after a conversion if the whole degrees of the temperature are at or
+ * above TH, or at or below TL. Devices that already have the thresholds are
+ * left alone.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param high Alarm high threshold in degrees Celsius
+ * @param low Alarm low threshold in degrees Celsius
+ * @param persist Also copy the setting to the device EEPROM so that it
+ *        survives a power cycle.
+ * @return Success or failure
+ */
+bool DS18B20::setAlarms(OneWire ds, int8_t high, int8_t low, bool persist) {
+    byte addr[8];           // address buffer
+    byte data[9];           // scratchpad buffer
+    int deviceCount = 0;    // track number of devices serviced
+
+    // Do this while devices are available
+    ds.reset_search();
+    while (ds.search(addr)) {
+        // Count this device
+        deviceCount++;
+
+        // Verify the CRC and family of the address
+        if (OneWire::crc8(addr, 7) != addr[7] || addr[0] != DS18B20_CODE)
+            return false;
+
+        // The configuration byte must be written along with the alarms, so
+        // the scratchpad has to be valid
+        if (!readScratchpad(ds, addr, data))
+            return false;
+        if ((int8_t)data[SPAD_ALARM_HIGH] == high &&
+            (int8_t)data[SPAD_ALARM_LOW] == low)
+            continue;
+
+        writeScratchpad(ds, addr, high, low, data[SPAD_CONFIG]);
+        if (persist)
+            copyScratchpad(ds, addr);
+    }
+
+    return deviceCount > 0;
+}
+
+/**
+ * Start a temperature conversion on every device at once (skip ROM). Alarm
+ * flags are updated when the conversion completes.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @return True if any device is present
+ */
+bool DS18B20::startConversion(OneWire ds) {
+    if (!ds.reset())
+        return false;
+    ds.skip();
+    ds.write(CMD_CONVERT_TEMP);   // 0x44 = start conversion
+    return true;
+}
+
+/**
+ * Find the devices in an alarm condition with a conditional search and read
+ * only those. When nothing is out of range this is one reset and a couple of
+ * bit slots on the bus.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param raw Pointer to where the raw temperature of the alarmed device
+ *        furthest outside its thresholds should be stored, whether above TH
+ *        or below TL.
+ * @return The number of devices in an alarm condition
+ */
+byte DS18B20::getAlarmTemperatureRaw(OneWire ds, int16_t *raw) {
+    byte addr[8];   // address buffer
+    byte data[9];   // scratchpad buffer
+    byte alarmCount = 0;
+    int worst = 0;  // how far the stored reading is outside its thresholds
+
+    ds.reset_search();
+    while (ds.search(addr, false)) {
+        // Skip anything garbled or not a thermometer
+        if (OneWire::crc8(addr, 7) != addr[7] || addr[0] != DS18B20_CODE)
+            continue;
+        if (!readScratchpad(ds, addr, data))
+            continue;
+
+        // Distance past TH or below TL, in raw units (thresholds are whole
+        // degrees, 16 raw units each)
+        int16_t temp_raw = scratchpadTemperature(data);
+        int above = temp_raw - (int8_t)data[SPAD_ALARM_HIGH] * 16;
+        int below = (int8_t)data[SPAD_ALARM_LOW] * 16 - temp_raw;
+        int outside = above > below ? above : below;
+        if (alarmCount == 0 || outside > worst) {
+            *raw = temp_raw;
+            worst = outside;
+        }
+        alarmCount++;
+    }
+
+    return alarmCount;
+}
+
+/**
+ * The raw temperature in a scratchpad. Below 12 bit resolution the low bits
+ * are undefined (p6 datasheet), so they are cleared.
+ *
+ * @param data Scratchpad contents.
+ * @return Raw temperature, 1/16 degree Celsius per unit.
+ */
+int16_t DS18B20::scratchpadTemperature(const byte data[9]) {
+    int16_t raw = (data[SPAD_TEMP_MSB] << 8) | data[SPAD_TEMP_LSB];
+    byte bits = (data[SPAD_CONFIG] >> 5) & 0x03;
+    return raw & ~((1 << (3 - bits)) - 1);
+}
+
+/**
+ * Read the scratchpad of one device.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param addr Address of the device.
+ * @param data Buffer of 9 bytes for the scratchpad contents.
+ * @return True if the scratchpad CRC is valid.
+ */
+bool DS18B20::readScratchpad(OneWire &ds, const byte addr[8], byte data[9]) {
+    ds.reset();
+    ds.select(addr);
+    ds.write(CMD_READ_SPAD);   // 0xBE = read scratchpad
+    ds.read_bytes(data, 9);
+    return OneWire::crc8(data, 8) == data[8];
+}
+
+/**
+ * Check whether one device's EEPROM holds the configuration byte of its
+ * scratchpad. The EEPROM is recalled into the scratchpad to read it, so if
+ * the alarm bytes there differ, the scratchpad ones are written back.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param addr Address of the device.
+ * @param data The device's scratchpad, as just read.
+ * @return True if the EEPROM has the same configuration. False if it differs
+ *         or couldn't be read.
+ */
+bool DS18B20::eepromHasConfig(OneWire &ds, const byte addr[8],
+                              const byte data[9]) {
+    byte e2[9];     // scratchpad after the recall
+
+    // Recall E2 and wait for it: read slots return 0 until it is done
+    ds.reset();
+    ds.select(addr);
+    ds.write(CMD_RECALL_E2);    // 0xB8 = recall EEPROM
+    for (int i = 0; i < RECALL_E2_POLLS && !ds.read_bit(); i++)
+        ;
+    if (!readScratchpad(ds, addr, e2) || e2[SPAD_CONFIG] != data[SPAD_CONFIG])
+        return false;
+
+    // Put back alarms that were set without persisting
+    if (e2[SPAD_ALARM_HIGH] != data[SPAD_ALARM_HIGH] ||
+        e2[SPAD_ALARM_LOW] != data[SPAD_ALARM_LOW])
+        writeScratchpad(ds, addr, data[SPAD_ALARM_HIGH], data[SPAD_ALARM_LOW],
+                        data[SPAD_CONFIG]);
+    return true;
+}
+
+/**
+ * Write the alarm and configuration bytes of one device's scratchpad.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param addr Address of the device.
+ * @param high Alarm high setting (TH)
+ * @param low Alarm low setting (TL)
+ * @param config Configuration register (resolution)
+ */
+void DS18B20::writeScratchpad(OneWire &ds, const byte addr[8], byte high,
+                              byte low, byte config) {
+    ds.reset();
+    ds.select(addr);
+    ds.write(CMD_WRITE_SPAD); // 0x4E = write scratchpad
+    ds.write(high);           // alarm high setting
+    ds.write(low);            // alarm low setting
+    ds.write(config);         // resolution
+}
+
+/**
+ * Copy the scratchpad alarm and configuration bytes of one device to its
+ * EEPROM. A parasite powered device draws its write current from the bus, so
+ * the bus is held high (strong pull-up) for the whole copy before releasing.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @param addr Address of the device.
+ */
+void DS18B20::copyScratchpad(OneWire &ds, const byte addr[8]) {
+    ds.reset();
+    ds.select(addr);
+    ds.write(CMD_COPY_SPAD, 1);   // 0x48 = copy scratchpad, keep bus powered
+    delay(COPY_SPAD_DELAY);
+    ds.depower();
 }
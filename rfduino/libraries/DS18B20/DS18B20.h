@@ -23,6 +23,8 @@
  */
 // Device ROM Code
 #define DS18B20_CODE        (0x28)
+// Raw temperature outside the sensor range, used to mean "no reading"
+#define DS18B20_NO_READING  ((int16_t)0x8000)
 // Thermometer resolutions
 #define RES_9BIT            (0b00011111)
 #define RES_10BIT           (0b00111111)
@@ -30,6 +32,17 @@
 #define RES_12BIT           (0b01111111)
 // Alarm codes
 #define ALARM_DISABLED      (0x00)
+// Scratchpad layout
+#define SPAD_TEMP_LSB       (0)
+#define SPAD_TEMP_MSB       (1)
+#define SPAD_ALARM_HIGH     (2)
+#define SPAD_ALARM_LOW      (3)
+#define SPAD_CONFIG         (4)
+#define SPAD_CRC            (8)
+// Time for a copy scratchpad to EEPROM to complete (ms), p12 datasheet
+#define COPY_SPAD_DELAY     (10)
+// Read slots to wait for a recall EEPROM to complete
+#define RECALL_E2_POLLS     (100)
 
 /**
  * DS18B20 Library class
@@ -38,7 +51,22 @@
 class DS18B20 {
     public:
          static float getTemperature(OneWire);
-         static bool setResolution(OneWire, byte);
+         static bool getTemperatureRaw(OneWire, int16_t*);
+         static long rawToCentiFahrenheit(int16_t);
+         static bool setResolution(OneWire, byte, bool persist = false);
+         static bool setAlarms(OneWire, int8_t, int8_t, bool persist = false);
+         static bool startConversion(OneWire);
+         static byte getAlarmTemperatureRaw(OneWire, int16_t*);
+    private:
+         // Single device scratchpad access
+         static bool readScratchpad(OneWire&, const byte[8], byte[9]);
+         static void writeScratchpad(OneWire&, const byte[8], byte, byte, byte);
+         static void copyScratchpad(OneWire&, const byte[8]);
+         static bool eepromHasConfig(OneWire&, const byte[8], const byte[9]);
+         static int16_t scratchpadTemperature(const byte[9]);
+
+         // Convert and read every device, summing the raw readings
+         static byte readRawTemperatures(OneWire&, long*);
 };
 
 #endif
@@ -0,0 +1,115 @@
+/**
+ * @file DS18B20Adaptive.cpp
+ * @brief Adaptive resolution controller for DS18B20
+ *
+ * Picks the lowest DS18B20 resolution that keeps up with the temperature.
+ *
+ * @author Michael Meli
+ */
+
+#include "DS18B20Adaptive.h"
+
+// Resolutions from lowest to highest
+const byte DS18B20Adaptive::resolutions[4] = {
+    RES_9BIT, RES_10BIT, RES_11BIT, RES_12BIT
+};
+
+/**
+ * Get the index of a resolution constant. Bits 5 and 6 of the configuration
+ * register hold the resolution, 0 (9 bit) through 3 (12 bit).
+ *
+ * @param res One of the resolution constants
+ * @return Index into the resolutions table
+ */
+byte DS18B20Adaptive::indexOf(byte res) {
+    return (res >> 5) & 0x03;
+}
+
+/**
+ * Create a controller. The sensors are assumed to start at the maximum
+ * resolution, as set in setup().
+ *
+ * @param minRes Lowest resolution the controller may drop to
+ * @param maxRes Highest resolution, used whenever the temperature moves
+ */
+DS18B20Adaptive::DS18B20Adaptive(byte minRes, byte maxRes) {
+    minIndex = indexOf(minRes);
+    maxIndex = indexOf(maxRes);
+    desired = maxIndex;
+    applied = maxIndex;
+    count = 0;
+    head = 0;
+    stable = 0;
+    writes = 0;
+}
+
+/**
+ * Add a reading and decide on the resolution. The thresholds are never
+ * tighter than the quantization of the current resolution, otherwise a
+ * reading that sits on a step boundary would bounce the resolution.
+ *
+ * @param raw Temperature in raw sensor units (1/16 degree Celsius)
+ * @return The resolution that should be in effect
+ */
+byte DS18B20Adaptive::addReading(int16_t raw) {
+    // Store the reading, overwriting the oldest
+    window[head] = raw;
+    head = (head + 1) % ADAPTIVE_WINDOW;
+    if (count < ADAPTIVE_WINDOW)
+        count++;
+
+    // Trend: change from the oldest to the newest reading
+    byte oldest = (count < ADAPTIVE_WINDOW) ? 0 : head;
+    int trend = raw - window[oldest];
+    if (trend < 0)
+        trend = -trend;
+
+    // Variance: mean absolute deviation from the mean (integer math only)
+    long sum = 0;
+    for (byte i = 0; i < count; i++)
+        sum += window[i];
+    long mean = sum / count;
+    long deviation = 0;
+    for (byte i = 0; i < count; i++)
+        deviation += (window[i] > mean) ? window[i] - mean : mean - window[i];
+    int spread = deviation / count;
+
+    // One step at the current resolution, in raw units (8 at 9 bit, 1 at 12)
+    int quantum = 1 << (3 - desired);
+    int trendLimit = ADAPTIVE_RAISE_TREND > quantum ? ADAPTIVE_RAISE_TREND : quantum;
+    int spreadLimit = ADAPTIVE_RAISE_SPREAD > quantum/2 ? ADAPTIVE_RAISE_SPREAD : quantum/2;
+
+    if (trend > trendLimit || spread > spreadLimit) {
+        // The temperature is moving: go straight back to full resolution
+        desired = maxIndex;
+        stable = 0;
+    } else if (trend <= trendLimit/2 && spread <= spreadLimit/2) {
+        // Stable: after enough stable readings, drop one step
+        if (++stable >= ADAPTIVE_STABLE_COUNT && desired > minIndex) {
+            desired--;
+            stable = 0;
+        }
+    } else {
+        stable = 0;
+    }
+
+    return resolutions[desired];
+}
+
+/**
+ * Write the desired resolution to the sensors, but only if it differs from
+ * what was last written. Most calls do no bus traffic at all.
+ *
+ * @param ds OneWire instance configured for communication with the DS18B20.
+ * @return Success or failure
+ */
+bool DS18B20Adaptive::apply(OneWire ds) {
+    if (desired == applied)
+        return true;
+
+    if (!DS18B20::setResolution(ds, resolutions[desired]))
+        return false;
+    applied = desired;
+    writes++;
+    return true;
+}
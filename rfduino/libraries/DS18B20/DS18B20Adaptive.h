@@ -0,0 +1,62 @@
+#ifndef DS18B20Adaptive_h
+#define DS18B20Adaptive_h
+
+/**
+ * Includes
+ */
+#include <OneWire.h>
+#include "DS18B20.h"
+
+/**
+ * Constants
+ *  Constants for use with the adaptive resolution controller. All
+ *  temperatures are in raw sensor units (1/16 degree Celsius).
+ */
+// Number of readings the trend and variance are computed over
+#define ADAPTIVE_WINDOW         (8)
+// Raise resolution when the change across the window exceeds this...
+#define ADAPTIVE_RAISE_TREND    (4)     // 0.25 C
+// ...or the mean absolute deviation from the window mean exceeds this
+#define ADAPTIVE_RAISE_SPREAD   (2)     // 0.125 C
+// Consecutive stable readings before dropping one step of resolution
+#define ADAPTIVE_STABLE_COUNT   (10)
+
+/**
+ * DS18B20 adaptive resolution controller
+ *  Drops the thermometer resolution while readings are stable and raises it
+ *  back to full resolution when the temperature starts to move. A 9 bit
+ *  conversion takes 94 ms versus 750 ms at 12 bit, so a flat skin
+ *  temperature costs an eighth of the conversion energy and bus time.
+ */
+class DS18B20Adaptive {
+    public:
+        DS18B20Adaptive(byte minRes = RES_9BIT, byte maxRes = RES_12BIT);
+
+        // Add a raw reading. Returns the resolution that should be in effect.
+        byte addReading(int16_t raw);
+
+        // Write the resolution to the sensors, only if it changed
+        bool apply(OneWire ds);
+
+        // Resolution currently programmed into the sensors
+        byte getResolution(void) { return resolutions[applied]; }
+
+        // Number of times the config register has been written
+        unsigned int getWriteCount(void) { return writes; }
+
+    private:
+        static const byte resolutions[4];
+        static byte indexOf(byte res);
+
+        int16_t window[ADAPTIVE_WINDOW];
+        byte count;         // readings in the window
+        byte head;          // position of the next reading
+        byte stable;        // consecutive stable readings
+        byte minIndex;
+        byte maxIndex;
+        byte desired;       // resolution index the readings call for
+        byte applied;       // resolution index written to the sensors
+        unsigned int writes;
+};
+
+#endif
@@ -0,0 +1,269 @@
+/**
+ * @file DeadlineScheduler.cpp
+ * @brief Cooperative deadline scheduler
+ *
+ * Runs periodic tasks at fixed deadlines and tells the caller how long it can
+ * sleep until the next one.
+ *
+ * @author Michael Meli
+ */
+
+#include "DeadlineScheduler.h"
+
+/**
+ * Create an empty scheduler.
+ */
+DeadlineScheduler::DeadlineScheduler() {
+    numTasks = 0;
+}
+
+/**
+ * Whether a deadline has arrived. Works across the millis() rollover as long
+ * as deadlines are less than ~24 days away.
+ *
+ * @param deadline Deadline in millis() time
+ * @param now Current millis() time
+ * @return Whether the deadline is now or in the past
+ */
+bool DeadlineScheduler::due(unsigned long deadline, unsigned long now) {
+    return (long)(now - deadline) >= 0;
+}
+
+/**
+ * Check a task id.
+ *
+ * @param id Task id from addTask
+ * @return Whether the id refers to a task
+ */
+bool DeadlineScheduler::valid(int id) {
+    return id >= 0 && id < numTasks;
+}
+
+/**
+ * Add a periodic task.
+ *
+ * @param task Function to run
+ * @param period Time between deadlines, at least 1 ms
+ * @param delay Time from now until the first deadline
+ * @return The task id, or SCHED_INVALID_TASK if the scheduler is full
+ */
+int DeadlineScheduler::addTask(SchedulerTask task, unsigned long period,
+                               unsigned long delay) {
+    if (numTasks >= SCHED_MAX_TASKS || task == NULL)
+        return SCHED_INVALID_TASK;
+
+    Task *t = &tasks[numTasks];
+    t->task = task;
+    t->period = period > 0 ? period : 1;
+    t->deadline = millis() + delay;
+    t->enabled = true;
+    t->runs = 0;
+    t->late = 0;
+    t->missed = 0;
+    t->maxLateness = 0;
+    t->lastLateness = 0;
+    t->minRunTime = 0;
+    t->maxRunTime = 0;
+    t->totalRunTime = 0;
+    return numTasks++;
+}
+
+/**
+ * Change the period of a task. The next deadline is unchanged.
+ *
+ * @param id Task id
+ * @param period Time between deadlines, at least 1 ms
+ * @return Success or failure
+ */
+bool DeadlineScheduler::setPeriod(int id, unsigned long period) {
+    if (!valid(id))
+        return false;
+    tasks[id].period = period > 0 ? period : 1;
+    return true;
+}
+
+/**
+ * Make a task due right away. Its later deadlines follow on from now.
+ *
+ * @param id Task id
+ * @return Success or failure
+ */
+bool DeadlineScheduler::runNow(int id) {
+    if (!valid(id))
+        return false;
+    tasks[id].deadline = millis();
+    return true;
+}
+
+/**
+ * Enable or disable a task. Disabled tasks do not run and do not limit how
+ * long the caller sleeps.
+ *
+ * @param id Task id
+ * @param enabled Whether the task should run
+ * @return Success or failure
+ */
+bool DeadlineScheduler::setEnabled(int id, bool enabled) {
+    if (!valid(id))
+        return false;
+    if (enabled && !tasks[id].enabled)
+        tasks[id].deadline = millis() + tasks[id].period;
+    tasks[id].enabled = enabled;
+    return true;
+}
+
+/**
+ * Run the tasks that are due, earliest deadline first. Each task runs at most
+ * once per call, so a task that overruns its own period cannot starve the
+ * caller. A task is moved to its next deadline before it runs; if it fell
+ * behind by whole periods, those runs are skipped rather than run back to
+ * back.
+ *
+ * @return Time in ms until the next deadline (0 if one is already due), or
+ *         SCHED_NO_DEADLINE if no task is enabled
+ */
+unsigned long DeadlineScheduler::run() {
+    unsigned int ran = 0;
+    for (;;) {
+        unsigned long now = millis();
+
+        // Find the earliest deadline among the enabled tasks that have not
+        // run yet
+        int next = SCHED_INVALID_TASK;
+        for (int i = 0; i < numTasks; i++) {
+            if (!tasks[i].enabled || (ran & (1 << i)))
+                continue;
+            if (next == SCHED_INVALID_TASK ||
+                (long)(tasks[i].deadline - tasks[next].deadline) < 0)
+                next = i;
+        }
+        if (next == SCHED_INVALID_TASK || !due(tasks[next].deadline, now))
+            break;
+
+        // Record how late it is
+        Task *t = &tasks[next];
+        unsigned long lateness = now - t->deadline;
+        t->lastLateness = lateness;
+        if (lateness > t->maxLateness)
+            t->maxLateness = lateness;
+        if (lateness > SCHED_LATE_TOLERANCE)
+            t->late++;
+
+        // Advance to the next deadline, skipping any that were missed
+        t->deadline += t->period;
+        if (due(t->deadline, now)) {
+            unsigned long skipped = (now - t->deadline) / t->period + 1;
+            t->missed += skipped;
+            t->deadline += skipped * t->period;
+        }
+
+        ran |= 1 << next;
+        t->runs++;
+        unsigned long start = micros();
+        t->task();
+
+        // Record how long it took
+        unsigned long took = micros() - start;
+        if (t->runs == 1 || took < t->minRunTime)
+            t->minRunTime = took;
+        if (took > t->maxRunTime)
+            t->maxRunTime = took;
+        t->totalRunTime += took;
+    }
+
+    // Time until the earliest deadline of any task
+    unsigned long now = millis();
+    unsigned long sleep = SCHED_NO_DEADLINE;
+    for (int i = 0; i < numTasks; i++) {
+        if (!tasks[i].enabled)
+            continue;
+        if (due(tasks[i].deadline, now))
+            return 0;
+        if (tasks[i].deadline - now < sleep)
+            sleep = tasks[i].deadline - now;
+    }
+    return sleep;
+}
+
+/**
+ * @param id Task id
+ * @return Number of times the task has run
+ */
+unsigned long DeadlineScheduler::getRunCount(int id) {
+    return valid(id) ? tasks[id].runs : 0;
+}
+
+/**
+ * @param id Task id
+ * @return Number of runs that started more than SCHED_LATE_TOLERANCE late
+ */
+unsigned long DeadlineScheduler::getLateCount(int id) {
+    return valid(id) ? tasks[id].late : 0;
+}
+
+/**
+ * @param id Task id
+ * @return Number of deadlines skipped because the task fell a whole period
+ *         behind
+ */
+unsigned long DeadlineScheduler::getMissedCount(int id) {
+    return valid(id) ? tasks[id].missed : 0;
+}
+
+/**
+ * @param id Task id
+ * @return Largest lateness of any run, in ms
+ */
+unsigned long DeadlineScheduler::getMaxLateness(int id) {
+    return valid(id) ? tasks[id].maxLateness : 0;
+}
+
+/**
+ * @param id Task id
+ * @return Lateness of the most recent run, in ms
+ */
+unsigned long DeadlineScheduler::getLastLateness(int id) {
+    return valid(id) ? tasks[id].lastLateness : 0;
+}
+
+/**
+ * @param id Task id
+ * @return Shortest run, in us
+ */
+unsigned long DeadlineScheduler::getMinRunTime(int id) {
+    return valid(id) ? tasks[id].minRunTime : 0;
+}
+
+/**
+ * @param id Task id
+ * @return Longest run, in us
+ */
+unsigned long DeadlineScheduler::getMaxRunTime(int id) {
+    return valid(id) ? tasks[id].maxRunTime : 0;
+}
+
+/**
+ * @param id Task id
+ * @return Average run, in us
+ */
+unsigned long DeadlineScheduler::getMeanRunTime(int id) {
+    if (!valid(id) || tasks[id].runs == 0)
+        return 0;
+    return tasks[id].totalRunTime / tasks[id].runs;
+}
+
+/**
+ * Clear the statistics of every task.
+ */
+void DeadlineScheduler::resetStats() {
+    for (int i = 0; i < numTasks; i++) {
+        tasks[i].runs = 0;
+        tasks[i].late = 0;
+        tasks[i].missed = 0;
+        tasks[i].maxLateness = 0;
+        tasks[i].lastLateness = 0;
+        tasks[i].minRunTime = 0;
+        tasks[i].maxRunTime = 0;
+        tasks[i].totalRunTime = 0;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef DeadlineScheduler_h
+#define DeadlineScheduler_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+
+/**
+ * Constants
+ *  Constants for use with the DeadlineScheduler library class. Times are in
+ *  milliseconds.
+ */
+// Most tasks a scheduler can hold (storage is static)
+#define SCHED_MAX_TASKS     (8)
+// Returned by addTask when the scheduler is full
+#define SCHED_INVALID_TASK  (-1)
+// Returned by run when no task is enabled
+#define SCHED_NO_DEADLINE   (0xFFFFFFFFUL)
+// A run that starts later than this after its deadline counts as late
+#define SCHED_LATE_TOLERANCE    (10)
+
+// Task body
+typedef void (*SchedulerTask)(void);
+
+/**
+ * Cooperative deadline scheduler
+ *  Runs periodic tasks from loop(). Each task has its own period, and its
+ *  next deadline is its previous deadline plus the period, so the cadence
+ *  does not drift by however long the work took. run() returns how long the
+ *  caller can sleep until the next deadline. Tasks never preempt each other;
+ *  a task that overruns makes the others late, which is recorded.
+ */
+class DeadlineScheduler {
+    public:
+        DeadlineScheduler();
+
+        // Add a task, first due after the given delay. Returns the task id.
+        int addTask(SchedulerTask task, unsigned long period,
+                    unsigned long delay = 0);
+
+        // Change a task's period, or make it due right away
+        bool setPeriod(int id, unsigned long period);
+        bool runNow(int id);
+
+        // Enable or disable a task. A re-enabled task is due after a period.
+        bool setEnabled(int id, bool enabled);
+
+        // Run every task that is due, earliest deadline first. Returns the
+        // time until the next deadline.
+        unsigned long run(void);
+
+        // Statistics
+        int getTaskCount(void) { return numTasks; }
+        unsigned long getRunCount(int id);
+        unsigned long getLateCount(int id);
+        unsigned long getMissedCount(int id);
+        unsigned long getMaxLateness(int id);
+        unsigned long getLastLateness(int id);
+
+        // Time the task takes to run, in us
+        unsigned long getMinRunTime(int id);
+        unsigned long getMaxRunTime(int id);
+        unsigned long getMeanRunTime(int id);
+
+        void resetStats(void);
+
+    private:
+        struct Task {
+            SchedulerTask task;
+            unsigned long period;
+            unsigned long deadline;
+            bool enabled;
+
+            unsigned long runs;
+            unsigned long late;         // runs started late
+            unsigned long missed;       // whole periods skipped
+            unsigned long maxLateness;
+            unsigned long lastLateness;
+
+            unsigned long minRunTime;
+            unsigned long maxRunTime;
+            unsigned long long totalRunTime;
+        };
+
+        bool valid(int id);
+        static bool due(unsigned long deadline, unsigned long now);
+
+        Task tasks[SCHED_MAX_TASKS];
+        int numTasks;
+};
+
+#endif
@@ -0,0 +1,357 @@
+/**
+ * @file FastFormat.cpp
+ * @brief Number formatting without sprintf or floating point
+ *
+ * Shared replacement for the FloatToString copies the sketches used to carry
+ * (originally by Don Kinzer, http://forum.arduino.cc/index.php/topic,44216.0.html#11),
+ * and for sprintf in the sketch's messages.
+ *
+ * @author Michael Meli
+ */
+
+#include "FastFormat.h"
+#include <string.h>
+
+#ifdef FMT_COUNT_DIVISIONS
+unsigned long fmtDivisions = 0;
+#define FMT_DIV(a, b)   (fmtDivisions++, (a) / (b))
+#else
+#define FMT_DIV(a, b)   ((a) / (b))
+#endif
+
+/**
+ * Digit pairs 00 to 99, and powers of ten
+ */
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const unsigned long powersOf10[FMT_MAX_DIGITS] = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+    100000000UL, 1000000000UL,
+#if FMT_MAX_DIGITS > 10
+    10000000000UL, 100000000000UL, 1000000000000UL, 10000000000000UL,
+    100000000000000UL, 1000000000000000UL, 10000000000000000UL,
+    100000000000000000UL, 1000000000000000000UL, 10000000000000000000UL
+#endif
+};
+
+/**
+ * Count the decimal digits of a value, by comparison rather than division.
+ *
+ * @param val The value
+ * @return Number of digits, at least 1
+ */
+static byte countDigits(unsigned long val) {
+    if (val < 100)
+        return val < 10 ? 1 : 2;
+    byte n = 3;
+    while (n < FMT_MAX_DIGITS && val >= powersOf10[n])
+        n++;
+    return n;
+}
+
+/**
+ * Write the digits of a value backwards from the end of a field, two at a
+ * time. The field must be exactly countDigits(val) long.
+ *
+ * @param val The value
+ * @param end One past the last character of the field
+ */
+static void writeDigits(unsigned long val, char *end) {
+    // Host builds may have 64-bit longs; the M0 only ever takes the 32-bit
+    // loop below
+    while (val > 0xFFFFFFFFUL) {
+        unsigned long q = FMT_DIV(val, 100);
+        const char *pair = digitPairs + 2 * (val - q * 100);
+        *--end = pair[1];
+        *--end = pair[0];
+        val = q;
+    }
+
+    uint32_t v = val;
+    while (v >= 100) {
+        uint32_t q = FMT_DIV(v, 100);
+        const char *pair = digitPairs + 2 * (v - q * 100);
+        *--end = pair[1];
+        *--end = pair[0];
+        v = q;
+    }
+    if (v >= 10) {
+        *--end = digitPairs[2 * v + 1];
+        *--end = digitPairs[2 * v];
+    } else {
+        *--end = '0' + v;
+    }
+}
+
+/**
+ * Write a value with leading zeroes to a width. The field must fit.
+ *
+ * @param val The value
+ * @param width Minimum number of digits
+ * @param buf Where to write
+ * @return Number of characters written
+ */
+static unsigned writePadded(unsigned long val, byte width, char *buf) {
+    byte digits = countDigits(val);
+    unsigned n = width > digits ? width : digits;
+    memset(buf, '0', n - digits);
+    writeDigits(val, buf + n);
+    return n;
+}
+
+/**
+ * Format an unsigned value. If width is non-zero, it is padded with leading
+ * zeroes to that many digits. If the buffer is too short, the leading
+ * characters that fit are written.
+ *
+ * @param val The value
+ * @param buf Buffer for the string
+ * @param bufLen Size of the buffer
+ * @param width Minimum number of digits
+ * @return Number of characters written, not counting the null
+ */
+unsigned fmtUnsigned(unsigned long val, char *buf, unsigned bufLen, byte width) {
+    if (!buf || !bufLen)
+        return 0;
+
+    byte digits = countDigits(val);
+    byte pad = width > digits ? width - digits : 0;
+    unsigned n = pad + digits;
+    if (n < bufLen) {
+        memset(buf, '0', pad);
+        writeDigits(val, buf + n);
+    } else {
+        // Only the leading zeroes and most significant digits fit
+        n = bufLen - 1;
+        if (pad >= n) {
+            memset(buf, '0', n);
+        } else {
+            memset(buf, '0', pad);
+            writeDigits(FMT_DIV(val, powersOf10[digits - (n - pad)]), buf + n);
+        }
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+/**
+ * Format a signed value.
+ *
+ * @param val The value
+ * @param buf Buffer for the string
+ * @param bufLen Size of the buffer
+ * @return Number of characters written, not counting the null
+ */
+unsigned fmtSigned(long val, char *buf, unsigned bufLen) {
+    if (!buf || !bufLen)
+        return 0;
+    if (val >= 0)
+        return fmtUnsigned(val, buf, bufLen, 0);
+    if (bufLen < 2) {
+        *buf = '\0';
+        return 0;
+    }
+    *buf = '-';
+    return 1 + fmtUnsigned(0 - (unsigned long)val, buf + 1, bufLen - 1, 0);
+}
+
+/**
+ * Format a fixed point value, val / 10^precision, without floating point
+ * math. For example, fmtFixed(9860, 2, buf, len) produces 98.60.
+ *
+ * @param val The value, in units of 10^-precision
+ * @param precision Decimal places, 0 to FMT_MAX_PRECISION
+ * @param buf Buffer for the string
+ * @param bufLen Size of the buffer
+ * @return Number of characters written, not counting the null
+ */
+unsigned fmtFixed(long val, byte precision, char *buf, unsigned bufLen) {
+    if (!buf || !bufLen)
+        return 0;
+    if (precision > FMT_MAX_PRECISION)
+        precision = FMT_MAX_PRECISION;
+
+    unsigned len = 0;
+    unsigned long mag = (unsigned long)val;
+    if (val < 0) {
+        mag = 0 - mag;
+        if (bufLen > 1) {
+            *buf++ = '-';
+            bufLen--;
+            len++;
+        }
+    }
+
+    // Integral part, then the fraction padded with leading zeroes
+    unsigned long div = powersOf10[precision];
+    unsigned long whole = FMT_DIV(mag, div);
+    unsigned n = fmtUnsigned(whole, buf, bufLen, 0);
+    buf += n;
+    bufLen -= n;
+    len += n;
+    if (precision > 0 && bufLen > 2) {
+        *buf++ = '.';
+        bufLen--;
+        len++;
+        len += fmtUnsigned(mag - whole * div, buf, bufLen, precision);
+    }
+    return len;
+}
+
+/**
+ * Format a floating point value with a number of decimal places. Kept for
+ * code that still has floating point values; prefer fmtFixed on the M0,
+ * where every double operation is a library call.
+ *
+ * @param val The value
+ * @param precision Decimal places, 0 to FMT_MAX_PRECISION
+ * @param buf Buffer for the string
+ * @param bufLen Size of the buffer
+ */
+void fmtFloat(double val, byte precision, char *buf, unsigned bufLen) {
+    if (!buf || !bufLen)
+        return;
+    if (precision > FMT_MAX_PRECISION)
+        precision = FMT_MAX_PRECISION;
+
+    if (val < 0.0 && bufLen > 1) {
+        val = -val;
+        *buf++ = '-';
+        bufLen--;
+    }
+
+    // Round, then split into the integral part and the fraction
+    unsigned long mult = powersOf10[precision];
+    val += 0.5 / mult;
+    unsigned long whole = (unsigned long)val;
+    unsigned n = fmtUnsigned(whole, buf, bufLen, 0);
+    buf += n;
+    bufLen -= n;
+    if (precision > 0 && bufLen > 2) {
+        *buf++ = '.';
+        bufLen--;
+        fmtUnsigned((unsigned long)((val - whole) * mult), buf, bufLen,
+                    precision);
+    }
+}
+
+/**
+ * Start building a message.
+ *
+ * @param buf Where to build it
+ * @param size Bytes available at buf
+ */
+Formatter::Formatter(char *buf, int size) {
+    this->buf = buf;
+    this->size = size;
+    len = 0;
+    overflow = false;
+    if (size > 0)
+        buf[0] = '\0';
+}
+
+/**
+ * Make room for a field at the end of the message.
+ *
+ * @param n Length of the field
+ * @return Where to write it, or NULL if it does not fit
+ */
+char *Formatter::reserve(int n) {
+    if (overflow || len + n > size) {
+        overflow = true;
+        return NULL;
+    }
+    char *p = buf + len;
+    len += n;
+    if (len < size)
+        buf[len] = '\0';
+    return p;
+}
+
+/**
+ * @param text Null-terminated text to append
+ * @return This formatter
+ */
+Formatter &Formatter::addText(const char *text) {
+    int n = strlen(text);
+    char *p = reserve(n);
+    if (p)
+        memcpy(p, text, n);
+    return *this;
+}
+
+/**
+ * @param c Character to append
+ * @return This formatter
+ */
+Formatter &Formatter::addChar(char c) {
+    char *p = reserve(1);
+    if (p)
+        *p = c;
+    return *this;
+}
+
+/**
+ * @param val Value to append
+ * @param width Minimum number of digits, padded with leading zeroes
+ * @return This formatter
+ */
+Formatter &Formatter::addUnsigned(unsigned long val, byte width) {
+    byte digits = countDigits(val);
+    char *p = reserve(width > digits ? width : digits);
+    if (p)
+        writePadded(val, width, p);
+    return *this;
+}
+
+/**
+ * @param val Value to append
+ * @return This formatter
+ */
+Formatter &Formatter::addSigned(long val) {
+    if (val >= 0)
+        return addUnsigned(val);
+    unsigned long mag = 0 - (unsigned long)val;
+    byte digits = countDigits(mag);
+    char *p = reserve(1 + digits);
+    if (p) {
+        *p = '-';
+        writeDigits(mag, p + 1 + digits);
+    }
+    return *this;
+}
+
+/**
+ * @param val Fixed point value, in units of 10^-precision
+ * @param precision Decimal places, 0 to FMT_MAX_PRECISION
+ * @return This formatter
+ */
+Formatter &Formatter::addFixed(long val, byte precision) {
+    if (precision > FMT_MAX_PRECISION)
+        precision = FMT_MAX_PRECISION;
+    unsigned long mag = val < 0 ? 0 - (unsigned long)val : (unsigned long)val;
+    unsigned long div = powersOf10[precision];
+    unsigned long whole = FMT_DIV(mag, div);
+    byte digits = countDigits(whole);
+    char *p = reserve((val < 0) + digits + (precision > 0 ? 1 + precision : 0));
+    if (!p)
+        return *this;
+    if (val < 0)
+        *p++ = '-';
+    writeDigits(whole, p + digits);
+    if (precision > 0) {
+        p[digits] = '.';
+        writePadded(mag - whole * div, precision, p + digits + 1);
+    }
+    return *this;
+}
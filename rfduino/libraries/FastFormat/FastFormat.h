@@ -0,0 +1,76 @@
+#ifndef FastFormat_h
+#define FastFormat_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include <limits.h>
+
+/**
+ * Constants
+ *  Constants for use with the FastFormat library.
+ */
+// Most decimal places of fixed point and floating point values
+#define FMT_MAX_PRECISION   (6)
+// Most digits an unsigned long takes (host builds may have 64-bit longs)
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define FMT_MAX_DIGITS      (20)
+#else
+#define FMT_MAX_DIGITS      (10)
+#endif
+
+// Host benchmarks build with FMT_COUNT_DIVISIONS to count the integer
+// divisions done, each a library call (__aeabi_uidiv) on the M0
+#ifdef FMT_COUNT_DIVISIONS
+extern unsigned long fmtDivisions;
+#endif
+
+/**
+ * Number formatting without sprintf
+ *  Integers are converted two digits at a time from a table, which halves
+ *  the divisions; the M0 has no divide instruction, so each one is a library
+ *  call. Fixed point values (an integer count of 10^-precision) are
+ *  formatted with integer math only.
+ *
+ *  These functions null-terminate the buffer and write at most bufLen - 1
+ *  characters. They return the number of characters written.
+ */
+unsigned fmtUnsigned(unsigned long val, char *buf, unsigned bufLen, byte width);
+unsigned fmtSigned(long val, char *buf, unsigned bufLen);
+unsigned fmtFixed(long val, byte precision, char *buf, unsigned bufLen);
+void fmtFloat(double val, byte precision, char *buf, unsigned bufLen);
+
+/**
+ * In-place message builder
+ *  Appends text and numbers straight into a buffer, e.g. a BLE transmit
+ *  queue slot, so nothing is formatted into a stack buffer and copied. A
+ *  field that does not fit is left out whole and the builder marked as
+ *  overflowed. The text is null-terminated while there is room for it.
+ */
+class Formatter {
+    public:
+        // Build into size bytes at buf
+        Formatter(char *buf, int size);
+
+        Formatter &addText(const char *text);
+        Formatter &addChar(char c);
+        Formatter &addUnsigned(unsigned long val, byte width = 0);
+        Formatter &addSigned(long val);
+        Formatter &addFixed(long val, byte precision);
+
+        // The text so far, length characters
+        const char *text(void) { return buf; }
+        int length(void) { return len; }
+        bool overflowed(void) { return overflow; }
+
+    private:
+        char *reserve(int n);
+
+        char *buf;
+        int size;
+        int len;
+        bool overflow;
+};
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * @file BootCounter.cpp
+ * @brief Count of resets kept in flash
+ *
+ * Numbers each boot, so data kept over a reset can be told apart from data
+ * taken since.
+ *
+ * @author Michael Meli
+ */
+
+#include "BootCounter.h"
+
+/**
+ * Create a counter in a flash page. Nothing is read until bump.
+ *
+ * @param flash The flash the page is in
+ * @param page Page to keep the count in, used for nothing else
+ */
+BootCounter::BootCounter(FlashDevice *flash, int page) {
+    this->flash = flash;
+    this->page = page;
+    count = 0;
+}
+
+/**
+ * Find the last count in the page and append the next one. Entries torn by a
+ * reset are skipped; a page with no room left, or that was never a counter,
+ * is erased first.
+ *
+ * @return Whether the new count was written
+ */
+bool BootCounter::bump() {
+    uint32_t entry[2];
+    uint32_t last = 0;
+    int free = -1;
+    for (int i = 0; i < BOOT_COUNTER_ENTRIES; i++) {
+        if (!flash->read(page, i * BOOT_COUNTER_ENTRY_SIZE, entry, sizeof(entry)))
+            break;
+        if (entry[0] == 0xFFFFFFFF && entry[1] == 0xFFFFFFFF) {
+            free = i;
+            break;
+        }
+        if (entry[1] == ~entry[0])
+            last = entry[0];
+    }
+
+    count = last + 1;
+    if (free < 0) {
+        if (!flash->erasePage(page))
+            return false;
+        free = 0;
+    }
+    entry[0] = count;
+    entry[1] = ~entry[0];
+    return flash->write(page, free * BOOT_COUNTER_ENTRY_SIZE, entry,
+                        sizeof(entry));
+}
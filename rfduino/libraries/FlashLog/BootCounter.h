@@ -0,0 +1,41 @@
+#ifndef BootCounter_h
+#define BootCounter_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "FlashLog.h"
+
+/**
+ * Constants
+ *  Constants for use with the BootCounter library class.
+ */
+// Entry: count, then its complement, so a torn entry is not taken for one
+#define BOOT_COUNTER_ENTRY_SIZE (8)
+#define BOOT_COUNTER_ENTRIES    (FLASH_PAGE_SIZE / BOOT_COUNTER_ENTRY_SIZE)
+
+/**
+ * Boot counter in flash
+ *  Counts resets in one flash page. Each boot appends an entry with the new
+ *  count, and the page is only erased once every entry is used, so it wears
+ *  one erase per BOOT_COUNTER_ENTRIES boots.
+ */
+class BootCounter {
+    public:
+        BootCounter(FlashDevice *flash, int page);
+
+        // Count this boot. Call once, at start up. The count goes up in RAM
+        // even if flash can't be written.
+        bool bump(void);
+
+        // Boots so far, this one included; 0 before bump
+        unsigned long getCount(void) { return count; }
+
+    private:
+        FlashDevice *flash;
+        int page;
+        unsigned long count;
+};
+
+#endif
@@ -0,0 +1,325 @@
+/**
+ * @file FlashLog.cpp
+ * @brief Wear-leveled circular record log in flash
+ *
+ * Keeps records across long disconnected periods, and across reboots, in a
+ * range of flash pages.
+ *
+ * @author Michael Meli
+ */
+
+#include "FlashLog.h"
+
+/**
+ * CRC-16-CCITT of a record.
+ *
+ * @param data Bytes to check
+ * @param len Number of bytes
+ * @return The CRC
+ */
+static uint16_t crc16(const byte *data, int len) {
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i] << 8;
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+/**
+ * Create a log over a range of pages. Nothing is read until begin.
+ *
+ * @param flash The flash the pages are in
+ * @param firstPage First page of the log
+ * @param numPages Number of pages, at least 2
+ */
+FlashLog::FlashLog(FlashDevice *flash, int firstPage, int numPages) {
+    this->flash = flash;
+    this->firstPage = firstPage;
+    this->numPages = numPages;
+    head = 0;
+    headOpen = false;
+    tail = 0;
+    records = 0;
+    pageSeq = 0;
+    hasNewest = false;
+    newestSeq = 0;
+    corrupt = 0;
+    cached = false;
+}
+
+/**
+ * Find the end of the log, the oldest unconsumed record and the newest record.
+ * The page with the highest sequence number is the one being written; going
+ * round from the page after it visits the rest oldest first.
+ *
+ * @return Whether the log could be set up
+ */
+bool FlashLog::begin() {
+    head = 0;
+    headOpen = false;
+    tail = 0;
+    records = 0;
+    pageSeq = 0;
+    hasNewest = false;
+    newestSeq = 0;
+    corrupt = 0;
+    cached = false;
+    if (numPages < 2)
+        return false;
+
+    // Find the newest page
+    int headPage = -1;
+    uint32_t header[2];
+    for (int i = 0; i < numPages; i++) {
+        if (flash->read(firstPage + i, 0, header, sizeof(header)) &&
+            header[0] == FLASH_LOG_MAGIC &&
+            (headPage < 0 || header[1] > pageSeq)) {
+            headPage = i;
+            pageSeq = header[1];
+        }
+    }
+    if (headPage < 0)
+        return true;
+
+    // Find its last used slot. A slot torn by a reset counts as used.
+    int used = FLASH_LOG_SLOTS_PER_PAGE;
+    unsigned long start = (unsigned long)headPage * FLASH_LOG_SLOTS_PER_PAGE;
+    while (used > 0 && readSlot(start + used - 1, NULL) == SLOT_EMPTY)
+        used--;
+    if (used < FLASH_LOG_SLOTS_PER_PAGE) {
+        head = start + used;
+        headOpen = true;
+    } else {
+        head = next(start + used - 1);
+    }
+
+    // Count what is left to read, oldest page first
+    for (int k = 1; k <= numPages; k++) {
+        int i = (headPage + k) % numPages;
+        if (!flash->read(firstPage + i, 0, header, sizeof(header)) ||
+            header[0] != FLASH_LOG_MAGIC)
+            continue;
+        unsigned long pos = (unsigned long)i * FLASH_LOG_SLOTS_PER_PAGE;
+        for (int s = 0; s < FLASH_LOG_SLOTS_PER_PAGE; s++, pos++) {
+            Record record;
+            SlotState state = readSlot(pos, &record);
+            if (state == SLOT_LIVE || state == SLOT_CONSUMED) {
+                hasNewest = true;
+                newestSeq = record.seq;
+            }
+            if (state == SLOT_LIVE) {
+                if (records == 0)
+                    tail = pos;
+                records++;
+            } else if (state == SLOT_CORRUPT) {
+                corrupt++;
+            }
+        }
+    }
+    if (records == 0)
+        tail = head;
+    return true;
+}
+
+/**
+ * Append a record. The next page is erased when the current one is full,
+ * unless it still holds records that have not been dropped.
+ *
+ * @param record The record
+ * @return Whether it was written; false when the log is full
+ */
+bool FlashLog::push(const Record *record) {
+    if (!headOpen) {
+        int index = head / FLASH_LOG_SLOTS_PER_PAGE;
+        if (records > 0 && (int)(tail / FLASH_LOG_SLOTS_PER_PAGE) == index)
+            return false;
+        if (!openPage(index))
+            return false;
+    }
+
+    uint32_t slot[3];
+    byte *b = (byte*)slot;
+    b[0] = record->seq & 0xFF;
+    b[1] = record->seq >> 8;
+    b[2] = record->time & 0xFF;
+    b[3] = record->time >> 8;
+    b[4] = (record->type << 6) | (record->index & 0x3F);
+    b[5] = record->boot;
+    b[6] = record->value & 0xFF;
+    b[7] = (record->value >> 8) & 0xFF;
+    uint16_t crc = crc16(b, 8);
+    b[8] = crc & 0xFF;
+    b[9] = crc >> 8;
+    b[10] = 0;      // written
+    b[11] = 0;
+
+    unsigned long pos = head;
+    bool written = flash->write(firstPage + pos / FLASH_LOG_SLOTS_PER_PAGE,
+                                FLASH_LOG_HEADER_SIZE +
+                                (pos % FLASH_LOG_SLOTS_PER_PAGE) * FLASH_LOG_SLOT_SIZE,
+                                slot, sizeof(slot));
+
+    // A failed write may have left part of the slot programmed, so it is
+    // skipped either way
+    head = next(head);
+    if (head % FLASH_LOG_SLOTS_PER_PAGE == 0)
+        headOpen = false;
+    if (!written)
+        return false;
+
+    if (records == 0)
+        tail = pos;
+    records++;
+    hasNewest = true;
+    newestSeq = record->seq;
+    return true;
+}
+
+/**
+ * Read a record.
+ *
+ * @param i Position, 0 being the oldest record
+ * @param record Pointer to hold the record
+ * @return Whether there is such a record
+ */
+bool FlashLog::read(unsigned long i, Record *record) {
+    if (i >= records)
+        return false;
+
+    unsigned long pos, k;
+    if (cached && cacheIndex <= i) {
+        pos = cachePos;
+        k = cacheIndex;
+    } else {
+        pos = findLive(tail);
+        k = 0;
+    }
+    while (k < i) {
+        pos = findLive(next(pos));
+        k++;
+    }
+
+    if (readSlot(pos, record) != SLOT_LIVE)
+        return false;
+    cached = true;
+    cacheIndex = i;
+    cachePos = pos;
+    return true;
+}
+
+/**
+ * Mark the oldest records consumed. Their pages can be erased once the log
+ * comes round to them.
+ *
+ * @param n Number of records
+ */
+void FlashLog::drop(unsigned long n) {
+    const uint32_t consumed = 0;
+    for (; n > 0 && records > 0; n--) {
+        unsigned long pos = findLive(tail);
+        flash->write(firstPage + pos / FLASH_LOG_SLOTS_PER_PAGE,
+                     FLASH_LOG_HEADER_SIZE +
+                     (pos % FLASH_LOG_SLOTS_PER_PAGE) * FLASH_LOG_SLOT_SIZE + 12,
+                     &consumed, sizeof(consumed));
+        tail = next(pos);
+        records--;
+    }
+    if (records == 0)
+        tail = head;
+    cached = false;
+}
+
+/**
+ * Get the sequence number of the newest record in the log, including
+ * records that have been dropped but whose page has not been erased yet.
+ *
+ * @param seq Pointer to hold the sequence number
+ * @return Whether the log has any record
+ */
+bool FlashLog::getNewestSeq(uint16_t *seq) {
+    if (hasNewest)
+        *seq = newestSeq;
+    return hasNewest;
+}
+
+/**
+ * @return Number of records the log holds at least. It holds up to a page
+ *  more, depending on where the oldest record is in its page.
+ */
+unsigned long FlashLog::getCapacity() {
+    return (unsigned long)(numPages - 1) * FLASH_LOG_SLOTS_PER_PAGE;
+}
+
+/**
+ * Read and check a slot.
+ *
+ * @param pos Slot position
+ * @param record Pointer to hold the record, or NULL
+ * @return State of the slot
+ */
+FlashLog::SlotState FlashLog::readSlot(unsigned long pos, Record *record) {
+    uint32_t slot[4];
+    const byte *b = (const byte*)slot;
+    if (!flash->read(firstPage + pos / FLASH_LOG_SLOTS_PER_PAGE,
+                     FLASH_LOG_HEADER_SIZE +
+                     (pos % FLASH_LOG_SLOTS_PER_PAGE) * FLASH_LOG_SLOT_SIZE,
+                     slot, sizeof(slot)))
+        return SLOT_CORRUPT;
+
+    if (slot[0] == 0xFFFFFFFF && slot[1] == 0xFFFFFFFF && slot[2] == 0xFFFFFFFF)
+        return SLOT_EMPTY;
+    if (b[10] != 0 || b[11] != 0 || crc16(b, 8) != (b[8] | (b[9] << 8)))
+        return SLOT_CORRUPT;
+
+    if (record) {
+        record->seq = b[0] | (b[1] << 8);
+        record->time = b[2] | (b[3] << 8);
+        record->type = b[4] >> 6;
+        record->index = b[4] & 0x3F;
+        record->boot = b[5];
+        record->value = (int16_t)(b[6] | (b[7] << 8));
+    }
+    return slot[3] == 0xFFFFFFFF ? SLOT_LIVE : SLOT_CONSUMED;
+}
+
+/**
+ * Erase a page and give it the next sequence number. The magic goes in last,
+ * so a page whose header was torn by a reset is not mistaken for the newest.
+ *
+ * @param index Page within the log
+ * @return Whether the page is ready to write
+ */
+bool FlashLog::openPage(int index) {
+    uint32_t seq = pageSeq + 1;
+    const uint32_t magic = FLASH_LOG_MAGIC;
+    if (!flash->erasePage(firstPage + index) ||
+        !flash->write(firstPage + index, 4, &seq, sizeof(seq)) ||
+        !flash->write(firstPage + index, 0, &magic, sizeof(magic)))
+        return false;
+    pageSeq++;
+    headOpen = true;
+    return true;
+}
+
+/**
+ * Find the first live record at or after a position, stopping at the end of
+ * the log.
+ *
+ * @param pos Slot position to start at
+ * @return Position of the live record, or of the end of the log
+ */
+unsigned long FlashLog::findLive(unsigned long pos) {
+    while (pos != head && readSlot(pos, NULL) != SLOT_LIVE)
+        pos = next(pos);
+    return pos;
+}
+
+/**
+ * @param pos Slot position
+ * @return The following slot position, going round the pages
+ */
+unsigned long FlashLog::next(unsigned long pos) {
+    return (pos + 1) % ((unsigned long)numPages * FLASH_LOG_SLOTS_PER_PAGE);
+}
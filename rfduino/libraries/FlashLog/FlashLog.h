@@ -0,0 +1,101 @@
+#ifndef FlashLog_h
+#define FlashLog_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "RecordRing.h"
+
+/**
+ * Constants
+ *  Constants for use with the FlashLog library class.
+ */
+// Size of a flash page (erase unit) on the RFduino
+#define FLASH_PAGE_SIZE         (1024)
+// Page header: magic, page sequence number, reserved
+#define FLASH_LOG_MAGIC         (0x32474C46)    // "FLG2"
+#define FLASH_LOG_HEADER_SIZE   (16)
+// Record slot: record (8: seq, time, type << 6 | index, boot, value), CRC-16
+// (2), written mark (2), consumed mark (4)
+#define FLASH_LOG_SLOT_SIZE     (16)
+#define FLASH_LOG_SLOTS_PER_PAGE \
+    ((FLASH_PAGE_SIZE - FLASH_LOG_HEADER_SIZE) / FLASH_LOG_SLOT_SIZE)
+
+/**
+ * Flash memory
+ *  The pages the log lives in, FLASH_PAGE_SIZE bytes each. Like NOR flash,
+ *  an erase sets a page to 0xFF and writes can only clear bits. Offsets and
+ *  lengths of writes are multiples of 4.
+ */
+class FlashDevice {
+    public:
+        virtual ~FlashDevice() {}
+        virtual bool erasePage(int page) = 0;
+        virtual bool write(int page, int offset, const void *data, int len) = 0;
+        virtual bool read(int page, int offset, void *data, int len) = 0;
+};
+
+/**
+ * Wear-leveled flash record log
+ *  An append-only log of records over a range of flash pages, used as a
+ *  circle. Pages are erased only when the log comes round to them again, so
+ *  every page wears at the same rate. Each record has a CRC, so one torn by
+ *  a reset is skipped rather than read back as garbage. Records are marked
+ *  consumed in place when dropped, and begin() finds the oldest unconsumed
+ *  record and the end of the log again after a reboot. When the log is full,
+ *  push fails; nothing is overwritten until it has been dropped. Consumed
+ *  records still count for getNewestSeq, so numbering can carry on after a
+ *  reboot without reusing the numbers of records already sent.
+ */
+class FlashLog : public RecordStore {
+    public:
+        // A log over numPages pages (at least 2) starting at firstPage
+        FlashLog(FlashDevice *flash, int firstPage, int numPages);
+
+        // Find the log in flash. Call before anything else.
+        bool begin(void);
+
+        // RecordStore
+        bool push(const Record *record);
+        bool read(unsigned long i, Record *record);
+        void drop(unsigned long n);
+        unsigned long count(void) { return records; }
+
+        // Records the log is sure to hold, and slots begin skipped as corrupt
+        unsigned long getCapacity(void);
+        unsigned long getCorruptCount(void) { return corrupt; }
+
+        // Sequence number of the last record written, consumed or not.
+        // False if the log has none.
+        bool getNewestSeq(uint16_t *seq);
+
+    private:
+        enum SlotState { SLOT_EMPTY, SLOT_LIVE, SLOT_CONSUMED, SLOT_CORRUPT };
+
+        SlotState readSlot(unsigned long pos, Record *record);
+        bool openPage(int index);
+        unsigned long findLive(unsigned long pos);
+        unsigned long next(unsigned long pos);
+
+        FlashDevice *flash;
+        int firstPage;
+        int numPages;
+
+        // Positions are slots counted from the start of the first page
+        unsigned long head;     // next slot to write
+        bool headOpen;          // whether head's page has been erased
+        unsigned long tail;     // no live records before this slot
+        unsigned long records;
+        uint32_t pageSeq;       // sequence number of the newest page
+        bool hasNewest;         // whether newestSeq is set
+        uint16_t newestSeq;     // record sequence number of the last record
+        unsigned long corrupt;
+
+        // Last record read, to make reading in order cheap
+        bool cached;
+        unsigned long cacheIndex;
+        unsigned long cachePos;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef RFduinoFlash_h
+#define RFduinoFlash_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "FlashLog.h"
+
+/**
+ * RFduino on-chip flash
+ *  Pages are memory mapped, so reads are plain copies. Erasing and writing
+ *  stall the CPU, and the radio, for a few ms.
+ */
+class RFduinoFlash : public FlashDevice {
+    public:
+        bool erasePage(int page) {
+            return flashPageErase(page) == 0;
+        }
+        bool write(int page, int offset, const void *data, int len) {
+            byte *dst = (byte*)ADDRESS_OF_PAGE(page) + offset;
+            return flashWriteBlock(dst, data, len) == 0;
+        }
+        bool read(int page, int offset, void *data, int len) {
+            memcpy(data, (byte*)ADDRESS_OF_PAGE(page) + offset, len);
+            return true;
+        }
+};
+
+#endif
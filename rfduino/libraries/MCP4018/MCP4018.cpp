@@ -9,84 +9,190 @@
 
 #include "MCP4018.h"
 
+// Value code last written to the wiper, POT_INVALID when not known
+byte MCP4018::currentValue = POT_INVALID;
+unsigned long MCP4018::errors = 0;
+
 /**
- * Sets the value of the potentiometer wiper.
+ * Sets the value of the potentiometer wiper. Nothing is sent if the wiper
+ * was already set to this value, so loops that revisit codes cost no bus
+ * traffic.
  *
  * @param val Value between 0 and 127 (inclusive) to set the resistance
  * @return Success or failure
  */
 bool MCP4018::setValue(byte val) {
     // Ensure the value is within the range
-    if (val < 0)
+    if (val > POT_MAX)
         return false;
 
+    // Already there
+    if (val == currentValue)
+        return true;
+
     // Transmit the value to the MCP4018
     Wire.beginTransmission(MCP4018_ADDR);
     Wire.write(val);
 
-    // Check that transmission completed successfully
-    return Wire.endTransmission() == I2C_RESULT_SUCCESS;
+    // Check that transmission completed successfully. If it didn't, the
+    // wiper may or may not have moved.
+    if (Wire.endTransmission() != I2C_RESULT_SUCCESS) {
+        currentValue = POT_INVALID;
+        errors++;
+        return false;
+    }
+    currentValue = val;
+    return true;
+}
+
+/**
+ * Sets the value of the potentiometer wiper and reads it back to confirm it
+ * landed. On a mismatch the cached value is dropped, so the next set writes
+ * again.
+ *
+ * @param val Value between 0 and 127 (inclusive) to set the resistance
+ * @return Success, or failure if the write failed or the wiper reads back
+ *         a different value
+ */
+bool MCP4018::setValueVerified(byte val) {
+    byte readback;
+    if (!setValue(val) || !readValue(&readback))
+        return false;
+
+    if (readback != val) {
+        currentValue = POT_INVALID;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the value of the potentiometer wiper from the MCP4018. This always
+ * goes to the bus, and updates the cached value.
+ *
+ * @param val Pointer to hold the value between 0 and 127
+ * @return Success or failure
+ */
+bool MCP4018::readValue(byte *val) {
+    if (Wire.requestFrom(MCP4018_ADDR, 1) != 1 || !Wire.available()) {
+        currentValue = POT_INVALID;
+        errors++;
+        return false;
+    }
+
+    // The MSB is always 0
+    *val = Wire.read() & POT_MAX;
+    currentValue = *val;
+    return true;
+}
+
+/**
+ * Gets the value last written to or read from the wiper, without using the
+ * bus.
+ *
+ * @return Value between 0 and 127, or POT_INVALID if not known
+ */
+byte MCP4018::getCachedValue() {
+    return currentValue;
+}
+
+/**
+ * Forgets the cached wiper value, so the next setValue writes to the bus.
+ * Use this if the MCP4018 may have been reset, e.g. after a brown-out.
+ */
+void MCP4018::invalidateCachedValue() {
+    currentValue = POT_INVALID;
 }
 
 /**
  * Sets the value of the potentiometer wiper as close to a resistance
  * as possible. NOTE: This sets the resistance between pins A and W.
  *
- * @param val desired resistance between 0 and 100k (max resistance)
+ * @param val desired resistance between 0 and 100k (max resistance) plus the
+ *        wiper resistance
  * @return Success or failure
  */
 bool MCP4018::setResistance(float val) {
-    // Ensure the value is within the range
-    if (val < 0 || val > MAX_RESISTANCE)
-        return false;
-
-    // Get value for the resistance
+    // Get value for the resistance. This also checks the range.
     byte value = getValueForResistance(val);
-    if (value == -1)
+    if (value == POT_INVALID)
         return false;
 
     // Set the value
     return setValue(value);
 }
 
+/**
+ * Nominal resistance for every value code, computed at compile time so it
+ * lives in flash. Code 127 is the wiper alone; each step down adds one step
+ * of the 100k element, rounded to the nearest ohm.
+ */
+#define R1(c) (WIPER_RESISTANCE + \
+               ((unsigned long)(POT_MAX - (c)) * MAX_RESISTANCE + POT_STEPS/2) / POT_STEPS)
+#define R8(c) R1(c), R1(c+1), R1(c+2), R1(c+3), R1(c+4), R1(c+5), R1(c+6), R1(c+7)
+#define R32(c) R8(c), R8(c+8), R8(c+16), R8(c+24)
+const unsigned long MCP4018::nominalTable[POT_MAX + 1] = {
+    R32(0), R32(32), R32(64), R32(96)
+};
+#undef R32
+#undef R8
+#undef R1
+
+// Table used for all conversions. Points at a fitted table once the unit has
+// been characterized.
+const unsigned long *MCP4018::resistanceTable = MCP4018::nominalTable;
+
 /**
  * Gets the value that will set the potentiometer as close to a resistance as
  * possible. This depends on the average measured wiper resistance. The wiper
  * resistance varies with voltage and temperature, so not perfectly accurrate.
  * NOTE: This gets the value for the resistance between pins A and W.
  *
- * @param val desired resistance between 0 and 100k (max resistance)
- * @return the value that can be used to set the potentiometer
+ * @param val desired resistance between 0 and 100k (max resistance) plus the
+ *        wiper resistance
+ * @return the value that can be used to set the potentiometer, or POT_INVALID
  */
 byte MCP4018::getValueForResistance(float val) {
     // Ensure the value is within the range
-    if (val < 0 || val > MAX_RESISTANCE)
-        return -1;
+    if (val < 0 || val > resistanceTable[POT_MIN])
+        return POT_INVALID;
 
-    // Determine how many steps are required to reach the resistance
-    int numSteps;
-    float resistance = WIPER_RESISTANCE;
-    for (numSteps = 127; numSteps >= 0; numSteps--) {
-        // Store the previous resistance for comparison later
-        float prevResistance = resistance;
-
-        // Add the step resistance
-        resistance += STEP_RESISTANCE;
-
-        // If the new resistance is over the desired, then compare the new one
-        // and the old one to see which is closer.
-        if (resistance >= val) {
-            float upperError = resistance - val;
-            float lowerError = val - resistance;
-            if (upperError > lowerError) {
-                // If upper is better, we take the current value of numSteps
-                return numSteps;
-            } else {
-                // If lower is better, we take the previous value of numSteps
-                return numSteps + 1;
-            }
-        }
-    }
+    return getValueForOhms((unsigned long)(val + 0.5));
+}
+
+/**
+ * Integer version of getValueForResistance(). The closed form gives the code
+ * directly; checking the neighbours against the table makes it the nearest
+ * code even where the table rounding disagrees with the formula.
+ *
+ * @param ohms desired resistance between 0 and 100k (max resistance) plus the
+ *        wiper resistance
+ * @return the value that can be used to set the potentiometer, or POT_INVALID
+ */
+byte MCP4018::getValueForOhms(unsigned long ohms) {
+    // Ensure the value is within the range
+    if (ohms > resistanceTable[POT_MIN])
+        return POT_INVALID;
+
+    // Number of steps above the wiper resistance, rounded, then clamped. The
+    // wiper and element resistance come from the ends of the table.
+    unsigned long wiper = resistanceTable[POT_MAX];
+    unsigned long element = resistanceTable[POT_MIN] - wiper;
+    long steps = 0;
+    if (ohms > wiper)
+        steps = ((ohms - wiper) * POT_STEPS + element/2) / element;
+    if (steps > POT_STEPS)
+        steps = POT_STEPS;
+    byte code = POT_MAX - steps;
+
+    // Settle on the nearest entry. Resistance falls as the code rises.
+    if (code > POT_MIN && distance(resistanceTable[code - 1], ohms) <
+                          distance(resistanceTable[code], ohms))
+        code--;
+    else if (code < POT_MAX && distance(resistanceTable[code + 1], ohms) <
+                               distance(resistanceTable[code], ohms))
+        code++;
+    return code;
 }
 
 /**
@@ -96,17 +202,109 @@ byte MCP4018::getValueForResistance(float val) {
  * NOTE: This gets the resistance for a value used to set between pins A and W.
  *
  * @param val value between 0 and 127 (inclusive) to set the resistance
- * @return the predicted resistance
+ * @return the predicted resistance, or -1 if the value is out of range
  */
 float MCP4018::getResistanceForValue(byte val) {
     // Ensure the value is within the range
-    if (val < 0)
+    if (val > POT_MAX)
+        return -1;
+
+    return resistanceTable[val];
+}
+
+/**
+ * Integer version of getResistanceForValue().
+ *
+ * @param val value between 0 and 127 (inclusive) to set the resistance
+ * @return the predicted resistance in ohms, or 0 if the value is out of range
+ */
+unsigned long MCP4018::getOhmsForValue(byte val) {
+    if (val > POT_MAX)
+        return 0;
+    return resistanceTable[val];
+}
+
+/**
+ * Absolute difference of two resistances.
+ */
+unsigned long MCP4018::distance(unsigned long a, unsigned long b) {
+    return a > b ? a - b : b - a;
+}
+
+/**
+ * Use a different resistance table for all conversions, such as one fitted to
+ * this unit by measurement and stored in flash. The table must hold POT_MAX+1
+ * entries, decreasing with the code, and stay valid while in use.
+ *
+ * @param table The table to use, or NULL to go back to the nominal values
+ */
+void MCP4018::setResistanceTable(const unsigned long *table) {
+    resistanceTable = table ? table : nominalTable;
+}
+
+/**
+ * Get the resistance table currently in use.
+ *
+ * @return Pointer to POT_MAX+1 resistances, indexed by value code
+ */
+const unsigned long *MCP4018::getResistanceTable() {
+    return resistanceTable;
+}
+
+/**
+ * Fill a resistance table from a wiper/element model.
+ *
+ * @param table Array of POT_MAX+1 entries to fill
+ * @param wiper The wiper resistance, in ohms
+ * @param element The end to end resistance of the element, in ohms
+ */
+void MCP4018::buildResistanceTable(unsigned long table[], unsigned long wiper,
+                                   unsigned long element) {
+    for (int code = POT_MIN; code <= POT_MAX; code++) {
+        table[code] = wiper +
+            ((unsigned long)(POT_MAX - code) * element + POT_STEPS/2) / POT_STEPS;
+    }
+}
+
+/**
+ * Fit the wiper resistance from measurements of several value codes. The
+ * measurements only need to be proportional to resistance (e.g. 1/magnitude
+ * from the AD5933 before any gain calibration), because the fit is a straight
+ * line through them: the intercept is the wiper and the slope is one step, so
+ * their ratio gives the wiper in steps without knowing the scale. The element
+ * resistance anchors the result in ohms.
+ *
+ * @param codes The value codes measured
+ * @param measured Measurement proportional to the resistance at each code
+ * @param n Number of measurements (at least 2 distinct codes)
+ * @param element The end to end resistance of the element, in ohms
+ * @return The wiper resistance in ohms, or -1 if the fit failed
+ */
+long MCP4018::fitWiperResistance(const byte codes[], const float measured[],
+                                 int n, unsigned long element) {
+    if (n < 2)
         return -1;
 
-    // Determine how many steps are required to reach the resistance
-    float resistance = WIPER_RESISTANCE;
-    for (int i = 0; i < (127 - val); i++) {
-        resistance += STEP_RESISTANCE;
+    // Least squares line through (steps, measured)
+    float sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    for (int i = 0; i < n; i++) {
+        float x = POT_MAX - codes[i];
+        sumX += x;
+        sumY += measured[i];
+        sumXX += x * x;
+        sumXY += x * measured[i];
     }
-    return resistance;
+    float denom = n * sumXX - sumX * sumX;
+    if (denom == 0)
+        return -1;
+    float slope = (n * sumXY - sumX * sumY) / denom;
+    float intercept = (sumY - slope * sumX) / n;
+    if (slope <= 0)
+        return -1;
+
+    // Wiper in steps, then in ohms. A slightly negative intercept is noise.
+    float wiper = intercept / slope * ((float)element / POT_STEPS);
+    if (wiper < 0)
+        wiper = 0;
+    return (long)(wiper + 0.5);
 }
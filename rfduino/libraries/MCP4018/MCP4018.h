@@ -21,6 +21,9 @@
 // Minimum and maximum positions
 #define POT_MIN     (0x00)
 #define POT_MAX     (0x7F)
+#define POT_STEPS   (POT_MAX - POT_MIN)
+// Returned when no value code matches a request
+#define POT_INVALID (0xFF)
 // I2C result success/fail
 #define I2C_RESULT_SUCCESS       (0)
 #define I2C_RESULT_DATA_TOO_LONG (1)
@@ -38,9 +41,19 @@
  */
 class MCP4018 {
     public:
-        // Set value between 0 and 127
+        // Set value between 0 and 127. Skipped if the wiper is already there.
         static bool setValue(byte);
 
+        // Set value and read it back to confirm it landed
+        static bool setValueVerified(byte);
+
+        // Read the wiper value from the device
+        static bool readValue(byte*);
+
+        // Value last written or read, without using the bus
+        static byte getCachedValue(void);
+        static void invalidateCachedValue(void);
+
         // Set the potentiometer close to a resistance as possible
         static bool setResistance(float);
 
@@ -50,6 +63,34 @@ class MCP4018 {
 
         // Get the predicted resistance of the potentiometer for a value code
         static float getResistanceForValue(byte);
+
+        // Integer versions of the two above, in ohms
+        static byte getValueForOhms(unsigned long);
+        static unsigned long getOhmsForValue(byte);
+
+        // Per-unit model: fit the wiper resistance from measurements, build
+        // a table from it, and use that table for the conversions above
+        static long fitWiperResistance(const byte[], const float[], int,
+                                       unsigned long);
+        static void buildResistanceTable(unsigned long[], unsigned long,
+                                         unsigned long);
+        static void setResistanceTable(const unsigned long*);
+        static const unsigned long *getResistanceTable(void);
+
+        // Number of failed I2C transactions since boot
+        static unsigned long getErrorCount(void) { return errors; }
+
+    private:
+        // Nominal and in-use resistance of every value code
+        static const unsigned long nominalTable[POT_MAX + 1];
+        static const unsigned long *resistanceTable;
+
+        // Shadow of the wiper value
+        static byte currentValue;
+
+        static unsigned long errors;
+
+        static unsigned long distance(unsigned long, unsigned long);
 };
 
 #endif
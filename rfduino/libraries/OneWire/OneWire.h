@@ -126,6 +126,26 @@
 #define DIRECT_WRITE_LOW(base, mask)    (GPOC = (mask))             //GPIO_OUT_W1TC_ADDRESS
 #define DIRECT_WRITE_HIGH(base, mask)   (GPOS = (mask))             //GPIO_OUT_W1TS_ADDRESS
 
+#elif defined(ARDUINO_ARCH_HOST)
+// Linux host build (rfduino/testcode). The shim routes the pin calls to a
+// simulated bus, so the same API calls as the fallback are used, minus the
+// warning.
+#define PIN_TO_BASEREG(pin)             (0)
+#define PIN_TO_BITMASK(pin)             (pin)
+#define IO_REG_TYPE unsigned int
+#define IO_REG_ASM
+#define DIRECT_READ(base, pin)          ((void)(base), digitalRead(pin))
+#define DIRECT_WRITE_LOW(base, pin)     ((void)(base), digitalWrite(pin, LOW))
+#define DIRECT_WRITE_HIGH(base, pin)    ((void)(base), digitalWrite(pin, HIGH))
+#define DIRECT_MODE_INPUT(base, pin)    ((void)(base), pinMode(pin,INPUT))
+#define DIRECT_MODE_OUTPUT(base, pin)   ((void)(base), pinMode(pin,OUTPUT))
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_byte
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
+
 #else
 #define PIN_TO_BASEREG(pin)             (0)
 #define PIN_TO_BITMASK(pin)             (pin)
@@ -209,8 +229,9 @@ class OneWire
     // no devices, or you have already retrieved all of them.  It
     // might be a good idea to check the CRC to make sure you didn't
     // get garbage.  The order is deterministic. You will always get
-    // the same devices in the same order.
-    uint8_t search(uint8_t *newAddr);
+    // the same devices in the same order.  With search_mode false, only
+    // devices in an alarm condition respond (conditional search).
+    uint8_t search(uint8_t *newAddr, bool search_mode = true);
 #endif
 
 #if ONEWIRE_CRC
@@ -0,0 +1,188 @@
+/**
+ * @file RecordRing.cpp
+ * @brief Store-and-forward ring of measurement records
+ *
+ * Keeps measurements taken while disconnected, in RAM and optionally an
+ * overflow store, and packs them into bulk frames for the app.
+ *
+ * @author Michael Meli
+ */
+
+#include "RecordRing.h"
+
+/**
+ * Create an empty ring with no overflow store.
+ */
+RecordRing::RecordRing() {
+    head = 0;
+    count = 0;
+    nextSeq = 0;
+    boot = 0;
+    packed = 0;
+    dropped = 0;
+    spill = NULL;
+}
+
+/**
+ * Set where records go when the RAM ring is full. Records in the store are
+ * older than those in RAM and are sent first.
+ *
+ * @param spill Overflow store, or NULL to drop the oldest record instead
+ */
+void RecordRing::setSpill(RecordStore *spill) {
+    this->spill = spill;
+}
+
+/**
+ * Add a record. When the ring is full, its oldest record is moved to the
+ * overflow store, or dropped if there is none or the store is full.
+ *
+ * @param type One of the RECORD_* types
+ * @param index Index within a group, e.g. the sweep point (0-63)
+ * @param value The measurement
+ * @param time Seconds since boot
+ */
+void RecordRing::add(byte type, byte index, int16_t value, uint16_t time) {
+    if (count == RECORD_RING_SIZE) {
+        // Moving the record to the end of the store keeps every record's
+        // position. Dropping it shifts the later ones down, which matters
+        // if it was already packed.
+        if (!spill || !spill->push(&ring[head])) {
+            unsigned long spilled = spill ? spill->count() : 0;
+            if (packed > spilled)
+                packed--;
+            dropped++;
+        }
+        head = (head + 1) % RECORD_RING_SIZE;
+        count--;
+    }
+
+    Record *r = &ring[(head + count) % RECORD_RING_SIZE];
+    r->seq = nextSeq++;
+    r->time = time;
+    r->boot = boot;
+    r->type = type;
+    r->index = index & 0x3F;
+    r->value = value;
+    count++;
+}
+
+/**
+ * Get a record, counting from the oldest in the overflow store.
+ *
+ * @param i Position, 0 being the oldest
+ * @param record Pointer to hold the record
+ * @return Whether there is such a record
+ */
+bool RecordRing::get(unsigned long i, Record *record) {
+    unsigned long spilled = spill ? spill->count() : 0;
+    if (i < spilled)
+        return spill->read(i, record);
+    i -= spilled;
+    if (i >= count)
+        return false;
+    *record = ring[(head + i) % RECORD_RING_SIZE];
+    return true;
+}
+
+/**
+ * @return Number of records held, in RAM and in the overflow store
+ */
+unsigned long RecordRing::getCount() {
+    return count + (spill ? spill->count() : 0);
+}
+
+/**
+ * Pack the next records into a frame. Consecutive records share the frame
+ * only while their sequence numbers are consecutive and they are from the
+ * same boot, so a gap from dropped records or a reset starts a new frame.
+ *
+ * @param frame Buffer of at least SWEEP_FRAME_SIZE bytes
+ * @return Frame length, or 0 if every record has been packed
+ */
+int RecordRing::packFrame(byte *frame) {
+    Record r;
+    if (!get(packed, &r))
+        return 0;
+
+    uint16_t firstSeq = r.seq;
+    byte frameBoot = r.boot;
+    frame[0] = SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4) |
+               SWEEP_FLAG_RECORDS;
+    frame[1] = firstSeq & 0xFF;
+    frame[2] = firstSeq >> 8;
+    frame[4] = frameBoot;
+
+    int n = 0;
+    byte *p = frame + RECORD_HEADER_SIZE;
+    while (n < RECORDS_PER_FRAME && get(packed, &r) &&
+           r.seq == (uint16_t)(firstSeq + n) && r.boot == frameBoot) {
+        p[0] = r.time & 0xFF;
+        p[1] = r.time >> 8;
+        p[2] = (r.type << 6) | (r.index & 0x3F);
+        p[3] = r.value & 0xFF;
+        p[4] = (r.value >> 8) & 0xFF;
+        p += RECORD_WIRE_SIZE;
+        packed++;
+        n++;
+    }
+    frame[3] = n;
+    return RECORD_HEADER_SIZE + n * RECORD_WIRE_SIZE;
+}
+
+/**
+ * Remove the records packed since the last commit, oldest first.
+ */
+void RecordRing::commit() {
+    unsigned long n = packed;
+    if (spill) {
+        unsigned long spilled = spill->count();
+        unsigned long fromSpill = n < spilled ? n : spilled;
+        spill->drop(fromSpill);
+        n -= fromSpill;
+    }
+    if (n > count)
+        n = count;
+    head = (head + n) % RECORD_RING_SIZE;
+    count -= n;
+    packed = 0;
+}
+
+/**
+ * Forget the packing progress, so the next packFrame starts again from the
+ * oldest record.
+ */
+void RecordRing::rewind() {
+    packed = 0;
+}
+
+/**
+ * Decode a record frame.
+ *
+ * @param data Received bytes
+ * @param len Number of bytes received
+ * @param records Array of at least RECORDS_PER_FRAME to hold the records
+ * @return Number of records, or 0 if this is not a record frame
+ */
+int RecordRing::decodeFrame(const byte *data, int len, Record records[]) {
+    if (len < RECORD_HEADER_SIZE || len > SWEEP_FRAME_SIZE ||
+        (data[0] & 0xF0) != (SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4)) ||
+        !(data[0] & SWEEP_FLAG_RECORDS))
+        return 0;
+
+    int n = data[3];
+    if (n > RECORDS_PER_FRAME || len != RECORD_HEADER_SIZE + n * RECORD_WIRE_SIZE)
+        return 0;
+
+    uint16_t seq = data[1] | (data[2] << 8);
+    const byte *p = data + RECORD_HEADER_SIZE;
+    for (int i = 0; i < n; i++, p += RECORD_WIRE_SIZE) {
+        records[i].seq = seq + i;
+        records[i].time = p[0] | (p[1] << 8);
+        records[i].boot = data[4];
+        records[i].type = p[2] >> 6;
+        records[i].index = p[2] & 0x3F;
+        records[i].value = (int16_t)(p[3] | (p[4] << 8));
+    }
+    return n;
+}
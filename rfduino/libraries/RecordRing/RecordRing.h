@@ -0,0 +1,121 @@
+#ifndef RecordRing_h
+#define RecordRing_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "SweepPacket.h"
+
+/**
+ * Constants
+ *  Constants for use with the RecordRing library class.
+ */
+// Records held in RAM
+#define RECORD_RING_SIZE    (64)
+// Record types (2 bits on the wire)
+#define RECORD_TEMPERATURE  (1)     // raw DS18B20 reading
+#define RECORD_BATTERY      (2)     // battery percentage
+#define RECORD_IMPEDANCE    (3)     // |Z| in ohms (unsigned, saturated)
+
+/**
+ * Record frame format (version 1)
+ *  Frames share the marker and version of the sweep frames (SweepPacket.h)
+ *  and set SWEEP_FLAG_RECORDS:
+ *
+ *  byte 0      SWEEP_FRAME_MARKER | version << 4 | SWEEP_FLAG_RECORDS
+ *  byte 1-2    sequence number of the first record, little-endian
+ *  byte 3      number of records in the frame
+ *  byte 4      boot the records were taken in (low 8 bits of the count)
+ *  byte 5..    records of RECORD_WIRE_SIZE bytes, with consecutive
+ *              sequence numbers:
+ *                  time (uint16, seconds since boot, little-endian)
+ *                  type << 6 | index (6 bits)
+ *                  value (int16, little-endian)
+ */
+#define RECORD_HEADER_SIZE      (SWEEP_HEADER_SIZE + 1)
+#define RECORD_WIRE_SIZE        (5)
+#define RECORDS_PER_FRAME       ((SWEEP_FRAME_SIZE - RECORD_HEADER_SIZE) / RECORD_WIRE_SIZE)
+
+/**
+ * A stored measurement
+ */
+struct Record {
+    uint16_t seq;       // assigned when added, wraps
+    uint16_t time;      // seconds since boot, wraps
+    byte boot;          // boot it was taken in, wraps
+    byte type;
+    byte index;         // e.g. sweep point; 0 for single values
+    int16_t value;
+};
+
+/**
+ * Overflow store
+ *  Somewhere for records to go when the RAM ring is full, e.g. a flash log.
+ *  Records are read and dropped oldest first. When full, push must fail
+ *  rather than overwrite the oldest record.
+ */
+class RecordStore {
+    public:
+        virtual ~RecordStore() {}
+        virtual bool push(const Record *record) = 0;
+        virtual bool read(unsigned long i, Record *record) = 0;
+        virtual void drop(unsigned long n) = 0;
+        virtual unsigned long count(void) = 0;
+};
+
+/**
+ * Store-and-forward record ring
+ *  Holds measurements taken while nobody is listening and packs them into
+ *  record frames later. Packing does not remove records; commit does, once
+ *  the frames have gone out, so a flush cut short by a disconnect is sent
+ *  again. The boot and sequence numbers let the receiver drop duplicates.
+ */
+class RecordRing {
+    public:
+        RecordRing();
+
+        // Records that do not fit in RAM go here (NULL to drop them)
+        void setSpill(RecordStore *spill);
+
+        // Number the next record seq, e.g. to carry on after the records a
+        // spill store kept over a reboot
+        void setNextSeq(uint16_t seq) { nextSeq = seq; }
+
+        // Boot to stamp the records added from now on with, so the receiver
+        // knows which boot their times count from
+        void setBoot(byte boot) { this->boot = boot; }
+
+        // Add a record; the oldest is spilled or dropped when full
+        void add(byte type, byte index, int16_t value, uint16_t time);
+
+        // Pack the next unsent records into a frame. Returns its length, or
+        // 0 when everything has been packed.
+        int packFrame(byte *frame);
+
+        // Remove the records packed so far, or start packing over
+        void commit(void);
+        void rewind(void);
+
+        unsigned long getCount(void);
+        bool isEmpty(void) { return getCount() == 0; }
+        unsigned long getDropCount(void) { return dropped; }
+
+        // Decode a record frame. Returns the number of records, 0 if the
+        // frame is not a record frame.
+        static int decodeFrame(const byte *data, int len, Record records[]);
+
+    private:
+        bool get(unsigned long i, Record *record);
+
+        Record ring[RECORD_RING_SIZE];
+        byte head;          // oldest record
+        byte count;
+        uint16_t nextSeq;
+        byte boot;
+        unsigned long packed;   // records packed since the last commit
+        unsigned long dropped;
+        RecordStore *spill;
+};
+
+#endif
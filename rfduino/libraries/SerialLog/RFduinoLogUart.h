@@ -0,0 +1,23 @@
+#ifndef RFduinoLogUart_h
+#define RFduinoLogUart_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "SerialLog.h"
+
+/**
+ * RFduino serial port
+ *  Writes to Serial, which has to be started with Serial.begin at the baud
+ *  rate given to the SerialLog.
+ */
+class RFduinoLogUart : public LogUart {
+    public:
+        void write(const byte *data, int len) {
+            Serial.write(data, len);
+        }
+        unsigned long now(void) { return micros(); }
+};
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * @file SerialLog.cpp
+ * @brief Buffered serial log
+ *
+ * Queues log lines and feeds them to the UART no faster than its baud rate,
+ * in place of printing to Serial and waiting for every byte.
+ *
+ * @author Michael Meli
+ */
+
+#include "SerialLog.h"
+#include <string.h>
+
+/**
+ * Create an empty log writing to a UART.
+ *
+ * @param uart UART to write to
+ * @param baud Its baud rate
+ * @param txBuffer Bytes it takes without blocking, counting the one going out
+ */
+SerialLog::SerialLog(LogUart *uart, unsigned long baud, int txBuffer)
+    : builder(lineBuf, sizeof(lineBuf)) {
+    this->uart = uart;
+    byteMicros = (LOG_BITS_PER_BYTE * 1000000UL + baud - 1) / baud;
+    freeAt = 0;
+    this->txBuffer = txBuffer < 1 ? 1 : txBuffer;
+    head = 0;
+    tail = 0;
+    dropped = 0;
+}
+
+/**
+ * Queue text followed by a line ending, or nothing if it does not all fit.
+ *
+ * @param text Text of the line
+ * @param len Its length
+ * @return Whether it was queued
+ */
+bool SerialLog::queue(const char *text, int len) {
+    if (len < 0 || len + 2 > (int)(LOG_BUFFER_SIZE - getCount())) {
+        dropped++;
+        return false;
+    }
+
+    for (int i = 0; i < len; i++)
+        buffer[head++ & (LOG_BUFFER_SIZE - 1)] = text[i];
+    buffer[head++ & (LOG_BUFFER_SIZE - 1)] = '\r';
+    buffer[head++ & (LOG_BUFFER_SIZE - 1)] = '\n';
+
+    pump();
+    return true;
+}
+
+/**
+ * @param text Null-terminated text of the line
+ * @return Whether it was queued
+ */
+bool SerialLog::line(const char *text) {
+    return queue(text, strlen(text));
+}
+
+/**
+ * @param text Null-terminated text to start the line with
+ * @param value Number to end it with
+ * @return Whether it was queued
+ */
+bool SerialLog::line(const char *text, long value) {
+    return line(start().addText(text).addSigned(value));
+}
+
+/**
+ * Queue a built line, usually one from start. One that overflowed is
+ * dropped rather than cut short.
+ *
+ * @param msg Builder holding the line
+ * @return Whether it was queued
+ */
+bool SerialLog::line(Formatter &msg) {
+    if (msg.overflowed()) {
+        dropped++;
+        return false;
+    }
+    return queue(msg.text(), msg.length());
+}
+
+/**
+ * @param text Text of the line, need not be null-terminated
+ * @param len Its length
+ * @return Whether it was queued
+ */
+bool SerialLog::write(const char *text, int len) {
+    return queue(text, len);
+}
+
+/**
+ * Start building a line. Anything started but not queued is discarded.
+ *
+ * @return Builder for the line, up to LOG_LINE_MAX characters
+ */
+Formatter &SerialLog::start() {
+    builder = Formatter(lineBuf, sizeof(lineBuf));
+    return builder;
+}
+
+/**
+ * Hand the UART the next len queued bytes, which it must be able to take,
+ * and note when it will have sent them.
+ *
+ * @param len Number of bytes
+ */
+void SerialLog::send(int len) {
+    unsigned long now = uart->now();
+    if ((long)(now - freeAt) > 0)
+        freeAt = now;
+    freeAt += len * byteMicros;
+
+    // The queued bytes may wrap around the end of the buffer
+    while (len > 0) {
+        int at = tail & (LOG_BUFFER_SIZE - 1);
+        int run = LOG_BUFFER_SIZE - at;
+        if (run > len)
+            run = len;
+        uart->write(&buffer[at], run);
+        tail += run;
+        len -= run;
+    }
+}
+
+/**
+ * Write as much as the UART can take without blocking: its buffer less what
+ * it has not yet sent of the bytes handed to it.
+ *
+ * @return Number of bytes written
+ */
+int SerialLog::pump() {
+    if (isEmpty())
+        return 0;
+    long sending = (long)(freeAt - uart->now());
+    int len = txBuffer;
+    if (sending > 0)
+        len -= (sending + byteMicros - 1) / byteMicros;
+    if (len > (int)getCount())
+        len = getCount();
+    if (len <= 0)
+        return 0;
+    send(len);
+    return len;
+}
+
+/**
+ * Write everything queued, waiting on the UART as needed.
+ */
+void SerialLog::flush() {
+    if (!isEmpty())
+        send(getCount());
+}
+
+/**
+ * @return Time in ms until the UART has sent all it was handed: 0 if now,
+ *         LOG_IDLE if nothing is queued
+ */
+unsigned long SerialLog::getDrainDelay() {
+    if (isEmpty())
+        return LOG_IDLE;
+    long wait = (long)(freeAt - uart->now());
+    return wait > 0 ? (wait + 999) / 1000 : 0;
+}
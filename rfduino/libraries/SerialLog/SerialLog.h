@@ -0,0 +1,139 @@
+#ifndef SerialLog_h
+#define SerialLog_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "FastFormat.h"
+
+/**
+ * Log levels
+ *  Define LOG_LEVEL before including this header to choose what is
+ *  compiled in. Messages above the level compile to nothing, arguments and
+ *  all.
+ */
+#define LOG_LEVEL_NONE      (0)
+#define LOG_LEVEL_ERROR     (1)
+#define LOG_LEVEL_WARN      (2)
+#define LOG_LEVEL_INFO      (3)
+#define LOG_LEVEL_DEBUG     (4)
+#ifndef LOG_LEVEL
+#define LOG_LEVEL           LOG_LEVEL_INFO
+#endif
+
+// Each takes the statements that log, e.g. LOG_INFO(serialLog.line("Hi"))
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...)      do { __VA_ARGS__; } while (0)
+#else
+#define LOG_ERROR(...)      do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...)       do { __VA_ARGS__; } while (0)
+#else
+#define LOG_WARN(...)       do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...)       do { __VA_ARGS__; } while (0)
+#else
+#define LOG_INFO(...)       do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...)      do { __VA_ARGS__; } while (0)
+#else
+#define LOG_DEBUG(...)      do {} while (0)
+#endif
+
+/**
+ * Constants
+ *  Constants for use with the SerialLog library class.
+ */
+// Bytes of queued output. Must be a power of two, at most 32768.
+#define LOG_BUFFER_SIZE     (512)
+// Longest line, not counting the line ending
+#define LOG_LINE_MAX        (63)
+// Bits on the wire per byte: start, 8 data, stop
+#define LOG_BITS_PER_BYTE   (10)
+// Returned by getDrainDelay when nothing is queued
+#define LOG_IDLE            (0xFFFFFFFFUL)
+
+/**
+ * UART model
+ *  Where the log writes to: a transmitter that takes bytes as fast as the
+ *  baud rate sends them, and a microsecond clock to pace them by.
+ */
+class LogUart {
+    public:
+        virtual ~LogUart() {}
+
+        // Hand bytes to the transmitter. Blocks while it is still busy.
+        virtual void write(const byte *data, int len) = 0;
+
+        // Current time in microseconds
+        virtual unsigned long now(void) = 0;
+};
+
+/**
+ * Buffered serial log
+ *  Lines are queued in a ring buffer and handed to the UART as much at a
+ *  time as its transmit buffer has room for, worked out from what was
+ *  handed to it and the baud rate, so logging never waits on the wire.
+ *  Call pump often, e.g. from loop and while waiting on hardware, and sleep
+ *  no longer than getDrainDelay so the UART is refilled once per chunk. A
+ *  line that does not fit is dropped whole and counted.
+ */
+class SerialLog {
+    public:
+        // txBuffer is how many bytes the UART takes without blocking,
+        // counting the one going out: 1 if each write waits for the last
+        SerialLog(LogUart *uart, unsigned long baud, int txBuffer = 1);
+
+        // Queue a line, a line ending in a number, or a built line, e.g.
+        // line(start().addText("Z=").addFixed(z, 2))
+        bool line(const char *text);
+        bool line(const char *text, long value);
+        bool line(Formatter &msg);
+
+        // Queue len characters of text as a line
+        bool write(const char *text, int len);
+
+        // Start building a line in place, to be queued with line
+        Formatter &start(void);
+
+        // Hand the UART what it can take without waiting. Returns the number
+        // of bytes written.
+        int pump(void);
+
+        // Send everything, waiting as needed
+        void flush(void);
+
+        // Time in ms until the UART has sent everything pump handed it: 0 if
+        // now, LOG_IDLE if nothing is queued
+        unsigned long getDrainDelay(void);
+
+        bool isEmpty(void) { return head == tail; }
+        unsigned int getCount(void) { return (uint16_t)(head - tail); }
+        unsigned long getDropCount(void) { return dropped; }
+
+    private:
+        bool queue(const char *text, int len);
+        void send(int len);
+
+        LogUart *uart;
+        unsigned long byteMicros;   // time to send one byte
+        unsigned long freeAt;       // when the UART will have sent it all
+        int txBuffer;
+
+        // Queued output
+        byte buffer[LOG_BUFFER_SIZE];
+        uint16_t head;
+        uint16_t tail;
+
+        // Line being built
+        char lineBuf[LOG_LINE_MAX];
+        Formatter builder;
+
+        unsigned long dropped;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/**
+ * @file StatsPacket.cpp
+ * @brief Binary framing of device statistics
+ *
+ * Packs run times and error counters into fixed-size frames the app can
+ * fetch with one command.
+ *
+ * @author Michael Meli
+ */
+
+#include "StatsPacket.h"
+
+/**
+ * Write a byte, saturating.
+ *
+ * @param p Where to write it
+ * @param value Value to write
+ * @return The byte after it
+ */
+static byte *put8(byte *p, unsigned long value) {
+    *p = value > 0xFF ? 0xFF : value;
+    return p + 1;
+}
+
+/**
+ * Write a little-endian uint16, saturating.
+ *
+ * @param p Where to write it
+ * @param value Value to write
+ * @return The byte after it
+ */
+static byte *put16(byte *p, unsigned long value) {
+    if (value > 0xFFFF)
+        value = 0xFFFF;
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+/**
+ * Write a little-endian uint32.
+ *
+ * @param p Where to write it
+ * @param value Value to write
+ * @return The byte after it
+ */
+static byte *put32(byte *p, unsigned long value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+    return p + 4;
+}
+
+/**
+ * @param p Little-endian uint16
+ * @return Its value
+ */
+static unsigned int get16(const byte *p) {
+    return p[0] | (p[1] << 8);
+}
+
+/**
+ * @param p Little-endian uint32
+ * @return Its value
+ */
+static unsigned long get32(const byte *p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+           ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/**
+ * Write the frame header.
+ *
+ * @param frame Frame buffer
+ * @param snapshot Snapshot id
+ * @param page Page of this frame
+ * @param pages Number of pages in the snapshot
+ * @return Where the page contents go
+ */
+static byte *putHeader(byte *frame, byte snapshot, byte page, byte pages) {
+    frame[0] = SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4) |
+               SWEEP_FLAG_STATS;
+    frame[1] = snapshot;
+    frame[2] = page;
+    frame[3] = pages;
+    return frame + SWEEP_HEADER_SIZE;
+}
+
+/**
+ * Pack the device page of a snapshot.
+ *
+ * @param frame Buffer of at least SWEEP_FRAME_SIZE bytes
+ * @param snapshot Snapshot id
+ * @param pages Number of pages in the snapshot
+ * @param stats Device counters
+ * @param last Counters sent in the previous snapshot, all zero for the first
+ * @return Frame length
+ */
+int StatsPacket::packDevice(byte *frame, byte snapshot, byte pages,
+                            const DeviceStats *stats,
+                            const DeviceStats *last) {
+    byte *p = putHeader(frame, snapshot, STATS_PAGE_DEVICE, pages);
+    p = put32(p, stats->uptime);
+    p = put16(p, stats->wakeupsPerHour);
+    p = put8(p, stats->i2cErrors - last->i2cErrors);
+    p = put8(p, stats->commandDrops - last->commandDrops);
+    p = put16(p, stats->bleRetries - last->bleRetries);
+    p = put16(p, stats->bleDrops - last->bleDrops);
+    p = put16(p, stats->recordDrops - last->recordDrops);
+    p = put8(p, stats->logDrops - last->logDrops);
+    p = put8(p, stats->sleepPercent);
+    return p - frame;
+}
+
+/**
+ * Pack a task page of a snapshot.
+ *
+ * @param frame Buffer of at least SWEEP_FRAME_SIZE bytes
+ * @param snapshot Snapshot id
+ * @param pages Number of pages in the snapshot
+ * @param taskId Scheduler task id
+ * @param stats Run times of the task
+ * @param last Counts sent in the previous snapshot, all zero for the first
+ * @return Frame length
+ */
+int StatsPacket::packTask(byte *frame, byte snapshot, byte pages,
+                          byte taskId, const TaskStats *stats,
+                          const TaskStats *last) {
+    byte *p = putHeader(frame, snapshot, STATS_PAGE_TASK + taskId, pages);
+    p = put16(p, stats->runs - last->runs);
+    p = put16(p, stats->late - last->late);
+    p = put32(p, stats->minMicros);
+    p = put32(p, stats->maxMicros);
+    p = put32(p, stats->meanMicros);
+    return p - frame;
+}
+
+/**
+ * Decode a stats frame.
+ *
+ * @param data Received bytes
+ * @param len Number of bytes received
+ * @param out Pointer to hold the decoded frame
+ * @return Success, or failure if this is not a stats frame
+ */
+bool StatsPacket::decode(const byte *data, int len, StatsFrame *out) {
+    if (len != SWEEP_FRAME_SIZE ||
+        (data[0] & 0xF0) != (SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4)) ||
+        !(data[0] & SWEEP_FLAG_STATS))
+        return false;
+
+    out->snapshot = data[1];
+    out->page = data[2];
+    out->pages = data[3];
+    if (out->page >= out->pages || out->pages > STATS_MAX_PAGES)
+        return false;
+
+    const byte *p = data + SWEEP_HEADER_SIZE;
+    if (out->page == STATS_PAGE_DEVICE) {
+        out->device.uptime = get32(p);
+        out->device.wakeupsPerHour = get16(p + 4);
+        out->device.i2cErrors = p[6];
+        out->device.commandDrops = p[7];
+        out->device.bleRetries = get16(p + 8);
+        out->device.bleDrops = get16(p + 10);
+        out->device.recordDrops = get16(p + 12);
+        out->device.logDrops = p[14];
+        out->device.sleepPercent = p[15];
+    } else {
+        out->task.runs = get16(p);
+        out->task.late = get16(p + 2);
+        out->task.minMicros = get32(p + 4);
+        out->task.maxMicros = get32(p + 8);
+        out->task.meanMicros = get32(p + 12);
+    }
+    return true;
+}
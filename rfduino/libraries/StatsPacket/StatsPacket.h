@@ -0,0 +1,100 @@
+#ifndef StatsPacket_h
+#define StatsPacket_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+#include "SweepPacket.h"
+
+/**
+ * Stats frame format (version 1)
+ *  Frames share the marker and version of the sweep frames (SweepPacket.h)
+ *  and set SWEEP_FLAG_STATS. A snapshot is one page for the device followed
+ *  by one page per task, sent back to back. Every frame is SWEEP_FRAME_SIZE
+ *  bytes:
+ *
+ *  byte 0      SWEEP_FRAME_MARKER | version << 4 | SWEEP_FLAG_STATS
+ *  byte 1      snapshot id, incremented per snapshot (wraps)
+ *  byte 2      page: STATS_PAGE_DEVICE, or STATS_PAGE_TASK + task id
+ *  byte 3      number of pages in the snapshot
+ *  byte 4..19  page contents, little-endian
+ *
+ *  Counters are what was counted since the previous snapshot, so they only
+ *  saturate if that one interval overflows them; the app adds them up. A
+ *  1 s task fills its runs after 18 h without a snapshot. Uptime, rates and
+ *  run times are since boot.
+ *
+ *  Device page:
+ *      uptime (uint32, s), wakeups per hour (uint16), I2C errors (uint8),
+ *      app commands dropped (uint8), BLE retries (uint16), BLE drops
+ *      (uint16), records dropped (uint16), log lines dropped (uint8), time
+ *      asleep (uint8, percent)
+ *  Task page:
+ *      runs (uint16), late runs (uint16), shortest, longest and mean run
+ *      time (uint32 each, us)
+ */
+#define STATS_PAGE_DEVICE   (0)
+#define STATS_PAGE_TASK     (1)
+// Most pages in a snapshot
+#define STATS_MAX_PAGES     (16)
+
+/**
+ * Device-wide counters
+ */
+struct DeviceStats {
+    unsigned long uptime;           // s
+    unsigned long wakeupsPerHour;
+    unsigned long i2cErrors;
+    unsigned long bleRetries;
+    unsigned long bleDrops;
+    unsigned long recordDrops;
+    unsigned long logDrops;
+    unsigned long commandDrops;     // not a command, or the mailbox was full
+    byte sleepPercent;
+};
+
+/**
+ * Run times of a scheduled task
+ */
+struct TaskStats {
+    unsigned long runs;
+    unsigned long late;
+    unsigned long minMicros;
+    unsigned long maxMicros;
+    unsigned long meanMicros;
+};
+
+/**
+ * A decoded stats frame. Only the part for its page is filled in.
+ */
+struct StatsFrame {
+    byte snapshot;
+    byte page;
+    byte pages;
+    DeviceStats device;
+    TaskStats task;
+};
+
+/**
+ * Stats packer
+ *  Packs a snapshot of the device and task statistics into frames, one page
+ *  per frame. Packing only subtracts and shifts; the rates and means are
+ *  worked out by the caller, which costs a division each.
+ */
+class StatsPacket {
+    public:
+        // Pack the device page or a task page from the totals and the totals
+        // the previous snapshot sent. Both return the frame length.
+        static int packDevice(byte *frame, byte snapshot, byte pages,
+                              const DeviceStats *stats,
+                              const DeviceStats *last);
+        static int packTask(byte *frame, byte snapshot, byte pages,
+                            byte taskId, const TaskStats *stats,
+                            const TaskStats *last);
+
+        // Decode a received frame
+        static bool decode(const byte *data, int len, StatsFrame *out);
+};
+
+#endif
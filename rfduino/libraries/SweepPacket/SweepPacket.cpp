@@ -0,0 +1,138 @@
+/**
+ * @file SweepPacket.cpp
+ * @brief Binary framing for impedance sweeps
+ *
+ * Packs sweep points four to a BLE notification instead of one ASCII string
+ * per point.
+ *
+ * @author Michael Meli
+ */
+
+#include "SweepPacket.h"
+
+/**
+ * Create a packer. Call begin before adding points.
+ */
+SweepPacket::SweepPacket() {
+    length = 0;
+    fill = 0;
+    numPoints = 0;
+    index = 0;
+    sentLast = true;
+}
+
+/**
+ * Start a sweep.
+ *
+ * @param sweepId Id of this sweep
+ * @param planId Id of the frequency plan the sweep follows
+ * @param flags SWEEP_FLAG_CALIBRATION or 0
+ * @param numPoints Number of points the sweep should have
+ */
+void SweepPacket::begin(byte sweepId, byte planId, byte flags, int numPoints) {
+    this->sweepId = sweepId;
+    this->planId = planId;
+    this->flags = flags & ~SWEEP_FLAG_LAST;
+    this->numPoints = numPoints;
+    index = 0;
+    length = 0;
+    sentLast = false;
+    startFrame();
+}
+
+/**
+ * Write the header for a frame starting at the next point.
+ */
+void SweepPacket::startFrame() {
+    frame[1] = sweepId;
+    frame[2] = index;
+    frame[3] = planId;
+    fill = SWEEP_HEADER_SIZE;
+}
+
+/**
+ * Add the next point of the sweep. A frame is ready when it is full, or when
+ * this is the last point of the sweep.
+ *
+ * @param real Real data
+ * @param imag Imaginary data
+ * @return Whether a frame is ready to send
+ */
+bool SweepPacket::add(int real, int imag) {
+    if (sentLast)
+        return false;
+
+    // A frame that was handed out is done with; start the next one
+    if (length > 0) {
+        startFrame();
+        length = 0;
+    }
+
+    frame[fill++] = real & 0xFF;
+    frame[fill++] = (real >> 8) & 0xFF;
+    frame[fill++] = imag & 0xFF;
+    frame[fill++] = (imag >> 8) & 0xFF;
+    index++;
+
+    bool last = index >= numPoints;
+    if (fill < SWEEP_FRAME_SIZE && !last)
+        return false;
+
+    frame[0] = SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4) | flags |
+               (last ? SWEEP_FLAG_LAST : 0);
+    length = fill;
+    sentLast = last;
+    return true;
+}
+
+/**
+ * End the sweep. If the last frame has not gone out (the sweep was cut
+ * short), the points packed so far are sent with the last flag, or a header
+ * only frame if there are none.
+ *
+ * @return Whether a frame is ready to send
+ */
+bool SweepPacket::finish() {
+    if (sentLast)
+        return false;
+
+    if (length > 0)
+        startFrame();
+    frame[0] = SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4) | flags |
+               SWEEP_FLAG_LAST;
+    length = fill;
+    sentLast = true;
+    return true;
+}
+
+/**
+ * Decode a frame.
+ *
+ * @param data Received bytes
+ * @param len Number of bytes received
+ * @param out Pointer to hold the decoded frame
+ * @return Success, or failure if this is not a frame of a known version
+ */
+bool SweepPacket::decode(const byte *data, int len, SweepFrame *out) {
+    if (len < SWEEP_HEADER_SIZE || len > SWEEP_FRAME_SIZE ||
+        (len - SWEEP_HEADER_SIZE) % SWEEP_POINT_SIZE != 0 ||
+        !(data[0] & SWEEP_FRAME_MARKER) ||
+        (data[0] & (SWEEP_FLAG_RECORDS | SWEEP_FLAG_STATS)))
+        return false;
+
+    out->version = (data[0] >> 4) & 0x07;
+    if (out->version != SWEEP_PROTOCOL_VERSION)
+        return false;
+    out->flags = data[0] & 0x0F;
+    out->sweepId = data[1];
+    out->startIndex = data[2];
+    out->planId = data[3];
+    out->count = (len - SWEEP_HEADER_SIZE) / SWEEP_POINT_SIZE;
+
+    const byte *p = data + SWEEP_HEADER_SIZE;
+    for (int i = 0; i < out->count; i++, p += SWEEP_POINT_SIZE) {
+        out->real[i] = (int16_t)(p[0] | (p[1] << 8));
+        out->imag[i] = (int16_t)(p[2] | (p[3] << 8));
+    }
+    return true;
+}
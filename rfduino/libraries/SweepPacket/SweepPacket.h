@@ -0,0 +1,88 @@
+#ifndef SweepPacket_h
+#define SweepPacket_h
+
+/**
+ * Includes
+ */
+#include <Arduino.h>
+
+/**
+ * Frame format (version 1)
+ *  Every frame fits one 20 byte BLE notification:
+ *
+ *  byte 0      SWEEP_FRAME_MARKER | version << 4 | flags
+ *  byte 1      sweep id, incremented per sweep (wraps)
+ *  byte 2      index of the first point in this frame
+ *  byte 3      frequency plan id
+ *  byte 4..    up to SWEEP_POINTS_PER_FRAME points, each int16 real then
+ *              int16 imaginary, little-endian
+ *
+ *  The number of points follows from the frame length. Text messages start
+ *  with an ASCII letter, so the marker bit tells the two apart.
+ */
+#define SWEEP_FRAME_SIZE        (20)
+#define SWEEP_HEADER_SIZE       (4)
+#define SWEEP_POINT_SIZE        (4)
+#define SWEEP_POINTS_PER_FRAME  ((SWEEP_FRAME_SIZE - SWEEP_HEADER_SIZE) / SWEEP_POINT_SIZE)
+#define SWEEP_FRAME_MARKER      (0x80)
+#define SWEEP_PROTOCOL_VERSION  (1)
+// Flags
+#define SWEEP_FLAG_CALIBRATION  (0x01)  // calibration resistor data
+#define SWEEP_FLAG_LAST         (0x02)  // last frame of the sweep
+#define SWEEP_FLAG_RECORDS      (0x04)  // stored records (see RecordRing.h)
+#define SWEEP_FLAG_STATS        (0x08)  // device statistics (see StatsPacket.h)
+
+/**
+ * A decoded frame
+ */
+struct SweepFrame {
+    byte version;
+    byte flags;
+    byte sweepId;
+    byte startIndex;
+    byte planId;
+    byte count;
+    int16_t real[SWEEP_POINTS_PER_FRAME];
+    int16_t imag[SWEEP_POINTS_PER_FRAME];
+};
+
+/**
+ * Sweep packer
+ *  Packs the points of one sweep into frames. Add points in order; whenever
+ *  add or finish returns true, a frame is ready to send.
+ */
+class SweepPacket {
+    public:
+        SweepPacket();
+
+        // Start a sweep of numPoints points
+        void begin(byte sweepId, byte planId, byte flags, int numPoints);
+
+        // Add the next point. Returns true when a frame is ready.
+        bool add(int real, int imag);
+
+        // End the sweep. Returns true when a last frame is ready.
+        bool finish(void);
+
+        // The frame that is ready
+        const byte *getFrame(void) { return frame; }
+        int getFrameLength(void) { return length; }
+
+        // Decode a received frame
+        static bool decode(const byte *data, int len, SweepFrame *out);
+
+    private:
+        void startFrame(void);
+
+        byte frame[SWEEP_FRAME_SIZE];
+        byte length;
+        byte fill;          // bytes in the frame being packed
+        byte sweepId;
+        byte planId;
+        byte flags;
+        int numPoints;
+        int index;          // index of the next point
+        bool sentLast;
+};
+
+#endif
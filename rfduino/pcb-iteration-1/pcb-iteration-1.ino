@@ -16,7 +16,7 @@
 #include <RFduinoBLE.h>
 #include <Wire.h>
 #include <OneWire.h>
-#include "FloatToString.h"
+#include "FastFormat.h"
 #include "AD5933.h"
 #include "DS18B20.h"
 #include "MCP4018.h"
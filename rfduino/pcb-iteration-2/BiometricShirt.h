@@ -8,20 +8,86 @@
 
 // Function definitions
 void measureTemperature(void);
+void checkTemperatureAlarm(void);
+void sendTemperature(int16_t, bool);
 void measureImpedance(void);
+void handleImpedancePoint(int, int, int);
+void pumpOutput(void);
 void measureBatteryVoltage(void);
+void sendBatteryLevel(void);
 bool switchImpedanceMeasurement(int);
 void sendCalibrationValues(void);
+void beginSweepData(byte, bool);
+bool sendSweepPoint(int, int, int, bool);
+void endSweepData(bool);
+void sendBinaryAck(void);
+void sendStats(void);
+void storeRecord(byte, byte, int16_t);
+bool forwardStoredRecords(void);
+char *messageBuffer(char*);
+void printMessage(const char*, int);
+void logCalibrationResistor(void);
+void handleBluetooth(void);
+byte parseAppCommand(const char*, int);
+void recalibrate(void);
+void reportLateness(void);
+bool calibrateImpedance(void);
+bool calibrateGainSurface(void);
+bool characterizePotentiometer(void);
+bool loadPotentiometerModel(void);
+bool savePotentiometerModel(unsigned long);
 
 // Frequency sweep settings
 #define START_FREQ      (80000)
 #define FREQ_INCR       (1000)
 #define NUM_INCR        (40)
 #define CALIB_RESIST    (1000)
+// Id of the frequency plan above, sent with binary sweep data. Change it
+// whenever the plan changes.
+#define FREQ_PLAN_ID    (1)
 
-// Minimum operating voltage for the LDO
-#define LDO_MIN_VOLTAGE (2.1)
-#define BAT_MAX_VOLTAGE (3.3)
+// Potentiometer self-characterization. These value codes (150 ohm to ~5.7k,
+// around the calibration resistance) are measured with the AD5933 and the
+// wiper resistance is fitted from them. The fitted table is kept in flash.
+#define POT_MODEL_CODES         { 127, 126, 125, 124, 123, 122, 121, 120 }
+#define POT_MODEL_REPEATS       (8)
+#define POT_MODEL_FLASH_PAGE    (251)
+#define POT_MODEL_MAGIC         (0x504F5431)    // "POT1"
+
+// Multi-point gain calibration. The potentiometers are set to each of these
+// resistances and swept; the gain surface keeps every SURFACE_FREQ_STEP'th
+// point of each sweep. A step is about 790 ohms, so each lands on its own
+// value code (127, 126, 125, 123, 121, 114 with the datasheet wiper).
+#define SURFACE_REF_OHMS        { 150, 1000, 2000, 3300, 5000, 10000 }
+#define SURFACE_FREQ_STEP       (4)
+
+// Offset from skin to body temperature, in 1/100 degree Fahrenheit
+#define BODY_OFFSET_CENTI_F (100)
+
+// Temperature alarm thresholds (whole degrees Celsius) for the thermometers.
+// Readings at or past these are sent right away; otherwise temperature is only
+// sent every TEMP_PERIOD seconds. Only the periodic readings are stored while
+// disconnected.
+#define TEMP_ALARM_HIGH (38)    // fever / overheating
+#define TEMP_ALARM_LOW  (-55)   // bottom of the range, i.e. unused
+#define TEMP_PERIOD     (10)
+
+// Task periods, in seconds
+#define ALARM_PERIOD        (1)
+#define BLUETOOTH_PERIOD    (1)
+#define IMPEDANCE_PERIOD    (60)
+#define BATTERY_PERIOD      (60)
+#define RECAL_PERIOD        (3600)
+#define LATENESS_PERIOD     (600)
+
+// Battery level for the supply voltage in mV, from full (3.3 V) down to the
+// LDO's minimum operating voltage (2.1 V). The level falls fastest near
+// the top and flattens out toward empty, so it is a table, not a line.
+#define BATTERY_CURVE   { { 3300, 100 }, { 3200, 90 }, { 3100, 75 }, \
+                          { 3000, 55 }, { 2900, 35 }, { 2700, 15 }, \
+                          { 2400, 5 }, { 2100, 0 } }
+// Time the ADC needs on the supply before it reads without artifacts, ms
+#define BATTERY_SETTLE_MS   (100)
 
 // Pin for temperature sensor
 #define TEMP_PIN    (2)
@@ -36,9 +102,49 @@ void sendCalibrationValues(void);
 #define IMP_MEASURE_CALIBRATE   (0)
 #define IMP_MEASURE_ELECTRODE   (1)
 
-// App commands
+// Store-and-forward. While nobody is listening, every IMPEDANCE_STORE_STEP'th
+// sweep point is kept along with temperature and battery readings. Stored
+// records go out at most FORWARD_BATCH_FRAMES frames per Bluetooth task run.
+#define IMPEDANCE_STORE_STEP    (4)
+#define FORWARD_BATCH_FRAMES    (24)
+
+// Stored records that do not fit in RAM go to a log in these flash pages,
+// just below the potentiometer model (about two hours of records)
+#define FLASH_LOG_FIRST_PAGE    (219)
+#define FLASH_LOG_PAGES         (32)
+// Boot count, in the page below the log
+#define BOOT_COUNTER_PAGE       (218)
+
+// Longest wait for the transmit queue to empty, in milliseconds
+#define BLE_FLUSH_TIMEOUT   (5000)
+
+// Serial output. |Z| is printed in hundredths of an ohm, so it is capped to
+// keep that in a long.
+#define SERIAL_BAUD     (9600)
+// Log bytes handed to Serial at a time. The loop wakes once per chunk; a
+// core whose Serial.write waits for each byte would hold the loop for this
+// many byte times instead.
+#define SERIAL_CHUNK    (16)
+#define LOG_MAX_OHMS    (10000000L)
+
+// App commands, queued in a CommandMailbox. 0 is reserved (MAILBOX_EMPTY).
 #define APP_CMD_CALIBRATION (0x01)
 #define APP_CMD_HYDRATION   (0x02)
+#define APP_CMD_CHARACTERIZE (0x03)
+#define APP_CMD_GAIN_SURFACE (0x04)
+#define APP_CMD_BINARY      (0x05)
+#define APP_CMD_TEXT        (0x06)
+#define APP_CMD_DUMP        (0x07)
+#define APP_CMD_STATS       (0x08)
+
+// Fitted potentiometer model as stored in flash
+struct PotModel {
+    unsigned long magic;
+    unsigned long wiper;
+    unsigned long table[POT_MAX + 1];
+    unsigned long checksum;
+};
+unsigned long potModelChecksum(const PotModel*);
 
 #endif
 
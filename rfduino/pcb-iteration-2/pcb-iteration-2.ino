@@ -16,25 +16,53 @@
 #include <RFduinoBLE.h>
 #include <Wire.h>
 #include <OneWire.h>
-#include "FloatToString.h"
+#include "FastFormat.h"
 #include "AD5933.h"
+#include "GainSurface.h"
 #include "DS18B20.h"
+#include "DS18B20Adaptive.h"
+#include "DeadlineScheduler.h"
+#include "CommandMailbox.h"
+#include "SweepPacket.h"
+#include "BleTxQueue.h"
+#include "RFduinoBleLink.h"
+#include "RecordRing.h"
+#include "StatsPacket.h"
+#include "FlashLog.h"
+#include "BootCounter.h"
+#include "RFduinoFlash.h"
 #include "MCP4018.h"
+#include "BatteryMonitor.h"
+#include "RFduinoBatteryAdc.h"
 #include "BiometricShirt.h"
 
+// Set to LOG_LEVEL_DEBUG to print every sweep point
+#define LOG_LEVEL LOG_LEVEL_INFO
+#include "SerialLog.h"
+#include "RFduinoLogUart.h"
+
 // Create instance for OneWire
 OneWire ds(TEMP_PIN);
 
+// Drops the thermometer resolution while the temperature is stable
+DS18B20Adaptive tempResolution(RES_9BIT, RES_12BIT);
+
 // AD5933 On-board Calibration - not to be included in final design
 double gain[NUM_INCR+1];
 int phase[NUM_INCR+1];
 
+// Gain factors across reference resistances, used instead of the single
+// point gain once it has been calibrated
+GainSurface gainSurface(NUM_INCR+1, SURFACE_FREQ_STEP);
+
 // AD5933 Calibration Resistor Values
 int realCalib[NUM_INCR+1];
 int imagCalib[NUM_INCR+1];
 
-// Timer step to track what we should do each iteration
-unsigned int timer = 0;
+// Runs each periodic task at its own deadline
+DeadlineScheduler scheduler;
+int impedanceTask = SCHED_INVALID_TASK;
+int bluetoothTask = SCHED_INVALID_TASK;
 
 // Value of the calibration resistor (predicted)
 float calibrationResistorValue = CALIB_RESIST;
@@ -44,8 +72,52 @@ bool bluetoothConnected = false;
 bool sendBluetooth = false;     // to prevent connections mid-sweep to send data
 bool sentCalibrationValues = false; // for tracking sending calibration values
 
-// Variable to denote when the app requests various commands
-volatile int appCommands = 0;
+// Everything sent to the app goes through the transmit queue, which paces
+// notifications to what the radio accepts
+RFduinoBleLink bleLink;
+BleTxQueue bleQueue(&bleLink);
+
+// Sweep data goes out as text until the app asks for binary frames
+bool binaryTelemetry = false;
+SweepPacket sweepPacket;
+byte sweepId = 0;
+
+// Measurements taken while disconnected, sent when the app is back. When
+// there are more than fit in RAM, the oldest go to flash.
+RecordRing storedRecords;
+RFduinoFlash flash;
+FlashLog flashLog(&flash, FLASH_LOG_FIRST_PAGE, FLASH_LOG_PAGES);
+
+// Resets so far. Records carry the boot they were taken in, since their
+// times count from it.
+BootCounter bootCounter(&flash, BOOT_COUNTER_PAGE);
+
+// Battery level, sampled while the loop is awake anyway
+const BatteryPoint batteryCurve[] = BATTERY_CURVE;
+RFduinoBatteryAdc batteryAdc;
+BatteryMonitor battery(&batteryAdc, batteryCurve,
+                       sizeof(batteryCurve)/sizeof(batteryCurve[0]),
+                       BATTERY_SETTLE_MS);
+
+// Commands from the app, posted by the BLE callback and handled in the loop.
+// Messages that aren't a command are counted by the callback and logged and
+// reported by the loop.
+CommandMailbox appCommands;
+volatile unsigned int invalidCommands = 0;
+
+// How often the loop wakes and how long it sleeps, for the stats command
+unsigned long wakeups = 0;
+unsigned long sleptMs = 0;
+byte statsSnapshot = 0;
+// Counts as of the last stats pages queued; each snapshot sends what was
+// counted since
+DeviceStats statsSent;
+TaskStats taskStatsSent[SCHED_MAX_TASKS];
+
+// Serial output is queued and written as fast as the baud rate allows, so
+// printing never holds up a measurement
+RFduinoLogUart logUart;
+SerialLog serialLog(&logUart, SERIAL_BAUD, SERIAL_CHUNK);
 
 void setup(void)
 {
@@ -56,9 +128,28 @@ void setup(void)
     // Begin I2C
     Wire.begin();
 
-    // Begin serial at 9600 baud for output
-    Serial.begin(9600);
-    Serial.println("PCB Iteration 2 Started!");
+    // Begin serial for output
+    Serial.begin(SERIAL_BAUD);
+    LOG_INFO(serialLog.line("PCB Iteration 2 Started!"));
+
+    // Count this boot, so records kept over the reset can be told apart
+    if (!bootCounter.bump()) {
+        LOG_ERROR(serialLog.line("FAILED in counting the boot!"));
+    }
+    storedRecords.setBoot(bootCounter.getCount());
+
+    // Pick up any records left in flash from before a reset, and carry on
+    // numbering after them so the app doesn't take new records for ones it
+    // already has
+    if (flashLog.begin()) {
+        uint16_t newestSeq;
+        if (flashLog.getNewestSeq(&newestSeq))
+            storedRecords.setNextSeq(newestSeq + 1);
+        storedRecords.setSpill(&flashLog);
+        LOG_INFO(serialLog.line("Flash log records: ", flashLog.count()));
+    } else {
+        LOG_ERROR(serialLog.line("FAILED in opening the flash log!"));
+    }
 
     // Set up pin GPIO3 for the digital switch and start measuring the
     // calibration resistor
@@ -69,25 +160,44 @@ void setup(void)
     pinMode(LED_PIN, OUTPUT);
     digitalWrite(LED_PIN, LOW);
 
-    // Set the potentiometers to as close to 1k as possible. Get the predicted
-    // resistance as well.
-    int valueCode = MCP4018::getValueForResistance(1000);
-    calibrationResistorValue = MCP4018::getResistanceForValue(valueCode);
-    if (MCP4018::setValue(valueCode)) {
-        Serial.println("Potentiometers set!");
+    // Use this unit's fitted potentiometer model if one was stored, so the
+    // predicted calibration resistance accounts for the actual wiper.
+    bool potModelLoaded = loadPotentiometerModel();
+    if (potModelLoaded) {
+        LOG_INFO(serialLog.line("Potentiometer model loaded!"));
     } else {
-        Serial.println("FAILED in setting the potentiometers!");
+        LOG_INFO(serialLog.line("No potentiometer model, using nominal values"));
     }
 
-    Serial.println(calibrationResistorValue);
+    // Set the potentiometers to as close to 1k as possible and read the wiper
+    // back to confirm. Get the predicted resistance as well.
+    byte valueCode = MCP4018::getValueForOhms(CALIB_RESIST);
+    calibrationResistorValue = MCP4018::getOhmsForValue(valueCode);
+    if (MCP4018::setValueVerified(valueCode)) {
+        LOG_INFO(serialLog.line("Potentiometers set!"));
+    } else {
+        LOG_ERROR(serialLog.line("FAILED in setting the potentiometers!"));
+    }
+
+    logCalibrationResistor();
 
-    // Set temperature resolution (default is 12 bit)
-    if (DS18B20::setResolution(ds, RES_12BIT)) {
-        Serial.println("Temperature resolution set!");
+    // Set temperature resolution (default is 12 bit) and persist it in the
+    // sensors' EEPROM. After the first boot this only reads the config back.
+    if (DS18B20::setResolution(ds, RES_12BIT, true)) {
+        LOG_INFO(serialLog.line("Temperature resolution set!"));
     } else {
-        Serial.println("FAILED in setting temperature resolution!");
+        LOG_ERROR(serialLog.line("FAILED in setting temperature resolution!"));
     }
 
+    // Program the alarm thresholds so out of range readings can be found
+    // with a cheap alarm search, then start the first conversion
+    if (DS18B20::setAlarms(ds, TEMP_ALARM_HIGH, TEMP_ALARM_LOW, true)) {
+        LOG_INFO(serialLog.line("Temperature alarms set!"));
+    } else {
+        LOG_ERROR(serialLog.line("FAILED in setting temperature alarms!"));
+    }
+    DS18B20::startConversion(ds);
+
     // Perform initial AD5933 configuration. Try again if any one of these fail.
     if (AD5933::reset() &&
         AD5933::setInternalClock(true) &&
@@ -96,197 +206,331 @@ void setup(void)
         AD5933::setNumberIncrements(NUM_INCR) &&
         AD5933::setPGAGain(PGA_GAIN_X1))
     {
-        Serial.println("AD5933 initialized!");
+        LOG_INFO(serialLog.line("AD5933 initialized!"));
     } else {
-        Serial.println("FAILED in initialization!");
+        LOG_ERROR(serialLog.line("FAILED in initialization!"));
         RFduino_ULPDelay(1);
     }
 
+    // On first boot, characterize the potentiometer. This only has to be done
+    // once per unit; the fitted model is reused from flash afterwards.
+    if (!potModelLoaded) {
+        if (characterizePotentiometer()) {
+            LOG_INFO(serialLog.line("Potentiometer characterized!"));
+        } else {
+            LOG_ERROR(serialLog.line("FAILED in characterizing the potentiometer!"));
+        }
+        logCalibrationResistor();
+    }
+
     // Perform calibration sweep to populate calibration data arrays
-    if (AD5933::calibrate(gain, phase, realCalib, imagCalib,
-                          calibrationResistorValue, NUM_INCR+1))
-    {
-        Serial.println("Calibrated!");
+    if (calibrateImpedance()) {
+        LOG_INFO(serialLog.line("Calibrated!"));
     } else {
-        Serial.println("FAILED in calibration!");
+        LOG_ERROR(serialLog.line("FAILED in calibration!"));
     }
 
-    // Begin measuring the electrode
-    switchImpedanceMeasurement(IMP_MEASURE_ELECTRODE);
+    // Calibrate the gain across the range of electrode impedances
+    if (calibrateGainSurface()) {
+        LOG_INFO(serialLog.line("Gain surface calibrated!"));
+    } else {
+        LOG_ERROR(serialLog.line("FAILED in gain surface calibration!"));
+    }
+
+    // Schedule the periodic tasks. Everything but the recalibration and
+    // lateness report runs right away.
+    scheduler.addTask(checkTemperatureAlarm, SECONDS(ALARM_PERIOD));
+    bluetoothTask = scheduler.addTask(handleBluetooth,
+                                      SECONDS(BLUETOOTH_PERIOD));
+    scheduler.addTask(measureTemperature, SECONDS(TEMP_PERIOD));
+    impedanceTask = scheduler.addTask(measureImpedance,
+                                      SECONDS(IMPEDANCE_PERIOD));
+    scheduler.addTask(measureBatteryVoltage, SECONDS(BATTERY_PERIOD));
+    scheduler.addTask(recalibrate, SECONDS(RECAL_PERIOD),
+                      SECONDS(RECAL_PERIOD));
+    scheduler.addTask(reportLateness, SECONDS(LATENESS_PERIOD),
+                      SECONDS(LATENESS_PERIOD));
 }
 
 void loop(void)
 {
+    wakeups++;
+
     // Toggle LED
     digitalWrite(LED_PIN, !digitalRead(LED_PIN));
 
-    // When a device first connects to the RFduino, the first impedance dataset
-    // that should be sent is the calibration resistor values.
-    if (bluetoothConnected && !sentCalibrationValues) {
-        // Delay briefly. After initial connection, it may take a moment for
-        // the actual data connection to establish.
-        RFduino_ULPDelay(SECONDS(1));
-
-        // Wait for the app to request the calibration resistor values
-        while (appCommands != APP_CMD_CALIBRATION) {}
-
-        // Send the calibration values
-        sendCalibrationValues();
-        sentCalibrationValues = true;
-        appCommands = 0;
-        Serial.println("Sent calibration resistor values");
-
-        // Reset the timer so we instantly do a sweep
-        timer = 0;
+    // Check if the bluetooth connected and we need to start sending bluetooth
+    // We check before running tasks to avoid sending data mid-sweep. The
+    // first dataset sent on a connection is the calibration values, so wait
+    // for the app to ask for those.
+    sendBluetooth = bluetoothConnected && sentCalibrationValues;
+
+    // The BLE callbacks run in interrupt context, so connection changes are
+    // logged here
+    static bool loggedConnected = false;
+    if (bluetoothConnected != loggedConnected) {
+        loggedConnected = bluetoothConnected;
+        LOG_INFO(serialLog.line(loggedConnected ?
+                                "Bluetooth connection established!" :
+                                "Bluetooth connection lost..."));
     }
-
-    // Check if we have any commands to handle sent from the app
-    if (appCommands > 0) {
-        // If the app needs hydration information, do a sweep
-        if (appCommands == APP_CMD_HYDRATION)
-            measureImpedance();
-
-        // Clear the command
-        appCommands = 0;
+    static unsigned int loggedInvalid = 0;
+    if (invalidCommands != loggedInvalid) {
+        loggedInvalid = invalidCommands;
+        LOG_WARN(serialLog.line("Invalid command!"));
     }
 
-    // Check if the bluetooth connected and we need to start sending bluetooth
-    // We check at the beginning of each loop to avoid sending data mid-sweep.
-    sendBluetooth = bluetoothConnected;
+    // Handle app commands as soon as we are awake
+    if (!appCommands.isEmpty())
+        scheduler.runNow(bluetoothTask);
+
+    // Anything still queued for a lost connection will never go out
+    if (!bluetoothConnected)
+        bleQueue.clear();
+
+    // Run whatever is due, take a battery sample if one has settled, keep
+    // the transmit queue and serial output moving, then sleep until the next
+    // deadline or until any of those needs the CPU again
+    unsigned long sleep = scheduler.run();
+    if (battery.poll(millis()))
+        sendBatteryLevel();
+    pumpOutput();
+    unsigned long sendDelay = bleQueue.getSendDelay();
+    if (sendDelay < sleep)
+        sleep = sendDelay;
+    unsigned long drainDelay = serialLog.getDrainDelay();
+    if (drainDelay < sleep)
+        sleep = drainDelay;
+    unsigned long batteryDelay = battery.getPollDelay(millis());
+    if (batteryDelay < sleep)
+        sleep = batteryDelay;
+    unsigned long sleepStart = millis();
+    RFduino_ULPDelay(sleep);
+    sleptMs += millis() - sleepStart;
+}
 
-    // Every 1 second, measure temperature
-    if (timer % 1 == 0) {
-        measureTemperature();
+// Handle the commands sent from the app, in the order they arrived
+void handleBluetooth() {
+    byte command;
+    while ((command = appCommands.take()) != MAILBOX_EMPTY) {
+        LOG_INFO(serialLog.line("Bluetooth command received: ", command));
+
+        switch (command) {
+            // When a device first connects to the RFduino, the app asks for
+            // the calibration resistor values first. Send them, then do a
+            // sweep right away.
+            case APP_CMD_CALIBRATION:
+                sendCalibrationValues();
+                sentCalibrationValues = true;
+                sendBluetooth = bluetoothConnected;
+                LOG_INFO(serialLog.line("Sent calibration resistor values"));
+                scheduler.runNow(impedanceTask);
+                break;
+
+            // If the app needs hydration information, do a sweep
+            case APP_CMD_HYDRATION:
+                measureImpedance();
+                break;
+
+            // If the app asks to re-characterize the potentiometer, do it and
+            // recalibrate with the new model
+            case APP_CMD_CHARACTERIZE:
+                characterizePotentiometer();
+                calibrateImpedance();
+                calibrateGainSurface();
+                break;
+
+            // If the app asks for a multi-point calibration, redo the surface
+            case APP_CMD_GAIN_SURFACE:
+                calibrateGainSurface();
+                break;
+
+            // The app can take binary sweep frames, or wants text back
+            case APP_CMD_BINARY:
+                binaryTelemetry = true;
+                sendBinaryAck();
+                break;
+            case APP_CMD_TEXT:
+                binaryTelemetry = false;
+                break;
+
+            // Bulk read-out: send every stored record now, in binary, rather
+            // than a batch per run
+            case APP_CMD_DUMP:
+                binaryTelemetry = true;
+                sendBinaryAck();
+                while (forwardStoredRecords())
+                    ;
+                break;
+
+            // Run time and error statistics, as binary frames
+            case APP_CMD_STATS:
+                sendStats();
+                break;
+        }
     }
 
-    // Every 5 seconds, measure impedance values and battery voltage
-    if (timer % 60 == 0) {
-        measureImpedance();
-        measureBatteryVoltage();
+    // Catch the app up on anything measured while it was away
+    forwardStoredRecords();
+
+    // Report commands lost to a full mailbox
+    static unsigned int reportedDrops = 0;
+    if (appCommands.getDropCount() != reportedDrops) {
+        reportedDrops = appCommands.getDropCount();
+        LOG_WARN(serialLog.line("Bluetooth commands dropped: ", reportedDrops));
     }
+}
 
-    // Increment timer, reset every so often
-    if (++timer >= 600) timer = 0;
+// Redo the calibration sweep, to follow drift with temperature and time
+void recalibrate() {
+    if (!calibrateImpedance())
+        LOG_ERROR(serialLog.line("FAILED in recalibration!"));
+}
 
-    // Delay
-    RFduino_ULPDelay( SECONDS(1) );
+// Print the tasks that have started late since boot
+void reportLateness() {
+    for (int id = 0; id < scheduler.getTaskCount(); id++) {
+        if (scheduler.getLateCount(id) == 0)
+            continue;
+        LOG_WARN(serialLog.line(serialLog.start()
+                 .addText("Task ").addUnsigned(id)
+                 .addText(": ").addUnsigned(scheduler.getLateCount(id))
+                 .addText(" late, ").addUnsigned(scheduler.getMissedCount(id))
+                 .addText(" missed, max ")
+                 .addUnsigned(scheduler.getMaxLateness(id)).addText(" ms")));
+    }
 }
 
 // Perform a temperature measurement and send the data
 void measureTemperature() {
-    // Get average temperature...add 1 to get body temperature
-    float temp = DS18B20::getTemperature(ds);
-    if (temp != 0.0) {
-        temp += 1.0;    // only add 1 if a temperature was received
+    // Get average temperature in raw sensor units
+    int16_t rawTemp;
+    if (DS18B20::getTemperatureRaw(ds, &rawTemp)) {
+        sendTemperature(rawTemp, true);
+
+        // Adjust the resolution to the trend. This only touches the bus when
+        // the resolution actually changes.
+        tempResolution.addReading(rawTemp);
+        tempResolution.apply(ds);
+    } else {
+        // Send 0 if no temperature was received
+        sendTemperature(DS18B20_NO_READING, true);
     }
+}
 
-    // Format temperature into string to send over Bluetooth
-    char str[65];
-    str[0] = 'T';
-    str[1] = '$';
-    fmtFloat(temp, 2, str+2, 63); // 2 decimals; sprintf sucks with arduino
-    Serial.println(str);
-
-    // Convert float to a string and send it over Bluetooth, if connected
-    if (sendBluetooth) {
-        RFduinoBLE.send(str, strlen(str));
+// Check whether any thermometer crossed an alarm threshold on its last
+// conversion and send the reading right away if so. Then start the next
+// conversion on all thermometers at once. Alarm readings are only sent:
+// measureTemperature keeps one every TEMP_PERIOD while nobody is listening,
+// so a fever does not flood the stored records.
+void checkTemperatureAlarm() {
+    int16_t rawTemp;
+    if (DS18B20::getAlarmTemperatureRaw(ds, &rawTemp) > 0) {
+        sendTemperature(rawTemp, false);
     }
+    DS18B20::startConversion(ds);
 }
 
-// Perform a battery voltage measurement and send the data
-void measureBatteryVoltage() {
-    // Configure ADC to read voltage level
-    analogReference(VBG);     // sets the reference to 1.2 V band gap (internal)
-    analogSelection(VDD_1_3_PS);  // set source to VDD with 1/3 prescaling
-
-    RFduino_ULPDelay(100);    // needed to avoid artifacts
-
-    // Read battery voltage value
-    // MATH: value is out of 1023. So value/1023 is fractional part of 1.2 V.
-    // However, we used a prescaler on VDD (3.6/3 = 1.2), so this is also
-    // fractional part of 3.3 V. Therefore: value / 1023 = voltage / 3.6
-    int sensorValue = analogRead(1);    // pin has no meaning...uses VDD
-    float batteryVoltage = sensorValue * (3.6 / 1023.0);
+// Format a raw temperature and send it, or store it if asked and the app is
+// not listening
+void sendTemperature(int16_t rawTemp, bool store) {
+    // Convert to hundredths of a degree Fahrenheit...add 1 to get body
+    // temperature. This is all integer math; the M0 has no FPU.
+    long temp = 0;
+    if (rawTemp != DS18B20_NO_READING) {
+        temp = DS18B20::rawToCentiFahrenheit(rawTemp) + BODY_OFFSET_CENTI_F;
+    }
 
-    // Reset the analog reference and selection
-    analogReference(DEFAULT);
-    analogSelection(AIN_1_3_PS);    // analog inputs with 1/3 prescaling
+    // Format the temperature with 2 decimals, straight into the transmit
+    // queue if the app is listening
+    char buf[TXQ_MAX_PAYLOAD];
+    char *str = messageBuffer(buf);
+    Formatter msg(str, TXQ_MAX_PAYLOAD);
+    msg.addText("T$").addFixed(temp, 2);
+    printMessage(str, msg.length());
+
+    // Send the string over Bluetooth, if connected and the queue had room.
+    // Otherwise keep it.
+    if (str != buf) {
+        bleQueue.commit(msg.length());
+    } else if (store && rawTemp != DS18B20_NO_READING) {
+        storeRecord(RECORD_TEMPERATURE, 0, rawTemp);
+    }
+}
 
-    RFduino_ULPDelay(100);    // needed to avoid artifacts
+// Start a battery voltage measurement. The ADC is switched to the supply
+// now, and the loop takes the sample once it has settled.
+void measureBatteryVoltage() {
+    battery.start(millis());
+}
 
-    // Convert the battery voltage to a percent based on the LDO minimum
-    if (batteryVoltage > 3.3) batteryVoltage = 3.3;
-    int batteryPercentage = (int)(((float)batteryVoltage - LDO_MIN_VOLTAGE)/
-                              ((float)BAT_MAX_VOLTAGE - LDO_MIN_VOLTAGE)*100.0);
+// Send the battery level, smoothed and mapped through the discharge curve
+void sendBatteryLevel() {
+    int batteryPercentage = battery.getPercent();
 
     // Print to serial and perhaps send to app
-    char str[65];
-    sprintf(str, "B$%d", batteryPercentage);
-    Serial.println(str);
-    if (sendBluetooth) {
-        RFduinoBLE.send(str, strlen(str));
+    char buf[TXQ_MAX_PAYLOAD];
+    char *str = messageBuffer(buf);
+    Formatter msg(str, TXQ_MAX_PAYLOAD);
+    msg.addText("B$").addSigned(batteryPercentage);
+    printMessage(str, msg.length());
+    if (str != buf) {
+        bleQueue.commit(msg.length());
+    } else {
+        storeRecord(RECORD_BATTERY, 0, batteryPercentage);
     }
 }
 
-// Perform an impedance measurement and send the data
+// Perform an impedance measurement and send the data. Each point is handled
+// while the AD5933 converts the next one.
 void measureImpedance() {
-    // Create variables to hold the impedance data and track frequency
-    int real, imag, i = 0, cfreq = START_FREQ/1000;
-
-    // Character array to hold data to print
-    char str[65];
-
-    // Initialize the frequency sweep
-    if (!(AD5933::setPowerMode(POWER_STANDBY) &&          // place in standby
-          AD5933::setControlMode(CTRL_INIT_START_FREQ) && // init start freq
-          AD5933::setControlMode(CTRL_START_FREQ_SWEEP))) // begin frequency sweep
-         {
-             Serial.println("Could not initialize frequency sweep...");
-         }
-
     // Send START command to app
-    sprintf(str, "I$START$%d", NUM_INCR+1);
-    Serial.println(str);
+    LOG_DEBUG(serialLog.line("I$START$", NUM_INCR+1));
     if (sendBluetooth) {
-        RFduinoBLE.send(str, strlen(str));
+        beginSweepData(0, false);
     }
 
     // Perform the actual sweep
-    while ((AD5933::readStatusRegister() & STATUS_SWEEP_DONE) != STATUS_SWEEP_DONE) {
-        // Get the frequency data for this frequency point
-        if (!AD5933::getComplexData(&real, &imag)) {
-            Serial.println("Could not get raw frequency data...");
-        }
-
-        // Print out the frequency data
-        sprintf(str, "I$%d$%d$%d", cfreq, real, imag);
-        Serial.print(str);
-        if (sendBluetooth) {
-            RFduinoBLE.send(str, strlen(str));
-        }
-
-        // Compute impedance
-        double magnitude = sqrt(pow(real, 2) + pow(imag, 2));
-        double impedance = 1/(magnitude*gain[i]);
-        Serial.print("  |Z|=");
-        Serial.println(impedance);
-
-        // Increment the frequency
-        i++;
-        cfreq += FREQ_INCR/1000;
-        AD5933::setControlMode(CTRL_INCREMENT_FREQ);
-    }
+    if (!AD5933::frequencySweepStream(handleImpedancePoint, NUM_INCR+1,
+                                      pumpOutput))
+        LOG_ERROR(serialLog.line("Could not complete frequency sweep..."));
 
     // Send HALT command
-    sprintf(str, "I$HALT");
-    Serial.println(str);
+    LOG_DEBUG(serialLog.line("I$HALT"));
     if (sendBluetooth) {
-        RFduinoBLE.send(str, strlen(str));
+        endSweepData(false);
     }
+}
 
-    // Set AD5933 power mode to standby when finished
-    if (!AD5933::setPowerMode(POWER_STANDBY))
-        Serial.println("Could not set to standby...");
+// Print, send and store one point of the impedance sweep
+void handleImpedancePoint(int i, int real, int imag) {
+    // Print out the frequency data
+    LOG_DEBUG(serialLog.line(serialLog.start().addText("I$")
+              .addSigned(START_FREQ/1000 + i*(FREQ_INCR/1000))
+              .addChar('$').addSigned(real).addChar('$').addSigned(imag)));
+    bool sent = sendBluetooth && sendSweepPoint(i, real, imag, false);
+
+    // Compute impedance
+    double magnitude = sqrt(pow(real, 2) + pow(imag, 2));
+    double g = gainSurface.isReady() ? gainSurface.getGain(i, magnitude)
+                                     : gain[i];
+    double impedance = 1/(magnitude*g);
+    LOG_DEBUG(serialLog.line(serialLog.start().addText("  |Z|=")
+              .addFixed(impedance < LOG_MAX_OHMS ? lround(impedance*100)
+                                                 : LOG_MAX_OHMS*100L, 2)));
+
+    // Nobody to send the sweep to, or no room in the transmit queue: keep a
+    // few of its points
+    if (!sent && i % IMPEDANCE_STORE_STEP == 0)
+        storeRecord(RECORD_IMPEDANCE, i,
+                    impedance < 65535 ? (uint16_t)impedance : 65535);
+}
+
+// Keep the transmit queue and serial output moving while waiting on the
+// AD5933
+void pumpOutput() {
+    bleQueue.pump();
+    serialLog.pump();
 }
 
 // Switch between measuring the calibration resistor or the electrode
@@ -304,37 +548,317 @@ bool switchImpedanceMeasurement(int option) {
     }
 }
 
+// Perform a calibration sweep on the calibration resistor to populate the
+// calibration data arrays, then go back to measuring the electrode.
+bool calibrateImpedance() {
+    switchImpedanceMeasurement(IMP_MEASURE_CALIBRATE);
+    bool calibrated = AD5933::calibrate(gain, phase, realCalib, imagCalib,
+                                        calibrationResistorValue, NUM_INCR+1);
+    switchImpedanceMeasurement(IMP_MEASURE_ELECTRODE);
+    return calibrated;
+}
+
+// Sweep each of the SURFACE_REF_OHMS references to build the gain surface.
+// The references are set with the potentiometers, so their values come from
+// the potentiometer model.
+bool calibrateGainSurface() {
+    static const unsigned long refs[] = SURFACE_REF_OHMS;
+    int real[NUM_INCR+1], imag[NUM_INCR+1];
+    byte lastCode = POT_INVALID;
+
+    gainSurface.clear();
+    switchImpedanceMeasurement(IMP_MEASURE_CALIBRATE);
+    for (unsigned int i = 0; i < sizeof(refs)/sizeof(refs[0]); i++) {
+        // The fitted pot model can put neighbouring references on the same
+        // code; sweeping it twice would only waste a surface slot
+        byte valueCode = MCP4018::getValueForOhms(refs[i]);
+        if (valueCode == POT_INVALID || valueCode == lastCode)
+            continue;
+        lastCode = valueCode;
+        if (!(MCP4018::setValue(valueCode) &&
+              AD5933::frequencySweep(real, imag, NUM_INCR+1) &&
+              gainSurface.addReference(MCP4018::getOhmsForValue(valueCode),
+                                       real, imag)))
+        {
+            LOG_ERROR(serialLog.line("Could not sweep gain surface reference..."));
+        }
+    }
+
+    // Put the potentiometers back on the calibration resistance
+    MCP4018::setValue(MCP4018::getValueForOhms(CALIB_RESIST));
+    switchImpedanceMeasurement(IMP_MEASURE_ELECTRODE);
+    return gainSurface.isReady();
+}
+
+// Characterize the potentiometer. Each code in POT_MODEL_CODES is measured
+// with the AD5933 on the calibration path. 1/magnitude is proportional to the
+// resistance, so a line through the points gives the wiper resistance relative
+// to a step without needing a known reference. The fitted table is stored in
+// flash and used from then on.
+bool characterizePotentiometer() {
+    static const byte codes[] = POT_MODEL_CODES;
+    const int n = sizeof(codes);
+    float measured[n];
+
+    // Measure each code
+    switchImpedanceMeasurement(IMP_MEASURE_CALIBRATE);
+    bool measuredAll = true;
+    for (int i = 0; i < n && measuredAll; i++) {
+        double magnitude;
+        measuredAll = MCP4018::setValueVerified(codes[i]) &&
+                      AD5933::measureMagnitude(&magnitude, POT_MODEL_REPEATS) &&
+                      magnitude > 0;
+        if (measuredAll)
+            measured[i] = 1.0 / magnitude;
+    }
+
+    // Fit the wiper and store the model
+    bool characterized = false;
+    if (measuredAll) {
+        long wiper = MCP4018::fitWiperResistance(codes, measured, n,
+                                                 MAX_RESISTANCE);
+        characterized = wiper >= 0 && savePotentiometerModel(wiper);
+    }
+
+    // Set the potentiometers back to the calibration resistance, using the
+    // new model if there is one
+    byte valueCode = MCP4018::getValueForOhms(CALIB_RESIST);
+    calibrationResistorValue = MCP4018::getOhmsForValue(valueCode);
+    MCP4018::setValue(valueCode);
+    switchImpedanceMeasurement(IMP_MEASURE_ELECTRODE);
+    return characterized;
+}
+
+// Checksum of a stored potentiometer model
+unsigned long potModelChecksum(const PotModel *model) {
+    unsigned long sum = model->magic + model->wiper;
+    for (int i = 0; i <= POT_MAX; i++)
+        sum = (sum << 1 | sum >> 31) + model->table[i];
+    return ~sum;
+}
+
+// Use the potentiometer model stored in flash, if there is a valid one
+bool loadPotentiometerModel() {
+    const PotModel *stored = (const PotModel*)ADDRESS_OF_PAGE(POT_MODEL_FLASH_PAGE);
+    if (stored->magic != POT_MODEL_MAGIC ||
+        stored->checksum != potModelChecksum(stored))
+        return false;
+
+    // The table is read straight from flash
+    MCP4018::setResistanceTable(stored->table);
+    return true;
+}
+
+// Build a table for a fitted wiper resistance and store it in flash
+bool savePotentiometerModel(unsigned long wiper) {
+    PotModel model;
+    model.magic = POT_MODEL_MAGIC;
+    model.wiper = wiper;
+    MCP4018::buildResistanceTable(model.table, wiper, MAX_RESISTANCE);
+    model.checksum = potModelChecksum(&model);
+
+    // Stop using the old table before its page is erased
+    MCP4018::setResistanceTable(NULL);
+    PotModel *stored = (PotModel*)ADDRESS_OF_PAGE(POT_MODEL_FLASH_PAGE);
+    if (flashPageErase(POT_MODEL_FLASH_PAGE) != 0 ||
+        flashWriteBlock(stored, &model, sizeof(model)) != 0)
+        return false;
+
+    return loadPotentiometerModel();
+}
+
 // Send calibration values, generally for after a device first connects.
 // Does NOT print to Serial, only send to Bluetooth, if connected.
 void sendCalibrationValues() {
     // Make sure Bluetooth is connected
     if (!bluetoothConnected) return;
 
-    // Character array to hold data to print
-    char str[65];
+    // Start the sweep data, marked as calibration values
+    beginSweepData(SWEEP_FLAG_CALIBRATION, true);
 
-    // Send START command
-    sprintf(str, "I$START$%d", NUM_INCR+1);
-    RFduinoBLE.send(str, strlen(str));
+    // Iterate over the stored arrays of calibration resistor data. The
+    // transmit queue paces the notifications to what the radio accepts; the
+    // app asked for these, so wait for room rather than drop any.
+    for (int i = 0; i < NUM_INCR+1; i++)
+        sendSweepPoint(i, realCalib[i], imagCalib[i], true);
 
-    // Iterate over the stored arrays of calibration resistor data.
-    int cfreq = START_FREQ/1000;
-    for (int i = 0; i < NUM_INCR+1; i++) {
-        // Pull data from calibration resistor arrays and send
-        sprintf(str, "I$%d$%d$%d", cfreq, realCalib[i], imagCalib[i]);
-        RFduinoBLE.send(str, strlen(str));
+    // End the sweep data, and make sure it all goes out before the first
+    // measurement
+    endSweepData(true);
+    if (!bleQueue.flush(BLE_FLUSH_TIMEOUT))
+        LOG_ERROR(serialLog.line("Could not send calibration values..."));
+}
 
-        // Increment current frequency
-        cfreq += FREQ_INCR/1000;
+// Start sending a sweep to the app. In text mode this is the START message;
+// binary frames carry their own sweep id instead. With wait false, nothing
+// here waits on the link: what does not fit in the transmit queue is left
+// out.
+void beginSweepData(byte flags, bool wait) {
+    if (binaryTelemetry) {
+        sweepPacket.begin(sweepId++, FREQ_PLAN_ID, flags, NUM_INCR+1);
+    } else {
+        char *slot = wait ? bleQueue.reserve() : bleQueue.tryReserve();
+        if (!slot)
+            return;
+        Formatter msg(slot, TXQ_MAX_PAYLOAD);
+        msg.addText("I$START$").addSigned(NUM_INCR+1);
+        bleQueue.commit(msg.length());
+    }
+}
 
-        // Arduino has a limit on the data transmission rate. To avoid dropping
-        // data, throttle the transmission slightly with a delay.
-        RFduino_ULPDelay(50);
+// Send one sweep point. In binary mode points are packed
+// SWEEP_POINTS_PER_FRAME to a notification. Returns false if the point could
+// not be queued.
+bool sendSweepPoint(int index, int real, int imag, bool wait) {
+    if (binaryTelemetry) {
+        if (!sweepPacket.add(real, imag))
+            return true;
+        return wait ? bleQueue.send(sweepPacket.getFrame(),
+                                    sweepPacket.getFrameLength())
+                    : bleQueue.trySend(sweepPacket.getFrame(),
+                                       sweepPacket.getFrameLength());
+    } else {
+        char *slot = wait ? bleQueue.reserve() : bleQueue.tryReserve();
+        if (!slot)
+            return false;
+        Formatter msg(slot, TXQ_MAX_PAYLOAD);
+        msg.addText("I$").addSigned((START_FREQ + index*FREQ_INCR)/1000)
+           .addChar('$').addSigned(real).addChar('$').addSigned(imag);
+        bleQueue.commit(msg.length());
     }
+    return true;
+}
 
-    // Send HALT command
-    sprintf(str, "I$HALT");
-    RFduinoBLE.send(str, strlen(str));
+// Finish sending a sweep. In binary mode, this flushes a sweep that was cut
+// short; in text mode it is the HALT message.
+void endSweepData(bool wait) {
+    const void *data = "I$HALT";
+    int len = 6;
+    if (binaryTelemetry) {
+        if (!sweepPacket.finish())
+            return;
+        data = sweepPacket.getFrame();
+        len = sweepPacket.getFrameLength();
+    }
+    if (wait)
+        bleQueue.send(data, len);
+    else
+        bleQueue.trySend(data, len);
+}
+
+// Keep a measurement to send once the app is connected again
+void storeRecord(byte type, byte index, int16_t value) {
+    storedRecords.add(type, index, value, millis() / 1000);
+}
+
+// Send stored records as bulk frames. This needs binary mode. The records
+// are only removed once the frames are out of the transmit queue; if the
+// connection drops first, they are sent again next time and the app drops
+// the duplicates by sequence number. Returns whether a batch was sent.
+bool forwardStoredRecords() {
+    if (!sendBluetooth || !binaryTelemetry || storedRecords.isEmpty())
+        return false;
+
+    // Tell the app the boot and the current time (seconds since boot), so it
+    // can place the timestamps of this boot's records, and how many records
+    // there are. Each record frame has the boot its records are from.
+    char *slot = bleQueue.tryReserve();
+    if (!slot)
+        return false;
+    Formatter msg(slot, TXQ_MAX_PAYLOAD);
+    msg.addText("R$").addUnsigned(bootCounter.getCount()).addChar('$')
+       .addUnsigned(millis() / 1000).addChar('$')
+       .addUnsigned(storedRecords.getCount());
+    bleQueue.commit(msg.length());
+
+    // Pack frames straight into the transmit queue while it has room, so
+    // that only records that were queued get packed
+    int len;
+    for (int i = 0; i < FORWARD_BATCH_FRAMES &&
+                    (slot = bleQueue.tryReserve()) != NULL &&
+                    (len = storedRecords.packFrame((byte*)slot)) > 0; i++)
+        bleQueue.commit(len);
+
+    if (bleQueue.flush(BLE_FLUSH_TIMEOUT) && bluetoothConnected) {
+        storedRecords.commit();
+        return true;
+    }
+    storedRecords.rewind();
+    return false;
+}
+
+// Confirm binary mode to the app, with the protocol version and the
+// frequency plan the frames refer to
+void sendBinaryAck() {
+    char *slot = bleQueue.tryReserve();
+    if (!slot)
+        return;
+    Formatter msg(slot, TXQ_MAX_PAYLOAD);
+    msg.addText("P$").addUnsigned(SWEEP_PROTOCOL_VERSION).addChar('$')
+       .addUnsigned(FREQ_PLAN_ID).addChar('$').addUnsigned(NUM_INCR+1);
+    bleQueue.commit(msg.length());
+}
+
+// Send a snapshot of the statistics: a device page, then a page per task.
+// These are binary frames whatever the telemetry mode. Counts are sent as
+// what was counted since the last page that made it into the queue, so a
+// page the queue had no room for is made up by the next snapshot. Working
+// out the rates and the mean run times takes a 64-bit division each.
+void sendStats() {
+    if (!bluetoothConnected)
+        return;
+
+    unsigned long now = millis();
+    DeviceStats device;
+    device.uptime = now / 1000;
+    device.wakeupsPerHour = now ? (unsigned long long)wakeups * 3600000 / now : 0;
+    device.i2cErrors = AD5933::getErrorCount() + MCP4018::getErrorCount();
+    device.bleRetries = bleQueue.getRetryCount();
+    device.bleDrops = bleQueue.getDropCount();
+    device.recordDrops = storedRecords.getDropCount();
+    device.logDrops = serialLog.getDropCount();
+    device.commandDrops = invalidCommands + appCommands.getDropCount();
+    device.sleepPercent = now ? (unsigned long long)sleptMs * 100 / now : 0;
+
+    byte frame[SWEEP_FRAME_SIZE];
+    byte pages = STATS_PAGE_TASK + scheduler.getTaskCount();
+    if (bleQueue.trySend(frame, StatsPacket::packDevice(frame, statsSnapshot,
+                                                        pages, &device,
+                                                        &statsSent)))
+        statsSent = device;
+    for (int id = 0; id < scheduler.getTaskCount(); id++) {
+        TaskStats task;
+        task.runs = scheduler.getRunCount(id);
+        task.late = scheduler.getLateCount(id);
+        task.minMicros = scheduler.getMinRunTime(id);
+        task.maxMicros = scheduler.getMaxRunTime(id);
+        task.meanMicros = scheduler.getMeanRunTime(id);
+        if (bleQueue.trySend(frame, StatsPacket::packTask(frame, statsSnapshot,
+                                                          pages, id, &task,
+                                                          &taskStatsSent[id])))
+            taskStatsSent[id] = task;
+    }
+    statsSnapshot++;
+}
+
+// Where to build a message: in the transmit queue when the app is listening
+// and it has room, so it is formatted in place, otherwise in buf. A message
+// built in the queue is sent with bleQueue.commit; one built in buf is
+// stored. This never waits on the link, as it runs inside scheduled tasks.
+char *messageBuffer(char *buf) {
+    char *slot = sendBluetooth ? bleQueue.tryReserve() : NULL;
+    return slot ? slot : buf;
+}
+
+// Print a message that is not null-terminated to Serial, on its own line
+void printMessage(const char *str, int len) {
+    LOG_INFO(serialLog.write(str, len));
+}
+
+// Print the predicted calibration resistance, in ohms
+void logCalibrationResistor() {
+    LOG_INFO(serialLog.line(serialLog.start()
+             .addFixed(lround(calibrationResistorValue*100), 2)));
 }
 
 // Callback for when we connect to a device
@@ -342,33 +866,51 @@ void RFduinoBLE_onConnect(){
     bluetoothConnected = true;
     sentCalibrationValues = false;
     sendBluetooth = false;
-    Serial.println("Bluetooth connection established!");
 }
 
 // Callback for when we disconnect from a device
 void RFduinoBLE_onDisconnect(){
     bluetoothConnected = false;
+    binaryTelemetry = false;    // a new connection has to ask again
     sendBluetooth = false;
     sentCalibrationValues = false;
-    Serial.println("Bluetooth connection lost...");
 }
 
-// Callback for when we receive data.
-void RFduinoBLE_onReceive(char *data, int len) {
-    // Serial print the command received
-    Serial.println("Bluetooth data received");
-    for (int i = 0; i < len; i++) {
-      Serial.print(data[i]);
-    }
-    Serial.println();
-
-    // Preliminarily the command
-    if (strncmp(data, "calibration", len) == 0) {
-        appCommands = APP_CMD_CALIBRATION;
-        sentCalibrationValues = false;
-    } else if (strncmp(data, "hydration", len) == 0) {
-        appCommands = APP_CMD_HYDRATION;
-    } else {
-      Serial.println("Invalid command!");
+// Text of each app command
+static const struct {
+    const char *text;
+    byte command;
+} appCommandTable[] = {
+    { "calibration",  APP_CMD_CALIBRATION },
+    { "hydration",    APP_CMD_HYDRATION },
+    { "characterize", APP_CMD_CHARACTERIZE },
+    { "surface",      APP_CMD_GAIN_SURFACE },
+    { "binary",       APP_CMD_BINARY },
+    { "text",         APP_CMD_TEXT },
+    { "dump",         APP_CMD_DUMP },
+    { "stats",        APP_CMD_STATS },
+};
+
+// Get the command for a received message, or MAILBOX_EMPTY if it is not one.
+// Apps may end a command with a NUL or a line ending, so trailing NULs and
+// whitespace are ignored.
+byte parseAppCommand(const char *data, int len) {
+    while (len > 0 && (unsigned char)data[len-1] <= ' ')
+        len--;
+    for (unsigned int i = 0; i < sizeof(appCommandTable)/sizeof(appCommandTable[0]); i++) {
+        const char *text = appCommandTable[i].text;
+        if ((int)strlen(text) == len && memcmp(data, text, len) == 0)
+            return appCommandTable[i].command;
     }
+    return MAILBOX_EMPTY;
+}
+
+// Callback for when we receive data. This runs in interrupt context, so it
+// only identifies the command and posts it; the loop does the work.
+void RFduinoBLE_onReceive(char *data, int len) {
+    byte command = parseAppCommand(data, len);
+    if (command == MAILBOX_EMPTY)
+        invalidCommands++;
+    else
+        appCommands.post(command);
 }
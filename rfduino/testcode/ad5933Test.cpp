@@ -0,0 +1,128 @@
+/**
+ * Tests streamed AD5933 sweeps against the simulated AD5933: every point
+ * arrives in order, and starting the next conversion before handling a
+ * point brings the sweep time down to about the conversion time. Exits
+ * non-zero if any check fails.
+ *
+ * Usage:
+ *  ./ad5933Test
+ */
+
+#include <Arduino.h>
+#include "AD5933.h"
+#include "AD5933Sim.h"
+#include "check.h"
+
+#define POINTS  (41)
+// What handling a point costs on the M0: |Z| in soft-float, formatting and
+// queueing the notification
+#define WORK_MICROS (900)
+
+static double ohmsAt(int point) {
+    return 500 + 25 * point;
+}
+
+static int numPoints;
+static bool inOrder;
+static int reals[POINTS + 8], imags[POINTS + 8];
+static unsigned long idleCalls;
+
+static void handlePoint(int index, int real, int imag) {
+    inOrder = inOrder && index == numPoints;
+    if (numPoints < POINTS + 8) {
+        reals[numPoints] = real;
+        imags[numPoints] = imag;
+    }
+    numPoints++;
+    delayMicroseconds(WORK_MICROS);
+}
+
+static void countIdle(void) {
+    idleCalls++;
+}
+
+static void resetPoints(void) {
+    numPoints = 0;
+    inOrder = true;
+    idleCalls = 0;
+}
+
+// The sweep loop measureImpedance used to run: read, handle, then increment
+static bool sequentialSweep(void) {
+    if (!(AD5933::setPowerMode(POWER_STANDBY) &&
+          AD5933::setControlMode(CTRL_INIT_START_FREQ) &&
+          AD5933::setControlMode(CTRL_START_FREQ_SWEEP)))
+        return false;
+    int i = 0, real, imag;
+    while ((AD5933::readStatusRegister() & STATUS_SWEEP_DONE) != STATUS_SWEEP_DONE) {
+        if (!AD5933::getComplexData(&real, &imag))
+            return false;
+        handlePoint(i++, real, imag);
+        AD5933::setControlMode(CTRL_INCREMENT_FREQ);
+    }
+    return AD5933::setPowerMode(POWER_STANDBY);
+}
+
+int main() {
+    VirtualAD5933 ad;
+    ad.setImpedanceFunction(ohmsAt);
+    shimAttachI2C(AD5933_ADDR, &ad);
+    CHECK(AD5933::setStartFrequency(80000) &&
+          AD5933::setIncrementFrequency(1000) &&
+          AD5933::setNumberIncrements(POINTS - 1));
+
+    // Streamed: every point, in order, with the right data
+    resetPoints();
+    unsigned long long start = shimMicros();
+    CHECK(AD5933::frequencySweepStream(handlePoint, POINTS, countIdle));
+    unsigned long long streamed = shimMicros() - start;
+    unsigned long streamIdle = ad.getIdleMicros();
+    CHECK(numPoints == POINTS && inOrder);
+    for (int i = 0; i < POINTS; i++) {
+        CHECK(reals[i] == lround(AD5933_SIM_SCALE / ohmsAt(i)));
+        CHECK(imags[i] == 0);
+    }
+    CHECK(ad.getIncrements() == POINTS - 1);
+
+    // The handler's work hid behind the conversions, so the time waiting
+    // for points was free for other work
+    CHECK(idleCalls > 0);
+
+    // Sequential, as before
+    resetPoints();
+    start = shimMicros();
+    CHECK(sequentialSweep());
+    unsigned long long sequential = shimMicros() - start;
+    unsigned long sequentialIdle = ad.getIdleMicros() - streamIdle;
+    CHECK(numPoints == POINTS && inOrder);
+
+    unsigned long long conversions = (unsigned long long)POINTS * AD5933_SIM_CONVERSION_MICROS;
+    printf("sweep of %d points: conversions alone %llu us, sequential %llu us, "
+           "streamed %llu us\n", POINTS, conversions, sequential, streamed);
+    printf("AD5933 idle with data waiting: sequential %lu us, streamed %lu us\n",
+           sequentialIdle, streamIdle);
+    // What is left on top of the conversions is reading the status and data
+    // registers over I2C, which has to happen before the next one can start
+    CHECK(streamed < sequential * 3 / 4);
+    CHECK(streamed < conversions * 3 / 2);
+    CHECK(streamIdle < sequentialIdle / 3);
+
+    // Results match the array sweep
+    int real[POINTS], imag[POINTS];
+    CHECK(AD5933::frequencySweep(real, imag, POINTS));
+    for (int i = 0; i < POINTS; i++)
+        CHECK(real[i] == reals[i] && imag[i] == imags[i]);
+
+    // A sweep longer than asked for is stopped
+    resetPoints();
+    CHECK(!AD5933::frequencySweepStream(handlePoint, 10));
+    CHECK(numPoints == 10);
+
+    // No device, and the failed transfers are counted
+    CHECK(AD5933::getErrorCount() == 0);
+    shimAttachI2C(AD5933_ADDR, NULL);
+    CHECK(!AD5933::frequencySweepStream(handlePoint, POINTS));
+    CHECK(AD5933::getErrorCount() > 0);
+
+    return checkResult("ad5933Test");
+}
@@ -0,0 +1,193 @@
+/**
+ * Tests the battery monitor on a simulated supply ADC: the discharge curve
+ * lookup, the moving average and hysteresis on a noisy supply, and that
+ * sampling never waits on the ADC. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./batteryTest
+ */
+
+#include <Arduino.h>
+#include "BatteryMonitor.h"
+#include "check.h"
+
+#define SETTLE_MS   (100)
+
+static const BatteryPoint curve[] = {
+    { 3300, 100 }, { 3200, 90 }, { 3100, 75 }, { 3000, 55 },
+    { 2900, 35 }, { 2700, 15 }, { 2400, 5 }, { 2100, 0 },
+};
+#define CURVE_POINTS    ((byte)(sizeof(curve) / sizeof(curve[0])))
+
+// Supply ADC with a settable voltage and noise. Reads taken before the ADC
+// has settled on the supply are counted.
+class SimBatteryAdc : public BatteryAdc {
+    public:
+        SimBatteryAdc() : millivolts(3000), noise(0), supply(false),
+                          selectedAt(0), rng(0x2545F491), early(0),
+                          reads(0), supplyMs(0), lastCounts(0) {}
+
+        void selectSupply(void) {
+            supply = true;
+            selectedAt = millis();
+        }
+        void selectInputs(void) {
+            if (supply)
+                supplyMs += millis() - selectedAt;
+            supply = false;
+        }
+        int read(void) {
+            reads++;
+            if (!supply || millis() - selectedAt < SETTLE_MS)
+                early++;
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            long mv = millivolts;
+            if (noise)
+                mv += (long)(rng % (2 * noise + 1)) - noise;
+            lastCounts = (mv * BATT_ADC_MAX + BATT_FULL_SCALE_MV / 2) /
+                         BATT_FULL_SCALE_MV;
+            return lastCounts;
+        }
+
+        long millivolts;
+        long noise;
+        bool supply;
+        unsigned long selectedAt;
+        uint32_t rng;
+        unsigned long early;
+        unsigned long reads;
+        unsigned long supplyMs;
+        int lastCounts;
+};
+
+// Take a sample the way the sketch does: start it from the task, then poll
+// it from the loop, which sleeps until something is due
+static void sample(BatteryMonitor *battery) {
+    battery->start(millis());
+    while (!battery->poll(millis()))
+        delay(battery->getPollDelay(millis()));
+}
+
+int main() {
+    // Discharge curve lookup
+    {
+        SimBatteryAdc adc;
+        BatteryMonitor battery(&adc, curve, CURVE_POINTS, SETTLE_MS);
+        CHECK(battery.percentFor(3600) == 100);
+        CHECK(battery.percentFor(3300) == 100);
+        CHECK(battery.percentFor(3250) == 95);
+        CHECK(battery.percentFor(3000) == 55);
+        CHECK(battery.percentFor(2950) == 45);
+        CHECK(battery.percentFor(2800) == 25);
+        CHECK(battery.percentFor(2100) == 0);
+        CHECK(battery.percentFor(1800) == 0);
+        for (unsigned int mv = 2000; mv < 3400; mv++)
+            CHECK(battery.percentFor(mv + 1) >= battery.percentFor(mv));
+        CHECK(BatteryMonitor::countsToMillivolts(1023) == 3600);
+        CHECK(BatteryMonitor::countsToMillivolts(0) == 0);
+        CHECK(BatteryMonitor::countsToMillivolts(853) == 3002);
+    }
+
+    // Sampling: the ADC is only on the supply while the sample settles, it
+    // is never read early, and nothing waits on it
+    {
+        SimBatteryAdc adc;
+        BatteryMonitor battery(&adc, curve, CURVE_POINTS, SETTLE_MS);
+        CHECK(!battery.isReady());
+        CHECK(battery.getPollDelay(millis()) == BATT_IDLE);
+        CHECK(!battery.poll(millis()));
+
+        unsigned long long start = shimMicros();
+        battery.start(millis());
+        CHECK(adc.supply);
+        CHECK(!battery.poll(millis()));
+        CHECK(battery.getPollDelay(millis()) == SETTLE_MS);
+        unsigned long long blocked = shimMicros() - start;
+
+        delay(SETTLE_MS / 2);
+        CHECK(!battery.poll(millis()));
+        CHECK(battery.getPollDelay(millis()) == SETTLE_MS / 2);
+        delay(SETTLE_MS / 2);
+        start = shimMicros();
+        CHECK(battery.poll(millis()));
+        blocked += shimMicros() - start;
+
+        CHECK(!adc.supply);
+        CHECK(adc.early == 0 && adc.reads == 1);
+        CHECK(adc.supplyMs == SETTLE_MS);
+        CHECK(battery.isReady());
+        CHECK(battery.getMillivolts() == 3002);
+        CHECK(battery.getPercent() == 55);
+        printf("sample: %llu us blocked, ADC on the supply for %lu ms "
+               "(was 200 ms blocked)\n", blocked, adc.supplyMs);
+        CHECK(blocked == 0);
+    }
+
+    // A noisy supply: the raw readings would flicker, the reported level
+    // stays put
+    {
+        SimBatteryAdc adc;
+        adc.millivolts = 3050;
+        adc.noise = 25;
+        BatteryMonitor battery(&adc, curve, CURVE_POINTS, SETTLE_MS);
+        int rawChanges = 0, reportedChanges = 0;
+        byte lastRaw = 0, lastReported = 0;
+        for (int i = 0; i < 200; i++) {
+            sample(&battery);
+            byte raw = battery.percentFor(
+                BatteryMonitor::countsToMillivolts(adc.lastCounts));
+            if (i > 0) {
+                rawChanges += raw != lastRaw;
+                reportedChanges += battery.getPercent() != lastReported;
+            }
+            lastRaw = raw;
+            lastReported = battery.getPercent();
+        }
+        printf("noisy supply: raw level changed %d times, reported %d times\n",
+               rawChanges, reportedChanges);
+        CHECK(rawChanges > 100);
+        CHECK(reportedChanges <= 2);
+        CHECK(battery.getMillivolts() > 3030 && battery.getMillivolts() < 3070);
+        CHECK(adc.early == 0);
+    }
+
+    // A real drop is followed within a few samples, to within the hysteresis
+    {
+        SimBatteryAdc adc;
+        adc.millivolts = 3200;
+        BatteryMonitor battery(&adc, curve, CURVE_POINTS, SETTLE_MS);
+        sample(&battery);
+        CHECK(battery.getPercent() == 90);
+        adc.millivolts = 2900;
+        byte settled = battery.percentFor(2900 + BATT_HYSTERESIS_MV);
+        int n = 0;
+        while (battery.getPercent() > settled && n < 50) {
+            sample(&battery);
+            n++;
+        }
+        printf("step from 3200 to 2900 mV followed in %d samples\n", n);
+        CHECK(n <= 20);
+        CHECK(battery.getPercent() >= 35);
+
+        // Small moves back up within the hysteresis are not reported
+        byte level = battery.getPercent();
+        adc.millivolts = 2900 + BATT_HYSTERESIS_MV / 2;
+        for (int i = 0; i < 20; i++)
+            sample(&battery);
+        CHECK(battery.getPercent() == level);
+    }
+
+    // Starting again while a sample is pending does not restart the wait
+    {
+        SimBatteryAdc adc;
+        BatteryMonitor battery(&adc, curve, CURVE_POINTS, SETTLE_MS);
+        battery.start(millis());
+        delay(SETTLE_MS - 10);
+        battery.start(millis());
+        CHECK(battery.getPollDelay(millis()) == 10);
+    }
+
+    return checkResult("batteryTest");
+}
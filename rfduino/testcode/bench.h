@@ -0,0 +1,42 @@
+/**
+ * Helpers shared by the host benchmarks. Cycle counts come from the time
+ * stamp counter where there is one, otherwise from the monotonic clock.
+ * Library call counts are for the M0, which has no FPU or divide.
+ */
+
+#ifndef bench_h
+#define bench_h
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Soft-float calls fmtFloat makes on the M0 for a positive value (compare,
+// unsigned to double twice, divide, add, double to unsigned twice,
+// subtract, multiply)
+#define FMTFLOAT_CALLS      (9)
+
+// Wall clock in nanoseconds
+static inline uint64_t benchNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// CPU cycles, or nanoseconds if the CPU has no readable cycle counter
+static inline uint64_t benchCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return benchNanos();
+#endif
+}
+
+// Keep the optimizer from discarding a benchmarked result
+static inline void benchKeep(const void *p) {
+    __asm__ __volatile__("" : : "g"(p) : "memory");
+}
+
+#endif
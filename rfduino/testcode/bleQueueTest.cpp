@@ -0,0 +1,197 @@
+/**
+ * Tests the BLE transmit queue against simulated links of different
+ * capacities, and compares it with the fixed 50 ms throttle it replaces.
+ * Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./bleQueueTest
+ */
+
+#include <Arduino.h>
+#include "BleTxQueue.h"
+#include "BleLinkSim.h"
+#include "check.h"
+
+// A 20 byte notification carrying a sequence number
+static void makePacket(char *packet, unsigned int seq) {
+    for (int i = 0; i < 20; i++)
+        packet[i] = (char)(seq * 7 + i);
+    packet[0] = seq & 0xFF;
+    packet[1] = seq >> 8;
+}
+
+// Whether the delivered packets are exactly 0..n-1 in order
+static bool deliveredInOrder(SimBleLink &link, unsigned int n) {
+    if (link.getDelivered() != n)
+        return false;
+    for (unsigned int i = 0; i < n; i++) {
+        char expect[20];
+        makePacket(expect, i);
+        if (link.getPacketLength(i) != 20 ||
+            memcmp(link.getPacket(i), expect, 20) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Let the link drain whatever is still buffered
+static void drain(SimBleLink &link) {
+    delay(100);
+    link.update();
+}
+
+// Send n packets through a queue and return the time it took in ms
+static unsigned long sendThroughQueue(SimBleLink &link, BleTxQueue &queue,
+                                      unsigned int n) {
+    unsigned long start = millis();
+    char packet[20];
+    for (unsigned int i = 0; i < n; i++) {
+        makePacket(packet, i);
+        CHECK(queue.send(packet, 20));
+    }
+    CHECK(queue.flush(10000));
+    unsigned long elapsed = millis() - start;
+    drain(link);
+    return elapsed;
+}
+
+int main() {
+    char packet[20];
+
+    // The old calibration dump: one notification per 50 ms
+    {
+        SimBleLink link;
+        unsigned long start = millis();
+        for (unsigned int i = 0; i < 43; i++) {
+            makePacket(packet, i);
+            link.send(packet, 20);
+            delay(50);
+        }
+        unsigned long elapsed = millis() - start;
+        drain(link);
+        printf("fixed 50 ms throttle: 43 packets in %lu ms\n", elapsed);
+        CHECK(deliveredInOrder(link, 43));
+    }
+
+    // Blind sends with no throttle lose most of a burst
+    {
+        SimBleLink link;
+        for (unsigned int i = 0; i < 43; i++) {
+            makePacket(packet, i);
+            link.send(packet, 20);
+        }
+        drain(link);
+        printf("unthrottled: %lu of 43 packets refused\n", link.getRefused());
+        CHECK(link.getRefused() > 0);
+    }
+
+    // Through the queue: nothing lost, far faster than the fixed throttle
+    {
+        SimBleLink link;
+        BleTxQueue queue(&link);
+        unsigned long elapsed = sendThroughQueue(link, queue, 43);
+        printf("queue: 43 packets in %lu ms, %lu retries\n", elapsed,
+               queue.getRetryCount());
+        CHECK(deliveredInOrder(link, 43));
+        CHECK(elapsed < 43 * 50 / 4);
+        CHECK(queue.getDropCount() == 0);
+    }
+
+    // A long transfer settles near the link's capacity (4 packets per 7.5 ms)
+    {
+        SimBleLink link;
+        BleTxQueue queue(&link);
+        unsigned long elapsed = sendThroughQueue(link, queue, 2000);
+        double ideal = 2000 / 4.0 * 7.5;
+        printf("queue: 2000 packets in %lu ms (link limit %.0f ms), gap %u ms\n",
+               elapsed, ideal, queue.getGap());
+        CHECK(deliveredInOrder(link, 2000));
+        CHECK(elapsed < 2 * ideal);
+    }
+
+    // A slow link with small buffers: the gap backs off, nothing is dropped
+    {
+        SimBleLink link(2, 1, 30000);
+        BleTxQueue queue(&link);
+        unsigned long elapsed = sendThroughQueue(link, queue, 200);
+        printf("slow link: 200 packets in %lu ms, %lu retries, gap %u ms\n",
+               elapsed, queue.getRetryCount(), queue.getGap());
+        CHECK(deliveredInOrder(link, 200));
+        CHECK(queue.getGap() >= 10);
+        CHECK(link.getAccepted() == 200);
+    }
+
+    // Air loss cannot be seen by the sender, but the queue loses nothing
+    // itself: every packet is accepted by the radio exactly once
+    {
+        SimBleLink link;
+        link.setLossRate(0.05);
+        BleTxQueue queue(&link);
+        sendThroughQueue(link, queue, 1000);
+        printf("lossy link: %lu delivered, %lu lost over the air\n",
+               link.getDelivered(), link.getLost());
+        CHECK(link.getAccepted() == 1000);
+        CHECK(link.getDelivered() + link.getLost() == 1000);
+    }
+
+    // Limits
+    {
+        SimBleLink link;
+        BleTxQueue queue(&link);
+        char big[TXQ_MAX_PAYLOAD + 1] = { 0 };
+        CHECK(!queue.send(big, sizeof(big)));
+        CHECK(queue.getDropCount() == 1);
+        CHECK(queue.getSendDelay() == TXQ_IDLE);
+        CHECK(queue.flush(0));
+    }
+
+    // On a stalled link the queue fills, and the non-blocking calls then fail
+    // at once instead of waiting on it
+    {
+        SimBleLink link;
+        BleTxQueue queue(&link);
+        char packet[TXQ_MAX_PAYLOAD] = { 0 };
+        int queued = 0;
+        while (queue.tryReserve() && queued < 100) {
+            CHECK(queue.trySend(packet, sizeof(packet)));
+            queued++;
+        }
+        CHECK((unsigned long)queued == TXQ_SLOTS + link.getAccepted());
+        unsigned long start = millis();
+        CHECK(queue.tryReserve() == NULL);
+        CHECK(queue.getDropCount() == 0);
+        CHECK(!queue.trySend(packet, sizeof(packet)));
+        CHECK(queue.getDropCount() == 1);
+        CHECK(millis() == start);
+
+        // Once the link moves again there is room
+        for (int i = 0; i < 100; i++) {
+            delay(1);
+            link.update();
+            queue.pump();
+        }
+        CHECK(queue.tryReserve() != NULL);
+    }
+
+    // Notifications built in place go out like copied ones, in order
+    {
+        SimBleLink link;
+        BleTxQueue queue(&link);
+        CHECK(queue.send("ab", 2));
+        char *slot = queue.reserve();
+        CHECK(slot != NULL);
+        memcpy(slot, "cde", 3);
+        CHECK(queue.commit(3));
+        CHECK(!queue.commit(TXQ_MAX_PAYLOAD + 1));
+        CHECK(queue.flush(1000));
+        for (int i = 0; i < 100; i++) {
+            delay(1);
+            link.update();
+        }
+        CHECK(link.getDelivered() == 2);
+        CHECK(link.getPacketLength(0) == 2 && !memcmp(link.getPacket(0), "ab", 2));
+        CHECK(link.getPacketLength(1) == 3 && !memcmp(link.getPacket(1), "cde", 3));
+    }
+
+    return checkResult("bleQueueTest");
+}
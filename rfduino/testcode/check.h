@@ -0,0 +1,27 @@
+/**
+ * Check helpers shared by the host tests. A failed check prints where it
+ * failed and the test carries on; checkResult() reports the outcome and
+ * gives main() its exit status.
+ */
+
+#ifndef check_h
+#define check_h
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// Prints whether the named test passed, and returns non-zero if it failed
+static inline int checkResult(const char *name) {
+    printf("%s: %s\n", name, failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,281 @@
+/**
+ * Tests the flash record log against file-backed flash: reading back across
+ * reboots, refusing to overwrite when full, wear leveling, and recovering
+ * from torn writes and corrupt cells. Also tests the boot counter. Exits
+ * non-zero if any check fails.
+ *
+ * Usage:
+ *  ./flashLogTest
+ */
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "FlashLog.h"
+#include "BootCounter.h"
+#include "FlashSim.h"
+#include "check.h"
+
+#define FLASH_FILE  "flashLogTest.bin"
+#define FIRST_PAGE  (219)
+#define PAGES       (8)
+#define BOOT_FILE   "flashLogTest.boot"
+#define BOOT_PAGE   (218)
+
+static Record makeRecord(uint16_t seq) {
+    Record r;
+    r.seq = seq;
+    r.time = seq * 7;
+    r.boot = seq % 5;
+    r.type = 1 + seq % 3;
+    r.index = seq % 41;
+    r.value = (int16_t)(seq * 13 - 3000);
+    return r;
+}
+
+static bool sameRecord(const Record &a, const Record &b) {
+    return a.seq == b.seq && a.time == b.time && a.boot == b.boot &&
+           a.type == b.type &&
+           a.index == b.index && a.value == b.value;
+}
+
+// Check the log holds exactly the records first to first + n - 1
+static bool holds(FlashLog &log, uint16_t first, unsigned long n) {
+    if (log.count() != n)
+        return false;
+    Record r;
+    for (unsigned long i = 0; i < n; i++) {
+        if (!log.read(i, &r) || !sameRecord(r, makeRecord(first + i)))
+            return false;
+    }
+    return !log.read(n, &r);
+}
+
+static unsigned long pushRange(FlashLog &log, uint16_t first, unsigned long n) {
+    unsigned long pushed = 0;
+    for (unsigned long i = 0; i < n; i++) {
+        Record r = makeRecord(first + i);
+        if (!log.push(&r))
+            break;
+        pushed++;
+    }
+    return pushed;
+}
+
+int main() {
+    remove(FLASH_FILE);
+    FileFlash flash(FLASH_FILE, FIRST_PAGE, PAGES);
+
+    // An erased range is an empty log
+    {
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        uint16_t seq;
+        CHECK(log.begin());
+        CHECK(log.count() == 0);
+        CHECK(!log.getNewestSeq(&seq));
+        CHECK(log.getCapacity() == (PAGES - 1) * FLASH_LOG_SLOTS_PER_PAGE);
+        CHECK(pushRange(log, 0, 100) == 100);
+        CHECK(holds(log, 0, 100));
+    }
+
+    // The records, and what was dropped, survive a reboot
+    {
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        CHECK(log.begin());
+        CHECK(holds(log, 0, 100));
+        log.drop(30);
+        CHECK(holds(log, 30, 70));
+    }
+    {
+        FileFlash reopened(FLASH_FILE, FIRST_PAGE, PAGES);
+        FlashLog log(&reopened, FIRST_PAGE, PAGES);
+        uint16_t seq;
+        CHECK(log.begin());
+        CHECK(holds(log, 30, 70));
+        CHECK(log.getNewestSeq(&seq) && seq == 99);
+    }
+
+    // When full, pushes fail and nothing is overwritten
+    {
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        CHECK(log.begin());
+        unsigned long room = pushRange(log, 100, 100000);
+        CHECK(room + 70 >= log.getCapacity());
+        CHECK(room + 70 <= PAGES * FLASH_LOG_SLOTS_PER_PAGE);
+        CHECK(holds(log, 30, 70 + room));
+
+        // Dropping a page's worth makes room again
+        Record r = makeRecord(0);
+        CHECK(!log.push(&r));
+        log.drop(2 * FLASH_LOG_SLOTS_PER_PAGE);
+        CHECK(pushRange(log, 100 + room, FLASH_LOG_SLOTS_PER_PAGE) ==
+              FLASH_LOG_SLOTS_PER_PAGE);
+        log.drop(log.count());
+        CHECK(log.count() == 0);
+    }
+
+    // Pages wear evenly over many fill and drain cycles, and no write ever
+    // tries to set a bit
+    {
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        CHECK(log.begin());
+        uint16_t seq = 0;
+        for (int cycle = 0; cycle < 200; cycle++) {
+            unsigned long n = pushRange(log, seq, 37 + cycle % 50);
+            seq += n;
+            log.drop(n - cycle % 3);
+
+            // Reboot now and then
+            if (cycle % 17 == 0) {
+                unsigned long left = log.count();
+                CHECK(log.begin());
+                CHECK(holds(log, seq - left, left));
+            }
+        }
+        unsigned long least = 0xFFFFFFFF, most = 0;
+        for (int p = FIRST_PAGE; p < FIRST_PAGE + PAGES; p++) {
+            unsigned long e = flash.getEraseCount(p);
+            least = e < least ? e : least;
+            most = e > most ? e : most;
+        }
+        printf("page erases: %lu to %lu\n", least, most);
+        CHECK(most > 10 && most - least <= 1);
+        CHECK(flash.getBitViolations() == 0);
+        log.drop(log.count());
+    }
+
+    // A reset partway through writing a record loses only that record
+    {
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        CHECK(log.begin());
+        CHECK(pushRange(log, 500, 10) == 10);
+        flash.setPowerFailAfter(5);
+        Record r = makeRecord(510);
+        CHECK(!log.push(&r));
+        flash.restore();
+
+        FlashLog rebooted(&flash, FIRST_PAGE, PAGES);
+        CHECK(rebooted.begin());
+        CHECK(rebooted.getCorruptCount() == 1);
+        CHECK(holds(rebooted, 500, 10));
+        CHECK(pushRange(rebooted, 510, 5) == 5);
+        CHECK(holds(rebooted, 500, 15));
+        rebooted.drop(15);
+    }
+
+    // Nor does a reset while opening a new page, wherever in the header or
+    // the first record it happens
+    for (int tornAt = 0; tornAt < 12; tornAt += 2) {
+        for (int p = FIRST_PAGE; p < FIRST_PAGE + PAGES; p++)
+            flash.erasePage(p);
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        CHECK(log.begin());
+        CHECK(pushRange(log, 0, FLASH_LOG_SLOTS_PER_PAGE) == FLASH_LOG_SLOTS_PER_PAGE);
+        flash.setPowerFailAfter(tornAt);
+        Record r = makeRecord(FLASH_LOG_SLOTS_PER_PAGE);
+        CHECK(!log.push(&r));
+        flash.restore();
+
+        CHECK(log.begin());
+        CHECK(holds(log, 0, FLASH_LOG_SLOTS_PER_PAGE));
+        CHECK(pushRange(log, FLASH_LOG_SLOTS_PER_PAGE, 10) == 10);
+        CHECK(log.begin());
+        CHECK(holds(log, 0, FLASH_LOG_SLOTS_PER_PAGE + 10));
+        log.drop(log.count());
+    }
+
+    // A bad cell in a record is caught by its CRC and the record skipped
+    {
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        CHECK(log.begin());
+        CHECK(pushRange(log, 700, 3) == 3);
+        Record r;
+        CHECK(log.read(1, &r));
+        unsigned long corruptBefore = log.getCorruptCount();
+        for (int p = FIRST_PAGE; p < FIRST_PAGE + PAGES; p++) {
+            for (int s = 0; s < FLASH_LOG_SLOTS_PER_PAGE; s++) {
+                uint32_t slot[4];
+                int offset = FLASH_LOG_HEADER_SIZE + s * FLASH_LOG_SLOT_SIZE;
+                flash.read(p, offset, slot, sizeof(slot));
+                if (slot[3] == 0xFFFFFFFF && (slot[0] & 0xFFFF) == 701)
+                    flash.corrupt(p, offset + 6, 3);
+            }
+        }
+        CHECK(log.begin());
+        CHECK(log.getCorruptCount() == corruptBefore + 1);
+        CHECK(log.count() == 2);
+        CHECK(log.read(0, &r) && r.seq == 700);
+        CHECK(log.read(1, &r) && r.seq == 702);
+        log.drop(2);
+    }
+
+    // As the RAM ring's overflow, records come out in order after a reboot
+    // of the log
+    {
+        FlashLog log(&flash, FIRST_PAGE, PAGES);
+        CHECK(log.begin());
+        RecordRing ring;
+        ring.setSpill(&log);
+        for (int i = 0; i < 300; i++)
+            ring.add(RECORD_IMPEDANCE, i % 41, i, i);
+        CHECK(log.count() == 300 - RECORD_RING_SIZE);
+        CHECK(ring.getDropCount() == 0);
+        CHECK(log.begin());
+
+        byte frame[SWEEP_FRAME_SIZE];
+        Record records[RECORDS_PER_FRAME];
+        int len, expected = 0;
+        while ((len = ring.packFrame(frame)) > 0) {
+            int n = RecordRing::decodeFrame(frame, len, records);
+            for (int k = 0; k < n; k++, expected++)
+                CHECK(records[k].seq == expected && records[k].value == expected);
+        }
+        CHECK(expected == 300);
+        ring.commit();
+        CHECK(ring.isEmpty() && log.count() == 0);
+
+        // After a reboot, a new ring numbers on from the records in flash,
+        // even though they have all been sent
+        uint16_t seq;
+        CHECK(log.begin());
+        CHECK(log.getNewestSeq(&seq) && seq == 300 - RECORD_RING_SIZE - 1);
+        RecordRing rebooted;
+        rebooted.setNextSeq(seq + 1);
+        rebooted.add(RECORD_BATTERY, 0, 80, 1);
+        len = rebooted.packFrame(frame);
+        CHECK(RecordRing::decodeFrame(frame, len, records) == 1);
+        CHECK(records[0].seq == 300 - RECORD_RING_SIZE);
+    }
+
+    // Boots are counted across resets, skipping an entry torn by one, and
+    // the page is erased only when every entry is used
+    {
+        remove(BOOT_FILE);
+        FileFlash bootFlash(BOOT_FILE, BOOT_PAGE, 1);
+        for (unsigned long boot = 1; boot <= 3; boot++) {
+            BootCounter counter(&bootFlash, BOOT_PAGE);
+            CHECK(counter.getCount() == 0);
+            CHECK(counter.bump());
+            CHECK(counter.getCount() == boot);
+        }
+
+        bootFlash.setPowerFailAfter(2);
+        BootCounter torn(&bootFlash, BOOT_PAGE);
+        CHECK(!torn.bump());
+        bootFlash.restore();
+        BootCounter next(&bootFlash, BOOT_PAGE);
+        CHECK(next.bump() && next.getCount() == 4);
+
+        for (int i = 0; i < 2 * BOOT_COUNTER_ENTRIES; i++) {
+            BootCounter counter(&bootFlash, BOOT_PAGE);
+            counter.bump();
+        }
+        BootCounter last(&bootFlash, BOOT_PAGE);
+        CHECK(last.bump() && last.getCount() == 5 + 2 * BOOT_COUNTER_ENTRIES);
+        CHECK(bootFlash.getEraseCount(BOOT_PAGE) == 2);
+        CHECK(bootFlash.getBitViolations() == 0);
+        remove(BOOT_FILE);
+    }
+
+    remove(FLASH_FILE);
+    return checkResult("flashLogTest");
+}
@@ -0,0 +1,213 @@
+/**
+ * Compares the cost of formatting the sketch's messages with sprintf, with
+ * the old FloatToString digit loop and fmtFloat, and with the shared
+ * FastFormat functions writing in place. Messages are a sweep point
+ * ("I$freq$real$imag") and a temperature ("T$98.60").
+ *
+ * The RFduino's Cortex-M0 has no divide instruction and no FPU, so there
+ * every division is a library call (__aeabi_uidiv, tens of cycles) and
+ * every double operation a soft-float call (around a hundred or more). The
+ * host does both in hardware, and turns divisions by a constant into
+ * multiplies, so its cycle counts say little about the M0. The comparison
+ * is made on those library calls: FastFormat is built with
+ * FMT_COUNT_DIVISIONS to count its divisions as it runs, and the digit loop
+ * counts its own. Host cycles are printed for reference only.
+ *
+ * Usage:
+ *  ./formatBench [iterations]
+ */
+
+#include <Arduino.h>
+#include <string.h>
+#include "FastFormat.h"
+#include "bench.h"
+
+#define POINTS  (41)
+
+// Soft-float calls for a temperature: fmtFloat's (see bench.h), plus the
+// divide and conversion to get the value in degrees
+#define TEMP_FLOAT_CALLS    (FMTFLOAT_CALLS + 2)
+
+// Divisions done by the digit loop; % and / by 10 are one __aeabi_uidivmod
+static unsigned long legacyDivisions = 0;
+
+// The digit loop the sketches' FloatToString copies used, one division
+// per digit. Kept out of line, as it was in its own file.
+__attribute__((noinline))
+static unsigned legacyUnsigned(unsigned long val, char *buf, unsigned bufLen) {
+    char dbuf[10];
+    unsigned idx = 0;
+    while (idx < sizeof(dbuf)) {
+        legacyDivisions++;
+        dbuf[idx++] = (val % 10) + '0';
+        if ((val /= 10) == 0)
+            break;
+    }
+    unsigned len = 0;
+    while (--bufLen > 0 && idx) {
+        *buf++ = dbuf[--idx];
+        len++;
+    }
+    *buf = '\0';
+    return len;
+}
+
+static unsigned legacySigned(long val, char *buf, unsigned bufLen) {
+    if (val >= 0)
+        return legacyUnsigned(val, buf, bufLen);
+    *buf = '-';
+    return 1 + legacyUnsigned(-val, buf + 1, bufLen - 1);
+}
+
+// Sweep points, as the AD5933 returns them
+static int reals[POINTS], imags[POINTS];
+
+static int pointSprintf(int i, char *out) {
+    char str[65];
+    sprintf(str, "I$%d$%d$%d", 80 + i, reals[i], imags[i]);
+    int len = strlen(str);
+    memcpy(out, str, len);   // RFduinoBLE.send copies the stack buffer
+    return len;
+}
+
+static int pointLegacy(int i, char *out) {
+    char str[65];
+    int len = 0;
+    str[len++] = 'I';
+    str[len++] = '$';
+    len += legacySigned(80 + i, str + len, sizeof(str) - len);
+    str[len++] = '$';
+    len += legacySigned(reals[i], str + len, sizeof(str) - len);
+    str[len++] = '$';
+    len += legacySigned(imags[i], str + len, sizeof(str) - len);
+    memcpy(out, str, len);
+    return len;
+}
+
+static int pointInPlace(int i, char *out) {
+    Formatter msg(out, 20);
+    msg.addText("I$").addSigned(80 + i).addChar('$').addSigned(reals[i])
+       .addChar('$').addSigned(imags[i]);
+    return msg.length();
+}
+
+// Temperatures in hundredths of a degree F, over the DS18B20 range
+static int tempSprintf(int i, char *out) {
+    long t = -6700 + i * 11;
+    char str[65];
+    long mag = t < 0 ? -t : t;
+    sprintf(str, "T$%s%ld.%02ld", t < 0 ? "-" : "", mag / 100, mag % 100);
+    int len = strlen(str);
+    memcpy(out, str, len);
+    return len;
+}
+
+static int tempFloat(int i, char *out) {
+    long t = -6700 + i * 11;
+    char str[65];
+    str[0] = 'T';
+    str[1] = '$';
+    fmtFloat(t / 100.0, 2, str + 2, 63);
+    int len = strlen(str);
+    memcpy(out, str, len);
+    return len;
+}
+
+static int tempInPlace(int i, char *out) {
+    long t = -6700 + i * 11;
+    Formatter msg(out, 20);
+    msg.addText("T$").addFixed(t, 2);
+    return msg.length();
+}
+
+// Divisions, as the M0 would make library calls for them, per message
+static double divisions(int (*format)(int, char*), int n) {
+    char out[20];
+    legacyDivisions = 0;
+    fmtDivisions = 0;
+    for (int i = 0; i < n; i++)
+        format(i, out);
+    return (double)(legacyDivisions + fmtDivisions) / n;
+}
+
+// Run a formatter over n messages and return cycles per message
+static double run(int (*format)(int, char*), int n, long iterations) {
+    char out[20];
+    uint64_t start = benchCycles();
+    for (long k = 0; k < iterations; k++) {
+        for (int i = 0; i < n; i++) {
+            format(i, out);
+            benchKeep(out);
+        }
+    }
+    return (double)(benchCycles() - start) / ((double)n * iterations);
+}
+
+// Check every way gives the same text
+static int compare(int (*a)(int, char*), int (*b)(int, char*), int n) {
+    int mismatches = 0;
+    for (int i = 0; i < n; i++) {
+        char x[20], y[20];
+        int lx = a(i, x), ly = b(i, y);
+        if (lx != ly || memcmp(x, y, lx)) {
+            printf("MISMATCH %.*s %.*s\n", lx, x, ly, y);
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+
+    uint32_t rng = 12345;
+    for (int i = 0; i < POINTS; i++) {
+        rng = rng * 1103515245 + 12345;
+        reals[i] = (int)(rng >> 16) % 32768 - 16384;
+        rng = rng * 1103515245 + 12345;
+        imags[i] = (int)(rng >> 16) % 32768 - 16384;
+    }
+    const int temps = 1640;
+
+    int mismatches = compare(pointSprintf, pointLegacy, POINTS) +
+                     compare(pointSprintf, pointInPlace, POINTS) +
+                     compare(tempSprintf, tempInPlace, temps);
+    // fmtFloat can round the last digit differently
+    for (int i = 0; i < temps; i++) {
+        char x[21], y[21];
+        x[tempSprintf(i, x)] = '\0';
+        y[tempFloat(i, y)] = '\0';
+        if (fabs(atof(x + 2) - atof(y + 2)) > 0.0101) {
+            printf("MISMATCH %s %s\n", x, y);
+            mismatches++;
+        }
+    }
+
+    double pL = divisions(pointLegacy, POINTS);
+    double pI = divisions(pointInPlace, POINTS);
+    double tF = divisions(tempFloat, temps);
+    double tI = divisions(tempInPlace, temps);
+    printf("M0 library calls per message\n");
+    printf("sweep point  digit loop:  %5.1f divisions\n", pL);
+    printf("             in place:    %5.1f divisions (%.1fx fewer)\n", pI,
+           pL / pI);
+    printf("temperature  fmtFloat:    %5.1f divisions + %d soft-float calls\n",
+           tF, TEMP_FLOAT_CALLS);
+    printf("             in place:    %5.1f divisions, no soft-float\n", tI);
+
+    printf("\nhost cycles per message (hardware divide and FPU; for "
+           "reference only)\n");
+    printf("sweep point  sprintf + copy:     %7.1f\n",
+           run(pointSprintf, POINTS, iterations));
+    printf("             digit loop + copy:  %7.1f\n",
+           run(pointLegacy, POINTS, iterations));
+    printf("             in place:           %7.1f\n",
+           run(pointInPlace, POINTS, iterations));
+    printf("temperature  sprintf + copy:     %7.1f\n",
+           run(tempSprintf, temps, iterations / 40));
+    printf("             fmtFloat + copy:    %7.1f\n",
+           run(tempFloat, temps, iterations / 40));
+    printf("             in place:           %7.1f\n",
+           run(tempInPlace, temps, iterations / 40));
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * Tests the shared number formatting against sprintf, including widths,
+ * short buffers and the in-place message builder. Exits non-zero if any
+ * check fails.
+ *
+ * Usage:
+ *  ./formatTest
+ */
+
+#include <Arduino.h>
+#include <limits.h>
+#include <string.h>
+#include "FastFormat.h"
+#include "check.h"
+
+// Values around every power of ten, and the extremes
+static long values[200];
+static int numValues = 0;
+
+static void addValue(long v) {
+    values[numValues++] = v;
+    values[numValues++] = -v;
+}
+
+int main() {
+    long p = 1;
+    addValue(0);
+    for (int i = 0; i < 10; i++, p *= 10) {
+        addValue(p - 1);
+        addValue(p);
+        addValue(p + 1);
+        addValue(p * 5 + 3);
+    }
+    addValue(LONG_MAX);
+    values[numValues++] = LONG_MIN;
+
+    char a[64], b[64];
+    for (int k = 0; k < numValues; k++) {
+        long v = values[k];
+        unsigned long u = (unsigned long)v;
+
+        // Integers, with and without padding
+        sprintf(a, "%lu", u);
+        CHECK(fmtUnsigned(u, b, sizeof(b), 0) == strlen(a) && !strcmp(a, b));
+        sprintf(a, "%012lu", u);
+        CHECK(fmtUnsigned(u, b, sizeof(b), 12) == strlen(a) && !strcmp(a, b));
+        sprintf(a, "%ld", v);
+        CHECK(fmtSigned(v, b, sizeof(b)) == strlen(a) && !strcmp(a, b));
+
+        // Fixed point, by exact integer arithmetic
+        for (byte prec = 0; prec <= FMT_MAX_PRECISION; prec++) {
+            unsigned long div = 1;
+            for (int i = 0; i < prec; i++)
+                div *= 10;
+            unsigned long mag = v < 0 ? 0 - u : u;
+            if (prec)
+                sprintf(a, "%s%lu.%0*lu", v < 0 ? "-" : "", mag / div, prec,
+                        mag % div);
+            else
+                sprintf(a, "%s%lu", v < 0 ? "-" : "", mag);
+            CHECK(fmtFixed(v, prec, b, sizeof(b)) == strlen(a) && !strcmp(a, b));
+
+            Formatter f(b, sizeof(b));
+            f.addFixed(v, prec);
+            CHECK(f.length() == (int)strlen(a) && !strcmp(a, b));
+        }
+
+        Formatter f(b, sizeof(b));
+        f.addSigned(v).addChar('$').addUnsigned(u, 11);
+        sprintf(a, "%ld$%011lu", v, u);
+        CHECK(f.length() == (int)strlen(a) && !strcmp(a, b) && !f.overflowed());
+    }
+
+    // Floating point, now with the sign
+    fmtFloat(-98.605, 2, b, sizeof(b));
+    CHECK(!strcmp(b, "-98.61") || !strcmp(b, "-98.60"));
+    fmtFloat(3.14159, 3, b, sizeof(b));
+    CHECK(!strcmp(b, "3.142"));
+    fmtFloat(7, 0, b, sizeof(b));
+    CHECK(!strcmp(b, "7"));
+
+    // Short buffers keep the leading characters and are terminated
+    CHECK(fmtUnsigned(123456, b, 4, 0) == 3 && !strcmp(b, "123"));
+    CHECK(fmtUnsigned(42, b, 4, 8) == 3 && !strcmp(b, "000"));
+    CHECK(fmtUnsigned(42, b, 6, 6) == 5 && !strcmp(b, "00004"));
+    CHECK(fmtUnsigned(42, b, 1, 0) == 0 && b[0] == '\0');
+    CHECK(fmtSigned(-42, b, 2) == 1 && !strcmp(b, "-"));
+    CHECK(fmtFixed(12345, 2, b, 5) == 3 && !strcmp(b, "123"));
+
+    // A builder leaves out a field that does not fit, and never writes past
+    // its size
+    memset(b, 'x', sizeof(b));
+    Formatter f(b, 8);
+    f.addText("I$").addSigned(-1234).addChar('$');
+    CHECK(f.length() == 8 && !f.overflowed() && !memcmp(b, "I$-1234$", 8));
+    f.addUnsigned(5);
+    CHECK(f.length() == 8 && f.overflowed() && b[8] == 'x');
+
+    memset(b, 'x', sizeof(b));
+    Formatter g(b, 8);
+    g.addText("T$").addFixed(9860, 2).addFixed(1, 2);
+    CHECK(g.overflowed() && g.length() == 7 && !strcmp(b, "T$98.60"));
+
+    return checkResult("formatTest");
+}
@@ -0,0 +1,98 @@
+/**
+ * Tests the AD5933 gain surface against a synthetic AD5933 whose gain drifts
+ * with both frequency and magnitude. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./gainSurfaceTest
+ */
+
+#include <Arduino.h>
+#include <math.h>
+#include "GainSurface.h"
+#include "check.h"
+
+#define POINTS  (41)
+#define STEP    (4)
+
+// Magnitude the synthetic AD5933 reads for an impedance at a sweep point. The
+// gain rolls off with frequency and compresses at large magnitudes.
+static double readMagnitude(double ohms, int point) {
+    double ideal = 2.0e7 / ohms * (1.0 - 0.002 * point);
+    return ideal * (1.0 - ideal / 2.0e6);
+}
+
+static void sweep(double ohms, int real[], int imag[]) {
+    for (int i = 0; i < POINTS; i++) {
+        double mag = readMagnitude(ohms, i);
+        // Put some of it in the imaginary part, as the real part would be
+        real[i] = (int)lround(mag * 0.8);
+        imag[i] = (int)lround(mag * 0.6);
+    }
+}
+
+static double relError(double measured, double actual) {
+    return fabs(measured - actual) / actual;
+}
+
+int main() {
+    const double refs[] = { 200, 500, 1000, 2000, 5000, 10000 };
+    int real[POINTS], imag[POINTS];
+
+    // Needs two references before it can interpolate
+    GainSurface surface(POINTS, STEP);
+    CHECK(!surface.isReady());
+    CHECK(surface.getGain(0, 1000) == 0);
+
+    // References can be added in any order
+    for (int k = 5; k >= 0; k--) {
+        sweep(refs[k], real, imag);
+        CHECK(surface.addReference(refs[k], real, imag));
+    }
+    CHECK(surface.isReady());
+    CHECK(surface.getReferenceCount() == 6);
+    CHECK(!surface.addReference(300, real, imag));
+
+    // Single point gain taken at 1k, as the firmware used to do
+    double single[POINTS];
+    sweep(1000, real, imag);
+    for (int i = 0; i < POINTS; i++)
+        single[i] = (1.0 / 1000) / sqrt(pow(real[i], 2) + pow(imag[i], 2));
+
+    // At the references and node frequencies the surface is exact
+    for (int k = 0; k < 6; k++) {
+        for (int i = 0; i < POINTS; i += STEP) {
+            double mag = readMagnitude(refs[k], i);
+            CHECK(relError(1 / (mag * surface.getGain(i, mag)), refs[k]) < 1e-3);
+        }
+    }
+
+    // In between, it is much closer than the single point gain
+    double worstSurface = 0, worstSingle = 0;
+    for (double ohms = 200; ohms <= 10000; ohms *= 1.07) {
+        for (int i = 0; i < POINTS; i++) {
+            double mag = readMagnitude(ohms, i);
+            double e = relError(1 / (mag * surface.getGain(i, mag)), ohms);
+            if (e > worstSurface)
+                worstSurface = e;
+            e = relError(1 / (mag * single[i]), ohms);
+            if (e > worstSingle)
+                worstSingle = e;
+        }
+    }
+    printf("worst |Z| error: surface %.3f%%, single point %.3f%%\n",
+           100 * worstSurface, 100 * worstSingle);
+    CHECK(worstSurface < 0.01);
+    CHECK(worstSurface < worstSingle / 4);
+
+    // Outside the references, the nearest reference's gain is used
+    CHECK(relError(surface.getGain(0, 1e9),
+                   surface.getGain(0, readMagnitude(200, 0))) < 1e-6);
+    CHECK(relError(surface.getGain(0, 1),
+                   surface.getGain(0, readMagnitude(10000, 0))) < 1e-6);
+
+    // Clearing forgets everything
+    surface.clear();
+    CHECK(!surface.isReady());
+
+    return checkResult("gainSurfaceTest");
+}
@@ -0,0 +1,216 @@
+/**
+ * Tests the buffered serial log on a simulated UART: lines come out whole
+ * and in order, logging never waits on the baud rate, and disabled levels
+ * compile out. Compares a sweep that logs every point through the buffer
+ * with one that prints straight to the UART. Exits non-zero if any check
+ * fails.
+ *
+ * Usage:
+ *  ./logTest
+ */
+
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+#include <Arduino.h>
+#include "SerialLog.h"
+#include "UartSim.h"
+#include "check.h"
+
+#define POINTS              (41)
+#define CONVERSION_MICROS   (1100)
+#define POLL_MICROS         (100)
+
+// The text the sketch logs for a sweep point
+static int pointLine(char *buf, int size, int i) {
+    Formatter msg(buf, size);
+    msg.addText("I$").addSigned(80 + i).addChar('$').addSigned(1000 - 37 * i)
+       .addChar('$').addSigned(-250 + 11 * i);
+    return msg.length();
+}
+
+// Wait out a conversion, polling like AD5933::frequencySweepStream and
+// pumping the log while waiting
+static void convert(SerialLog *log) {
+    for (int t = 0; t < CONVERSION_MICROS; t += POLL_MICROS) {
+        delayMicroseconds(POLL_MICROS);
+        if (log)
+            log->pump();
+    }
+}
+
+// Whether the received text is some of the point lines, whole and in order,
+// and how many
+static bool wholePointLines(const char *text, int *count) {
+    int next = 0;
+    *count = 0;
+    while (*text) {
+        const char *eol = strstr(text, "\r\n");
+        if (!eol)
+            return false;
+        char expect[LOG_LINE_MAX + 1];
+        bool found = false;
+        for (; next < POINTS && !found; next++) {
+            int len = pointLine(expect, sizeof(expect), next);
+            found = eol - text == len && !memcmp(text, expect, len);
+        }
+        if (!found)
+            return false;
+        (*count)++;
+        text = eol + 2;
+    }
+    return true;
+}
+
+int main() {
+    char str[LOG_LINE_MAX + 1];
+
+    // Printing each point straight to a 9600 baud UART
+    unsigned long long direct;
+    {
+        SimUart uart(9600);
+        unsigned long long start = shimMicros();
+        for (int i = 0; i < POINTS; i++) {
+            convert(NULL);
+            int len = pointLine(str, sizeof(str), i);
+            uart.write((const byte*)str, len);
+            uart.write((const byte*)"\r\n", 2);
+        }
+        direct = shimMicros() - start;
+        printf("direct at 9600 baud: sweep of %d points took %llu us, "
+               "%llu us waiting on the UART\n", POINTS, direct,
+               uart.getBlockedMicros());
+    }
+
+    // The same through the log: the sweep takes the conversions alone. What
+    // the UART cannot keep up with is dropped a line at a time.
+    for (unsigned long baud = 9600; baud <= 115200; baud *= 12) {
+        SimUart uart(baud);
+        SerialLog log(&uart, baud);
+        unsigned long long start = shimMicros();
+        for (int i = 0; i < POINTS; i++) {
+            convert(&log);
+            log.write(str, pointLine(str, sizeof(str), i));
+        }
+        unsigned long long buffered = shimMicros() - start;
+        CHECK(uart.getBlockedMicros() == 0);
+        CHECK(buffered == (unsigned long long)POINTS * CONVERSION_MICROS);
+        CHECK(buffered < direct / 10);
+
+        log.flush();
+        int lines;
+        CHECK(wholePointLines(uart.getReceived(), &lines));
+        CHECK(lines + log.getDropCount() == POINTS);
+        printf("logged at %lu baud: sweep took %llu us, %d lines sent, "
+               "%lu dropped\n", baud, buffered, lines, log.getDropCount());
+    }
+
+    // Nothing is lost when the UART keeps up
+    {
+        SimUart uart(9600);
+        SerialLog log(&uart, 9600);
+        for (int i = 0; i < 10; i++) {
+            log.write(str, pointLine(str, sizeof(str), i));
+            while (!log.isEmpty()) {
+                delay(log.getDrainDelay());
+                log.pump();
+            }
+        }
+        int lines;
+        CHECK(wholePointLines(uart.getReceived(), &lines));
+        CHECK(lines == 10 && log.getDropCount() == 0);
+        CHECK(uart.getBlockedMicros() == 0);
+    }
+
+    // Lines and numbers
+    {
+        SimUart uart(115200);
+        SerialLog log(&uart, 115200);
+        CHECK(log.line("PCB Iteration 2 Started!"));
+        CHECK(log.line("Flash log records: ", 42));
+        CHECK(log.line("Temperature: ", -7));
+        CHECK(log.line(log.start().addText("  |Z|=").addFixed(123456, 2)));
+        log.flush();
+        CHECK(!strcmp(uart.getReceived(),
+                      "PCB Iteration 2 Started!\r\n"
+                      "Flash log records: 42\r\n"
+                      "Temperature: -7\r\n"
+                      "  |Z|=1234.56\r\n"));
+    }
+
+    // A line too long to build is dropped, not cut short
+    {
+        SimUart uart(115200);
+        SerialLog log(&uart, 115200);
+        Formatter &msg = log.start();
+        for (int i = 0; i < LOG_LINE_MAX + 1; i++)
+            msg.addChar('x');
+        CHECK(!log.line(msg));
+        CHECK(log.getDropCount() == 1);
+        CHECK(log.isEmpty());
+    }
+
+    // Drain delay follows the UART
+    {
+        SimUart uart(9600);
+        SerialLog log(&uart, 9600);
+        CHECK(log.getDrainDelay() == LOG_IDLE);
+        log.line("ab");
+        CHECK(log.getCount() == 3);
+        CHECK(log.getDrainDelay() == 2);
+        delay(2);
+        CHECK(log.getDrainDelay() == 0);
+        CHECK(log.pump() == 1);
+    }
+
+    // A UART with a transmit buffer is handed a chunk at a time, and the
+    // drain delay covers the whole chunk, so a long burst costs one wakeup
+    // per buffer rather than one per byte
+    {
+        SimUart uart(9600, 16);
+        SerialLog log(&uart, 9600, 16);
+        for (int i = 0; i < 10; i++)
+            log.write(str, pointLine(str, sizeof(str), i));
+        unsigned int queued = log.getCount() + 16;
+        CHECK(log.getCount() > 100);
+        CHECK(log.getDrainDelay() == (16 * 1042 + 999) / 1000);
+        CHECK(log.pump() == 0);
+        int wakeups = 0;
+        while (!log.isEmpty()) {
+            delay(log.getDrainDelay());
+            CHECK(log.pump() > 0);
+            wakeups++;
+        }
+        CHECK(wakeups == (int)(queued - 16 + 15) / 16);
+        CHECK(uart.getBlockedMicros() == 0);
+        int lines;
+        CHECK(wholePointLines(uart.getReceived(), &lines));
+        CHECK(lines == 10 && log.getDropCount() == 0);
+    }
+
+    // The count stays right as the queue indices wrap
+    {
+        SimUart uart(115200, 64);
+        SerialLog log(&uart, 115200, 64);
+        int len = pointLine(str, sizeof(str), 0);
+        for (long sent = 0; sent < 70000; sent += len + 2) {
+            log.write(str, len);
+            log.flush();
+            CHECK(log.getCount() == 0);
+        }
+        log.write(str, len);
+        CHECK(log.getCount() <= (unsigned int)len + 2);
+        CHECK(log.getDropCount() == 0);
+    }
+
+    // Levels above LOG_LEVEL compile out, arguments and all
+    {
+        int evaluated = 0;
+        LOG_ERROR(evaluated++);
+        LOG_WARN(evaluated++);
+        LOG_INFO(evaluated++);
+        LOG_DEBUG(evaluated++);
+        CHECK(evaluated == 3);
+    }
+
+    return checkResult("logTest");
+}
@@ -0,0 +1,65 @@
+/**
+ * Tests the command mailbox, including a producer thread posting against a
+ * consumer taking at full speed. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./mailboxTest
+ */
+
+#include <Arduino.h>
+#include <thread>
+#include "CommandMailbox.h"
+#include "check.h"
+
+#define STRESS_COMMANDS (200000)
+
+// Commands cycle through 1..255, skipping MAILBOX_EMPTY
+static byte commandFor(long i) {
+    return (byte)(i % 255 + 1);
+}
+
+int main() {
+    CommandMailbox box;
+    CHECK(box.isEmpty() && box.take() == MAILBOX_EMPTY);
+    CHECK(!box.post(MAILBOX_EMPTY));
+
+    // Fills to exactly MAILBOX_SIZE, in order, and counts drops past that
+    for (int i = 0; i < MAILBOX_SIZE; i++)
+        CHECK(box.post(i + 1));
+    CHECK(box.getCount() == MAILBOX_SIZE);
+    CHECK(!box.post(99) && box.getDropCount() == 1);
+    for (int i = 0; i < MAILBOX_SIZE; i++)
+        CHECK(box.take() == i + 1);
+    CHECK(box.isEmpty());
+
+    // Wraps around the 8-bit indices
+    for (int i = 0; i < 1000; i++) {
+        CHECK(box.post(commandFor(i)) && box.post(commandFor(i + 1)));
+        CHECK(box.take() == commandFor(i) && box.take() == commandFor(i + 1));
+    }
+
+    // Concurrent producer: every command arrives once, in order. The producer
+    // yields and retries when full so nothing is dropped.
+    CommandMailbox shared;
+    std::thread producer([&shared]() {
+        for (long i = 0; i < STRESS_COMMANDS; i++)
+            while (!shared.post(commandFor(i)))
+                std::this_thread::yield();
+    });
+    long received = 0, outOfOrder = 0;
+    while (received < STRESS_COMMANDS) {
+        byte command = shared.take();
+        if (command == MAILBOX_EMPTY) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (command != commandFor(received))
+            outOfOrder++;
+        received++;
+    }
+    producer.join();
+    CHECK(outOfOrder == 0);
+    CHECK(shared.isEmpty());
+
+    return checkResult("mailboxTest");
+}
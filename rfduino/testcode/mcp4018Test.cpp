@@ -0,0 +1,130 @@
+/**
+ * Tests the MCP4018 resistance mapping over every value code. Exits non-zero
+ * if any check fails.
+ *
+ * Usage:
+ *  ./mcp4018Test
+ */
+
+#include <Arduino.h>
+#include "MCP4018.h"
+#include "MCP4018Sim.h"
+#include "check.h"
+
+// Brute force nearest code, for comparison
+static byte nearest(unsigned long ohms) {
+    byte best = POT_MIN;
+    for (int code = POT_MIN; code <= POT_MAX; code++) {
+        long d = (long)MCP4018::getOhmsForValue(code) - (long)ohms;
+        long b = (long)MCP4018::getOhmsForValue(best) - (long)ohms;
+        if (labs(d) < labs(b))
+            best = code;
+    }
+    return best;
+}
+
+int main() {
+    // Every code round-trips, through both the integer and float API
+    for (int code = POT_MIN; code <= POT_MAX; code++) {
+        unsigned long ohms = MCP4018::getOhmsForValue(code);
+        CHECK(MCP4018::getValueForOhms(ohms) == code);
+        CHECK(MCP4018::getResistanceForValue(code) == (float)ohms);
+        CHECK(MCP4018::getValueForResistance(ohms) == code);
+
+        // Matches the nominal model to within rounding
+        double model = WIPER_RESISTANCE + (POT_MAX - code) * STEP_RESISTANCE;
+        CHECK(fabs(ohms - model) <= 0.5);
+    }
+
+    // Resistance decreases monotonically with the code
+    for (int code = POT_MIN + 1; code <= POT_MAX; code++)
+        CHECK(MCP4018::getOhmsForValue(code) < MCP4018::getOhmsForValue(code - 1));
+
+    // Every resistance in range maps to the nearest code
+    for (unsigned long ohms = 0; ohms <= MAX_RESISTANCE + WIPER_RESISTANCE; ohms += 7) {
+        byte code = MCP4018::getValueForOhms(ohms);
+        long d = labs((long)MCP4018::getOhmsForValue(code) - (long)ohms);
+        long b = labs((long)MCP4018::getOhmsForValue(nearest(ohms)) - (long)ohms);
+        CHECK(d == b);
+    }
+
+    // Out of range inputs
+    CHECK(MCP4018::getValueForOhms(MAX_RESISTANCE + WIPER_RESISTANCE) == POT_MIN);
+    CHECK(MCP4018::getValueForOhms(MAX_RESISTANCE + WIPER_RESISTANCE + 1) == POT_INVALID);
+    CHECK(MCP4018::getValueForResistance(-1.0) == POT_INVALID);
+    CHECK(MCP4018::getResistanceForValue(POT_MAX + 1) == -1);
+    CHECK(MCP4018::getOhmsForValue(POT_MAX + 1) == 0);
+    CHECK(MCP4018::getValueForOhms(0) == POT_MAX);
+    CHECK(!MCP4018::setResistance(2 * MAX_RESISTANCE));
+
+    // The calibration reference used by the firmware
+    CHECK(MCP4018::getValueForOhms(1000) == 126);
+
+    // Fitting a unit whose wiper is 95 ohm from unscaled, noisy measurements
+    const byte codes[] = { 127, 126, 125, 124, 123, 122, 121, 120 };
+    const int n = sizeof(codes);
+    float measured[n];
+    for (int i = 0; i < n; i++) {
+        double ohms = 95 + (POT_MAX - codes[i]) * STEP_RESISTANCE;
+        measured[i] = 3.7e-4 * ohms * (i % 2 ? 1.002 : 0.998);
+    }
+    long wiper = MCP4018::fitWiperResistance(codes, measured, n, MAX_RESISTANCE);
+    CHECK(labs(wiper - 95) <= 5);
+    CHECK(MCP4018::fitWiperResistance(codes, measured, 1, MAX_RESISTANCE) < 0);
+
+    // A fitted table is used for lookups until the nominal one is restored
+    unsigned long table[POT_MAX + 1];
+    MCP4018::buildResistanceTable(table, 95, MAX_RESISTANCE);
+    CHECK(table[POT_MAX] == 95);
+    MCP4018::setResistanceTable(table);
+    CHECK(MCP4018::getResistanceTable() == table);
+    CHECK(MCP4018::getOhmsForValue(POT_MAX) == 95);
+    for (int code = POT_MIN; code <= POT_MAX; code++)
+        CHECK(MCP4018::getValueForOhms(table[code]) == code);
+    MCP4018::setResistanceTable(NULL);
+    CHECK(MCP4018::getOhmsForValue(POT_MAX) == WIPER_RESISTANCE);
+
+    // No device on the bus: nothing is cached
+    CHECK(!MCP4018::setValue(100));
+    CHECK(MCP4018::getCachedValue() == POT_INVALID);
+
+    // Writes land, and repeats of the same code are skipped
+    VirtualMCP4018 pot;
+    shimAttachI2C(MCP4018_ADDR, &pot);
+    CHECK(!MCP4018::setValue(POT_MAX + 1));
+    CHECK(MCP4018::setValue(100));
+    CHECK(pot.getWiper() == 100);
+    for (int i = 0; i < 10; i++)
+        CHECK(MCP4018::setValue(100));
+    CHECK(pot.getWriteCount() == 1);
+    CHECK(MCP4018::getCachedValue() == 100);
+
+    // Readback
+    byte value = 0;
+    CHECK(MCP4018::readValue(&value) && value == 100);
+    CHECK(MCP4018::setValueVerified(126));
+    CHECK(pot.getWiper() == 126);
+    CHECK(pot.getWriteCount() == 2 && pot.getReadCount() == 2);
+
+    // A wiper that did not move is reported, and the next set writes again
+    pot.setStuck(true);
+    CHECK(!MCP4018::setValueVerified(10));
+    CHECK(MCP4018::getCachedValue() == POT_INVALID);
+    pot.setStuck(false);
+    CHECK(MCP4018::setValueVerified(10) && pot.getWiper() == 10);
+
+    // A NAK drops the cached value
+    pot.setNak(true);
+    CHECK(!MCP4018::setValue(11));
+    CHECK(MCP4018::getCachedValue() == POT_INVALID);
+    pot.setNak(false);
+
+    // After a reset of the pot, invalidating forces the write
+    CHECK(MCP4018::setValue(20));
+    pot.powerCycle();
+    MCP4018::invalidateCachedValue();
+    CHECK(MCP4018::setValue(20) && pot.getWiper() == 20);
+    shimAttachI2C(MCP4018_ADDR, NULL);
+
+    return checkResult("mcp4018Test");
+}
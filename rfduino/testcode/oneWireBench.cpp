@@ -0,0 +1,58 @@
+/**
+ * Measures the cost of enumerating and reading DS18B20s as the number of
+ * sensors on the bus grows. Bus time is virtual (what the RFduino would spend
+ * bit-banging), host time is what the simulation took.
+ *
+ * Usage:
+ *  ./oneWireBench [max sensors]
+ */
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include "DS18B20.h"
+#include "OneWireSim.h"
+#include "bench.h"
+
+#define BENCH_PIN   (2)
+
+int main(int argc, char *argv[]) {
+    int maxSensors = argc > 1 ? atoi(argv[1]) : 32;
+    if (maxSensors > ONEWIRE_SIM_MAX_DEVICES)
+        maxSensors = ONEWIRE_SIM_MAX_DEVICES;
+
+    printf("%8s %14s %14s %10s %12s\n", "sensors", "search (us)",
+           "read all (us)", "slots", "host (us)");
+    for (int n = 1; n <= maxSensors; n *= 2) {
+        OneWireBus bus(BENCH_PIN);
+        VirtualDS18B20 *sensors[ONEWIRE_SIM_MAX_DEVICES];
+        for (int i = 0; i < n; i++) {
+            // Spread the serials so the search tree has real branching
+            sensors[i] = new VirtualDS18B20(0x5DEECE66DULL * (i + 1));
+            bus.addDevice(sensors[i]);
+        }
+        OneWire ds(BENCH_PIN);
+
+        // Enumerate only
+        byte addr[8];
+        unsigned long long start = shimMicros();
+        ds.reset_search();
+        while (ds.search(addr)) ;
+        unsigned long long searchTime = shimMicros() - start;
+
+        // Full getTemperatureRaw: search + convert + read scratchpad each
+        int16_t raw;
+        bus.resetStats();
+        uint64_t hostStart = benchNanos();
+        start = shimMicros();
+        DS18B20::getTemperatureRaw(ds, &raw);
+        unsigned long long readTime = shimMicros() - start;
+        uint64_t hostTime = (benchNanos() - hostStart) / 1000;
+
+        printf("%8d %14llu %14llu %10lu %12llu\n", n, searchTime, readTime,
+               bus.getSlotCount(), (unsigned long long)hostTime);
+
+        for (int i = 0; i < n; i++)
+            delete sensors[i];
+    }
+    return 0;
+}
@@ -0,0 +1,310 @@
+/**
+ * Regression tests for OneWire and the DS18B20 library against the simulated
+ * 1-Wire bus. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./oneWireTest
+ */
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include "DS18B20.h"
+#include "DS18B20Adaptive.h"
+#include "OneWireSim.h"
+#include "check.h"
+
+#define TEST_PIN    (2)
+#define NUM_SENSORS (5)
+
+// Every device on the bus is found exactly once with a valid CRC
+static void testSearch(OneWire &ds, VirtualDS18B20 **sensors, int n) {
+    byte addr[8];
+    int found = 0;
+    bool seen[NUM_SENSORS] = { false };
+
+    ds.reset_search();
+    while (ds.search(addr)) {
+        found++;
+        CHECK(OneWire::crc8(addr, 7) == addr[7]);
+        for (int i = 0; i < n; i++) {
+            if (memcmp(addr, sensors[i]->getRom(), 8) == 0) {
+                CHECK(!seen[i]);
+                seen[i] = true;
+            }
+        }
+    }
+    CHECK(found == n);
+    for (int i = 0; i < n; i++)
+        CHECK(seen[i]);
+}
+
+// Resolution is written to every device, but only when it differs, and
+// survives a power cycle only when persisted
+static void testResolution(OneWire &ds, VirtualDS18B20 **sensors, int n) {
+    CHECK(DS18B20::setResolution(ds, RES_9BIT));
+    for (int i = 0; i < n; i++)
+        CHECK(sensors[i]->getConfig() == RES_9BIT);
+
+    unsigned long writes = sensors[0]->getScratchpadWrites();
+    CHECK(DS18B20::setResolution(ds, RES_9BIT));
+    CHECK(sensors[0]->getScratchpadWrites() == writes);
+
+    sensors[0]->powerCycle();
+    CHECK(sensors[0]->getConfig() == RES_12BIT);
+
+    CHECK(DS18B20::setResolution(ds, RES_10BIT, true));
+    for (int i = 0; i < n; i++) {
+        CHECK(sensors[i]->getEeprom()[2] == RES_10BIT);
+        sensors[i]->powerCycle();
+        CHECK(sensors[i]->getConfig() == RES_10BIT);
+    }
+
+    // Alarm settings are written back unchanged
+    CHECK(sensors[0]->getAlarmHigh() == 0x4B);
+    CHECK(sensors[0]->getAlarmLow() == 0x46);
+
+    // A write without persist leaves the EEPROM behind, and persisting the
+    // same resolution afterwards still reaches it
+    CHECK(DS18B20::setResolution(ds, RES_11BIT));
+    CHECK(DS18B20::setResolution(ds, RES_11BIT, true));
+    for (int i = 0; i < n; i++)
+        CHECK(sensors[i]->getEeprom()[2] == RES_11BIT);
+    unsigned long copies = sensors[0]->getEepromWrites();
+    CHECK(DS18B20::setResolution(ds, RES_11BIT, true));
+    CHECK(sensors[0]->getEepromWrites() == copies);
+
+    CHECK(DS18B20::setResolution(ds, RES_12BIT, true));
+    for (int i = 0; i < n; i++)
+        CHECK(sensors[i]->getConfig() == RES_12BIT);
+}
+
+// The first read returns the power-on value because the conversion is still
+// running; after waiting, the average of the sensors comes back
+static void testTemperature(OneWire &ds, VirtualDS18B20 **sensors, int n) {
+    int16_t raw;
+    for (int i = 0; i < n; i++) {
+        sensors[i]->powerCycle();
+        sensors[i]->setTemperatureRaw(592 + 16 * (i - n / 2)); // 37 C mean
+    }
+    CHECK(DS18B20::getTemperatureRaw(ds, &raw));
+    CHECK(raw == DS18B20_SIM_POWER_ON_RAW);
+
+    delay(1000);
+    CHECK(DS18B20::getTemperatureRaw(ds, &raw));
+    CHECK(raw == 592);
+    CHECK(DS18B20::rawToCentiFahrenheit(raw) == 9860);
+}
+
+// Below 12 bits the sensors leave noise in the undefined low bits, and the
+// readings come back with them cleared
+static void testLowResolution(OneWire &ds, VirtualDS18B20 **sensors, int n) {
+    int16_t raw;
+    for (int i = 0; i < n; i++)
+        sensors[i]->setTemperatureRaw(599);     // 37.4375 C
+    CHECK(DS18B20::setResolution(ds, RES_9BIT));
+    for (int pass = 0; pass < 8; pass++) {
+        CHECK(DS18B20::getTemperatureRaw(ds, &raw));
+        delay(100);
+        if (pass > 0)
+            CHECK(raw == 592);                  // 37.0 C in half degrees
+    }
+
+    CHECK(DS18B20::setResolution(ds, RES_10BIT));
+    CHECK(DS18B20::setAlarms(ds, 37, -55));
+    for (int pass = 0; pass < 8; pass++) {
+        CHECK(DS18B20::startConversion(ds));
+        delay(200);
+        CHECK(DS18B20::getAlarmTemperatureRaw(ds, &raw) == n);
+        CHECK(raw == 596);                      // 37.25 C in quarter degrees
+    }
+    CHECK(DS18B20::setAlarms(ds, 38, -55));
+    CHECK(DS18B20::setResolution(ds, RES_12BIT));
+}
+
+// A broadcast conversion (skip ROM) reaches every device at once
+static void testBroadcastConversion(OneWire &ds, VirtualDS18B20 **sensors,
+                                    int n) {
+    unsigned long before[NUM_SENSORS];
+    for (int i = 0; i < n; i++)
+        before[i] = sensors[i]->getConversionCount();
+    CHECK(ds.reset());
+    ds.skip();
+    ds.write(CMD_CONVERT_TEMP);
+    for (int i = 0; i < n; i++)
+        CHECK(sensors[i]->getConversionCount() == before[i] + 1);
+
+    // Read slots return 0 while converting and 1 once done
+    CHECK(ds.read_bit() == 0);
+    delay(1000);
+    CHECK(ds.read_bit() == 1);
+}
+
+// Only sensors past a threshold answer the alarm search, and only after a
+// conversion has updated their flags
+static void testAlarmSearch(OneWire &ds, VirtualDS18B20 **sensors, int n) {
+    int16_t raw;
+    CHECK(DS18B20::setAlarms(ds, 38, -55));
+    for (int i = 0; i < n; i++) {
+        CHECK((int8_t)sensors[i]->getAlarmHigh() == 38);
+        CHECK((int8_t)sensors[i]->getAlarmLow() == -55);
+        sensors[i]->setTemperature(36.0);
+    }
+    CHECK(DS18B20::startConversion(ds));
+    delay(1000);
+    CHECK(DS18B20::getAlarmTemperatureRaw(ds, &raw) == 0);
+
+    // Setting the same thresholds again writes nothing
+    unsigned long writes = sensors[0]->getScratchpadWrites();
+    CHECK(DS18B20::setAlarms(ds, 38, -55));
+    CHECK(sensors[0]->getScratchpadWrites() == writes);
+
+    sensors[1]->setTemperature(38.5);
+    sensors[3]->setTemperature(39.0);
+    CHECK(DS18B20::getAlarmTemperatureRaw(ds, &raw) == 0);
+    CHECK(DS18B20::startConversion(ds));
+    delay(1000);
+    CHECK(DS18B20::getAlarmTemperatureRaw(ds, &raw) == 2);
+    CHECK(raw == 39 * 16);
+
+    // A sensor far below TL is reported over ones just above TH
+    CHECK(DS18B20::setAlarms(ds, 38, 30));
+    sensors[2]->setTemperature(20.0);
+    CHECK(DS18B20::startConversion(ds));
+    delay(1000);
+    CHECK(DS18B20::getAlarmTemperatureRaw(ds, &raw) == 3);
+    CHECK(raw == 20 * 16);
+    sensors[2]->setTemperature(36.0);
+    CHECK(DS18B20::setAlarms(ds, 38, -55));
+
+    // The resolution can change without losing the thresholds
+    CHECK(DS18B20::setResolution(ds, RES_11BIT));
+    CHECK((int8_t)sensors[1]->getAlarmHigh() == 38);
+    CHECK(DS18B20::setResolution(ds, RES_12BIT));
+}
+
+// A parasite-powered copy only sticks if the strong pull-up is held
+static void testCopyScratchpad(OneWire &ds, VirtualDS18B20 *sensor) {
+    sensor->setParasitePower(true);
+    unsigned long writes = sensor->getEepromWrites();
+
+    ds.reset();
+    ds.select(sensor->getRom());
+    ds.write(CMD_COPY_SPAD);        // released immediately: copy fails
+    delay(20);
+    CHECK(sensor->getEepromWrites() == writes);
+
+    ds.reset();
+    ds.select(sensor->getRom());
+    ds.write(CMD_COPY_SPAD, 1);     // strong pull-up for 10 ms
+    delay(10);
+    ds.depower();
+    CHECK(sensor->getEepromWrites() == writes + 1);
+    sensor->setParasitePower(false);
+}
+
+// With bit errors injected, the search never returns an address that passes
+// the CRC but isn't real, and scratchpad corruption is caught by its CRC
+static void testBitErrors(OneWire &ds, VirtualDS18B20 **sensors, int n) {
+    byte addr[8];
+    byte data[9];
+    int corrupt = 0;
+    sensors[0]->setBitErrorRate(0.01);
+    for (int pass = 0; pass < 200; pass++) {
+        ds.reset_search();
+        while (ds.search(addr)) {
+            if (OneWire::crc8(addr, 7) != addr[7])
+                continue;
+            bool known = false;
+            for (int i = 0; i < n; i++)
+                known |= memcmp(addr, sensors[i]->getRom(), 8) == 0;
+            CHECK(known);
+        }
+
+        ds.reset();
+        ds.select(sensors[0]->getRom());
+        ds.write(CMD_READ_SPAD);
+        ds.read_bytes(data, 9);
+        if (OneWire::crc8(data, 8) != data[8])
+            corrupt++;
+        else
+            CHECK(data[4] == sensors[0]->getConfig());
+    }
+    CHECK(sensors[0]->getBitErrors() > 0);
+    CHECK(corrupt > 0);
+    sensors[0]->setBitErrorRate(0.0);
+}
+
+// A scratchpad that reads back corrupt never gets its alarms replaced
+static void testResolutionKeepsAlarms(OneWire &ds, VirtualDS18B20 **sensors,
+                                      int n) {
+    CHECK(DS18B20::setAlarms(ds, 38, -55));
+    sensors[0]->setBitErrorRate(0.02);
+    for (int pass = 0; pass < 100; pass++)
+        DS18B20::setResolution(ds, pass & 1 ? RES_12BIT : RES_9BIT);
+    CHECK(sensors[0]->getBitErrors() > 0);
+    sensors[0]->setBitErrorRate(0.0);
+    for (int i = 0; i < n; i++) {
+        CHECK((int8_t)sensors[i]->getAlarmHigh() == 38);
+        CHECK((int8_t)sensors[i]->getAlarmLow() == -55);
+    }
+    CHECK(DS18B20::setResolution(ds, RES_12BIT));
+}
+
+// Stable readings walk the resolution down one step at a time with one config
+// write per step; a temperature swing jumps straight back to 12 bit
+static void testAdaptive(OneWire &ds, VirtualDS18B20 **sensors, int n) {
+    DS18B20Adaptive adaptive(RES_9BIT, RES_12BIT);
+    for (int i = 0; i < 3 * ADAPTIVE_STABLE_COUNT; i++) {
+        adaptive.addReading(592 + (i & 1));
+        CHECK(adaptive.apply(ds));
+    }
+    CHECK(adaptive.getResolution() == RES_9BIT);
+    CHECK(adaptive.getWriteCount() == 3);
+    for (int i = 0; i < n; i++)
+        CHECK(sensors[i]->getConfig() == RES_9BIT);
+
+    // Quantization flicker at 9 bit doesn't raise it
+    for (int i = 0; i < ADAPTIVE_WINDOW; i++) {
+        adaptive.addReading(592 + 8 * (i & 1));
+        adaptive.apply(ds);
+    }
+    CHECK(adaptive.getResolution() == RES_9BIT);
+
+    adaptive.addReading(592 + 32);
+    CHECK(adaptive.apply(ds));
+    CHECK(adaptive.getResolution() == RES_12BIT);
+    CHECK(adaptive.getWriteCount() == 4);
+    for (int i = 0; i < n; i++)
+        CHECK(sensors[i]->getConfig() == RES_12BIT);
+}
+
+int main() {
+    OneWireBus bus(TEST_PIN);
+    VirtualDS18B20 *sensors[NUM_SENSORS];
+    for (int i = 0; i < NUM_SENSORS; i++) {
+        sensors[i] = new VirtualDS18B20(0x0000A1B2C300ULL + i * 0x010203ULL);
+        bus.addDevice(sensors[i]);
+    }
+    OneWire ds(TEST_PIN);
+
+    // An empty bus has no presence pulse
+    OneWireBus empty(TEST_PIN + 1);
+    OneWire none(TEST_PIN + 1);
+    CHECK(none.reset() == 0);
+
+    testSearch(ds, sensors, NUM_SENSORS);
+    testResolution(ds, sensors, NUM_SENSORS);
+    testTemperature(ds, sensors, NUM_SENSORS);
+    testLowResolution(ds, sensors, NUM_SENSORS);
+    testBroadcastConversion(ds, sensors, NUM_SENSORS);
+    testAdaptive(ds, sensors, NUM_SENSORS);
+    testAlarmSearch(ds, sensors, NUM_SENSORS);
+    testResolutionKeepsAlarms(ds, sensors, NUM_SENSORS);
+    testCopyScratchpad(ds, sensors[0]);
+    testBitErrors(ds, sensors, NUM_SENSORS);
+
+    for (int i = 0; i < NUM_SENSORS; i++)
+        delete sensors[i];
+
+    return checkResult("oneWireTest");
+}
@@ -0,0 +1,172 @@
+/**
+ * Tests the store-and-forward record ring: packing into frames, decoding,
+ * resending after an interrupted flush, and overflow with and without a
+ * spill store. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./recordRingTest
+ */
+
+#include <Arduino.h>
+#include "RecordRing.h"
+#include "check.h"
+
+// In-memory overflow store
+class MemoryStore : public RecordStore {
+    public:
+        MemoryStore(unsigned long capacity) : capacity(capacity), n(0) {}
+        bool push(const Record *record) {
+            if (n >= capacity)
+                return false;
+            records[n++] = *record;
+            return true;
+        }
+        bool read(unsigned long i, Record *record) {
+            if (i >= n)
+                return false;
+            *record = records[i];
+            return true;
+        }
+        void drop(unsigned long k) {
+            if (k > n)
+                k = n;
+            for (unsigned long i = k; i < n; i++)
+                records[i - k] = records[i];
+            n -= k;
+        }
+        unsigned long count(void) { return n; }
+
+    private:
+        Record records[1024];
+        unsigned long capacity;
+        unsigned long n;
+};
+
+// Pack and decode everything; returns the number of records, checking the
+// sequence numbers run from firstSeq without gaps
+static unsigned long forward(RecordRing &ring, uint16_t firstSeq, int *frames) {
+    byte frame[SWEEP_FRAME_SIZE];
+    Record records[RECORDS_PER_FRAME];
+    unsigned long total = 0;
+    int len;
+    *frames = 0;
+    while ((len = ring.packFrame(frame)) > 0) {
+        (*frames)++;
+        CHECK(len <= SWEEP_FRAME_SIZE);
+        int n = RecordRing::decodeFrame(frame, len, records);
+        CHECK(n > 0);
+        for (int i = 0; i < n; i++, total++) {
+            uint16_t seq = firstSeq + total;
+            CHECK(records[i].seq == seq);
+            CHECK(records[i].time == seq * 10);
+            CHECK(records[i].type == RECORD_IMPEDANCE);
+            CHECK(records[i].index == seq % 41 % 64);
+            CHECK(records[i].value == (int16_t)(seq * 3 - 500));
+        }
+    }
+    return total;
+}
+
+static void addRecords(RecordRing &ring, uint16_t from, int n) {
+    for (int i = 0; i < n; i++) {
+        uint16_t seq = from + i;
+        ring.add(RECORD_IMPEDANCE, seq % 41, seq * 3 - 500, seq * 10);
+    }
+}
+
+int main() {
+    int frames;
+
+    // A few records round-trip, three to a frame
+    {
+        RecordRing ring;
+        byte frame[SWEEP_FRAME_SIZE];
+        CHECK(ring.isEmpty() && ring.packFrame(frame) == 0);
+        addRecords(ring, 0, 10);
+        CHECK(forward(ring, 0, &frames) == 10);
+        CHECK(frames == (10 + RECORDS_PER_FRAME - 1) / RECORDS_PER_FRAME);
+
+        // Nothing is removed until the frames are committed; a flush that
+        // was cut short goes out again from the start
+        CHECK(ring.getCount() == 10);
+        ring.rewind();
+        CHECK(forward(ring, 0, &frames) == 10);
+        ring.commit();
+        CHECK(ring.isEmpty());
+
+        // Sequence numbers carry on, or from where they are set to
+        addRecords(ring, 10, 2);
+        CHECK(forward(ring, 10, &frames) == 2);
+        ring.commit();
+        ring.setNextSeq(1000);
+        addRecords(ring, 1000, 4);
+        CHECK(forward(ring, 1000, &frames) == 4);
+        ring.commit();
+
+        // Records carry their boot, and a reset starts a new frame even
+        // though the numbers run on
+        byte records3[SWEEP_FRAME_SIZE];
+        Record boots[RECORDS_PER_FRAME];
+        ring.setBoot(7);
+        ring.add(RECORD_BATTERY, 0, 90, 5);
+        ring.setBoot(8);
+        ring.add(RECORD_BATTERY, 0, 89, 1);
+        int n = RecordRing::decodeFrame(records3, ring.packFrame(records3), boots);
+        CHECK(n == 1 && boots[0].boot == 7 && boots[0].seq == 1004);
+        n = RecordRing::decodeFrame(records3, ring.packFrame(records3), boots);
+        CHECK(n == 1 && boots[0].boot == 8 && boots[0].seq == 1005);
+        ring.commit();
+
+        // Sweep frames are not record frames and vice versa
+        SweepFrame sweep;
+        Record records[RECORDS_PER_FRAME];
+        ring.rewind();
+        int len = ring.packFrame(frame);
+        CHECK(!SweepPacket::decode(frame, len, &sweep));
+        const byte sweepFrame[4] = { SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4), 0, 0, 1 };
+        CHECK(RecordRing::decodeFrame(sweepFrame, 4, records) == 0);
+    }
+
+    // Without a spill store, the oldest records are dropped and the
+    // sequence numbers show the gap
+    {
+        RecordRing ring;
+        addRecords(ring, 0, RECORD_RING_SIZE + 20);
+        CHECK(ring.getCount() == RECORD_RING_SIZE);
+        CHECK(ring.getDropCount() == 20);
+        CHECK(forward(ring, 20, &frames) == RECORD_RING_SIZE);
+    }
+
+    // Records dropped while a flush is in progress do not throw off the
+    // records still to be committed
+    {
+        RecordRing ring;
+        byte frame[SWEEP_FRAME_SIZE];
+        addRecords(ring, 0, RECORD_RING_SIZE);
+        ring.packFrame(frame);
+        addRecords(ring, RECORD_RING_SIZE, 2);
+        ring.commit();
+        CHECK(ring.getCount() == RECORD_RING_SIZE - 1);
+        CHECK(forward(ring, 3, &frames) == RECORD_RING_SIZE - 1);
+    }
+
+    // With a spill store, nothing is lost and the spilled records go first
+    {
+        RecordRing ring;
+        MemoryStore store(500);
+        ring.setSpill(&store);
+        addRecords(ring, 0, 400);
+        CHECK(ring.getDropCount() == 0);
+        CHECK(store.count() == 400 - RECORD_RING_SIZE);
+        CHECK(ring.getCount() == 400);
+        CHECK(forward(ring, 0, &frames) == 400);
+        ring.commit();
+        CHECK(ring.isEmpty() && store.count() == 0);
+
+        // A full store falls back to dropping
+        addRecords(ring, 400, 500 + RECORD_RING_SIZE + 5);
+        CHECK(ring.getDropCount() == 5);
+    }
+
+    return checkResult("recordRingTest");
+}
@@ -0,0 +1,100 @@
+/**
+ * Tests the deadline scheduler on the virtual clock. Exits non-zero if any
+ * check fails.
+ *
+ * Usage:
+ *  ./schedulerTest
+ */
+
+#include <Arduino.h>
+#include "DeadlineScheduler.h"
+#include "check.h"
+
+// Start times of each run, and how long the slow task takes
+static unsigned long fastRuns[64], slowRuns[64];
+static int numFast = 0, numSlow = 0;
+static unsigned long slowWork = 0;
+
+static void fastTask() {
+    if (numFast < 64)
+        fastRuns[numFast] = millis();
+    numFast++;
+    delay(3);
+}
+
+static void slowTask() {
+    if (numSlow < 64)
+        slowRuns[numSlow] = millis();
+    numSlow++;
+    delay(slowWork);
+}
+
+// Runs the scheduler like loop() does, sleeping between deadlines
+static int runUntil(DeadlineScheduler &s, unsigned long end) {
+    int wakeups = 0;
+    while (millis() < end) {
+        unsigned long sleep = s.run();
+        wakeups++;
+        if (sleep == SCHED_NO_DEADLINE)
+            break;
+        delay(sleep);
+    }
+    return wakeups;
+}
+
+int main() {
+    unsigned long start = millis();
+    DeadlineScheduler s;
+    CHECK(s.run() == SCHED_NO_DEADLINE);
+
+    // The 1 s task takes 3 ms, yet its cadence does not drift
+    int fast = s.addTask(fastTask, 1000);
+    int slow = s.addTask(slowTask, 10000, 500);
+    CHECK(fast == 0 && slow == 1);
+    int wakeups = runUntil(s, start + 20000);
+    CHECK(numFast == 20);
+    for (int i = 0; i < numFast; i++)
+        CHECK(fastRuns[i] == start + 1000UL * i);
+    CHECK(numSlow == 2);
+    CHECK(slowRuns[0] == start + 500 && slowRuns[1] == start + 10500);
+
+    // Only wakes when something is due
+    CHECK(wakeups == numFast + numSlow);
+    CHECK(s.getLateCount(fast) == 0 && s.getMaxLateness(fast) == 0);
+
+    // A task that overruns makes the next one late, and it is recorded
+    slowWork = 2500;
+    numFast = numSlow = 0;
+    s.resetStats();
+    runUntil(s, start + 40000);
+    CHECK(s.getRunCount(slow) == 2);
+    CHECK(s.getMaxLateness(fast) == 2000);
+    CHECK(s.getLateCount(fast) == 2);
+    CHECK(s.getMissedCount(fast) == 4);
+
+    // Later deadlines stay on the original grid
+    CHECK((fastRuns[numFast - 1] - start) % 1000 == 0);
+
+    // Run times are recorded per task
+    CHECK(s.getMinRunTime(fast) == 3000 && s.getMaxRunTime(fast) == 3000);
+    CHECK(s.getMeanRunTime(fast) == 3000);
+    CHECK(s.getMinRunTime(slow) == 2500000 && s.getMeanRunTime(slow) == 2500000);
+
+    // Run now, and disabling
+    s.resetStats();
+    CHECK(s.getMaxRunTime(fast) == 0 && s.getMeanRunTime(fast) == 0);
+    CHECK(s.runNow(slow));
+    s.run();
+    CHECK(s.getRunCount(slow) == 1);
+    CHECK(s.setEnabled(fast, false) && s.setEnabled(slow, false));
+    CHECK(s.run() == SCHED_NO_DEADLINE);
+    CHECK(!s.runNow(7) && !s.setPeriod(-1, 10));
+
+    // Full
+    DeadlineScheduler full;
+    for (int i = 0; i < SCHED_MAX_TASKS; i++)
+        CHECK(full.addTask(fastTask, 100) == i);
+    CHECK(full.addTask(fastTask, 100) == SCHED_INVALID_TASK);
+
+    return checkResult("schedulerTest");
+}
@@ -0,0 +1,138 @@
+/**
+ * @file AD5933Sim.cpp
+ * @brief Simulated AD5933 impedance converter
+ *
+ * Register writes are a register address and a value; the address pointer
+ * command (ADDR_PTR) selects the register a following read returns, and a
+ * block read command (BLOCK_READ) makes the next read run on through the
+ * following registers, provided the read follows a repeated start; a stop
+ * abandons the block read as on the part. The status register reports valid data once the virtual clock passes the end
+ * of the conversion, and sweep done with the last point's data.
+ */
+
+#include "AD5933Sim.h"
+#include <math.h>
+#include <string.h>
+
+VirtualAD5933::VirtualAD5933() : pointer(0), block(0), sweeping(false),
+    converting(false), point(0), readyAt(0), idleSince(0), idle(0),
+    conversion(AD5933_SIM_CONVERSION_MICROS), ohms(1000), phase(0),
+    ohmsAt(NULL), conversions(0), increments(0) {
+    memset(registers, 0, sizeof(registers));
+    registers[CTRL_REG1] = CTRL_STANDBY_MODE;
+}
+
+void VirtualAD5933::setImpedance(double ohms, double phase) {
+    this->ohms = ohms;
+    this->phase = phase;
+    ohmsAt = NULL;
+}
+
+void VirtualAD5933::setImpedanceFunction(double (*ohmsAt)(int point)) {
+    this->ohmsAt = ohmsAt;
+}
+
+bool VirtualAD5933::i2cWrite(const uint8_t *data, int len) {
+    if (len < 2)
+        return len == 0;
+    if (data[0] == ADDR_PTR) {
+        pointer = data[1];
+        return true;
+    }
+    if (data[0] == BLOCK_READ) {
+        block = data[1];
+        return true;
+    }
+    update();
+    registers[data[0]] = data[1];
+    if (data[0] == CTRL_REG1)
+        command(data[1] & 0xF0);
+    return true;
+}
+
+int VirtualAD5933::i2cRead(uint8_t *data, int len) {
+    for (int i = 0; i < len; i++)
+        data[i] = readRegister(i < block ? pointer + i : pointer);
+    block = 0;
+    return len;
+}
+
+void VirtualAD5933::i2cStop(void) {
+    block = 0;
+}
+
+void VirtualAD5933::command(uint8_t mode) {
+    switch (mode) {
+        case CTRL_INIT_START_FREQ:
+            sweeping = false;
+            converting = false;
+            point = 0;
+            registers[STATUS_REG] = 0;
+            break;
+        case CTRL_START_FREQ_SWEEP:
+            sweeping = true;
+            point = 0;
+            startConversion();
+            break;
+        case CTRL_INCREMENT_FREQ: {
+            int increments = (registers[NUM_INC_1] << 8) | registers[NUM_INC_2];
+            if (sweeping && point < increments) {
+                point++;
+                this->increments++;
+                startConversion();
+            }
+            break;
+        }
+        case CTRL_REPEAT_FREQ:
+            if (sweeping)
+                startConversion();
+            break;
+        case CTRL_TEMP_MEASURE:
+            registers[STATUS_REG] |= STATUS_TEMP_VALID;
+            break;
+        case CTRL_STANDBY_MODE:
+        case CTRL_POWER_DOWN_MODE:
+            sweeping = false;
+            converting = false;
+            registers[STATUS_REG] = 0;
+            break;
+    }
+}
+
+void VirtualAD5933::startConversion(void) {
+    // Time the previous point's data sat unread counts as idle
+    if (!converting && (registers[STATUS_REG] & STATUS_DATA_VALID))
+        idle += shimMicros() - idleSince;
+    registers[STATUS_REG] &= ~(STATUS_DATA_VALID | STATUS_SWEEP_DONE);
+    converting = true;
+    readyAt = shimMicros() + conversion;
+}
+
+void VirtualAD5933::update(void) {
+    if (!converting || shimMicros() < readyAt)
+        return;
+    converting = false;
+    conversions++;
+    idleSince = readyAt;
+
+    double z = ohmsAt ? ohmsAt(point) : ohms;
+    double mag = AD5933_SIM_SCALE / z;
+    long re = lround(mag * cos(phase));
+    long im = lround(mag * sin(phase));
+    re = re > 32767 ? 32767 : (re < -32768 ? -32768 : re);
+    im = im > 32767 ? 32767 : (im < -32768 ? -32768 : im);
+    registers[REAL_DATA_1] = (re >> 8) & 0xFF;
+    registers[REAL_DATA_2] = re & 0xFF;
+    registers[IMAG_DATA_1] = (im >> 8) & 0xFF;
+    registers[IMAG_DATA_2] = im & 0xFF;
+
+    int increments = (registers[NUM_INC_1] << 8) | registers[NUM_INC_2];
+    registers[STATUS_REG] |= STATUS_DATA_VALID;
+    if (point >= increments)
+        registers[STATUS_REG] |= STATUS_SWEEP_DONE;
+}
+
+uint8_t VirtualAD5933::readRegister(uint8_t reg) {
+    update();
+    return registers[reg];
+}
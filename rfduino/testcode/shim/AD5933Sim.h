@@ -0,0 +1,71 @@
+/**
+ * Simulated AD5933 impedance converter for host builds. Attach it to the
+ * Wire shim at AD5933_ADDR and the real AD5933 library drives it. Sweeps
+ * follow the control register commands, and each point takes a conversion
+ * time on the virtual clock before its data is valid. The impedance it
+ * measures can be set per sweep point.
+ */
+
+#ifndef AD5933Sim_h
+#define AD5933Sim_h
+
+#include <Arduino.h>
+#include "Wire.h"
+#include "AD5933.h"
+
+// Time from a start, increment or repeat command to valid data: settling
+// cycles plus a 1024 sample DFT at the internal clock
+#define AD5933_SIM_CONVERSION_MICROS    (1100)
+// Magnitude read for 1 ohm; an impedance Z reads as this / Z
+#define AD5933_SIM_SCALE                (4.0e6)
+
+class VirtualAD5933 : public ShimI2CDevice {
+    public:
+        VirtualAD5933();
+
+        // Impedance measured at every point, or per point through a function
+        // of the point index. The phase is in radians.
+        void setImpedance(double ohms, double phase = 0);
+        void setImpedanceFunction(double (*ohmsAt)(int point));
+
+        void setConversionMicros(unsigned long us) { conversion = us; }
+
+        // Inspection
+        int getPoint(void) const { return point; }
+        unsigned long getConversions(void) const { return conversions; }
+        unsigned long getIdleMicros(void) const { return (unsigned long)idle; }
+        unsigned long getIncrements(void) const { return increments; }
+
+        // ShimI2CDevice
+        bool i2cWrite(const uint8_t *data, int len);
+        int i2cRead(uint8_t *data, int len);
+        void i2cStop(void);
+
+    private:
+        void command(uint8_t mode);
+        void startConversion(void);
+        void update(void);
+        uint8_t readRegister(uint8_t reg);
+
+        uint8_t registers[256];
+        uint8_t pointer;
+        int block;      // bytes of a block read in progress
+
+        // Sweep state
+        bool sweeping;
+        bool converting;
+        int point;
+        unsigned long long readyAt;     // end of the conversion in progress
+        unsigned long long idleSince;   // when the last data became valid
+        unsigned long long idle;        // time spent with valid data, waiting
+        unsigned long conversion;
+
+        double ohms;
+        double phase;
+        double (*ohmsAt)(int);
+
+        unsigned long conversions;
+        unsigned long increments;
+};
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * @file Arduino.cpp
+ * @brief Host implementation of the Arduino core
+ *
+ * Pins without an attached device behave like a floating input with a
+ * pull-up: they read back whatever was last written, or HIGH. Every advance
+ * of the clock goes through advance(), which runs the shimAt callbacks that
+ * fall due on the way.
+ */
+
+#include "Arduino.h"
+
+#define SHIM_NUM_PINS   (32)
+#define SHIM_MAX_TIMERS (16)
+
+// Virtual time in microseconds
+static unsigned long long nowMicros = 0;
+
+// Pending shimAt callbacks
+static struct {
+    unsigned long long at;
+    void (*fn)(void *);
+    void *arg;
+} timers[SHIM_MAX_TIMERS];
+static int numTimers = 0;
+
+// Pin state and attached devices
+static uint8_t pinModes[SHIM_NUM_PINS];
+static uint8_t pinValues[SHIM_NUM_PINS];
+static ShimPinDevice *pinDevices[SHIM_NUM_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= SHIM_NUM_PINS)
+        return;
+    pinModes[pin] = mode;
+    if (pinDevices[pin])
+        pinDevices[pin]->pinChanged(mode, pinValues[pin]);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin >= SHIM_NUM_PINS)
+        return;
+    pinValues[pin] = value ? HIGH : LOW;
+    if (pinDevices[pin])
+        pinDevices[pin]->pinChanged(pinModes[pin], pinValues[pin]);
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin >= SHIM_NUM_PINS)
+        return LOW;
+    if (pinDevices[pin])
+        return pinDevices[pin]->pinRead();
+    return pinModes[pin] == OUTPUT ? pinValues[pin] : HIGH;
+}
+
+// Move the clock forward, stopping at each callback that falls due. A
+// callback can advance the clock itself or add more callbacks.
+static void advance(unsigned long long us) {
+    unsigned long long end = nowMicros + us;
+    while (numTimers > 0) {
+        int next = 0;
+        for (int i = 1; i < numTimers; i++)
+            if (timers[i].at < timers[next].at)
+                next = i;
+        if (timers[next].at > end)
+            break;
+        void (*fn)(void *) = timers[next].fn;
+        void *arg = timers[next].arg;
+        if (timers[next].at > nowMicros)
+            nowMicros = timers[next].at;
+        timers[next] = timers[--numTimers];
+        fn(arg);
+    }
+    if (end > nowMicros)
+        nowMicros = end;
+}
+
+void delay(unsigned long ms) {
+    advance((unsigned long long)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    advance(us);
+}
+
+unsigned long millis(void) {
+    return (unsigned long)(nowMicros / 1000);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)nowMicros;
+}
+
+void shimAttachPin(uint8_t pin, ShimPinDevice *device) {
+    if (pin < SHIM_NUM_PINS)
+        pinDevices[pin] = device;
+}
+
+unsigned long long shimMicros(void) {
+    return nowMicros;
+}
+
+void shimAdvanceMicros(unsigned long long us) {
+    advance(us);
+}
+
+bool shimAt(unsigned long long atMicros, void (*fn)(void *), void *arg) {
+    if (numTimers >= SHIM_MAX_TIMERS)
+        return false;
+    timers[numTimers].at = atMicros;
+    timers[numTimers].fn = fn;
+    timers[numTimers].arg = arg;
+    numTimers++;
+    return true;
+}
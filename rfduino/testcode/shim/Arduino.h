@@ -0,0 +1,118 @@
+/**
+ * Minimal Arduino core for building the RFduino libraries and sketches on a
+ * Linux host. Time is virtual: delay() and friends advance a simulated clock
+ * instead of sleeping, so host programs run as fast as the CPU allows. The
+ * parts of the RFduino core the sketches use (ULP sleep, flash, the ADC and
+ * Serial) are here too, so a sketch builds unmodified.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Pin levels and modes
+#define LOW     (0)
+#define HIGH    (1)
+#define INPUT   (0)
+#define OUTPUT  (1)
+
+// Number bases for Serial.print
+#define DEC     (10)
+#define HEX     (16)
+#define OCT     (8)
+#define BIN     (2)
+
+// Digital I/O
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Timing, driven by the virtual clock
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis(void);
+unsigned long micros(void);
+
+// There are no interrupts on the host
+inline void noInterrupts(void) {}
+inline void interrupts(void) {}
+
+// RFduino ultra low power sleep, in ms. Time spent here counts as asleep.
+#define INFINITE    (0xFFFFFFFFFFFFFFFFULL)
+#define SECONDS(x)  ((x) * 1000UL)
+#define MINUTES(x)  ((x) * 60UL * 1000)
+#define HOURS(x)    ((x) * 60UL * 60 * 1000)
+#define DAYS(x)     ((x) * 24UL * 60 * 60 * 1000)
+void RFduino_ULPDelay(uint64_t ms);
+
+// RFduino flash: 256 pages of 1 KB, kept in RAM and starting erased.
+// Erasing and writing stall the CPU as on the nRF51.
+#define ADDRESS_OF_PAGE(page)   ((uint32_t*)shimFlashPage(page))
+int flashPageErase(uint8_t page);
+int flashWrite(uint32_t *address, uint32_t value);
+int flashWriteBlock(void *dst, const void *src, int cb);
+
+// RFduino ADC: 10 bits against the 1.2 V band gap, reading an input or the
+// supply through a prescaler
+#define VBG         (0)
+#define DEFAULT     (1)
+#define AIN_NO_PS   (0)
+#define AIN_2_3_PS  (1)
+#define AIN_1_3_PS  (2)
+#define VDD_2_3_PS  (3)
+#define VDD_1_3_PS  (4)
+void analogReference(uint8_t reference);
+void analogSelection(uint8_t selection);
+int analogRead(uint8_t pin);
+
+#include "HardwareSerial.h"
+
+/**
+ * Simulated device attached to a digital pin. The shim forwards every change
+ * the firmware makes to the pin and asks the device for the level on reads.
+ */
+class ShimPinDevice {
+    public:
+        virtual ~ShimPinDevice() {}
+
+        // The firmware changed the pin mode or output value
+        virtual void pinChanged(uint8_t mode, uint8_t value) = 0;
+
+        // The firmware reads the pin
+        virtual int pinRead(void) = 0;
+};
+
+// Attach a simulated device to a pin (NULL to detach)
+void shimAttachPin(uint8_t pin, ShimPinDevice *device);
+
+// Virtual clock in microseconds since start
+unsigned long long shimMicros(void);
+void shimAdvanceMicros(unsigned long long us);
+
+// Call fn(arg) once the virtual clock reaches atMicros, as an interrupt
+// would: from inside whatever delay or transfer is running at the time.
+// Returns false if too many are pending.
+bool shimAt(unsigned long long atMicros, void (*fn)(void *), void *arg);
+
+// Time spent in RFduino_ULPDelay, and how many times it was called
+unsigned long long shimSleepMicros(void);
+unsigned long shimSleepCount(void);
+
+// Simulated flash page, and the number of erases and bytes written
+byte *shimFlashPage(int page);
+unsigned long shimFlashErases(void);
+unsigned long shimFlashBytesWritten(void);
+
+// Supply and analog input voltages the ADC sees, in mV
+void shimSetSupplyMillivolts(int mv);
+void shimSetAnalogMillivolts(uint8_t pin, int mv);
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * @file BleLinkSim.cpp
+ * @brief Simulated BLE notification link
+ *
+ * Each connection event moves up to packetsPerEvent packets out of the
+ * transmit buffer. A lost packet still frees its slot: BLE notifications are
+ * not acknowledged to the application.
+ */
+
+#include "BleLinkSim.h"
+#include <string.h>
+
+SimBleLink::SimBleLink(int bufferSlots, int packetsPerEvent,
+                       unsigned long intervalMicros) :
+    bufferSlots(bufferSlots > 32 ? 32 : bufferSlots),
+    packetsPerEvent(packetsPerEvent), interval(intervalMicros),
+    lossRate(0), rngState(0x2545F491), buffered(0), accepted(0), refused(0),
+    delivered(0), lost(0) {
+    nextEvent = shimMicros() + interval;
+}
+
+void SimBleLink::update(void) {
+    unsigned long long now = shimMicros();
+    while (nextEvent <= now) {
+        for (int i = 0; i < packetsPerEvent && buffered > 0; i++) {
+            rngState ^= rngState << 13;
+            rngState ^= rngState >> 17;
+            rngState ^= rngState << 5;
+            if ((rngState / 4294967296.0) < lossRate) {
+                lost++;
+            } else {
+                if (delivered < BLE_SIM_LOG_SIZE) {
+                    memcpy(log[delivered], buffer[0], bufferLength[0]);
+                    logLength[delivered] = bufferLength[0];
+                }
+                delivered++;
+            }
+            buffered--;
+            memmove(buffer[0], buffer[1], sizeof(buffer[0]) * buffered);
+            memmove(bufferLength, bufferLength + 1, buffered);
+        }
+        nextEvent += interval;
+    }
+}
+
+bool SimBleLink::send(const char *data, int len) {
+    update();
+    if (buffered >= bufferSlots || len > 20) {
+        refused++;
+        return false;
+    }
+    memcpy(buffer[buffered], data, len);
+    bufferLength[buffered] = len;
+    buffered++;
+    accepted++;
+    return true;
+}
@@ -0,0 +1,66 @@
+/**
+ * Simulated BLE notification link for host builds. Notifications go into a
+ * limited transmit buffer that drains a few packets per connection event on
+ * the virtual clock; a send into a full buffer is refused, as RFduinoBLE
+ * does. Delivered packets can be lost over the air at a configurable rate.
+ */
+
+#ifndef BleLinkSim_h
+#define BleLinkSim_h
+
+#include <Arduino.h>
+#include "BleTxQueue.h"
+
+// Delivered packets kept for inspection
+#define BLE_SIM_LOG_SIZE    (4096)
+
+class SimBleLink : public BleLink {
+    public:
+        // Buffer slots, packets per connection event and the connection
+        // interval in microseconds
+        SimBleLink(int bufferSlots = 6, int packetsPerEvent = 4,
+                   unsigned long intervalMicros = 7500);
+
+        void setLossRate(double rate) { lossRate = rate; }
+
+        // BleLink
+        bool send(const char *data, int len);
+        unsigned long now(void) { return millis(); }
+        void sleep(unsigned long ms) { delay(ms); }
+
+        // Deliver everything due up to now
+        void update(void);
+
+        // Inspection
+        unsigned long getAccepted(void) const { return accepted; }
+        unsigned long getRefused(void) const { return refused; }
+        unsigned long getDelivered(void) const { return delivered; }
+        unsigned long getLost(void) const { return lost; }
+        int getBuffered(void) const { return buffered; }
+        const uint8_t *getPacket(unsigned long i) const { return log[i]; }
+        int getPacketLength(unsigned long i) const { return logLength[i]; }
+
+    private:
+        int bufferSlots;
+        int packetsPerEvent;
+        unsigned long long interval;
+        unsigned long long nextEvent;
+        double lossRate;
+        uint32_t rngState;
+
+        // Transmit buffer, oldest first
+        uint8_t buffer[32][20];
+        uint8_t bufferLength[32];
+        int buffered;
+
+        // Packets that made it across, in order
+        uint8_t log[BLE_SIM_LOG_SIZE][20];
+        uint8_t logLength[BLE_SIM_LOG_SIZE];
+
+        unsigned long accepted;
+        unsigned long refused;
+        unsigned long delivered;
+        unsigned long lost;
+};
+
+#endif
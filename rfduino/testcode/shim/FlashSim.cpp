@@ -0,0 +1,110 @@
+/**
+ * @file FlashSim.cpp
+ * @brief File-backed flash
+ *
+ * Writes read the old contents and AND the new data into them, as
+ * programming flash does.
+ */
+
+#include "FlashSim.h"
+#include <string.h>
+
+FileFlash::FileFlash(const char *path, int firstPage, int numPages) :
+    firstPage(firstPage),
+    numPages(numPages > FLASH_SIM_MAX_PAGES ? FLASH_SIM_MAX_PAGES : numPages),
+    budget(-1), powerLost(false), violations(0) {
+    memset(erases, 0, sizeof(erases));
+    file = fopen(path, "r+b");
+    if (!file) {
+        file = fopen(path, "w+b");
+        byte erased[FLASH_PAGE_SIZE];
+        memset(erased, 0xFF, sizeof(erased));
+        for (int i = 0; file && i < this->numPages; i++)
+            fwrite(erased, 1, sizeof(erased), file);
+    }
+}
+
+FileFlash::~FileFlash() {
+    if (file)
+        fclose(file);
+}
+
+bool FileFlash::locate(int page, int offset, int len, long *pos) {
+    if (!file || powerLost || page < firstPage || page >= firstPage + numPages ||
+        offset < 0 || len < 0 || offset + len > FLASH_PAGE_SIZE)
+        return false;
+    *pos = (long)(page - firstPage) * FLASH_PAGE_SIZE + offset;
+    return true;
+}
+
+bool FileFlash::erasePage(int page) {
+    long pos;
+    if (!locate(page, 0, FLASH_PAGE_SIZE, &pos))
+        return false;
+    byte erased[FLASH_PAGE_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    fseek(file, pos, SEEK_SET);
+    fwrite(erased, 1, sizeof(erased), file);
+    fflush(file);
+    erases[page - firstPage]++;
+    return true;
+}
+
+bool FileFlash::write(int page, int offset, const void *data, int len) {
+    long pos;
+    if ((offset % 4) != 0 || (len % 4) != 0 || !locate(page, offset, len, &pos))
+        return false;
+
+    byte cells[FLASH_PAGE_SIZE];
+    fseek(file, pos, SEEK_SET);
+    if (fread(cells, 1, len, file) != (size_t)len)
+        return false;
+
+    // Program byte by byte until the power goes
+    const byte *src = (const byte*)data;
+    int n = len;
+    if (budget >= 0 && budget < n) {
+        n = budget;
+        powerLost = true;
+    }
+    for (int i = 0; i < n; i++) {
+        if (src[i] & ~cells[i])
+            violations++;
+        cells[i] &= src[i];
+    }
+    if (budget >= 0)
+        budget -= n;
+
+    fseek(file, pos, SEEK_SET);
+    fwrite(cells, 1, n, file);
+    fflush(file);
+    return !powerLost;
+}
+
+bool FileFlash::read(int page, int offset, void *data, int len) {
+    long pos;
+    if (!locate(page, offset, len, &pos))
+        return false;
+    fseek(file, pos, SEEK_SET);
+    return fread(data, 1, len, file) == (size_t)len;
+}
+
+void FileFlash::corrupt(int page, int offset, int bit) {
+    long pos;
+    byte cell;
+    if (!locate(page, offset, 1, &pos))
+        return;
+    fseek(file, pos, SEEK_SET);
+    if (fread(&cell, 1, 1, file) != 1)
+        return;
+    cell ^= 1 << bit;
+    fseek(file, pos, SEEK_SET);
+    fwrite(&cell, 1, 1, file);
+    fflush(file);
+}
+
+unsigned long FileFlash::getEraseCount(int page) const {
+    if (page < firstPage || page >= firstPage + numPages)
+        return 0;
+    return erases[page - firstPage];
+}
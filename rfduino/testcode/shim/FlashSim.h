@@ -0,0 +1,56 @@
+/**
+ * File-backed flash for host builds. Pages live in a file, so a log written
+ * by one run (or one FlashLog instance) is there for the next, like flash
+ * across a reboot. Writes behave like NOR flash: they can only clear bits,
+ * and an attempt to set one is counted. A power failure can be injected
+ * partway through a write.
+ */
+
+#ifndef FlashSim_h
+#define FlashSim_h
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "FlashLog.h"
+
+// Most pages the simulated flash keeps counts for
+#define FLASH_SIM_MAX_PAGES (256)
+
+class FileFlash : public FlashDevice {
+    public:
+        // Pages firstPage to firstPage + numPages - 1, kept in path. A new
+        // file starts erased.
+        FileFlash(const char *path, int firstPage, int numPages);
+        ~FileFlash();
+
+        // FlashDevice
+        bool erasePage(int page);
+        bool write(int page, int offset, const void *data, int len);
+        bool read(int page, int offset, void *data, int len);
+
+        // Lose power after this many more bytes have been written: the write
+        // in progress stops partway and everything fails until restore.
+        // Negative to never fail.
+        void setPowerFailAfter(long bytes) { budget = bytes; }
+        void restore(void) { budget = -1; powerLost = false; }
+
+        // Flip a bit in place, as a flash cell going bad would
+        void corrupt(int page, int offset, int bit);
+
+        // Inspection
+        unsigned long getEraseCount(int page) const;
+        unsigned long getBitViolations(void) const { return violations; }
+
+    private:
+        bool locate(int page, int offset, int len, long *pos);
+
+        FILE *file;
+        int firstPage;
+        int numPages;
+        long budget;
+        bool powerLost;
+        unsigned long erases[FLASH_SIM_MAX_PAGES];
+        unsigned long violations;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file HardwareSerial.cpp
+ * @brief Host implementation of the serial port
+ *
+ * Only transmission is timed: a byte waits for room in the transmit buffer,
+ * and waiting advances the clock.
+ */
+
+#include "Arduino.h"
+
+HardwareSerial Serial;
+
+HardwareSerial::HardwareSerial() : byteMicros(0), busyUntil(0), blocked(0),
+    written(0), echo(false) {
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    byteMicros = baud ? (10 * 1000000UL + baud - 1) / baud : 0;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    // Wait until the buffer has room, i.e. all but a buffer less one bytes
+    // have gone out
+    unsigned long long now = shimMicros();
+    unsigned long long room = (unsigned long long)byteMicros *
+                              (SERIAL_TX_BUFFER_SIZE - 1);
+    if (busyUntil > now + room) {
+        blocked += busyUntil - room - now;
+        shimAdvanceMicros(busyUntil - room - now);
+        now = shimMicros();
+    }
+    busyUntil = (busyUntil > now ? busyUntil : now) + byteMicros;
+    written++;
+    if (echo)
+        putchar(c);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        write(data[i]);
+    return len;
+}
+
+size_t HardwareSerial::write(const char *str) {
+    return write((const uint8_t*)str, strlen(str));
+}
+
+size_t HardwareSerial::print(long n, int base) {
+    if (base == 10) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%ld", n);
+        return write(buf);
+    }
+    return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base) {
+    char buf[8 * sizeof(long) + 1];
+    char *p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    if (base < 2)
+        base = 10;
+    do {
+        int digit = n % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        n /= base;
+    } while (n);
+    return write(p);
+}
+
+size_t HardwareSerial::print(double n, int digits) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+void HardwareSerial::flush(void) {
+    unsigned long long now = shimMicros();
+    if (busyUntil > now)
+        shimAdvanceMicros(busyUntil - now);
+}
@@ -0,0 +1,72 @@
+/**
+ * Serial port for host builds. Bytes go into a transmit buffer that sends
+ * one per ten bit times on the virtual clock; writing to a full buffer
+ * blocks, advancing the clock. What is written can be echoed to stdout.
+ */
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes the transmitter holds, counting the one going out
+#define SERIAL_TX_BUFFER_SIZE   (64)
+
+class HardwareSerial {
+    public:
+        HardwareSerial();
+
+        void begin(unsigned long baud);
+        void end(void) {}
+
+        // Output
+        size_t write(uint8_t c);
+        size_t write(const uint8_t *data, size_t len);
+        size_t write(const char *str);
+        size_t write(const char *data, size_t len) {
+            return write((const uint8_t*)data, len);
+        }
+        size_t print(const char *str) { return write(str); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(long n, int base = 10);
+        size_t print(unsigned long n, int base = 10);
+        size_t print(int n, int base = 10) { return print((long)n, base); }
+        size_t print(unsigned int n, int base = 10) {
+            return print((unsigned long)n, base);
+        }
+        size_t print(double n, int digits = 2);
+        size_t println(void) { return write("\r\n"); }
+        template <typename T> size_t println(T value) {
+            size_t n = print(value);
+            return n + println();
+        }
+        template <typename T> size_t println(T value, int format) {
+            size_t n = print(value, format);
+            return n + println();
+        }
+        void flush(void);
+
+        // Nothing is ever received
+        int available(void) { return 0; }
+        int read(void) { return -1; }
+        int peek(void) { return -1; }
+
+        operator bool() { return true; }
+
+        // Host side: echo to stdout, and what has gone out
+        void setEcho(bool echo) { this->echo = echo; }
+        unsigned long long getBytesWritten(void) const { return written; }
+        unsigned long long getBlockedMicros(void) const { return blocked; }
+
+    private:
+        unsigned long byteMicros;
+        unsigned long long busyUntil;
+        unsigned long long blocked;
+        unsigned long long written;
+        bool echo;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file MCP4018Sim.cpp
+ * @brief Simulated MCP4018 digital potentiometer
+ *
+ * A write is a single byte whose low 7 bits set the wiper; a read returns the
+ * wiper value with the MSB clear.
+ */
+
+#include "MCP4018Sim.h"
+
+VirtualMCP4018::VirtualMCP4018() : wiper(MCP4018_SIM_POR_VALUE),
+    stuck(false), nak(false), writes(0), reads(0) {
+}
+
+bool VirtualMCP4018::i2cWrite(const uint8_t *data, int len) {
+    if (nak)
+        return false;
+    writes++;
+    if (len > 0 && !stuck)
+        wiper = data[len - 1] & 0x7F;
+    return true;
+}
+
+int VirtualMCP4018::i2cRead(uint8_t *data, int len) {
+    reads++;
+    for (int i = 0; i < len; i++)
+        data[i] = wiper;
+    return len;
+}
@@ -0,0 +1,44 @@
+/**
+ * Simulated MCP4018 digital potentiometer for host builds. Attach it to the
+ * Wire shim at MCP4018_ADDR and the real MCP4018 library drives it.
+ */
+
+#ifndef MCP4018Sim_h
+#define MCP4018Sim_h
+
+#include <Arduino.h>
+#include "Wire.h"
+
+// Wiper value at power-on (mid-scale), per the datasheet
+#define MCP4018_SIM_POR_VALUE   (0x3F)
+
+class VirtualMCP4018 : public ShimI2CDevice {
+    public:
+        VirtualMCP4018();
+
+        // Fault injection: ignore writes (the wiper stays put) or NAK them
+        void setStuck(bool stuck) { this->stuck = stuck; }
+        void setNak(bool nak) { this->nak = nak; }
+
+        // Simulate a power cycle: the wiper returns to mid-scale
+        void powerCycle(void) { wiper = MCP4018_SIM_POR_VALUE; }
+
+        // Inspection
+        uint8_t getWiper(void) const { return wiper; }
+        unsigned long getWriteCount(void) const { return writes; }
+        unsigned long getReadCount(void) const { return reads; }
+        void resetStats(void) { writes = 0; reads = 0; }
+
+        // ShimI2CDevice
+        bool i2cWrite(const uint8_t *data, int len);
+        int i2cRead(uint8_t *data, int len);
+
+    private:
+        uint8_t wiper;
+        bool stuck;
+        bool nak;
+        unsigned long writes;
+        unsigned long reads;
+};
+
+#endif
@@ -0,0 +1,448 @@
+/**
+ * @file OneWireSim.cpp
+ * @brief Bit-level 1-Wire bus simulator
+ *
+ * The bus watches the pin the master drives. A falling edge starts a slot:
+ * any device that is transmitting a 0 holds the line low for a while. The
+ * matching rising edge ends the slot: its length tells a reset from a 1 or a
+ * 0, which is delivered to every device that is receiving.
+ */
+
+#include "OneWireSim.h"
+
+// Device family code and command bytes, per the DS18B20 datasheet
+#define SIM_FAMILY_DS18B20  (0x28)
+#define SIM_ROM_READ        (0x33)
+#define SIM_ROM_MATCH       (0x55)
+#define SIM_ROM_SKIP        (0xCC)
+#define SIM_ROM_SEARCH      (0xF0)
+#define SIM_ROM_ALARM       (0xEC)
+#define SIM_FN_CONVERT      (0x44)
+#define SIM_FN_WRITE_SPAD   (0x4E)
+#define SIM_FN_READ_SPAD    (0xBE)
+#define SIM_FN_COPY_SPAD    (0x48)
+#define SIM_FN_RECALL_E2    (0xB8)
+#define SIM_FN_READ_PWR     (0xB4)
+
+// Dallas/Maxim CRC-8 (x^8 + x^5 + x^4 + 1), computed independently of the
+// OneWire library so the library's table can be checked against it.
+static uint8_t simCrc8(const uint8_t *data, uint8_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        uint8_t b = *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            uint8_t mix = (crc ^ b) & 0x01;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+            b >>= 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * VirtualDS18B20
+ */
+
+VirtualDS18B20::VirtualDS18B20(uint64_t serial) {
+    uint8_t r[8];
+    r[0] = SIM_FAMILY_DS18B20;
+    for (int i = 1; i < 7; i++)
+        r[i] = (serial >> (8 * (i - 1))) & 0xFF;
+    r[7] = simCrc8(r, 7);
+    setRom(r);
+
+    // Factory defaults: alarms 75/70 C, 12 bit resolution
+    eeprom[0] = 0x4B;
+    eeprom[1] = 0x46;
+    eeprom[2] = 0x7F;
+    temperatureRaw = 0x0190;    // 25 C
+    convertTime12Bit = DS18B20_SIM_CONVERT_12BIT;
+    bitErrorRate = 0.0;
+    parasite = false;
+    rngState = (uint32_t)(serial * 2654435761u) | 1;
+    junkState = rngState ^ 0x5BD1E995;
+    conversions = 0;
+    convertingMicros = 0;
+    spadWrites = 0;
+    eepromWrites = 0;
+    bitErrors = 0;
+    powerCycle();
+}
+
+void VirtualDS18B20::setRom(const uint8_t r[8]) {
+    memcpy(rom, r, 8);
+}
+
+void VirtualDS18B20::setTemperatureRaw(int16_t raw) {
+    temperatureRaw = raw;
+}
+
+void VirtualDS18B20::setTemperature(float celsius) {
+    temperatureRaw = (int16_t)lroundf(celsius * 16.0f);
+}
+
+void VirtualDS18B20::setConfig(uint8_t config) {
+    scratchpad[4] = (config & 0x60) | 0x1F;
+    updateCrc();
+}
+
+void VirtualDS18B20::setConversionTime(unsigned long us12bit) {
+    convertTime12Bit = us12bit;
+}
+
+void VirtualDS18B20::setBitErrorRate(double rate) {
+    bitErrorRate = rate;
+}
+
+void VirtualDS18B20::setParasitePower(bool p) {
+    parasite = p;
+}
+
+void VirtualDS18B20::powerCycle(void) {
+    scratchpad[0] = DS18B20_SIM_POWER_ON_RAW & 0xFF;
+    scratchpad[1] = DS18B20_SIM_POWER_ON_RAW >> 8;
+    scratchpad[2] = eeprom[0];
+    scratchpad[3] = eeprom[1];
+    scratchpad[4] = eeprom[2];
+    scratchpad[5] = 0xFF;
+    scratchpad[6] = 0x0C;
+    scratchpad[7] = 0x10;
+    updateCrc();
+    state = STATE_IDLE;
+    conversionPending = false;
+    alarmFlag = false;
+    txSlot = false;
+    copyPending = false;
+    busyUntil = 0;
+}
+
+void VirtualDS18B20::updateCrc(void) {
+    scratchpad[8] = simCrc8(scratchpad, 8);
+}
+
+// Conversion time halves with every bit of resolution dropped
+unsigned long VirtualDS18B20::conversionTime(void) const {
+    uint8_t bits = (scratchpad[4] >> 5) & 0x03;
+    return convertTime12Bit >> (3 - bits);
+}
+
+// Finish a pending conversion once its time is up
+void VirtualDS18B20::update(unsigned long long now) {
+    if (!conversionPending || now < busyUntil)
+        return;
+
+    // Lower resolutions leave the low bits undefined. Fill them with noise
+    // so that a reader has to mask them.
+    uint8_t bits = (scratchpad[4] >> 5) & 0x03;
+    int16_t undefined = (1 << (3 - bits)) - 1;
+    junkState ^= junkState << 13;
+    junkState ^= junkState >> 17;
+    junkState ^= junkState << 5;
+    int16_t raw = (temperatureRaw & ~undefined) | (junkState & undefined);
+    scratchpad[0] = raw & 0xFF;
+    scratchpad[1] = (raw >> 8) & 0xFF;
+    updateCrc();
+    conversionPending = false;
+
+    // The alarm flag is evaluated after every conversion against the integer
+    // part of the temperature
+    int8_t whole = (int8_t)(raw >> 4);
+    alarmFlag = whole >= (int8_t)scratchpad[2] || whole <= (int8_t)scratchpad[3];
+}
+
+// Pseudo-random bit flip at the configured rate
+bool VirtualDS18B20::injectError(void) {
+    if (bitErrorRate <= 0.0)
+        return false;
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    if ((rngState / 4294967296.0) < bitErrorRate) {
+        bitErrors++;
+        return true;
+    }
+    return false;
+}
+
+void VirtualDS18B20::startTransmit(const uint8_t *buf, uint8_t bytes) {
+    memcpy(txBuf, buf, bytes);
+    txBits = 0;
+    txTarget = bytes * 8;
+    state = STATE_TRANSMIT;
+}
+
+void VirtualDS18B20::busReset(void) {
+    state = STATE_ROM_CMD;
+    rxBits = 0;
+    rxTarget = 8;
+    txSlot = false;
+}
+
+// A read slot started. Returns true if this device pulls the line low.
+bool VirtualDS18B20::slotStart(unsigned long long now) {
+    update(now);
+
+    uint8_t bit;
+    switch (state) {
+        case STATE_TRANSMIT:
+            bit = (txBuf[txBits / 8] >> (txBits % 8)) & 0x01;
+            if (++txBits >= txTarget)
+                state = STATE_IDLE;
+            break;
+        case STATE_BUSY:
+            bit = now >= busyUntil ? 1 : 0;
+            break;
+        case STATE_SEARCH:
+            if (searchPhase == 2)
+                return false;
+            bit = (rom[searchBit / 8] >> (searchBit % 8)) & 0x01;
+            if (searchPhase == 1)
+                bit = !bit;
+            searchPhase++;
+            break;
+        default:
+            return false;
+    }
+
+    txSlot = true;
+    if (injectError())
+        bit = !bit;
+    return bit == 0;
+}
+
+// A slot ended with the master writing a bit
+void VirtualDS18B20::slotBit(uint8_t bit, unsigned long long now) {
+    // Slots this device transmitted in are read slots, not writes
+    if (txSlot) {
+        txSlot = false;
+        return;
+    }
+
+    switch (state) {
+        case STATE_SEARCH: {
+            uint8_t mine = (rom[searchBit / 8] >> (searchBit % 8)) & 0x01;
+            if (bit != mine) {
+                state = STATE_IDLE;   // lost the search at this bit
+                return;
+            }
+            searchPhase = 0;
+            if (++searchBit >= 64) {
+                // Search won: the device is selected
+                state = STATE_FUNC_CMD;
+                rxBits = 0;
+                rxTarget = 8;
+            }
+            return;
+        }
+        case STATE_ROM_CMD:
+        case STATE_MATCH_ROM:
+        case STATE_FUNC_CMD:
+        case STATE_RECEIVE:
+            break;
+        default:
+            return;
+    }
+
+    // Shift the bit in, LSB first
+    if ((rxBits % 8) == 0)
+        rxBuf[rxBits / 8] = 0;
+    if (bit)
+        rxBuf[rxBits / 8] |= 1 << (rxBits % 8);
+    if (++rxBits < rxTarget)
+        return;
+    rxBits = 0;
+
+    switch (state) {
+        case STATE_ROM_CMD:
+            handleRomCommand(rxBuf[0]);
+            break;
+        case STATE_MATCH_ROM:
+            if (memcmp(rxBuf, rom, 8) == 0) {
+                state = STATE_FUNC_CMD;
+                rxTarget = 8;
+            } else {
+                state = STATE_IDLE;
+            }
+            break;
+        case STATE_FUNC_CMD:
+            handleFunctionCommand(rxBuf[0], now);
+            break;
+        case STATE_RECEIVE:
+            // TH, TL and config of a write scratchpad
+            scratchpad[2] = rxBuf[0];
+            scratchpad[3] = rxBuf[1];
+            scratchpad[4] = (rxBuf[2] & 0x60) | 0x1F;
+            updateCrc();
+            spadWrites++;
+            state = STATE_IDLE;
+            break;
+        default:
+            break;
+    }
+}
+
+void VirtualDS18B20::handleRomCommand(uint8_t cmd) {
+    switch (cmd) {
+        case SIM_ROM_READ:
+            startTransmit(rom, 8);
+            break;
+        case SIM_ROM_MATCH:
+            state = STATE_MATCH_ROM;
+            rxTarget = 64;
+            break;
+        case SIM_ROM_SKIP:
+            state = STATE_FUNC_CMD;
+            rxTarget = 8;
+            break;
+        case SIM_ROM_ALARM:
+            if (!alarmFlag) {
+                state = STATE_IDLE;
+                break;
+            }
+            // fall through
+        case SIM_ROM_SEARCH:
+            state = STATE_SEARCH;
+            searchBit = 0;
+            searchPhase = 0;
+            break;
+        default:
+            state = STATE_IDLE;
+            break;
+    }
+}
+
+void VirtualDS18B20::handleFunctionCommand(uint8_t cmd,
+                                           unsigned long long now) {
+    switch (cmd) {
+        case SIM_FN_CONVERT:
+            conversions++;
+            conversionPending = true;
+            busyUntil = now + conversionTime();
+            convertingMicros += conversionTime();
+            state = STATE_BUSY;
+            break;
+        case SIM_FN_READ_SPAD:
+            update(now);
+            startTransmit(scratchpad, 9);
+            break;
+        case SIM_FN_WRITE_SPAD:
+            state = STATE_RECEIVE;
+            rxTarget = 24;
+            break;
+        case SIM_FN_COPY_SPAD:
+            // Externally powered parts copy on their own; parasite parts need
+            // the master to hold a strong pull-up for the whole copy
+            if (parasite) {
+                copyPending = true;
+                copyStart = now;
+            } else {
+                memcpy(eeprom, &scratchpad[2], 3);
+                eepromWrites++;
+            }
+            busyUntil = now + DS18B20_SIM_COPY_TIME;
+            state = STATE_BUSY;
+            break;
+        case SIM_FN_RECALL_E2:
+            memcpy(&scratchpad[2], eeprom, 3);
+            updateCrc();
+            busyUntil = now;
+            state = STATE_BUSY;
+            break;
+        case SIM_FN_READ_PWR: {
+            uint8_t supply = parasite ? 0x00 : 0xFF;
+            startTransmit(&supply, 1);
+            break;
+        }
+        default:
+            state = STATE_IDLE;
+            break;
+    }
+}
+
+// The master stopped driving the line high
+void VirtualDS18B20::pullupEnded(unsigned long long now) {
+    if (!copyPending)
+        return;
+    copyPending = false;
+    if (now - copyStart >= DS18B20_SIM_COPY_TIME) {
+        memcpy(eeprom, &scratchpad[2], 3);
+        eepromWrites++;
+    }
+}
+
+/**
+ * OneWireBus
+ */
+
+OneWireBus::OneWireBus(uint8_t p) : pin(p), numDevices(0), masterLow(false),
+    strongPullup(false), fallTime(0), holdUntil(0), presenceStart(0),
+    presenceEnd(0), resets(0), slots(0) {
+    shimAttachPin(pin, this);
+}
+
+OneWireBus::~OneWireBus() {
+    shimAttachPin(pin, NULL);
+}
+
+bool OneWireBus::addDevice(VirtualDS18B20 *device) {
+    if (numDevices >= ONEWIRE_SIM_MAX_DEVICES)
+        return false;
+    devices[numDevices++] = device;
+    return true;
+}
+
+void OneWireBus::removeAll(void) {
+    numDevices = 0;
+}
+
+void OneWireBus::pinChanged(uint8_t mode, uint8_t value) {
+    unsigned long long now = shimMicros();
+    bool low = (mode == OUTPUT && value == LOW);
+    bool strong = (mode == OUTPUT && value == HIGH);
+
+    // Leaving a strong pull-up ends any parasite-powered operation
+    if (strongPullup && !strong) {
+        for (int i = 0; i < numDevices; i++)
+            devices[i]->pullupEnded(now);
+    }
+    strongPullup = strong;
+
+    if (!masterLow && low) {
+        // Falling edge: a slot starts
+        fallTime = now;
+        slots++;
+        for (int i = 0; i < numDevices; i++) {
+            if (devices[i]->slotStart(now) &&
+                holdUntil < now + ONEWIRE_SIM_HOLD_TIME)
+                holdUntil = now + ONEWIRE_SIM_HOLD_TIME;
+        }
+    } else if (masterLow && !low) {
+        // Rising edge: the length of the low pulse says what it was
+        unsigned long long pulse = now - fallTime;
+        if (pulse >= ONEWIRE_SIM_RESET_MIN) {
+            resets++;
+            slots--;
+            for (int i = 0; i < numDevices; i++)
+                devices[i]->busReset();
+            if (numDevices > 0) {
+                presenceStart = now + ONEWIRE_SIM_PRESENCE_WAIT;
+                presenceEnd = presenceStart + ONEWIRE_SIM_PRESENCE_TIME;
+            }
+        } else {
+            uint8_t bit = pulse < ONEWIRE_SIM_WRITE1_MAX ? 1 : 0;
+            for (int i = 0; i < numDevices; i++)
+                devices[i]->slotBit(bit, now);
+        }
+    }
+    masterLow = low;
+}
+
+int OneWireBus::pinRead(void) {
+    unsigned long long now = shimMicros();
+    if (masterLow || now < holdUntil ||
+        (now >= presenceStart && now < presenceEnd))
+        return LOW;
+    return HIGH;
+}
@@ -0,0 +1,177 @@
+/**
+ * Bit-level 1-Wire bus simulator for host builds.
+ *
+ * The bus attaches to a pin of the Arduino shim, so the real OneWire library
+ * runs on it unmodified: every reset pulse, write slot and read slot the
+ * library generates is decoded from the pin timing on the virtual clock, and
+ * the virtual devices answer by holding the line low exactly like hardware.
+ * That makes OneWire::search, OneWire::crc8 and the DS18B20 command sequences
+ * testable without sensors.
+ */
+
+#ifndef OneWireSim_h
+#define OneWireSim_h
+
+#include <Arduino.h>
+
+/**
+ * Constants
+ */
+// Maximum number of devices on one simulated bus
+#define ONEWIRE_SIM_MAX_DEVICES (64)
+// Slot timing (microseconds). A low pulse at least RESET_MIN long is a reset,
+// shorter than WRITE1_MAX is a 1 (or a read slot), anything else is a 0.
+#define ONEWIRE_SIM_RESET_MIN   (480)
+#define ONEWIRE_SIM_WRITE1_MAX  (15)
+// How long a device holds the line low for a 0 bit and for presence
+#define ONEWIRE_SIM_HOLD_TIME   (30)
+#define ONEWIRE_SIM_PRESENCE_WAIT   (15)
+#define ONEWIRE_SIM_PRESENCE_TIME   (120)
+// DS18B20 timings (microseconds)
+#define DS18B20_SIM_CONVERT_12BIT   (750000)
+#define DS18B20_SIM_COPY_TIME       (10000)
+// DS18B20 power-on temperature register, 85 C
+#define DS18B20_SIM_POWER_ON_RAW    (0x0550)
+
+/**
+ * Virtual DS18B20 thermometer. Everything about it can be configured by a
+ * test: ROM code, starting resolution, conversion latency, temperature,
+ * parasite power and a rate of injected bit errors on the bits it transmits.
+ */
+class VirtualDS18B20 {
+    public:
+        // Create with a 48-bit serial number; the family code and CRC of the
+        // ROM are filled in automatically
+        VirtualDS18B20(uint64_t serial);
+
+        // Configuration
+        void setRom(const uint8_t rom[8]);
+        void setTemperatureRaw(int16_t raw);
+        void setTemperature(float celsius);
+        void setConfig(uint8_t config);
+        void setConversionTime(unsigned long us12bit);
+        void setBitErrorRate(double rate);
+        void setParasitePower(bool parasite);
+
+        // Inspection
+        const uint8_t *getRom(void) const { return rom; }
+        uint8_t getConfig(void) const { return scratchpad[4]; }
+        uint8_t getAlarmHigh(void) const { return scratchpad[2]; }
+        uint8_t getAlarmLow(void) const { return scratchpad[3]; }
+        const uint8_t *getEeprom(void) const { return eeprom; }
+        unsigned long getConversionCount(void) const { return conversions; }
+        unsigned long long getConvertingMicros(void) const { return convertingMicros; }
+        unsigned long getScratchpadWrites(void) const { return spadWrites; }
+        unsigned long getEepromWrites(void) const { return eepromWrites; }
+        unsigned long getBitErrors(void) const { return bitErrors; }
+
+        // Simulate a power cycle: scratchpad reloads from EEPROM
+        void powerCycle(void);
+
+        // Bus interface, called by OneWireBus
+        void busReset(void);
+        bool slotStart(unsigned long long now);
+        void slotBit(uint8_t bit, unsigned long long now);
+        void pullupEnded(unsigned long long now);
+
+    private:
+        // Protocol state
+        enum State {
+            STATE_IDLE,         // not selected, waiting for a reset
+            STATE_ROM_CMD,      // receiving a ROM command
+            STATE_MATCH_ROM,    // receiving a ROM code to match
+            STATE_SEARCH,       // in a (conditional) search
+            STATE_FUNC_CMD,     // receiving a function command
+            STATE_RECEIVE,      // receiving scratchpad bytes
+            STATE_TRANSMIT,     // transmitting a buffer
+            STATE_BUSY,         // transmitting busy/done status bits
+        };
+
+        void startTransmit(const uint8_t *buf, uint8_t bytes);
+        void handleRomCommand(uint8_t cmd);
+        void handleFunctionCommand(uint8_t cmd, unsigned long long now);
+        void update(unsigned long long now);
+        void updateCrc(void);
+        unsigned long conversionTime(void) const;
+        bool injectError(void);
+
+        // Memory
+        uint8_t rom[8];
+        uint8_t scratchpad[9];
+        uint8_t eeprom[3];
+
+        // Behaviour
+        int16_t temperatureRaw;
+        unsigned long convertTime12Bit;
+        double bitErrorRate;
+        bool parasite;
+        uint32_t rngState;
+        uint32_t junkState;     // undefined temperature bits
+
+        // Protocol progress
+        State state;
+        uint8_t rxBuf[8];
+        uint8_t rxBits;
+        uint8_t rxTarget;
+        uint8_t txBuf[9];
+        uint8_t txBits;
+        uint8_t txTarget;
+        uint8_t searchBit;
+        uint8_t searchPhase;
+        unsigned long long busyUntil;
+        bool conversionPending;
+        bool alarmFlag;
+        bool txSlot;
+        bool copyPending;
+        unsigned long long copyStart;
+
+        // Statistics
+        unsigned long conversions;
+        unsigned long long convertingMicros;
+        unsigned long spadWrites;
+        unsigned long eepromWrites;
+        unsigned long bitErrors;
+};
+
+/**
+ * Simulated 1-Wire bus with an open-drain line and a pull-up. Attach it to the
+ * pin the OneWire instance is constructed with.
+ */
+class OneWireBus : public ShimPinDevice {
+    public:
+        OneWireBus(uint8_t pin);
+        ~OneWireBus();
+
+        // Devices are owned by the caller
+        bool addDevice(VirtualDS18B20 *device);
+        void removeAll(void);
+        int getDeviceCount(void) const { return numDevices; }
+
+        // Statistics
+        unsigned long getResetCount(void) const { return resets; }
+        unsigned long getSlotCount(void) const { return slots; }
+        void resetStats(void) { resets = 0; slots = 0; }
+
+        // ShimPinDevice
+        void pinChanged(uint8_t mode, uint8_t value);
+        int pinRead(void);
+
+    private:
+        uint8_t pin;
+        VirtualDS18B20 *devices[ONEWIRE_SIM_MAX_DEVICES];
+        int numDevices;
+
+        // Line state
+        bool masterLow;
+        bool strongPullup;
+        unsigned long long fallTime;
+        unsigned long long holdUntil;
+        unsigned long long presenceStart;
+        unsigned long long presenceEnd;
+
+        // Statistics
+        unsigned long resets;
+        unsigned long slots;
+};
+
+#endif
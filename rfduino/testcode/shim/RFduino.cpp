@@ -0,0 +1,134 @@
+/**
+ * @file RFduino.cpp
+ * @brief Host implementation of the RFduino core: ULP sleep, flash and ADC
+ *
+ * Flash follows the nRF51: an erase sets a page to 0xFF and takes about
+ * 21 ms, a write can only clear bits and takes about 46 us per word. The ADC
+ * returns the supply or input voltage, prescaled, against its reference.
+ */
+
+#include "Arduino.h"
+
+// Flash size, and the nRF51 flash timing (us)
+#define SHIM_FLASH_PAGE_SIZE    (1024)
+#define SHIM_FLASH_PAGES        (256)
+#define FLASH_ERASE_MICROS  (21000)
+#define FLASH_WORD_MICROS   (46)
+// ADC conversion time (us) and the band gap reference (mV)
+#define ADC_MICROS          (68)
+#define ADC_BAND_GAP_MV     (1200)
+#define ADC_MAX             (1023)
+#define ADC_NUM_PINS        (7)
+
+static byte flash[SHIM_FLASH_PAGES][SHIM_FLASH_PAGE_SIZE];
+static bool flashReady = false;
+static unsigned long flashErases = 0;
+static unsigned long flashBytes = 0;
+
+static unsigned long long sleepMicros = 0;
+static unsigned long sleepCount = 0;
+
+static uint8_t adcSelection = AIN_1_3_PS;
+static int supplyMillivolts = 3000;
+static int analogMillivolts[ADC_NUM_PINS];
+
+void RFduino_ULPDelay(uint64_t ms) {
+    // INFINITE only ends on an interrupt the shim cannot deliver; a day is
+    // long enough for any run to notice
+    if (ms == INFINITE)
+        ms = 24UL * 3600 * 1000;
+    sleepCount++;
+    sleepMicros += ms * 1000;
+    shimAdvanceMicros(ms * 1000);
+}
+
+unsigned long long shimSleepMicros(void) {
+    return sleepMicros;
+}
+
+unsigned long shimSleepCount(void) {
+    return sleepCount;
+}
+
+byte *shimFlashPage(int page) {
+    if (!flashReady) {
+        memset(flash, 0xFF, sizeof(flash));
+        flashReady = true;
+    }
+    if (page < 0 || page >= SHIM_FLASH_PAGES)
+        return NULL;
+    return flash[page];
+}
+
+int flashPageErase(uint8_t page) {
+    byte *p = shimFlashPage(page);
+    if (!p)
+        return 1;
+    memset(p, 0xFF, SHIM_FLASH_PAGE_SIZE);
+    flashErases++;
+    shimAdvanceMicros(FLASH_ERASE_MICROS);
+    return 0;
+}
+
+int flashWriteBlock(void *dst, const void *src, int cb) {
+    byte *base = shimFlashPage(0);
+    byte *d = (byte*)dst;
+    if (cb < 0 || d < base || d + cb > base + sizeof(flash))
+        return 1;
+    const byte *s = (const byte*)src;
+    for (int i = 0; i < cb; i++)
+        d[i] &= s[i];
+    flashBytes += cb;
+    shimAdvanceMicros((unsigned long long)(cb + 3) / 4 * FLASH_WORD_MICROS);
+    return 0;
+}
+
+int flashWrite(uint32_t *address, uint32_t value) {
+    return flashWriteBlock(address, &value, sizeof(value));
+}
+
+unsigned long shimFlashErases(void) {
+    return flashErases;
+}
+
+unsigned long shimFlashBytesWritten(void) {
+    return flashBytes;
+}
+
+void analogReference(uint8_t reference) {
+    // Both references are the band gap on the RFduino
+    (void)reference;
+}
+
+void analogSelection(uint8_t selection) {
+    adcSelection = selection;
+}
+
+int analogRead(uint8_t pin) {
+    long mv;
+    switch (adcSelection) {
+        case VDD_2_3_PS: mv = supplyMillivolts * 2L / 3; break;
+        case VDD_1_3_PS: mv = supplyMillivolts / 3L; break;
+        default:
+            mv = pin < ADC_NUM_PINS ? analogMillivolts[pin] : 0;
+            if (adcSelection == AIN_2_3_PS)
+                mv = mv * 2 / 3;
+            else if (adcSelection == AIN_1_3_PS)
+                mv = mv / 3;
+            break;
+    }
+    shimAdvanceMicros(ADC_MICROS);
+    long counts = (mv * ADC_MAX + ADC_BAND_GAP_MV / 2) / ADC_BAND_GAP_MV;
+    if (counts < 0)
+        return 0;
+    return counts > ADC_MAX ? ADC_MAX : (int)counts;
+}
+
+void shimSetSupplyMillivolts(int mv) {
+    supplyMillivolts = mv;
+}
+
+void shimSetAnalogMillivolts(uint8_t pin, int mv) {
+    if (pin < ADC_NUM_PINS)
+        analogMillivolts[pin] = mv;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file RFduinoBLE.cpp
+ * @brief Host implementation of RFduinoBLE on a simulated link
+ */
+
+#include "RFduinoBLE.h"
+#include "BleLinkSim.h"
+
+RFduinoBLEClass RFduinoBLE;
+
+RFduinoBLEClass::RFduinoBLEClass() : deviceName("RFduino"),
+    advertisementData(""), advertisementInterval(80), txPowerLevel(0),
+    started(false), link(NULL), refused(0) {
+}
+
+int RFduinoBLEClass::begin(void) {
+    started = true;
+    if (RFduinoBLE_onAdvertisement)
+        RFduinoBLE_onAdvertisement(true);
+    return 0;
+}
+
+void RFduinoBLEClass::end(void) {
+    if (link)
+        shimBleDisconnect();
+    started = false;
+}
+
+bool RFduinoBLEClass::send(char data) {
+    return send(&data, 1);
+}
+
+bool RFduinoBLEClass::send(const char *data, int len) {
+    if (!link || !link->send(data, len)) {
+        refused++;
+        return false;
+    }
+    return true;
+}
+
+void shimBleConnect(SimBleLink *link) {
+    if (!RFduinoBLE.started || RFduinoBLE.link)
+        return;
+    RFduinoBLE.link = link;
+    if (RFduinoBLE_onAdvertisement)
+        RFduinoBLE_onAdvertisement(false);
+    if (RFduinoBLE_onConnect)
+        RFduinoBLE_onConnect();
+}
+
+void shimBleDisconnect(void) {
+    if (!RFduinoBLE.link)
+        return;
+    RFduinoBLE.link->update();
+    RFduinoBLE.link = NULL;
+    if (RFduinoBLE_onDisconnect)
+        RFduinoBLE_onDisconnect();
+    if (RFduinoBLE.started && RFduinoBLE_onAdvertisement)
+        RFduinoBLE_onAdvertisement(true);
+}
+
+void shimBleReceive(const char *data, int len) {
+    if (!RFduinoBLE.isConnected() || !RFduinoBLE_onReceive)
+        return;
+    char buf[20];
+    if (len > (int)sizeof(buf))
+        len = sizeof(buf);
+    memcpy(buf, data, len);
+    RFduinoBLE_onReceive(buf, len);
+}
@@ -0,0 +1,61 @@
+/**
+ * RFduinoBLE for host builds. Notifications go to a simulated link attached
+ * while a central is connected; the sketch's callbacks are called when the
+ * host program connects, disconnects or writes, as the radio would.
+ */
+
+#ifndef RFduinoBLE_h
+#define RFduinoBLE_h
+
+#include <Arduino.h>
+
+class SimBleLink;
+
+class RFduinoBLEClass {
+    public:
+        RFduinoBLEClass();
+
+        // Advertising, as set by the sketch before begin
+        const char *deviceName;
+        const char *advertisementData;
+        int advertisementInterval;      // ms
+        int txPowerLevel;               // dBm
+
+        int begin(void);
+        void end(void);
+
+        // Queue a notification. Refused when nothing is connected or the
+        // link's transmit buffers are full.
+        bool send(char data);
+        bool send(const char *data, int len);
+
+        // Host side
+        bool isStarted(void) const { return started; }
+        bool isConnected(void) const { return link != NULL; }
+        unsigned long getRefusedCount(void) const { return refused; }
+
+    private:
+        bool started;
+        SimBleLink *link;
+        unsigned long refused;
+
+        friend void shimBleConnect(SimBleLink *link);
+        friend void shimBleDisconnect(void);
+};
+
+extern RFduinoBLEClass RFduinoBLE;
+
+// Sketch callbacks, all optional
+void RFduinoBLE_onAdvertisement(bool start) __attribute__((weak));
+void RFduinoBLE_onConnect(void) __attribute__((weak));
+void RFduinoBLE_onDisconnect(void) __attribute__((weak));
+void RFduinoBLE_onReceive(char *data, int len) __attribute__((weak));
+void RFduinoBLE_onRSSI(int rssi) __attribute__((weak));
+
+// Connect a central over link, disconnect it (what is still in the link's
+// buffers is delivered if due, the rest is lost), and write to the sketch
+void shimBleConnect(SimBleLink *link);
+void shimBleDisconnect(void);
+void shimBleReceive(const char *data, int len);
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * @file UartSim.cpp
+ * @brief Simulated UART transmitter
+ */
+
+#include "UartSim.h"
+
+SimUart::SimUart(unsigned long baud, int buffer) {
+    byteMicros = (10 * 1000000UL + baud - 1) / baud;
+    this->buffer = buffer;
+    busyUntil = 0;
+    blocked = 0;
+    length = 0;
+    received[0] = '\0';
+}
+
+void SimUart::write(const byte *data, int len) {
+    for (int i = 0; i < len; i++) {
+        // Wait for room, i.e. all but a buffer less one bytes to go out
+        unsigned long long now = shimMicros();
+        unsigned long long room = (unsigned long long)byteMicros *
+                                  (buffer - 1);
+        if (busyUntil > now + room) {
+            blocked += busyUntil - room - now;
+            shimAdvanceMicros(busyUntil - room - now);
+            now = busyUntil - room;
+        }
+        busyUntil = (busyUntil > now ? busyUntil : now) + byteMicros;
+
+        if (length < UART_SIM_LOG_SIZE) {
+            received[length++] = data[i];
+            received[length] = '\0';
+        }
+    }
+}
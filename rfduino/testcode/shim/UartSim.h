@@ -0,0 +1,40 @@
+/**
+ * Simulated UART transmitter for host builds. A byte takes ten bit times on
+ * the virtual clock, and the transmitter holds a given number of bytes,
+ * counting the one going out; writing when it is full blocks, advancing
+ * the clock. With the default of one, every byte waits for the one before.
+ */
+
+#ifndef UartSim_h
+#define UartSim_h
+
+#include <Arduino.h>
+#include "SerialLog.h"
+
+// Received bytes kept for inspection
+#define UART_SIM_LOG_SIZE   (65536)
+
+class SimUart : public LogUart {
+    public:
+        SimUart(unsigned long baud = 9600, int buffer = 1);
+
+        // LogUart
+        void write(const byte *data, int len);
+        unsigned long now(void) { return micros(); }
+
+        // Inspection
+        const char *getReceived(void) const { return received; }
+        unsigned long getLength(void) const { return length; }
+        unsigned long long getBlockedMicros(void) const { return blocked; }
+        void clearReceived(void) { length = 0; received[0] = '\0'; }
+
+    private:
+        unsigned long byteMicros;
+        int buffer;
+        unsigned long long busyUntil;
+        unsigned long long blocked;
+        char received[UART_SIM_LOG_SIZE + 1];
+        unsigned long length;
+};
+
+#endif
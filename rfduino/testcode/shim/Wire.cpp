@@ -0,0 +1,85 @@
+/**
+ * @file Wire.cpp
+ * @brief Host implementation of the Wire library
+ *
+ * Each transaction also advances the virtual clock by roughly what it would
+ * take on a 400 kHz bus (9 bit times per byte plus start/stop).
+ */
+
+#include "Wire.h"
+
+// Bit time at 400 kHz is 2.5 us; round to whole microseconds per byte
+#define WIRE_BYTE_MICROS    (23)
+#define WIRE_FRAME_MICROS   (5)
+
+TwoWire Wire;
+
+static ShimI2CDevice *i2cDevices[128];
+
+void shimAttachI2C(uint8_t address, ShimI2CDevice *device) {
+    i2cDevices[address & 0x7F] = device;
+}
+
+TwoWire::TwoWire() : txAddress(0), txLength(0), rxIndex(0), rxLength(0),
+    transactions(0) {
+}
+
+void TwoWire::begin(void) {
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    txAddress = address & 0x7F;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if (txLength >= WIRE_BUFFER_LENGTH)
+        return 0;
+    txBuffer[txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity) {
+    size_t n = 0;
+    while (n < quantity && write(data[n]))
+        n++;
+    return n;
+}
+
+uint8_t TwoWire::endTransmission(bool stop) {
+    transactions++;
+    shimAdvanceMicros(WIRE_FRAME_MICROS + WIRE_BYTE_MICROS * (txLength + 1));
+    ShimI2CDevice *device = i2cDevices[txAddress];
+    if (!device)
+        return 2;   // address NAK
+    if (!device->i2cWrite(txBuffer, txLength))
+        return 3;
+    if (stop)
+        device->i2cStop();
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+    if (quantity > WIRE_BUFFER_LENGTH)
+        quantity = WIRE_BUFFER_LENGTH;
+    transactions++;
+    shimAdvanceMicros(WIRE_FRAME_MICROS + WIRE_BYTE_MICROS * (quantity + 1));
+    rxIndex = 0;
+    rxLength = 0;
+    ShimI2CDevice *device = i2cDevices[address & 0x7F];
+    if (device) {
+        int n = device->i2cRead(rxBuffer, quantity);
+        rxLength = n < 0 ? 0 : n;
+    }
+    return rxLength;
+}
+
+int TwoWire::available(void) {
+    return rxLength - rxIndex;
+}
+
+int TwoWire::read(void) {
+    if (rxIndex >= rxLength)
+        return -1;
+    return rxBuffer[rxIndex++];
+}
@@ -0,0 +1,68 @@
+/**
+ * Host implementation of the Arduino Wire (I2C master) library. Transactions
+ * are routed to simulated devices attached by 7-bit address; an address with
+ * nothing attached NAKs like an empty bus.
+ */
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+
+// Size of the transmit and receive buffers, as in the Arduino core
+#define WIRE_BUFFER_LENGTH  (32)
+
+/**
+ * Simulated I2C device. A write transaction delivers all bytes between the
+ * start and the stop or repeated start; a read asks for a number of bytes.
+ */
+class ShimI2CDevice {
+    public:
+        virtual ~ShimI2CDevice() {}
+
+        // Master wrote bytes. Return false to NAK.
+        virtual bool i2cWrite(const uint8_t *data, int len) = 0;
+
+        // Master reads bytes. Return how many were supplied.
+        virtual int i2cRead(uint8_t *data, int len) = 0;
+
+        // Master ended a write with a stop rather than a repeated start
+        virtual void i2cStop(void) {}
+};
+
+// Attach a simulated device to an address (NULL to detach)
+void shimAttachI2C(uint8_t address, ShimI2CDevice *device);
+
+class TwoWire {
+    public:
+        TwoWire();
+        void begin(void);
+        void beginTransmission(uint8_t address);
+        void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+        uint8_t endTransmission(void) { return endTransmission(true); }
+        uint8_t endTransmission(bool stop);
+        uint8_t requestFrom(uint8_t address, uint8_t quantity);
+        uint8_t requestFrom(int address, int quantity) {
+            return requestFrom((uint8_t)address, (uint8_t)quantity);
+        }
+        size_t write(uint8_t data);
+        size_t write(const uint8_t *data, size_t quantity);
+        int available(void);
+        int read(void);
+
+        // Number of transactions, for benchmarks
+        unsigned long getTransactionCount(void) { return transactions; }
+
+    private:
+        uint8_t txAddress;
+        uint8_t txBuffer[WIRE_BUFFER_LENGTH];
+        uint8_t txLength;
+        uint8_t rxBuffer[WIRE_BUFFER_LENGTH];
+        uint8_t rxIndex;
+        uint8_t rxLength;
+        unsigned long transactions;
+};
+
+extern TwoWire Wire;
+
+#endif
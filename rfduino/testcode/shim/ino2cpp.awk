@@ -0,0 +1,61 @@
+# Turns an Arduino sketch into a C++ translation unit, as the Arduino IDE
+# does before compiling: a prototype for every function the sketch defines is
+# put before the first of them, so functions can be used before they are
+# defined. #line directives keep compiler messages pointing at the sketch.
+#
+# Usage:
+#  awk -f ino2cpp.awk sketch.ino sketch.ino > sketch.cpp
+
+# A function definition starts in column 0 outside a comment, with a return
+# type, a name and a parameter list, and no semicolon after it
+function isDefinition(line) {
+    if (line !~ /^[A-Za-z_][A-Za-z0-9_]*[ \t*]+[A-Za-z0-9_ \t*]*[A-Za-z_][A-Za-z0-9_]*[ \t]*\([^;]*\)[ \t]*\{?[ \t]*(\/\/.*)?$/)
+        return 0
+    return line !~ /^(return|else|if|while|for|switch|do|case|typedef)[^A-Za-z0-9_]/
+}
+
+function prototype(line) {
+    sub(/[ \t]*(\/\/.*)?$/, "", line)
+    sub(/[ \t]*\{$/, "", line)
+    return line ";"
+}
+
+# Whether the line leaves us inside a /* */ comment
+function updateComment(line, inside) {
+    while (1) {
+        if (inside) {
+            if (!match(line, /\*\//))
+                return 1
+            line = substr(line, RSTART + 2)
+            inside = 0
+        } else {
+            sub(/\/\/.*/, "", line)
+            if (!match(line, /\/\*/))
+                return 0
+            line = substr(line, RSTART + 2)
+            inside = 1
+        }
+    }
+}
+
+# First pass: collect the prototypes
+FNR == NR {
+    if (!inComment && isDefinition($0)) {
+        if (!first)
+            first = FNR
+        protos[++numProtos] = prototype($0)
+    }
+    inComment = updateComment($0, inComment)
+    next
+}
+
+# Second pass: the sketch, with the prototypes before the first definition
+FNR == 1 {
+    printf "#line 1 \"%s\"\n", FILENAME
+}
+FNR == first {
+    for (i = 1; i <= numProtos; i++)
+        print protos[i]
+    printf "#line %d \"%s\"\n", FNR, FILENAME
+}
+{ print }
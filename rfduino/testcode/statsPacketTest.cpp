@@ -0,0 +1,90 @@
+/**
+ * Round-trips device and task statistics through the binary stats frames.
+ * Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./statsPacketTest
+ */
+
+#include <Arduino.h>
+#include "StatsPacket.h"
+#include "RecordRing.h"
+#include "check.h"
+
+int main() {
+    byte frame[SWEEP_FRAME_SIZE];
+    StatsFrame out;
+
+    // Device page, the first snapshot
+    DeviceStats none = {};
+    DeviceStats device = { 86400UL * 3, 3600, 2, 17, 0, 70000, 300, 4, 97 };
+    int len = StatsPacket::packDevice(frame, 9, 7, &device, &none);
+    CHECK(len == SWEEP_FRAME_SIZE);
+    CHECK(StatsPacket::decode(frame, len, &out));
+    CHECK(out.snapshot == 9 && out.page == STATS_PAGE_DEVICE && out.pages == 7);
+    CHECK(out.device.uptime == 86400UL * 3);
+    CHECK(out.device.wakeupsPerHour == 3600);
+    CHECK(out.device.i2cErrors == 2 && out.device.bleRetries == 17);
+    CHECK(out.device.bleDrops == 0);
+    CHECK(out.device.recordDrops == 0xFFFF);    // saturated
+    CHECK(out.device.logDrops == 0xFF);         // saturated
+    CHECK(out.device.commandDrops == 4);
+    CHECK(out.device.sleepPercent == 97);
+
+    // Later snapshots send the counts since the last one, so they do not
+    // saturate however long the shirt has been up
+    DeviceStats later = device;
+    later.uptime += 3600;
+    later.i2cErrors += 1000;
+    later.recordDrops += 5;
+    later.logDrops += 10;
+    CHECK(StatsPacket::packDevice(frame, 10, 7, &later, &device) == SWEEP_FRAME_SIZE);
+    CHECK(StatsPacket::decode(frame, SWEEP_FRAME_SIZE, &out));
+    CHECK(out.device.uptime == 86400UL * 3 + 3600);
+    CHECK(out.device.i2cErrors == 0xFF);        // saturated in the interval
+    CHECK(out.device.bleRetries == 0 && out.device.commandDrops == 0);
+    CHECK(out.device.recordDrops == 5 && out.device.logDrops == 10);
+
+    // Task page
+    TaskStats zero = {};
+    TaskStats task = { 1440, 3, 61000, 2900000, 75500 };
+    len = StatsPacket::packTask(frame, 9, 7, 4, &task, &zero);
+    CHECK(len == SWEEP_FRAME_SIZE);
+    CHECK(StatsPacket::decode(frame, len, &out));
+    CHECK(out.page == STATS_PAGE_TASK + 4);
+    CHECK(out.task.runs == 1440 && out.task.late == 3);
+    CHECK(out.task.minMicros == 61000 && out.task.maxMicros == 2900000);
+    CHECK(out.task.meanMicros == 75500);
+
+    // A 1 s task a day and a half in, and counters that wrapped since
+    TaskStats before = { 0xFFFFFF00UL, 65000, 61000, 2900000, 75500 };
+    TaskStats after = before;
+    after.runs += 86400 + 0x100;
+    after.late += 2;
+    CHECK(StatsPacket::packTask(frame, 11, 7, 4, &after, &before) == SWEEP_FRAME_SIZE);
+    CHECK(StatsPacket::decode(frame, SWEEP_FRAME_SIZE, &out));
+    CHECK(out.task.runs == 0xFFFF && out.task.late == 2);
+    before.runs = after.runs - 3600;
+    CHECK(StatsPacket::packTask(frame, 12, 7, 4, &after, &before) == SWEEP_FRAME_SIZE);
+    CHECK(StatsPacket::decode(frame, SWEEP_FRAME_SIZE, &out));
+    CHECK(out.task.runs == 3600);
+
+    // Not mistaken for sweep or record frames, and vice versa
+    SweepFrame sweep;
+    Record records[RECORDS_PER_FRAME];
+    CHECK(!SweepPacket::decode(frame, len, &sweep));
+    CHECK(RecordRing::decodeFrame(frame, len, records) == 0);
+    SweepPacket packet;
+    packet.begin(1, 1, 0, 4);
+    for (int i = 0; i < 4; i++)
+        packet.add(i, -i);
+    CHECK(!StatsPacket::decode(packet.getFrame(), packet.getFrameLength(), &out));
+    CHECK(!StatsPacket::decode((const byte*)"B$87", 4, &out));
+
+    // Malformed
+    CHECK(!StatsPacket::decode(frame, len - 1, &out));
+    frame[2] = 7;   // page beyond the page count
+    CHECK(!StatsPacket::decode(frame, len, &out));
+
+    return checkResult("statsPacketTest");
+}
@@ -0,0 +1,86 @@
+/**
+ * Tests the binary sweep framing: packs sweeps, decodes the frames and checks
+ * every point arrives. Exits non-zero if any check fails.
+ *
+ * Usage:
+ *  ./sweepPacketTest
+ */
+
+#include <Arduino.h>
+#include "SweepPacket.h"
+#include "MCP4018.h"
+#include "BiometricShirt.h"
+#include "check.h"
+
+// Pack a sweep of n points (stopping after sent points) and decode it back
+// into real/imag. Returns the number of frames.
+static int roundTrip(int n, int sent, byte flags, int real[], int imag[],
+                     bool *lastSeen) {
+    SweepPacket packet;
+    SweepFrame frame;
+    int frames = 0;
+    *lastSeen = false;
+
+    packet.begin(7, FREQ_PLAN_ID, flags, n);
+    for (int i = 0; i <= sent; i++) {
+        bool ready = i < sent ? packet.add(i * 37 - 900, -i * 101)
+                              : packet.finish();
+        if (!ready)
+            continue;
+        frames++;
+        CHECK(packet.getFrameLength() <= SWEEP_FRAME_SIZE);
+        CHECK(SweepPacket::decode(packet.getFrame(), packet.getFrameLength(),
+                                  &frame));
+        CHECK(!*lastSeen);
+        CHECK(frame.sweepId == 7 && frame.planId == FREQ_PLAN_ID);
+        CHECK((frame.flags & SWEEP_FLAG_CALIBRATION) == flags);
+        for (int k = 0; k < frame.count; k++) {
+            real[frame.startIndex + k] = frame.real[k];
+            imag[frame.startIndex + k] = frame.imag[k];
+        }
+        if (frame.flags & SWEEP_FLAG_LAST)
+            *lastSeen = true;
+    }
+    return frames;
+}
+
+int main() {
+    int real[256], imag[256];
+    bool last;
+
+    // A full sweep: every point arrives, in about a quarter of the
+    // notifications the text protocol needs (one per point, START and HALT)
+    int frames = roundTrip(NUM_INCR+1, NUM_INCR+1, 0, real, imag, &last);
+    int textFrames = NUM_INCR+1 + 2;
+    printf("%d points: %d binary frames, %d text messages\n", NUM_INCR+1,
+           frames, textFrames);
+    CHECK(last);
+    CHECK(frames == (NUM_INCR+1 + SWEEP_POINTS_PER_FRAME - 1) / SWEEP_POINTS_PER_FRAME);
+    CHECK(frames * 4 <= textFrames + 4);
+    for (int i = 0; i < NUM_INCR+1; i++)
+        CHECK(real[i] == i * 37 - 900 && imag[i] == -i * 101);
+
+    // Exact multiple of the frame size, calibration flag
+    frames = roundTrip(8, 8, SWEEP_FLAG_CALIBRATION, real, imag, &last);
+    CHECK(frames == 2 && last);
+
+    // Cut short: what was packed still arrives, marked last
+    frames = roundTrip(41, 10, 0, real, imag, &last);
+    CHECK(frames == 3 && last);
+    CHECK(real[9] == 9 * 37 - 900);
+
+    // Cut short on a frame boundary: a header only frame ends it
+    frames = roundTrip(41, 8, 0, real, imag, &last);
+    CHECK(frames == 3 && last);
+
+    // Text messages and malformed frames are not decoded
+    SweepFrame frame;
+    CHECK(!SweepPacket::decode((const byte*)"I$HALT", 6, &frame));
+    byte bad[SWEEP_FRAME_SIZE] = { SWEEP_FRAME_MARKER | (2 << 4) };
+    CHECK(!SweepPacket::decode(bad, SWEEP_HEADER_SIZE, &frame));
+    bad[0] = SWEEP_FRAME_MARKER | (SWEEP_PROTOCOL_VERSION << 4);
+    CHECK(SweepPacket::decode(bad, SWEEP_HEADER_SIZE, &frame) && frame.count == 0);
+    CHECK(!SweepPacket::decode(bad, SWEEP_HEADER_SIZE + 3, &frame));
+
+    return checkResult("sweepPacketTest");
+}
@@ -0,0 +1,114 @@
+/**
+ * Compares the cost of turning a DS18B20 reading into the "T$" string the
+ * old way (getTemperature + fmtFloat, as the first measureTemperature did)
+ * against the integer path the sketch uses now (getTemperatureRaw +
+ * rawToCentiFahrenheit + Formatter). Both read a virtual sensor on the
+ * simulated bus, over its whole range.
+ *
+ * As in formatBench, the comparison is made on the M0's library calls, not
+ * host cycles: FastFormat is built with FMT_COUNT_DIVISIONS to count its
+ * divisions as it runs, and the soft-float calls of each path are tallied
+ * below from the code. What it leaves out: the cost of each call on the M0
+ * (tens of cycles for a division, a hundred or more for a double
+ * operation), the flash the soft-float library takes, and printing and
+ * sending the string. The bus time is printed to show the scale; it is the
+ * same for both paths and far larger than either.
+ *
+ * Usage:
+ *  ./tempBench
+ */
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include "DS18B20.h"
+#include "MCP4018.h"
+#include "FastFormat.h"
+#include "BiometricShirt.h"
+#include "OneWireSim.h"
+#include "bench.h"
+
+#define BENCH_PIN   (2)
+
+// DS18B20 range is -55 to 125 C, or -880 to 2000 in 1/16 C
+#define RAW_MIN (-880)
+#define RAW_MAX (2000)
+
+// Soft-float calls in getTemperature for one sensor: the sum and count to
+// float and a float divide, then to double, multiply by 1/16 and back, then
+// to double, multiply by 1.8, add 32 and back
+#define GET_TEMPERATURE_CALLS   (10)
+// The old measureTemperature: compare with 0, then to double, add 1 and
+// back, and to double again for fmtFloat
+#define OLD_SKETCH_CALLS        (5)
+#define OLD_PATH_CALLS  (GET_TEMPERATURE_CALLS + OLD_SKETCH_CALLS + FMTFLOAT_CALLS)
+// Integer divisions of the new path outside FastFormat: the average over
+// the sensors in getTemperatureRaw
+#define NEW_PATH_DIVISIONS      (1)
+
+// Old path: what measureTemperature() did with a reading
+static int oldPath(OneWire &ds, char *str) {
+    float temp = DS18B20::getTemperature(ds);
+    if (temp != 0.0) {
+        temp += 1.0;
+    }
+    str[0] = 'T';
+    str[1] = '$';
+    fmtFloat(temp, 2, str + 2, 63);
+    return strlen(str);
+}
+
+// New path: what measureTemperature() and sendTemperature() do now
+static int newPath(OneWire &ds, char *str) {
+    int16_t raw;
+    long temp = 0;
+    if (DS18B20::getTemperatureRaw(ds, &raw))
+        temp = DS18B20::rawToCentiFahrenheit(raw) + BODY_OFFSET_CENTI_F;
+    Formatter msg(str, 64);
+    msg.addText("T$").addFixed(temp, 2);
+    return msg.length();
+}
+
+int main() {
+    OneWireBus bus(BENCH_PIN);
+    VirtualDS18B20 sensor(0x28C0FFEE01ULL);
+    bus.addDevice(&sensor);
+    OneWire ds(BENCH_PIN);
+
+    // Both paths over every reading: they must agree, to within the last
+    // digit where fmtFloat rounds differently
+    int mismatches = 0;
+    long readings = 0;
+    unsigned long oldDivisions = 0, newDivisions = 0;
+    unsigned long long busMicros = 0;
+    for (int raw = RAW_MIN; raw <= RAW_MAX; raw++) {
+        char a[65], b[65];
+        sensor.setTemperatureRaw(raw);
+
+        fmtDivisions = 0;
+        unsigned long long start = shimMicros();
+        a[oldPath(ds, a)] = '\0';
+        busMicros += shimMicros() - start;
+        oldDivisions += fmtDivisions;
+
+        fmtDivisions = 0;
+        b[newPath(ds, b)] = '\0';
+        newDivisions += fmtDivisions + NEW_PATH_DIVISIONS;
+        benchKeep(a);
+        benchKeep(b);
+
+        if (fabs(atof(a + 2) - atof(b + 2)) > 0.0101) {
+            printf("MISMATCH raw=%d old=%s new=%s\n", raw, a, b);
+            mismatches++;
+        }
+        readings++;
+    }
+
+    printf("M0 library calls per reading, one sensor\n");
+    printf("getTemperature + fmtFloat:     %4.1f divisions + %d soft-float calls\n",
+           (double)oldDivisions / readings, OLD_PATH_CALLS);
+    printf("getTemperatureRaw + addFixed:  %4.1f divisions, no soft-float\n",
+           (double)newDivisions / readings);
+    printf("bus time per reading:          %llu us, for either path\n",
+           busMicros / readings);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,318 @@
+/**
+ * Runs the pcb-iteration-2 sketch, unmodified, on a virtual shirt. The
+ * AD5933, MCP4018 and DS18B20 are simulated, a phone connects for part of
+ * every hour and sends what the app sends, the body's impedance and
+ * temperature drift through the day and the battery runs down. A day of
+ * virtual time takes a few seconds.
+ *
+ * At the end it reports, per hour: loop wakeups and time asleep, what each
+ * scheduled task cost, radio traffic by kind, serial and flash use, and an
+ * estimate of the charge drawn. The currents are rough datasheet figures for
+ * the nRF51822 (RFduino) and AD5933; adjust them to measurements. Exits
+ * non-zero if any stored record was dropped, which a day of this shirt,
+ * fever included, should never need.
+ *
+ * Usage:
+ *  ./virtualShirt [-v] [hours]
+ *   -v  echo the sketch's serial output
+ */
+
+#include <Arduino.h>
+#include <RFduinoBLE.h>
+#include "AD5933.h"
+#include "MCP4018.h"
+#include "DeadlineScheduler.h"
+#include "BleTxQueue.h"
+#include "RecordRing.h"
+#include "SweepPacket.h"
+#include "SerialLog.h"
+#include "BatteryMonitor.h"
+#include "BiometricShirt.h"
+#include "AD5933Sim.h"
+#include "MCP4018Sim.h"
+#include "OneWireSim.h"
+#include "BleLinkSim.h"
+#include "bench.h"
+
+// The sketch
+void setup(void);
+void loop(void);
+extern DeadlineScheduler scheduler;
+extern BleTxQueue bleQueue;
+extern RecordRing storedRecords;
+extern SerialLog serialLog;
+extern BatteryMonitor battery;
+extern volatile unsigned int invalidCommands;
+
+#define HOUR_MICROS     (3600ULL * 1000000)
+#define MINUTE_MICROS   (60ULL * 1000000)
+
+// The phone connects PHONE_CONNECT_MIN minutes into every hour and stays for
+// PHONE_STAY_MIN. The app switches to binary, asks for the calibration
+// values, and asks for statistics just before it leaves.
+#define PHONE_CONNECT_MIN   (5)
+#define PHONE_STAY_MIN      (15)
+#define PHONE_BINARY_MS         (300)
+#define PHONE_CALIBRATION_MS    (1000)
+#define PHONE_STATS_MS          (30000)
+
+// Body: electrode impedance swinging through the day, falling slightly with
+// frequency, and a temperature with a fever in the afternoon
+#define BODY_OHMS           (600.0)
+#define BODY_OHMS_SWING     (150.0)
+#define BODY_OHMS_SLOPE     (0.003)     // per sweep point
+#define BODY_TEMP           (36.8)
+#define BODY_TEMP_SWING     (0.4)
+#define FEVER_TEMP          (38.6)
+#define FEVER_START_HOUR    (14)
+#define FEVER_END_HOUR      (16)
+
+// Hardware: the real potentiometer wiper, and the supply
+#define VIRTUAL_WIPER_OHMS  (120.0)
+#define SUPPLY_START_MV     (3250)
+#define SUPPLY_DROP_MV_PER_HOUR (25)
+#define SUPPLY_NOISE_MV     (5)
+
+// Current draw
+#define CPU_MA              (4.4)       // running from flash, radio idle
+#define SLEEP_MA            (0.004)     // ULP sleep with the RTC running
+#define ADVERTISE_UC        (20.0)      // one advertising event, 3 channels
+#define CONN_EVENT_UC       (6.0)       // one empty connection event
+#define NOTIFY_UC           (3.0)       // one 20 byte notification on air
+#define AD5933_MA           (10.0)      // while converting
+#define DS18B20_MA          (1.0)       // while converting
+#define SUPPLY_V            (3.0)
+
+// Simulated devices
+static VirtualAD5933 ad5933;
+static VirtualMCP4018 pot;
+static OneWireBus bus(TEMP_PIN);
+static VirtualDS18B20 thermometer(0x1234567890ULL);
+
+// Current connection, and totals over all of them
+static SimBleLink *phoneLink = NULL;
+static unsigned long long connectedAt = 0;
+static unsigned long long connectedMicros = 0;
+static unsigned long connections = 0;
+static unsigned long accepted = 0, refused = 0, delivered = 0, lost = 0;
+
+// Delivered notifications by kind
+enum {
+    KIND_IMPEDANCE, KIND_CALIBRATION, KIND_TEMPERATURE, KIND_BATTERY,
+    KIND_RECORDS, KIND_STATS, KIND_CONTROL, NUM_KINDS
+};
+static const char *kindNames[NUM_KINDS] = {
+    "impedance", "calibration", "temperature", "battery", "stored records",
+    "statistics", "control"
+};
+static unsigned long kindCounts[NUM_KINDS];
+static unsigned long unlogged = 0;
+
+// Task names, in the order the sketch adds them
+static const char *taskNames[] = {
+    "alarm", "bluetooth", "temperature", "impedance", "battery",
+    "recalibrate", "lateness"
+};
+
+static uint32_t rngState = 0x9E3779B9;
+
+static int noise(int amplitude) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return (int)(rngState % (2 * amplitude + 1)) - amplitude;
+}
+
+static double hoursNow(void) {
+    return (double)shimMicros() / HOUR_MICROS;
+}
+
+// What the AD5933 sees: the potentiometer on the calibration path, the body
+// on the electrode path
+static double ohmsAt(int point) {
+    if (digitalRead(IMP_MEASURE_SELECT_PIN) == LOW)
+        return VIRTUAL_WIPER_OHMS +
+               (POT_MAX - pot.getWiper()) * (double)MAX_RESISTANCE / POT_STEPS;
+    double ohms = BODY_OHMS + BODY_OHMS_SWING * sin(2 * M_PI * hoursNow() / 24);
+    return ohms * (1 - BODY_OHMS_SLOPE * point);
+}
+
+// Every minute: move the temperature and the supply along
+static void updateBody(void *) {
+    double hours = hoursNow();
+    double hourOfDay = fmod(hours, 24);
+    if (hourOfDay >= FEVER_START_HOUR && hourOfDay < FEVER_END_HOUR)
+        thermometer.setTemperature(FEVER_TEMP);
+    else
+        thermometer.setTemperature(BODY_TEMP + BODY_TEMP_SWING *
+                                   sin(2 * M_PI * (hourOfDay - 4) / 24));
+    shimSetSupplyMillivolts(SUPPLY_START_MV - (int)(SUPPLY_DROP_MV_PER_HOUR * hours) +
+                            noise(SUPPLY_NOISE_MV));
+    shimAt(shimMicros() + MINUTE_MICROS, updateBody, NULL);
+}
+
+static int classify(const uint8_t *packet, int len) {
+    if (len > 0 && (packet[0] & SWEEP_FRAME_MARKER)) {
+        if (packet[0] & SWEEP_FLAG_STATS)
+            return KIND_STATS;
+        if (packet[0] & SWEEP_FLAG_RECORDS)
+            return KIND_RECORDS;
+        if (packet[0] & SWEEP_FLAG_CALIBRATION)
+            return KIND_CALIBRATION;
+        return KIND_IMPEDANCE;
+    }
+    switch (len > 0 ? packet[0] : 0) {
+        case 'I': return KIND_IMPEDANCE;
+        case 'T': return KIND_TEMPERATURE;
+        case 'B': return KIND_BATTERY;
+        default:  return KIND_CONTROL;
+    }
+}
+
+static void phoneSend(void *text) {
+    shimBleReceive((const char*)text, strlen((const char*)text));
+}
+
+static void phoneDisconnect(void *) {
+    shimBleDisconnect();
+    connectedMicros += shimMicros() - connectedAt;
+
+    // Count what the phone got
+    unsigned long logged = phoneLink->getDelivered();
+    if (logged > BLE_SIM_LOG_SIZE)
+        logged = BLE_SIM_LOG_SIZE;
+    for (unsigned long i = 0; i < logged; i++)
+        kindCounts[classify(phoneLink->getPacket(i), phoneLink->getPacketLength(i))]++;
+    unlogged += phoneLink->getDelivered() - logged;
+    accepted += phoneLink->getAccepted();
+    refused += phoneLink->getRefused();
+    delivered += phoneLink->getDelivered();
+    lost += phoneLink->getLost() + phoneLink->getBuffered();
+    delete phoneLink;
+    phoneLink = NULL;
+}
+
+static void phoneConnect(void *) {
+    unsigned long long now = shimMicros();
+    phoneLink = new SimBleLink();
+    connectedAt = now;
+    connections++;
+    shimBleConnect(phoneLink);
+    shimAt(now + PHONE_BINARY_MS * 1000ULL, phoneSend, (void*)"binary");
+    shimAt(now + PHONE_CALIBRATION_MS * 1000ULL, phoneSend, (void*)"calibration");
+    shimAt(now + PHONE_STAY_MIN * MINUTE_MICROS - PHONE_STATS_MS * 1000ULL,
+           phoneSend, (void*)"stats\n");
+    shimAt(now + PHONE_STAY_MIN * MINUTE_MICROS, phoneDisconnect, NULL);
+    shimAt(now + HOUR_MICROS, phoneConnect, NULL);
+}
+
+static void report(double hours, double wallSeconds) {
+    printf("virtual shirt: %.1f h in %.2f s (%.0fx real time)\n", hours,
+           wallSeconds, hours * 3600 / wallSeconds);
+
+    unsigned long long asleep = shimSleepMicros();
+    unsigned long long awake = shimMicros() - asleep;
+    printf("\nloop: %.0f wakeups/h, awake %.3f%% (%.1f s/h)\n",
+           shimSleepCount() / hours, 100.0 * awake / shimMicros(),
+           awake / 1e6 / hours);
+
+    printf("\n%-12s %8s %6s %7s %9s %9s %9s %9s\n", "task", "runs/h", "late",
+           "missed", "max late", "min us", "mean us", "max us");
+    printf("(late and missed are over the whole run)\n");
+    for (int id = 0; id < scheduler.getTaskCount(); id++) {
+        char name[16];
+        if (id < (int)(sizeof(taskNames)/sizeof(taskNames[0])))
+            snprintf(name, sizeof(name), "%s", taskNames[id]);
+        else
+            snprintf(name, sizeof(name), "task %d", id);
+        printf("%-12s %8.1f %6lu %7lu %6lu ms %9lu %9lu %9lu\n", name,
+               scheduler.getRunCount(id) / hours, scheduler.getLateCount(id),
+               scheduler.getMissedCount(id), scheduler.getMaxLateness(id),
+               scheduler.getMinRunTime(id), scheduler.getMeanRunTime(id),
+               scheduler.getMaxRunTime(id));
+    }
+
+    printf("\nradio: %lu connections, connected %.1f min/h\n", connections,
+           connectedMicros / 60e6 / hours);
+    printf("  notifications/h: %.1f accepted, %.1f refused (retried), "
+           "%.1f delivered, %.1f lost\n", accepted / hours, refused / hours,
+           delivered / hours, lost / hours);
+    printf("  queue: %lu retries, %lu dropped; records dropped %lu; "
+           "invalid commands %u\n", bleQueue.getRetryCount(),
+           bleQueue.getDropCount(), storedRecords.getDropCount(),
+           invalidCommands);
+    for (int k = 0; k < NUM_KINDS; k++)
+        printf("  %-16s %8.1f/h\n", kindNames[k], kindCounts[k] / hours);
+    if (unlogged)
+        printf("  (%lu delivered past the link log, not classified)\n", unlogged);
+
+    printf("\nserial: %.0f bytes/h, blocked %.1f ms/h, %lu lines dropped\n",
+           Serial.getBytesWritten() / hours,
+           Serial.getBlockedMicros() / 1e3 / hours, serialLog.getDropCount());
+    printf("flash: %lu page erases, %lu bytes written\n", shimFlashErases(),
+           shimFlashBytesWritten());
+    printf("i2c errors: %lu; battery %d%% at %d mV\n",
+           AD5933::getErrorCount() + MCP4018::getErrorCount(),
+           battery.getPercent(), battery.getMillivolts());
+
+    // Charge in uC over the run
+    double disconnectedMs = (shimMicros() - connectedMicros) / 1e3;
+    double charge[] = {
+        CPU_MA * awake / 1e3,
+        SLEEP_MA * asleep / 1e3,
+        ADVERTISE_UC * disconnectedMs / RFduinoBLE.advertisementInterval,
+        CONN_EVENT_UC * connectedMicros / 7500.0,
+        NOTIFY_UC * delivered,
+        AD5933_MA * ad5933.getConversions() * (double)AD5933_SIM_CONVERSION_MICROS / 1e3,
+        DS18B20_MA * thermometer.getConvertingMicros() / 1e3,
+    };
+    const char *chargeNames[] = {
+        "cpu awake", "sleep", "advertising", "connection events",
+        "notifications", "AD5933", "DS18B20"
+    };
+    double total = 0;
+    printf("\n%-18s %10s\n", "energy", "mAh/h");
+    for (unsigned int i = 0; i < sizeof(charge)/sizeof(charge[0]); i++) {
+        printf("%-18s %10.4f\n", chargeNames[i], charge[i] / 3600e3 / hours);
+        total += charge[i];
+    }
+    printf("%-18s %10.4f (%.1f mJ/h at %.1f V)\n", "total",
+           total / 3600e3 / hours, total / 1e3 * SUPPLY_V / hours, SUPPLY_V);
+}
+
+int main(int argc, char *argv[]) {
+    double hours = 24;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0)
+            Serial.setEcho(true);
+        else
+            hours = atof(argv[i]);
+    }
+    if (hours <= 0)
+        hours = 24;
+
+    // Wire up the shirt
+    ad5933.setImpedanceFunction(ohmsAt);
+    shimAttachI2C(AD5933_ADDR, &ad5933);
+    shimAttachI2C(MCP4018_ADDR, &pot);
+    bus.addDevice(&thermometer);
+    updateBody(NULL);
+    shimAt(PHONE_CONNECT_MIN * MINUTE_MICROS, phoneConnect, NULL);
+
+    uint64_t start = benchNanos();
+    unsigned long long end = (unsigned long long)(hours * HOUR_MICROS);
+    setup();
+    while (shimMicros() < end)
+        loop();
+    if (phoneLink)
+        phoneDisconnect(NULL);
+    fflush(stdout);
+
+    report(shimMicros() / (double)HOUR_MICROS, (benchNanos() - start) / 1e9);
+    if (storedRecords.getDropCount()) {
+        printf("virtualShirt: FAILED, %lu stored records dropped\n",
+               storedRecords.getDropCount());
+        return 1;
+    }
+    return 0;
+}